@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include "alloc.h"
+
+// Front end allocators: the C library, and in builds without NDEBUG the heap profiler
+
+static void *libc_allocate(void *context, size_t size, const char *site) {
+    (void)context;
+    (void)site;
+    return malloc(size);
+}
+
+static void *libc_reallocate(void *context, void *pointer, size_t size, const char *site) {
+    (void)context;
+    (void)site;
+    return realloc(pointer, size);
+}
+
+static void libc_release(void *context, void *pointer) {
+    (void)context;
+    free(pointer);
+}
+
+static const Allocator libc_allocator = { libc_allocate, libc_reallocate, libc_release, NULL };
+
+const Allocator *current_allocator = &libc_allocator;
+
+void alloc_set(const Allocator *allocator) {
+    current_allocator = allocator != NULL ? allocator : &libc_allocator;
+}
+
+#ifdef NDEBUG
+
+void heap_profile_init(void) {
+}
+
+#else
+
+/******************************************************/
+/* Heap profiler */
+
+#define MAX_SITES 256        // Power of two, sites past it are counted as one
+
+typedef struct {
+    const char *site;
+    unsigned long long allocations;
+    unsigned long long reallocations;
+    unsigned long long frees;
+    unsigned long long bytes;        // Total asked for
+    size_t live;
+    size_t peak;
+} Site;
+
+// Put in front of every block, so a free knows its size and site
+typedef struct {
+    alignas(16) size_t size;
+    size_t site;
+} Header;
+
+static Site sites[MAX_SITES + 1];
+static size_t live_bytes;
+static size_t peak_bytes;
+static unsigned long long live_blocks;
+static unsigned long long peak_blocks;
+static const char *profile_path;
+
+// Site literals are looked up by address, the same file and line always has the same one
+static size_t find_site(const char *site) {
+    size_t slot = ((uintptr_t)site >> 3) & (MAX_SITES - 1);
+    for (size_t probe = 0; probe < MAX_SITES; probe++) {
+        size_t index = (slot + probe) & (MAX_SITES - 1);
+        if (sites[index].site == site) {
+            return index;
+        }
+        if (sites[index].site == NULL) {
+            sites[index].site = site;
+            return index;
+        }
+    }
+    sites[MAX_SITES].site = "other";
+    return MAX_SITES;
+}
+
+static void account(size_t index, size_t size) {
+    Site *s = &sites[index];
+    s->bytes += size;
+    s->live += size;
+    if (s->live > s->peak) {
+        s->peak = s->live;
+    }
+    live_bytes += size;
+    if (live_bytes > peak_bytes) {
+        peak_bytes = live_bytes;
+    }
+}
+
+static void unaccount(const Header *header) {
+    sites[header->site].live -= header->size;
+    live_bytes -= header->size;
+}
+
+static void *profile_allocate(void *context, size_t size, const char *site) {
+    (void)context;
+    Header *header = malloc(sizeof(Header) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    size_t index = find_site(site);
+    header->size = size;
+    header->site = index;
+    sites[index].allocations++;
+    account(index, size);
+    if (++live_blocks > peak_blocks) {
+        peak_blocks = live_blocks;
+    }
+    return header + 1;
+}
+
+static void *profile_reallocate(void *context, void *pointer, size_t size, const char *site) {
+    if (pointer == NULL) {
+        return profile_allocate(context, size, site);
+    }
+    Header *header = (Header *)pointer - 1;
+    Header old = *header;
+    header = realloc(header, sizeof(Header) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    // The block moves to the site that resized it
+    unaccount(&old);
+    size_t index = find_site(site);
+    header->size = size;
+    header->site = index;
+    sites[index].reallocations++;
+    account(index, size);
+    return header + 1;
+}
+
+static void profile_release(void *context, void *pointer) {
+    (void)context;
+    Header *header = (Header *)pointer - 1;
+    sites[header->site].frees++;
+    unaccount(header);
+    live_blocks--;
+    free(header);
+}
+
+static const Allocator profile_allocator = { profile_allocate, profile_reallocate, profile_release, NULL };
+
+static int compare_sites(const void *a, const void *b) {
+    const Site *x = a, *y = b;
+    return (y->peak > x->peak) - (y->peak < x->peak);
+}
+
+static void write_profile(void) {
+    FILE *out = strcmp(profile_path, "-") == 0 ? stderr : fopen(profile_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Error: cannot write heap profile to %s\n", profile_path);
+        return;
+    }
+    Site used[MAX_SITES + 1];
+    int num_used = 0;
+    for (int s = 0; s <= MAX_SITES; s++) {
+        if (sites[s].site != NULL) {
+            used[num_used++] = sites[s];
+        }
+    }
+    qsort(used, num_used, sizeof(Site), compare_sites);
+
+    fprintf(out, "Heap profile: peak %zu bytes in %llu blocks, %zu bytes still live\n\n", peak_bytes, peak_blocks,
+            live_bytes);
+    fprintf(out, "%-24s %12s %12s %10s %14s %12s %12s\n", "site", "allocs", "reallocs", "frees", "bytes",
+            "peak", "live");
+    for (int s = 0; s < num_used; s++) {
+        const char *name = strrchr(used[s].site, '/');
+        fprintf(out, "%-24s %12llu %12llu %10llu %14llu %12zu %12zu\n", name ? name + 1 : used[s].site,
+                used[s].allocations, used[s].reallocations, used[s].frees, used[s].bytes, used[s].peak, used[s].live);
+    }
+    if (out != stderr) {
+        fclose(out);
+    }
+}
+
+// Switches to the profiler if CORE_HEAP_PROFILE is set, before anything is allocated
+void heap_profile_init(void) {
+    profile_path = getenv("CORE_HEAP_PROFILE");
+    if (profile_path == NULL || *profile_path == '\0') {
+        return;
+    }
+    alloc_set(&profile_allocator);
+    atexit(write_profile);
+}
+
+#endif
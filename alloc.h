@@ -0,0 +1,66 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+#include <string.h>
+#include "instrument.h"
+
+// Allocator used by the front end (alloc.c)
+//
+// The parse tree, the token list and the call graph of dead_code.c are allocated through
+// core_malloc() and friends, which pass the call site on to the current allocator and feed
+// the allocation counters of instrument.h. The default allocator is the C library. Builds
+// without NDEBUG also have a heap profiler: with CORE_HEAP_PROFILE set to a file name, or
+// to "-" for stderr, heap_profile_init() switches to an allocator that keeps the count,
+// bytes, live bytes and peak of every call site and writes them at exit.
+
+typedef struct {
+    void *(*allocate)(void *context, size_t size, const char *site);
+    void *(*reallocate)(void *context, void *pointer, size_t size, const char *site);
+    void (*release)(void *context, void *pointer);
+    void *context;
+} Allocator;
+
+extern const Allocator *current_allocator;
+
+// Only before the first allocation: memory must be freed by the allocator that allocated it
+void alloc_set(const Allocator *allocator);
+void heap_profile_init(void);
+
+#define ALLOC_STRING_(x) #x
+#define ALLOC_STRING(x) ALLOC_STRING_(x)
+#define ALLOC_SITE __FILE__ ":" ALLOC_STRING(__LINE__)
+
+static inline void *core_malloc_at(size_t size, const char *site) {
+    STAT_ADD(STAT_ALLOCATIONS, 1);
+    STAT_ADD(STAT_ALLOCATED_BYTES, size);
+    return current_allocator->allocate(current_allocator->context, size, site);
+}
+
+static inline void *core_realloc_at(void *pointer, size_t size, const char *site) {
+    STAT_ADD(STAT_ALLOCATIONS, 1);
+    STAT_ADD(STAT_ALLOCATED_BYTES, size);
+    return current_allocator->reallocate(current_allocator->context, pointer, size, site);
+}
+
+static inline char *core_strdup_at(const char *string, const char *site) {
+    size_t size = strlen(string) + 1;
+    char *copy = core_malloc_at(size, site);
+    if (copy != NULL) {
+        memcpy(copy, string, size);
+    }
+    return copy;
+}
+
+static inline void core_free(void *pointer) {
+    if (pointer != NULL) {
+        STAT_ADD(STAT_FREES, 1);
+        current_allocator->release(current_allocator->context, pointer);
+    }
+}
+
+#define core_malloc(size) core_malloc_at(size, ALLOC_SITE)
+#define core_realloc(pointer, size) core_realloc_at(pointer, size, ALLOC_SITE)
+#define core_strdup(string) core_strdup_at(string, ALLOC_SITE)
+
+#endif //ALLOC_H
@@ -0,0 +1,931 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "ir.h"
+
+// x86-64 assembler for the output of codegen.c
+//
+// Turns the Intel syntax that codegen.c writes into machine code, so the JIT does not need
+// an external assembler. Only the instructions and operand forms that codegen.c and jit.c
+// produce are known; anything else is an error. Jumps always take a 32-bit displacement so
+// that instruction sizes never depend on label addresses, which keeps it to a single pass
+// followed by the fix-ups done when the object is linked at its final address.
+
+#define RIP_BASE 16
+#define MAX_SYMBOL_LENGTH 64
+
+typedef enum {
+    OPERAND_NONE,
+    OPERAND_REGISTER,
+    OPERAND_XMM,
+    OPERAND_MEMORY,
+    OPERAND_IMMEDIATE,
+    OPERAND_LABEL
+} OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    int size;               // 1, 4 or 8 bytes, 0 for memory without a size
+    int reg;                // Register number, 0 to 15
+    int base, index, scale; // Memory operands, IR_NONE for no register
+    int64_t value;          // Immediate or displacement
+    char symbol[MAX_SYMBOL_LENGTH];
+    bool through_slot;      // symbol@GOTPCREL, the address of a slot holding the symbol's address
+} Operand;
+
+typedef struct {
+    char name[MAX_SYMBOL_LENGTH];
+    bool in_data;
+    size_t offset;
+} Label;
+
+// A 32-bit displacement to patch at link time: symbol + addend - (end of the displacement)
+typedef struct {
+    size_t offset;          // Of the displacement in the code
+    char symbol[MAX_SYMBOL_LENGTH];
+    int64_t addend;
+    bool through_slot;
+} Fixup;
+
+struct X86Object {
+    uint8_t *code;
+    size_t code_size, code_capacity;
+    uint8_t *data;
+    size_t data_size, data_capacity;
+    Label *labels;
+    int num_labels, labels_capacity;
+    Fixup *fixups;
+    int num_fixups, fixups_capacity;
+    // Names of the labels defined anywhere in the text, known before encoding starts
+    char (*defined)[MAX_SYMBOL_LENGTH];
+    int num_defined;
+    bool in_data;
+    int line;
+    bool failed;
+};
+
+static const char *registers64[] = { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                                     "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" };
+static const char *registers32[] = { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                                     "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" };
+static const char *registers8[] = { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+                                    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" };
+static const char *conditions[] = { "o", "no", "b", "ae", "e", "ne", "be", "a",
+                                    "s", "ns", "p", "np", "l", "ge", "le", "g" };
+
+static void asm_error(X86Object *object, const char *message, const char *text) {
+    if (!object->failed) {
+        fprintf(stderr, "Error: %s '%s' at assembly line %d\n", message, text, object->line);
+    }
+    object->failed = true;
+}
+
+/******************************************************/
+/* Output */
+
+static void put_byte(X86Object *object, uint8_t byte) {
+    uint8_t **buffer = object->in_data ? &object->data : &object->code;
+    size_t *size = object->in_data ? &object->data_size : &object->code_size;
+    size_t *capacity = object->in_data ? &object->data_capacity : &object->code_capacity;
+    if (*size == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 4096;
+        *buffer = realloc(*buffer, *capacity);
+    }
+    (*buffer)[(*size)++] = byte;
+}
+
+static void put_bytes(X86Object *object, int64_t value, int count) {
+    for (int i = 0; i < count; i++) {
+        put_byte(object, (uint8_t)((uint64_t)value >> (8 * i)));
+    }
+}
+
+static size_t position(const X86Object *object) {
+    return object->in_data ? object->data_size : object->code_size;
+}
+
+static void add_fixup(X86Object *object, const char *symbol, int64_t addend, bool through_slot) {
+    if (object->num_fixups == object->fixups_capacity) {
+        object->fixups_capacity = object->fixups_capacity ? object->fixups_capacity * 2 : 64;
+        object->fixups = realloc(object->fixups, sizeof(Fixup) * object->fixups_capacity);
+    }
+    Fixup *fixup = &object->fixups[object->num_fixups++];
+    fixup->offset = object->code_size;
+    snprintf(fixup->symbol, sizeof(fixup->symbol), "%s", symbol);
+    fixup->addend = addend;
+    fixup->through_slot = through_slot;
+    put_bytes(object, 0, 4);
+}
+
+static void define_label(X86Object *object, const char *name) {
+    if (object->num_labels == object->labels_capacity) {
+        object->labels_capacity = object->labels_capacity ? object->labels_capacity * 2 : 64;
+        object->labels = realloc(object->labels, sizeof(Label) * object->labels_capacity);
+    }
+    Label *label = &object->labels[object->num_labels++];
+    snprintf(label->name, sizeof(label->name), "%s", name);
+    label->in_data = object->in_data;
+    label->offset = position(object);
+}
+
+static bool is_defined(const X86Object *object, const char *name) {
+    for (int i = 0; i < object->num_defined; i++) {
+        if (strcmp(object->defined[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/******************************************************/
+/* Operands */
+
+static int find_name(const char *name, const char **names) {
+    for (int r = 0; r < 16; r++) {
+        if (strcmp(name, names[r]) == 0) {
+            return r;
+        }
+    }
+    return IR_NONE;
+}
+
+// Register of any width, with its size in bytes, 16 for xmm registers
+static int parse_register(const char *name, int *size) {
+    int r;
+    if ((r = find_name(name, registers64)) != IR_NONE) {
+        *size = 8;
+    } else if ((r = find_name(name, registers32)) != IR_NONE) {
+        *size = 4;
+    } else if ((r = find_name(name, registers8)) != IR_NONE) {
+        *size = 1;
+    } else if (strncmp(name, "xmm", 3) == 0 && isdigit((unsigned char)name[3])) {
+        r = atoi(name + 3);
+        *size = 16;
+        if (r > 15) {
+            r = IR_NONE;
+        }
+    }
+    return r;
+}
+
+static bool parse_number(const char *text, int64_t *value) {
+    char *end;
+    if (text[0] == '-') {
+        *value = strtoll(text, &end, 0);
+    } else if (isdigit((unsigned char)text[0])) {
+        *value = (int64_t)strtoull(text, &end, 0);
+    } else {
+        return false;
+    }
+    return *end == '\0';
+}
+
+static char *trim(char *text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+// The inside of [...]: registers, reg*scale, numbers and at most one symbol, joined by + and -
+static bool parse_address(X86Object *object, char *text, Operand *operand) {
+    operand->kind = OPERAND_MEMORY;
+    operand->base = operand->index = IR_NONE;
+    operand->scale = 1;
+    operand->value = 0;
+    operand->symbol[0] = '\0';
+
+    int sign = 1;
+    char *p = text;
+    while (*p) {
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '+' || *p == '-') {
+            sign = *p == '-' ? -1 : 1;
+            p++;
+            continue;
+        }
+        char term[MAX_SYMBOL_LENGTH];
+        int n = 0;
+        while (*p && *p != '+' && *p != '-' && !isspace((unsigned char)*p) && n < (int)sizeof(term) - 1) {
+            term[n++] = *p++;
+        }
+        term[n] = '\0';
+        if (n == 0) {
+            break;
+        }
+
+        int size;
+        char *star = strchr(term, '*');
+        int64_t number;
+        if (star != NULL) {
+            *star = '\0';
+            operand->index = parse_register(term, &size);
+            operand->scale = atoi(star + 1);
+            if (operand->index == IR_NONE || size != 8) {
+                asm_error(object, "invalid index register", term);
+                return false;
+            }
+        } else if (strcmp(term, "rip") == 0) {
+            operand->base = RIP_BASE;
+        } else if (parse_register(term, &size) != IR_NONE && size == 8) {
+            int r = parse_register(term, &size);
+            if (operand->base == IR_NONE) {
+                operand->base = r;
+            } else {
+                operand->index = r;
+            }
+        } else if (parse_number(term, &number)) {
+            operand->value += sign * number;
+        } else {
+            char *at = strchr(term, '@');
+            if (at != NULL) {
+                operand->through_slot = strcmp(at, "@GOTPCREL") == 0;
+                *at = '\0';
+            }
+            snprintf(operand->symbol, sizeof(operand->symbol), "%s", term);
+        }
+        sign = 1;
+    }
+    if (operand->symbol[0] != '\0' && operand->base != RIP_BASE) {
+        asm_error(object, "symbol without rip", text);
+        return false;
+    }
+    return true;
+}
+
+static bool parse_operand(X86Object *object, char *text, Operand *operand) {
+    memset(operand, 0, sizeof(*operand));
+    text = trim(text);
+    int size = 0;
+    if (strncmp(text, "QWORD PTR", 9) == 0) {
+        size = 8;
+        text = trim(text + 9);
+    } else if (strncmp(text, "DWORD PTR", 9) == 0) {
+        size = 4;
+        text = trim(text + 9);
+    } else if (strncmp(text, "BYTE PTR", 8) == 0) {
+        size = 1;
+        text = trim(text + 8);
+    }
+
+    if (text[0] == '[') {
+        char *close = strchr(text, ']');
+        if (close == NULL) {
+            asm_error(object, "unterminated address", text);
+            return false;
+        }
+        *close = '\0';
+        if (!parse_address(object, text + 1, operand)) {
+            return false;
+        }
+        operand->size = size;
+        return true;
+    }
+
+    int r = parse_register(text, &size);
+    if (r != IR_NONE) {
+        operand->kind = size == 16 ? OPERAND_XMM : OPERAND_REGISTER;
+        operand->reg = r;
+        operand->size = size;
+        return true;
+    }
+    if (parse_number(text, &operand->value)) {
+        operand->kind = OPERAND_IMMEDIATE;
+        return true;
+    }
+    char *at = strchr(text, '@');
+    if (at != NULL) {
+        *at = '\0';
+    }
+    operand->kind = OPERAND_LABEL;
+    snprintf(operand->symbol, sizeof(operand->symbol), "%s", text);
+    return true;
+}
+
+/******************************************************/
+/* Encoding */
+
+// Prefix, REX, opcode and ModRM for reg_field with rm, then the displacement; imm_size bytes follow
+static void encode(X86Object *object, int prefix, bool rex_w, const uint8_t *opcode, int opcode_length,
+                   int reg_field, const Operand *rm, int imm_size) {
+    int rex = rex_w ? 0x48 : 0;
+    if (reg_field & 8) rex |= 0x44;
+    if (rm->kind == OPERAND_MEMORY) {
+        if (rm->index != IR_NONE && (rm->index & 8)) rex |= 0x42;
+        if (rm->base != IR_NONE && rm->base != RIP_BASE && (rm->base & 8)) rex |= 0x41;
+    } else if (rm->reg & 8) {
+        rex |= 0x41;
+    }
+    // spl, bpl, sil and dil only exist with a REX prefix
+    if (rm->kind == OPERAND_REGISTER && rm->size == 1 && rm->reg >= 4 && rm->reg < 8) {
+        rex |= 0x40;
+    }
+
+    if (prefix) put_byte(object, (uint8_t)prefix);
+    if (rex) put_byte(object, (uint8_t)rex);
+    for (int i = 0; i < opcode_length; i++) {
+        put_byte(object, opcode[i]);
+    }
+
+    int reg = reg_field & 7;
+    if (rm->kind != OPERAND_MEMORY) {
+        put_byte(object, (uint8_t)(0xC0 | reg << 3 | (rm->reg & 7)));
+        return;
+    }
+    if (rm->base == RIP_BASE) {
+        put_byte(object, (uint8_t)(reg << 3 | 5));
+        if (rm->symbol[0] != '\0') {
+            add_fixup(object, rm->symbol, rm->value - imm_size, rm->through_slot);
+        } else {
+            put_bytes(object, rm->value - imm_size, 4);
+        }
+        return;
+    }
+
+    int64_t disp = rm->value;
+    int base = rm->base & 7;
+    int mod = disp == 0 && base != 5 ? 0 : disp >= -128 && disp <= 127 ? 1 : 2;
+    if (rm->index == IR_NONE && base != 4) {
+        put_byte(object, (uint8_t)(mod << 6 | reg << 3 | base));
+    } else {
+        int scale_bits = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+        int index = rm->index == IR_NONE ? 4 : rm->index & 7;
+        put_byte(object, (uint8_t)(mod << 6 | reg << 3 | 4));
+        put_byte(object, (uint8_t)(scale_bits << 6 | index << 3 | base));
+    }
+    if (mod == 1) {
+        put_bytes(object, disp, 1);
+    } else if (mod == 2) {
+        put_bytes(object, disp, 4);
+    }
+}
+
+static void encode1(X86Object *object, int prefix, bool rex_w, uint8_t opcode, int reg_field, const Operand *rm, int imm_size) {
+    encode(object, prefix, rex_w, &opcode, 1, reg_field, rm, imm_size);
+}
+
+static void encode2(X86Object *object, int prefix, bool rex_w, uint8_t opcode, int reg_field, const Operand *rm, int imm_size) {
+    uint8_t bytes[2] = { 0x0F, opcode };
+    encode(object, prefix, rex_w, bytes, 2, reg_field, rm, imm_size);
+}
+
+static int condition_code(const char *name) {
+    if (strcmp(name, "z") == 0) return 4;
+    if (strcmp(name, "nz") == 0) return 5;
+    for (int c = 0; c < 16; c++) {
+        if (strcmp(name, conditions[c]) == 0) {
+            return c;
+        }
+    }
+    return IR_NONE;
+}
+
+static int operand_size(const Operand *a, const Operand *b) {
+    if (a->kind == OPERAND_REGISTER) return a->size;
+    if (b != NULL && b->kind == OPERAND_REGISTER) return b->size;
+    return a->size ? a->size : 8;
+}
+
+static bool fits8(int64_t value) {
+    return value >= -128 && value <= 127;
+}
+
+static void jump_to(X86Object *object, const char *label) {
+    add_fixup(object, label, 0, false);
+}
+
+// add, or, and, sub, xor and cmp, n being the operation's number in the opcode map
+static bool encode_alu(X86Object *object, int n, const Operand *dst, const Operand *src) {
+    int size = operand_size(dst, src);
+    bool w = size == 8;
+    int prefix = 0;
+    if (src->kind == OPERAND_IMMEDIATE) {
+        if (size == 1) {
+            encode1(object, prefix, false, 0x80, n, dst, 1);
+            put_bytes(object, src->value, 1);
+        } else if (fits8(src->value)) {
+            encode1(object, prefix, w, 0x83, n, dst, 1);
+            put_bytes(object, src->value, 1);
+        } else {
+            encode1(object, prefix, w, 0x81, n, dst, 4);
+            put_bytes(object, src->value, 4);
+        }
+        return true;
+    }
+    if (dst->kind == OPERAND_REGISTER) {
+        encode1(object, prefix, w, (uint8_t)(8 * n + (size == 1 ? 2 : 3)), dst->reg, src, 0);
+        return true;
+    }
+    if (src->kind == OPERAND_REGISTER) {
+        encode1(object, prefix, w, (uint8_t)(8 * n + (size == 1 ? 0 : 1)), src->reg, dst, 0);
+        return true;
+    }
+    return false;
+}
+
+static bool encode_mov(X86Object *object, const Operand *dst, const Operand *src) {
+    int size = operand_size(dst, src);
+    bool w = size == 8;
+    if (src->kind == OPERAND_IMMEDIATE) {
+        if (dst->kind == OPERAND_REGISTER && size == 4) {
+            if (dst->reg & 8) put_byte(object, 0x41);
+            put_byte(object, (uint8_t)(0xB8 + (dst->reg & 7)));
+            put_bytes(object, src->value, 4);
+        } else if (size == 1) {
+            encode1(object, 0, false, 0xC6, 0, dst, 1);
+            put_bytes(object, src->value, 1);
+        } else {
+            if (src->value < INT32_MIN || src->value > INT32_MAX) {
+                return false;
+            }
+            encode1(object, 0, w, 0xC7, 0, dst, 4);
+            put_bytes(object, src->value, 4);
+        }
+        return true;
+    }
+    if (dst->kind == OPERAND_REGISTER) {
+        encode1(object, 0, w, size == 1 ? 0x8A : 0x8B, dst->reg, src, 0);
+        return true;
+    }
+    if (src->kind == OPERAND_REGISTER) {
+        encode1(object, 0, w, size == 1 ? 0x88 : 0x89, src->reg, dst, 0);
+        return true;
+    }
+    return false;
+}
+
+typedef struct {
+    const char *name;
+    int prefix;
+    uint8_t opcode;
+    uint8_t store_opcode;   // For a memory destination, 0 if there is none
+} SseInstruction;
+
+static const SseInstruction sse_instructions[] = {
+    { "movsd", 0xF2, 0x10, 0x11 },
+    { "movapd", 0x66, 0x28, 0 },
+    { "addsd", 0xF2, 0x58, 0 },
+    { "mulsd", 0xF2, 0x59, 0 },
+    { "subsd", 0xF2, 0x5C, 0 },
+    { "divsd", 0xF2, 0x5E, 0 },
+    { "ucomisd", 0x66, 0x2E, 0 },
+    { "xorpd", 0x66, 0x57, 0 },
+};
+
+static bool encode_instruction(X86Object *object, const char *mnemonic, Operand *ops, int count) {
+    Operand *a = &ops[0], *b = &ops[1];
+
+    static const char *alu[] = { "add", "or", "adc", "sbb", "and", "sub", "xor", "cmp" };
+    for (int n = 0; n < 8; n++) {
+        if (strcmp(mnemonic, alu[n]) == 0 && count == 2) {
+            return encode_alu(object, n, a, b);
+        }
+    }
+    for (size_t s = 0; s < sizeof(sse_instructions) / sizeof(sse_instructions[0]); s++) {
+        const SseInstruction *sse = &sse_instructions[s];
+        if (strcmp(mnemonic, sse->name) != 0 || count != 2) {
+            continue;
+        }
+        if (a->kind == OPERAND_XMM) {
+            encode2(object, sse->prefix, false, sse->opcode, a->reg, b, 0);
+            return true;
+        }
+        if (sse->store_opcode && b->kind == OPERAND_XMM) {
+            encode2(object, sse->prefix, false, sse->store_opcode, b->reg, a, 0);
+            return true;
+        }
+        return false;
+    }
+
+    if (strcmp(mnemonic, "mov") == 0 && count == 2) {
+        return encode_mov(object, a, b);
+    }
+    if (strcmp(mnemonic, "movabs") == 0 && count == 2 && a->kind == OPERAND_REGISTER) {
+        put_byte(object, (uint8_t)(0x48 | (a->reg & 8 ? 1 : 0)));
+        put_byte(object, (uint8_t)(0xB8 + (a->reg & 7)));
+        put_bytes(object, b->value, 8);
+        return true;
+    }
+    if (strcmp(mnemonic, "lea") == 0 && count == 2 && b->kind == OPERAND_MEMORY) {
+        encode1(object, 0, true, 0x8D, a->reg, b, 0);
+        return true;
+    }
+    if ((strcmp(mnemonic, "push") == 0 || strcmp(mnemonic, "pop") == 0) && count == 1) {
+        bool push = mnemonic[1] == 'u';
+        if (a->kind == OPERAND_REGISTER) {
+            if (a->reg & 8) put_byte(object, 0x41);
+            put_byte(object, (uint8_t)((push ? 0x50 : 0x58) + (a->reg & 7)));
+            return true;
+        }
+        if (push && a->kind == OPERAND_MEMORY) {
+            encode1(object, 0, false, 0xFF, 6, a, 0);
+            return true;
+        }
+        return false;
+    }
+    if (strcmp(mnemonic, "imul") == 0 && count == 2 && a->kind == OPERAND_REGISTER) {
+        encode2(object, 0, a->size == 8, 0xAF, a->reg, b, 0);
+        return true;
+    }
+
+    // Group 3 and 5 one operand instructions
+    static const struct { const char *name; uint8_t opcode; int field; } unary[] = {
+        { "neg", 0xF7, 3 }, { "idiv", 0xF7, 7 }, { "inc", 0xFF, 0 }, { "dec", 0xFF, 1 },
+    };
+    for (size_t u = 0; u < sizeof(unary) / sizeof(unary[0]); u++) {
+        if (strcmp(mnemonic, unary[u].name) == 0 && count == 1) {
+            encode1(object, 0, operand_size(a, NULL) == 8, unary[u].opcode, unary[u].field, a, 0);
+            return true;
+        }
+    }
+    if (strcmp(mnemonic, "shr") == 0 && count == 2 && b->kind == OPERAND_IMMEDIATE) {
+        if (b->value == 1) {
+            encode1(object, 0, operand_size(a, NULL) == 8, 0xD1, 5, a, 0);
+        } else {
+            encode1(object, 0, operand_size(a, NULL) == 8, 0xC1, 5, a, 1);
+            put_bytes(object, b->value, 1);
+        }
+        return true;
+    }
+    if (strcmp(mnemonic, "btc") == 0 && count == 2 && b->kind == OPERAND_IMMEDIATE) {
+        encode2(object, 0, operand_size(a, NULL) == 8, 0xBA, 7, a, 1);
+        put_bytes(object, b->value, 1);
+        return true;
+    }
+    if (strcmp(mnemonic, "test") == 0 && count == 2) {
+        int size = operand_size(a, b);
+        if (b->kind == OPERAND_IMMEDIATE) {
+            if (size == 1) {
+                encode1(object, 0, false, 0xF6, 0, a, 1);
+                put_bytes(object, b->value, 1);
+            } else {
+                encode1(object, 0, size == 8, 0xF7, 0, a, 4);
+                put_bytes(object, b->value, 4);
+            }
+            return true;
+        }
+        encode1(object, 0, size == 8, size == 1 ? 0x84 : 0x85, b->reg, a, 0);
+        return true;
+    }
+    if (strcmp(mnemonic, "movzx") == 0 && count == 2) {
+        encode2(object, 0, a->size == 8, 0xB6, a->reg, b, 0);
+        return true;
+    }
+    if (strcmp(mnemonic, "movsxd") == 0 && count == 2) {
+        encode1(object, 0, true, 0x63, a->reg, b, 0);
+        return true;
+    }
+    if (strcmp(mnemonic, "movq") == 0 && count == 2) {
+        if (a->kind == OPERAND_XMM && b->kind == OPERAND_REGISTER) {
+            encode2(object, 0x66, true, 0x6E, a->reg, b, 0);
+            return true;
+        }
+        if (a->kind == OPERAND_REGISTER && b->kind == OPERAND_XMM) {
+            encode2(object, 0x66, true, 0x7E, b->reg, a, 0);
+            return true;
+        }
+        return false;
+    }
+    if (strcmp(mnemonic, "cvtsi2sd") == 0 && count == 2) {
+        encode2(object, 0xF2, operand_size(b, NULL) == 8, 0x2A, a->reg, b, 0);
+        return true;
+    }
+    if (strcmp(mnemonic, "cvttsd2si") == 0 && count == 2) {
+        encode2(object, 0xF2, a->size == 8, 0x2C, a->reg, b, 0);
+        return true;
+    }
+    if (strcmp(mnemonic, "cqo") == 0 && count == 0) {
+        put_byte(object, 0x48);
+        put_byte(object, 0x99);
+        return true;
+    }
+    if (strcmp(mnemonic, "ret") == 0 && count == 0) {
+        put_byte(object, 0xC3);
+        return true;
+    }
+
+    if (strcmp(mnemonic, "jmp") == 0 && count == 1 && a->kind == OPERAND_LABEL) {
+        if (!is_defined(object, a->symbol) && a->symbol[0] != '.' && !isdigit((unsigned char)a->symbol[0])) {
+            // A tail call to a function outside the object, through its slot like a call
+            Operand slot = { .kind = OPERAND_MEMORY, .base = RIP_BASE, .index = IR_NONE, .through_slot = true };
+            snprintf(slot.symbol, sizeof(slot.symbol), "%s", a->symbol);
+            encode1(object, 0, false, 0xFF, 4, &slot, 0);
+            return true;
+        }
+        put_byte(object, 0xE9);
+        jump_to(object, a->symbol);
+        return true;
+    }
+    if (strcmp(mnemonic, "call") == 0 && count == 1) {
+        if (a->kind == OPERAND_LABEL && is_defined(object, a->symbol)) {
+            put_byte(object, 0xE8);
+            jump_to(object, a->symbol);
+            return true;
+        }
+        if (a->kind == OPERAND_LABEL) {
+            // Anything outside the object is called through a slot holding its address
+            Operand slot = { .kind = OPERAND_MEMORY, .base = RIP_BASE, .index = IR_NONE, .through_slot = true };
+            snprintf(slot.symbol, sizeof(slot.symbol), "%s", a->symbol);
+            encode1(object, 0, false, 0xFF, 2, &slot, 0);
+            return true;
+        }
+        encode1(object, 0, false, 0xFF, 2, a, 0);
+        return true;
+    }
+    if (mnemonic[0] == 'j' && count == 1 && a->kind == OPERAND_LABEL) {
+        int cc = condition_code(mnemonic + 1);
+        if (cc == IR_NONE) {
+            return false;
+        }
+        put_byte(object, 0x0F);
+        put_byte(object, (uint8_t)(0x80 + cc));
+        jump_to(object, a->symbol);
+        return true;
+    }
+    if (strncmp(mnemonic, "set", 3) == 0 && count == 1) {
+        int cc = condition_code(mnemonic + 3);
+        if (cc == IR_NONE) {
+            return false;
+        }
+        encode2(object, 0, false, (uint8_t)(0x90 + cc), 0, a, 0);
+        return true;
+    }
+    if (strncmp(mnemonic, "cmov", 4) == 0 && count == 2) {
+        int cc = condition_code(mnemonic + 4);
+        if (cc == IR_NONE) {
+            return false;
+        }
+        encode2(object, 0, a->size == 8, (uint8_t)(0x40 + cc), a->reg, b, 0);
+        return true;
+    }
+    return false;
+}
+
+/******************************************************/
+/* Directives and lines */
+
+static void parse_string(X86Object *object, const char *text) {
+    const char *p = strchr(text, '"');
+    if (p == NULL) {
+        asm_error(object, "invalid string", text);
+        return;
+    }
+    for (p++; *p && *p != '"'; p++) {
+        if (*p != '\\') {
+            put_byte(object, (uint8_t)*p);
+            continue;
+        }
+        p++;
+        if (*p >= '0' && *p <= '7') {
+            int value = 0;
+            for (int digits = 0; digits < 3 && *p >= '0' && *p <= '7'; digits++) {
+                value = value * 8 + (*p++ - '0');
+            }
+            p--;
+            put_byte(object, (uint8_t)value);
+        } else {
+            switch (*p) {
+                case 'n': put_byte(object, '\n'); break;
+                case 't': put_byte(object, '\t'); break;
+                default: put_byte(object, (uint8_t)*p); break;
+            }
+        }
+    }
+    put_byte(object, 0);
+}
+
+static void assemble_directive(X86Object *object, char *line) {
+    char *arguments = line;
+    while (*arguments && !isspace((unsigned char)*arguments)) arguments++;
+    if (*arguments) *arguments++ = '\0';
+    arguments = trim(arguments);
+
+    if (strcmp(line, ".text") == 0) {
+        object->in_data = false;
+    } else if (strcmp(line, ".section") == 0) {
+        object->in_data = strncmp(arguments, ".rodata", 7) == 0 || strncmp(arguments, ".data", 5) == 0;
+    } else if (strcmp(line, ".align") == 0) {
+        int64_t alignment = 1;
+        parse_number(arguments, &alignment);
+        while (position(object) % alignment != 0) {
+            put_byte(object, object->in_data ? 0 : 0x90);
+        }
+    } else if (strcmp(line, ".string") == 0) {
+        parse_string(object, arguments);
+    } else if (strcmp(line, ".quad") == 0) {
+        int64_t value = 0;
+        if (!parse_number(arguments, &value)) {
+            asm_error(object, "invalid .quad", arguments);
+        }
+        put_bytes(object, value, 8);
+    } else if (strcmp(line, ".zero") == 0) {
+        int64_t count = 0;
+        parse_number(arguments, &count);
+        for (int64_t i = 0; i < count; i++) {
+            put_byte(object, 0);
+        }
+    } else if (strcmp(line, ".intel_syntax") != 0 && strcmp(line, ".type") != 0 &&
+               strcmp(line, ".size") != 0 && strcmp(line, ".globl") != 0) {
+        asm_error(object, "unknown directive", line);
+    }
+}
+
+static void assemble_line(X86Object *object, char *line) {
+    line = trim(line);
+    if (*line == '\0') {
+        return;
+    }
+    size_t length = strlen(line);
+    if (line[length - 1] == ':') {
+        line[length - 1] = '\0';
+        define_label(object, line);
+        return;
+    }
+    if (line[0] == '.') {
+        assemble_directive(object, line);
+        return;
+    }
+
+    char *arguments = line;
+    while (*arguments && !isspace((unsigned char)*arguments)) arguments++;
+    if (*arguments) *arguments++ = '\0';
+
+    Operand ops[2];
+    int count = 0;
+    char *next = trim(arguments);
+    while (*next && count < 2) {
+        char *comma = strchr(next, ',');
+        if (comma) *comma = '\0';
+        if (!parse_operand(object, next, &ops[count++])) {
+            return;
+        }
+        if (!comma) break;
+        next = comma + 1;
+    }
+    if (object->in_data) {
+        asm_error(object, "instruction in a data section", line);
+        return;
+    }
+    if (!encode_instruction(object, line, ops, count)) {
+        asm_error(object, "unsupported instruction", line);
+    }
+}
+
+// Assembles Intel syntax text into code and data with unresolved references, NULL on an error
+X86Object *x86_assemble(const char *text, size_t length) {
+    X86Object *object = calloc(1, sizeof(X86Object));
+    char *copy = malloc(length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    // Labels first, so calls know whether their target is in the object
+    int defined_capacity = 0;
+    for (char *line = copy; line < copy + length; ) {
+        char *end = strchr(line, '\n');
+        if (end == NULL) end = copy + length;
+        char *last = end;
+        while (last > line && isspace((unsigned char)last[-1])) last--;
+        if (last > line && last[-1] == ':') {
+            while (isspace((unsigned char)*line)) line++;
+            if (object->num_defined == defined_capacity) {
+                defined_capacity = defined_capacity ? defined_capacity * 2 : 64;
+                object->defined = realloc(object->defined, MAX_SYMBOL_LENGTH * (size_t)defined_capacity);
+            }
+            int n = (int)(last - 1 - line);
+            if (n >= MAX_SYMBOL_LENGTH) n = MAX_SYMBOL_LENGTH - 1;
+            memcpy(object->defined[object->num_defined], line, n);
+            object->defined[object->num_defined++][n] = '\0';
+        }
+        line = end + 1;
+    }
+
+    object->line = 0;
+    for (char *line = copy; line < copy + length && !object->failed; ) {
+        char *end = strchr(line, '\n');
+        if (end == NULL) end = copy + length;
+        *end = '\0';
+        object->line++;
+        assemble_line(object, line);
+        line = end + 1;
+    }
+    free(copy);
+    if (object->failed) {
+        x86_free(object);
+        return NULL;
+    }
+    return object;
+}
+
+/******************************************************/
+/* Linking */
+
+size_t x86_code_size(const X86Object *object) {
+    return object->code_size;
+}
+
+// Data, then one 8-byte slot per fix-up that goes through a slot
+size_t x86_data_size(const X86Object *object) {
+    size_t size = (object->data_size + 7) / 8 * 8;
+    for (int f = 0; f < object->num_fixups; f++) {
+        if (object->fixups[f].through_slot) {
+            size += 8;
+        }
+    }
+    return size;
+}
+
+static const Label *find_label(const X86Object *object, const char *name, size_t reference) {
+    // 1f is the next "1:" after the reference, 1b the last one before it
+    size_t length = strlen(name);
+    if (length >= 2 && isdigit((unsigned char)name[0]) && (name[length - 1] == 'f' || name[length - 1] == 'b')) {
+        bool forward = name[length - 1] == 'f';
+        const Label *found = NULL;
+        for (int l = 0; l < object->num_labels; l++) {
+            const Label *label = &object->labels[l];
+            if (label->in_data || strncmp(label->name, name, length - 1) != 0 || label->name[length - 1] != '\0') {
+                continue;
+            }
+            if (forward && label->offset > reference) {
+                return label;
+            }
+            if (!forward && label->offset <= reference) {
+                found = label;
+            }
+        }
+        return found;
+    }
+    for (int l = 0; l < object->num_labels; l++) {
+        if (strcmp(object->labels[l].name, name) == 0) {
+            return &object->labels[l];
+        }
+    }
+    return NULL;
+}
+
+static uint8_t *label_address(const Label *label, uint8_t *code, uint8_t *data) {
+    return (label->in_data ? data : code) + label->offset;
+}
+
+// Copies the object to code and data, which must be within 2 GB of each other and of every
+// symbol the resolver returns an address for without a slot, and resolves every reference
+bool x86_link(const X86Object *object, uint8_t *code, uint8_t *data, X86Resolver resolve, void *context) {
+    memcpy(code, object->code, object->code_size);
+    memcpy(data, object->data, object->data_size);
+    size_t next_slot = (object->data_size + 7) / 8 * 8;
+
+    for (int f = 0; f < object->num_fixups; f++) {
+        const Fixup *fixup = &object->fixups[f];
+        const Label *label = find_label(object, fixup->symbol, fixup->offset);
+        uint8_t *target;
+        if (label != NULL && !fixup->through_slot) {
+            target = label_address(label, code, data);
+        } else {
+            void *address = NULL;
+            void **slot = NULL;
+            if (label != NULL) {
+                address = label_address(label, code, data);
+            } else if (!resolve(context, fixup->symbol, &address, &slot)) {
+                fprintf(stderr, "Error: undefined symbol '%s' in compiled code\n", fixup->symbol);
+                return false;
+            }
+            if (slot == NULL && fixup->through_slot) {
+                slot = (void **)(data + next_slot);
+                next_slot += 8;
+                *slot = address;
+            }
+            target = slot != NULL ? (uint8_t *)slot : (uint8_t *)address;
+        }
+        uint8_t *end = code + fixup->offset + 4;
+        int64_t displacement = (int64_t)(target + fixup->addend - end);
+        if (displacement < INT32_MIN || displacement > INT32_MAX) {
+            fprintf(stderr, "Error: '%s' is out of reach of compiled code\n", fixup->symbol);
+            return false;
+        }
+        int32_t value = (int32_t)displacement;
+        memcpy(code + fixup->offset, &value, 4);
+    }
+    return true;
+}
+
+// Address of a label once the object is linked at code and data
+void *x86_symbol(const X86Object *object, const char *name, uint8_t *code, uint8_t *data) {
+    const Label *label = find_label(object, name, 0);
+    return label ? label_address(label, code, data) : NULL;
+}
+
+void x86_free(X86Object *object) {
+    if (object == NULL) {
+        return;
+    }
+    free(object->code);
+    free(object->data);
+    free(object->labels);
+    free(object->fixups);
+    free(object->defined);
+    free(object);
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+// Allocation counter, loaded into the scanner and parser with LD_PRELOAD
+//
+// Wraps the allocation functions and, when the program exits, writes how often each was
+// called and how many bytes were asked for to the file named by CORE_ALLOC_STATS. The
+// real functions are glibc's __libc_* entry points, which avoids dlsym() allocating
+// while the wrappers are still being set up.
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void __libc_free(void *pointer);
+
+static unsigned long long allocations;
+static unsigned long long reallocations;
+static unsigned long long frees;
+static unsigned long long bytes;
+
+void *malloc(size_t size) {
+    allocations++;
+    bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    allocations++;
+    bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    if (pointer == NULL) {
+        allocations++;
+    } else {
+        reallocations++;
+    }
+    bytes += size;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) {
+    if (pointer != NULL) {
+        frees++;
+    }
+    __libc_free(pointer);
+}
+
+__attribute__((destructor))
+static void write_stats(void) {
+    const char *path = getenv("CORE_ALLOC_STATS");
+    if (path == NULL) {
+        return;
+    }
+    // Copied first, writing the file allocates too
+    unsigned long long counts[] = { allocations, reallocations, frees, bytes };
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return;
+    }
+    fprintf(file, "%llu %llu %llu %llu\n", counts[0], counts[1], counts[2], counts[3]);
+    fclose(file);
+}
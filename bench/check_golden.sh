@@ -0,0 +1,62 @@
+#!/bin/sh
+# Scans and parses every program of test_lexer/ and test_parser/ and compares the symbol
+# table and the parse result with the golden files in their expected/ directories. The
+# parse result is the tree for a valid program, and the exit status, the diagnostics and
+# the partial tree for an invalid one. With --update the golden files are written instead.
+# Usage: bench/check_golden.sh <scanner> <parser> [--update]
+
+if [ $# -lt 2 ] || [ $# -gt 3 ] || { [ $# -eq 3 ] && [ "$3" != "--update" ]; }; then
+    echo "Usage: $0 <scanner> <parser> [--update]"
+    exit 1
+fi
+
+scanner=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+parser=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+update=$3
+root_dir=$(cd "$(dirname "$0")/.." && pwd)
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+cd "$work_dir" || exit 1
+
+# Compares a result with its golden file, or replaces the golden file with --update
+check() {
+    if [ -n "$update" ]; then
+        cp "$1" "$2"
+    elif [ ! -f "$2" ]; then
+        echo "$name: no golden file $(basename "$2"), run with --update"
+        failed=$((failed + 1))
+    elif ! cmp -s "$1" "$2"; then
+        echo "$name: $(basename "$2") differs"
+        diff -u "$2" "$1" | head -n 20
+        failed=$((failed + 1))
+    fi
+}
+
+failed=0
+checked=0
+for program in "$root_dir"/test_lexer/*.core "$root_dir"/test_parser/*.core; do
+    expected_dir=$(dirname "$program")/expected
+    name=$(basename "$(dirname "$program")")/$(basename "$program" .core)
+    mkdir -p "$expected_dir"
+    rm -f symbol_table.txt string_table.txt parse_tree_output.ebnf
+
+    "$scanner" -q "$program" > /dev/null 2>&1
+    check symbol_table.txt "$expected_dir/$(basename "$program" .core).tokens"
+
+    timeout 10 "$parser" -q > /dev/null 2> parser.err
+    status=$?
+    if [ $status -eq 0 ]; then
+        cp parse_tree_output.ebnf result.tree
+    else
+        { echo "exit $status"; cat parser.err; cat parse_tree_output.ebnf 2> /dev/null; } > result.tree
+    fi
+    check result.tree "$expected_dir/$(basename "$program" .core).tree"
+    checked=$((checked + 1))
+done
+
+if [ -n "$update" ]; then
+    echo "Golden files of $checked programs updated"
+    exit 0
+fi
+echo "$checked programs checked, $failed differences"
+[ $failed -eq 0 ]
@@ -0,0 +1,82 @@
+#!/bin/sh
+# Compiles every program that lowers to the IR to x86-64 and checks that the native
+# executable prints the same output and exits with the same status as the interpreter,
+# and that running it with the JIT and from an image saved with --save does too.
+# Usage: bench/check_native.sh <scanner> <parser>
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <scanner> <parser>"
+    exit 1
+fi
+
+scanner=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+parser=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+bench_dir=$(cd "$(dirname "$0")" && pwd)
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+cd "$work_dir" || exit 1
+
+# Input given to the programs that read some
+input="12 2.25 x"
+
+# Program output, without the parser's own messages
+program_output() {
+    grep -v -e '^Parsing token' -e '^PARSING!' -e '^Parsing successful!' -e '^Dead code elimination' \
+            -e '^Loop optimization' -e '^Inlin' -e '^Memoization' -e '^Bounds checks' -e '^Assembly written' \
+            -e '^Image ' -e '^$' "$1"
+}
+
+status=0
+checked=0
+for program in "$bench_dir"/../test_parser/*.core "$bench_dir"/loops/*.core; do
+    name=$(basename "$program" .core)
+    "$scanner" "$program" > /dev/null 2>&1
+    for flags in "" "-O"; do
+        rm -f output.s program.corec
+        # Some of the parser tests are invalid programs, they are skipped
+        echo "$input" | timeout 10 "$parser" $flags --asm --run --save program.corec > interp.out 2> interp.err
+        if [ ! -f output.s ]; then
+            echo "$name${flags:+ $flags}: skipped, not compiled"
+            break
+        fi
+        if ! gcc output.s -o program -lm; then
+            echo "$name${flags:+ $flags}: assembly failed"
+            status=1
+            continue
+        fi
+        echo "$input" | timeout 10 ./program > native.txt 2> /dev/null
+        native_status=$?
+        program_output interp.out > interp.txt
+        # The native program exits with main's result, or 1 after a runtime error
+        expected_status=$(sed -n 's/^Program returned \([-0-9]*\) .*/\1/p' interp.err)
+        expected_status=$(( ${expected_status:-1} & 255 ))
+        if ! cmp -s interp.txt native.txt || [ "$expected_status" -ne "$native_status" ]; then
+            echo "$name${flags:+ $flags}: native output differs"
+            diff interp.txt native.txt | head -10
+            status=1
+            continue
+        fi
+        echo "$input" | timeout 10 "$parser" $flags --jit > jit.out 2> jit.err
+        program_output jit.out > jit.txt
+        jit_status=$(sed -n 's/^Program returned \([-0-9]*\) .*/\1/p' jit.err)
+        if ! cmp -s interp.txt jit.txt || [ "$(( ${jit_status:-1} & 255 ))" -ne "$expected_status" ]; then
+            echo "$name${flags:+ $flags}: output with the JIT differs"
+            diff interp.txt jit.txt | head -10
+            status=1
+            continue
+        fi
+        echo "$input" | timeout 10 "$parser" --load program.corec --run > image.out 2> image.err
+        program_output image.out > image.txt
+        image_status=$(sed -n 's/^Program returned \([-0-9]*\) .*/\1/p' image.err)
+        if ! cmp -s interp.txt image.txt || [ "$(( ${image_status:-1} & 255 ))" -ne "$expected_status" ]; then
+            echo "$name${flags:+ $flags}: output from the saved image differs"
+            diff interp.txt image.txt | head -10
+            status=1
+            continue
+        fi
+        echo "$name${flags:+ $flags}: ok"
+        checked=$((checked + 1))
+    done
+done
+echo "$checked programs checked"
+exit $status
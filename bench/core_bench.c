@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Benchmark of the scanner and the parser on generated workloads
+//
+// Every workload is a program written by core_gen. The scanner and then the parser run on
+// it in a scratch directory, each RUNS times; the median wall time gives tokens and parse
+// tree nodes per second, wait4() gives the peak resident set size and the alloc_count
+// library, preloaded into both, the number of allocations. The tables go to stdout and
+// to the output file; the workloads are fixed, so only the times change between runs.
+
+#define RUNS 5
+#define TIMEOUT_SECONDS 120
+
+static const struct {
+    const char *shape;
+    int size;
+} workloads[] = {
+    { "mixed", 5000 },
+    { "deep", 500 },
+    { "wide", 50000 },
+    { "strings", 2000 },
+    { "comments", 2500 },
+    { "functions", 5000 },
+};
+
+#define NUM_WORKLOADS (int)(sizeof(workloads) / sizeof(workloads[0]))
+
+typedef struct {
+    double ms;                       // Median wall time
+    long peak_rss_kb;
+    unsigned long long allocations;
+    unsigned long long reallocations;
+    unsigned long long frees;
+    unsigned long long bytes;
+} Measurement;
+
+typedef struct {
+    long file_bytes;
+    long tokens;
+    long nodes;
+    Measurement scanner;
+    Measurement parser;
+} Result;
+
+static char directory[] = "/tmp/core_bench.XXXXXX";
+static const char *alloc_library;
+
+static char *path_in(const char *name) {
+    static char path[sizeof(directory) + 64];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    return path;
+}
+
+static double now_ms(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+// Runs argv in the scratch directory with stdout going to output, false if it failed
+static bool run(char *argv[], const char *output, double *ms, struct rusage *usage) {
+    fflush(stdout);
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || chdir(directory) != 0) {
+            _exit(127);
+        }
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+        if (alloc_library != NULL) {
+            setenv("LD_PRELOAD", alloc_library, 1);
+            setenv("CORE_ALLOC_STATS", path_in("alloc_stats.txt"), 1);
+        }
+        // The parser does not recover from every error, so a hang must not stall the benchmark
+        alarm(TIMEOUT_SECONDS);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (wait4(pid, &status, 0, usage) < 0) {
+        perror("wait4");
+        return false;
+    }
+    *ms = now_ms() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Error: %s failed on the workload\n", argv[0]);
+        return false;
+    }
+    return true;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static bool measure(char *argv[], Measurement *m) {
+    double times[RUNS];
+    struct rusage usage;
+    for (int r = 0; r < RUNS; r++) {
+        if (!run(argv, "/dev/null", &times[r], &usage)) {
+            return false;
+        }
+    }
+    qsort(times, RUNS, sizeof(double), compare_doubles);
+    m->ms = times[RUNS / 2];
+    m->peak_rss_kb = usage.ru_maxrss;
+
+    // The counts are the same on every run, the last one's are kept
+    FILE *stats = fopen(path_in("alloc_stats.txt"), "r");
+    if (stats != NULL) {
+        if (fscanf(stats, "%llu %llu %llu %llu", &m->allocations, &m->reallocations, &m->frees, &m->bytes) != 4) {
+            m->allocations = m->reallocations = m->frees = m->bytes = 0;
+        }
+        fclose(stats);
+        remove(path_in("alloc_stats.txt"));
+    }
+    return true;
+}
+
+// Lines of the file for which counted() is true
+static long count_lines(const char *name, bool (*counted)(const char *line)) {
+    FILE *file = fopen(path_in(name), "r");
+    if (file == NULL) {
+        return 0;
+    }
+    long count = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    while (getline(&line, &capacity, file) != -1) {
+        if (counted(line)) {
+            count++;
+        }
+    }
+    free(line);
+    fclose(file);
+    return count;
+}
+
+// Token rows of symbol_table.txt start with the token code
+static bool is_token(const char *line) {
+    return line[0] >= '0' && line[0] <= '9';
+}
+
+// Every node of parse_tree_output.ebnf starts a line, the other lines only close nodes
+static bool is_node(const char *line) {
+    line += strspn(line, " \t");
+    return *line != ')' && *line != '\n' && *line != '\0';
+}
+
+static bool bench(char *scanner, char *parser, char *generator, int w, Result *result) {
+    char size[16];
+    snprintf(size, sizeof(size), "%d", workloads[w].size);
+    char *generate[] = { generator, "-s", (char *)workloads[w].shape, "-n", size, NULL };
+    const char *saved = alloc_library;
+    double ms;
+    struct rusage usage;
+    alloc_library = NULL;
+    bool generated = run(generate, path_in("workload.core"), &ms, &usage);
+    alloc_library = saved;
+    if (!generated) {
+        return false;
+    }
+
+    FILE *file = fopen(path_in("workload.core"), "r");
+    fseek(file, 0, SEEK_END);
+    result->file_bytes = ftell(file);
+    fclose(file);
+
+    char *scan[] = { scanner, "workload.core", NULL };
+    char *parse[] = { parser, NULL };
+    if (!measure(scan, &result->scanner)) {
+        return false;
+    }
+    result->tokens = count_lines("symbol_table.txt", is_token);
+    if (!measure(parse, &result->parser)) {
+        return false;
+    }
+    result->nodes = count_lines("parse_tree_output.ebnf", is_node);
+
+    remove(path_in("workload.core"));
+    remove(path_in("symbol_table.txt"));
+    remove(path_in("string_table.txt"));
+    remove(path_in("parse_tree_output.ebnf"));
+    return true;
+}
+
+static void print_phase(FILE *out, const char *phase, const char *unit, Result results[], bool scanner) {
+    fprintf(out, "%-10s %10s %12s %12s %12s %10s %10s %14s\n", phase, "ms", unit, "peak RSS KB",
+            "allocs", "reallocs", "frees", "bytes");
+    for (int w = 0; w < NUM_WORKLOADS; w++) {
+        const Measurement *m = scanner ? &results[w].scanner : &results[w].parser;
+        long items = scanner ? results[w].tokens : results[w].nodes;
+        fprintf(out, "%-10s %10.1f %12.0f %12ld %12llu %10llu %10llu %14llu\n", workloads[w].shape, m->ms,
+                m->ms > 0 ? items / (m->ms / 1e3) : 0.0, m->peak_rss_kb, m->allocations, m->reallocations,
+                m->frees, m->bytes);
+    }
+}
+
+static void print_results(FILE *out, Result results[]) {
+    fprintf(out, "Scanner and parser benchmark, median of %d runs\n\n", RUNS);
+    fprintf(out, "%-10s %10s %12s %12s %12s\n", "workload", "size", "bytes", "tokens", "nodes");
+    for (int w = 0; w < NUM_WORKLOADS; w++) {
+        fprintf(out, "%-10s %10d %12ld %12ld %12ld\n", workloads[w].shape, workloads[w].size,
+                results[w].file_bytes, results[w].tokens, results[w].nodes);
+    }
+    fputc('\n', out);
+    print_phase(out, "scanner", "tokens/s", results, true);
+    fputc('\n', out);
+    print_phase(out, "parser", "nodes/s", results, false);
+}
+
+int main(int argc, char* argv[argc + 1]) {
+    if (argc != 5 && argc != 6) {
+        printf("Usage: ./%s <scanner> <parser> <core_gen> <output file> [alloc_count library]\n", argv[0]);
+        return 1;
+    }
+    char *programs[3];
+    for (int p = 0; p < 3; p++) {
+        programs[p] = realpath(argv[1 + p], NULL);
+        if (programs[p] == NULL) {
+            fprintf(stderr, "Error: cannot find %s\n", argv[1 + p]);
+            return 1;
+        }
+    }
+    alloc_library = argc == 6 ? realpath(argv[5], NULL) : NULL;
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    Result results[NUM_WORKLOADS] = { 0 };
+    bool ok = true;
+    for (int w = 0; w < NUM_WORKLOADS && ok; w++) {
+        printf("Running %s...\n", workloads[w].shape);
+        ok = bench(programs[0], programs[1], programs[2], w, &results[w]);
+    }
+    rmdir(directory);
+    if (!ok) {
+        return 1;
+    }
+
+    FILE *out = fopen(argv[4], "w");
+    if (out == NULL) {
+        fprintf(stderr, "Error: cannot write %s\n", argv[4]);
+        return 1;
+    }
+    print_results(out, results);
+    fclose(out);
+    putchar('\n');
+    print_results(stdout, results);
+    printf("\nResults written to %s\n", argv[4]);
+    return 0;
+}
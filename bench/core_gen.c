@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Generator of synthetic .core programs for the benchmarks
+//
+// Writes a program that the scanner and parser accept, and that lowers and runs with
+// --run, to stdout. The shape picks what the program is made of, the size how many of
+// those pieces there are, and the same seed always gives the same program:
+//   mixed      a bit of everything below
+//   deep       statements with deeply nested expressions
+//   wide       long declaration lists and array initializers
+//   strings    printf() calls with long strings
+//   comments   more comment lines than code
+//   functions  many functions with long bodies
+
+#define MAX_STRING_LENGTH 400      // The scanner cuts lexemes at 500 characters
+#define MAX_NESTING 3
+
+typedef enum {
+    SHAPE_MIXED,
+    SHAPE_DEEP,
+    SHAPE_WIDE,
+    SHAPE_STRINGS,
+    SHAPE_COMMENTS,
+    SHAPE_FUNCTIONS
+} Shape;
+
+static const char *shape_names[] = { "mixed", "deep", "wide", "strings", "comments", "functions" };
+
+static uint64_t rng_state;
+static int next_name;       // Keeps every local name unique
+static FILE *out;
+
+static uint32_t rng(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 2685821657736338717ull) >> 32);
+}
+
+static int random_below(int n) {
+    return (int)(rng() % (uint32_t)n);
+}
+
+static void indent(int level) {
+    for (int i = 0; i < level; i++) {
+        fputs("    ", out);
+    }
+}
+
+/******************************************************/
+/* Expressions */
+
+// Operands every function body has: parameters a and b, locals x and y, array t[8]
+static void leaf(void) {
+    switch (random_below(6)) {
+        case 0: fputs("a", out); break;
+        case 1: fputs("b", out); break;
+        case 2: fputs("x", out); break;
+        case 3: fputs("y", out); break;
+        case 4: fprintf(out, "t[%d]", random_below(8)); break;
+        default: fprintf(out, "%d", random_below(100)); break;
+    }
+}
+
+static void expression(int depth) {
+    if (depth <= 0) {
+        leaf();
+        return;
+    }
+    // Divisors are non-zero constants, so the programs also run
+    static const char *operators[] = { "+", "-", "*", "+", "-", "<", "==", "&&", "||" };
+    switch (random_below(8)) {
+        case 0:
+            fputs("(", out);
+            expression(depth - 1);
+            fprintf(out, " %s %d)", random_below(2) ? "/" : "%", 1 + random_below(9));
+            break;
+        case 1:
+            fputs("-(", out);
+            expression(depth - 1);
+            fputs(")", out);
+            break;
+        default:
+            fputs("(", out);
+            expression(depth - 1);
+            fprintf(out, " %s ", operators[random_below(9)]);
+            if (random_below(2)) {
+                leaf();
+            } else {
+                expression(depth / 2);
+            }
+            fputs(")", out);
+            break;
+    }
+}
+
+// Nested on the left and the right at once, depth levels deep
+static void deep_expression(int depth) {
+    if (depth == 0) {
+        leaf();
+        return;
+    }
+    fputs("(", out);
+    leaf();
+    fprintf(out, " %s ", random_below(2) ? "+" : "-");
+    deep_expression(depth - 1);
+    fputs(")", out);
+}
+
+/******************************************************/
+/* Statements */
+
+static void comment(int level, int length) {
+    static const char *words[] = { "the", "loop", "keeps", "a", "running", "total", "of", "values",
+                                   "until", "counter", "reaches", "bound", "so", "each", "step", "is" };
+    indent(level);
+    fputs("//", out);
+    int written = 0;
+    while (written < length) {
+        const char *word = words[random_below(16)];
+        fprintf(out, " %s", word);
+        written += (int)strlen(word) + 1;
+    }
+    fputc('\n', out);
+}
+
+static void string_literal(int length) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz      ,.";
+    fputc('"', out);
+    for (int i = 0; i < length; i++) {
+        fputc(letters[random_below((int)sizeof(letters) - 1)], out);
+    }
+    fputs(" %d\\n\"", out);
+}
+
+static void statement(Shape shape, int level, int nesting);
+
+static void block(Shape shape, int level, int nesting, int count) {
+    for (int i = 0; i < count; i++) {
+        statement(shape, level, nesting);
+    }
+}
+
+static void statement(Shape shape, int level, int nesting) {
+    int kind = random_below(10);
+    if (shape == SHAPE_DEEP) {
+        kind = 0;
+    } else if (shape == SHAPE_STRINGS) {
+        kind = random_below(2) ? 9 : kind;
+    } else if (shape == SHAPE_COMMENTS) {
+        for (int c = 1 + random_below(3); c > 0; c--) {
+            comment(level, 40 + random_below(120));
+        }
+    }
+    if (nesting >= MAX_NESTING && kind >= 5 && kind <= 7) {
+        kind = 2;
+    }
+
+    switch (kind) {
+        case 0:
+        case 1:
+            indent(level);
+            fprintf(out, "%s = ", random_below(2) ? "x" : "y");
+            if (shape == SHAPE_DEEP) {
+                deep_expression(40 + random_below(40));
+            } else {
+                expression(1 + random_below(4));
+            }
+            fputs(";\n", out);
+            break;
+        case 2:
+        case 3:
+            indent(level);
+            fprintf(out, "t[%d] = ", random_below(8));
+            expression(1 + random_below(3));
+            fputs(";\n", out);
+            break;
+        case 4: {
+            int name = next_name++;
+            indent(level);
+            fprintf(out, "int v%d = ", name);
+            expression(2);
+            fputs(";\n", out);
+            indent(level);
+            fprintf(out, "x = x + v%d;\n", name);
+            break;
+        }
+        case 5:
+            indent(level);
+            fputs("if (", out);
+            expression(2);
+            fputs(") {\n", out);
+            block(shape, level + 1, nesting + 1, 1 + random_below(3));
+            indent(level);
+            if (random_below(2)) {
+                fputs("} else {\n", out);
+                block(shape, level + 1, nesting + 1, 1 + random_below(3));
+                indent(level);
+            }
+            fputs("}\n", out);
+            break;
+        case 6: {
+            // Bounded loops, so the programs stay quick to run
+            int name = next_name++;
+            indent(level);
+            fprintf(out, "int i%d = 0;\n", name);
+            indent(level);
+            fprintf(out, "while (i%d < %d) {\n", name, 2 + random_below(3));
+            block(shape, level + 1, nesting + 1, 1 + random_below(3));
+            indent(level + 1);
+            fprintf(out, "i%d = i%d + 1;\n", name, name);
+            indent(level);
+            fputs("}\n", out);
+            break;
+        }
+        case 7: {
+            int name = next_name++;
+            indent(level);
+            fprintf(out, "int k%d;\n", name);
+            indent(level);
+            fprintf(out, "for (k%d = 0; k%d < %d; k%d = k%d + 1) {\n", name, name, 2 + random_below(3), name, name);
+            block(shape, level + 1, nesting + 1, 1 + random_below(3));
+            indent(level);
+            fputs("}\n", out);
+            break;
+        }
+        case 8:
+            indent(level);
+            fputs("printf(\"%d %d\\n\", x, y);\n", out);
+            break;
+        default:
+            indent(level);
+            fputs("printf(", out);
+            string_literal(shape == SHAPE_STRINGS ? 100 + random_below(MAX_STRING_LENGTH - 100) : 10 + random_below(30));
+            fputs(", x);\n", out);
+            break;
+    }
+}
+
+/******************************************************/
+/* Declarations */
+
+static void function(Shape shape, int id, int statements) {
+    if (shape == SHAPE_COMMENTS) {
+        comment(0, 60 + random_below(100));
+    }
+    fprintf(out, "int f%d(int a, int b) {\n", id);
+    fputs("    int x = a;\n    int y = b;\n    int t[8];\n", out);
+    block(shape, 1, 0, statements);
+    fputs("    return x + y;\n}\n\n", out);
+}
+
+static void wide_declarations(int count) {
+    for (int done = 0; done < count; ) {
+        int length = 50 + random_below(200);
+        if (length > count - done) {
+            length = count - done;
+        }
+        if (random_below(2)) {
+            fputs("int", out);
+            for (int i = 0; i < length; i++) {
+                fprintf(out, "%s w%d = %d", i ? "," : "", next_name++, random_below(1000));
+            }
+            fputs(";\n", out);
+        } else {
+            fprintf(out, "int w%d[%d] = {", next_name++, length);
+            for (int i = 0; i < length; i++) {
+                fprintf(out, "%s%d", i ? ", " : "", random_below(1000));
+            }
+            fputs("};\n", out);
+        }
+        done += length;
+    }
+    fputc('\n', out);
+}
+
+static void program(Shape shape, int size) {
+    fprintf(out, "// Generated by core_gen: shape %s, size %d\n\n", shape_names[shape], size);
+    int functions;
+    int statements;
+    switch (shape) {
+        case SHAPE_WIDE:
+            wide_declarations(size);
+            functions = 1;
+            statements = 10;
+            break;
+        case SHAPE_FUNCTIONS:
+            functions = size / 50 + 1;
+            statements = 50;
+            break;
+        case SHAPE_MIXED:
+            wide_declarations(size / 10);
+            functions = size / 20 + 1;
+            statements = 20;
+            break;
+        default:
+            functions = size / 25 + 1;
+            statements = 25;
+            break;
+    }
+
+    for (int id = 0; id < functions; id++) {
+        Shape body = shape;
+        if (shape == SHAPE_MIXED) {
+            static const Shape mix[] = { SHAPE_DEEP, SHAPE_STRINGS, SHAPE_COMMENTS, SHAPE_FUNCTIONS };
+            body = mix[random_below(4)];
+        }
+        function(body, id, statements);
+    }
+
+    fputs("int main() {\n    int total = 0;\n", out);
+    for (int id = 0; id < functions; id++) {
+        fprintf(out, "    total = total + f%d(%d, %d);\n", id, random_below(50), random_below(50));
+    }
+    fputs("    printf(\"total = %d\\n\", total);\n    return 0;\n}\n", out);
+}
+
+int main(int argc, char* argv[argc + 1]) {
+    Shape shape = SHAPE_MIXED;
+    int size = 1000;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            int found = -1;
+            for (int s = 0; s < (int)(sizeof(shape_names) / sizeof(shape_names[0])); s++) {
+                if (strcmp(name, shape_names[s]) == 0) {
+                    found = s;
+                }
+            }
+            if (found < 0) {
+                fprintf(stderr, "Unknown shape '%s'\n", name);
+                return 1;
+            }
+            shape = (Shape)found;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            printf("Usage: ./%s [-s mixed|deep|wide|strings|comments|functions] [-n size] [-r seed]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    rng_state = seed * 0x9E3779B97F4A7C15ull + 1;
+    out = stdout;
+    program(shape, size < 1 ? 1 : size);
+    return 0;
+}
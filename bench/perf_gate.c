@@ -0,0 +1,453 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Performance gate of the scanner and the parser
+//
+// Times both on every program of test_lexer/ and test_parser/ and on a few core_gen
+// workloads, the fastest of RUNS runs each, and compares the times with a stored baseline.
+// Times are kept in units of a fixed calibration loop run in this process, so a baseline
+// recorded on one machine still means something on another; the loop runs between the
+// programs too and the fastest run is the unit, which keeps out bursts of load. The gate fails when the scanner
+// or the parser is slower than its baseline by more than the threshold over all programs
+// together, or on one program by more than the threshold and NOISE_MS; a program that
+// looks slower is measured again first, and the fastest time counts. With -u the baseline
+// is written instead. The baseline records the build type given with -b, and is only
+// compared with tools of the same build type: an optimized build would hide a regression
+// behind its speedup over an unoptimized baseline.
+
+#define RUNS 5
+#define TIMEOUT_SECONDS 60
+#define DEFAULT_THRESHOLD 25       // Percent
+#define NOISE_MS 2.0               // Smaller differences are process start-up noise
+#define RETRIES 2                  // Times a program that looks slower is measured again
+#define MAX_PROGRAMS 256
+#define DEFAULT_BUILD_TYPE "default"
+
+// The calibration loop is compiled as the baseline was recorded, without optimization, so
+// that its unit is the same in a Release build as in the default one
+#if defined(__clang__)
+#define CALIBRATION_BUILD __attribute__((optnone, noinline))
+#elif defined(__GNUC__)
+#define CALIBRATION_BUILD __attribute__((optimize("O0"), noinline))
+#else
+#define CALIBRATION_BUILD
+#endif
+
+static const struct {
+    const char *shape;
+    int size;
+} workloads[] = {
+    { "mixed", 1000 },
+    { "deep", 100 },
+    { "strings", 2000 },
+    { "functions", 2000 },
+};
+
+#define NUM_WORKLOADS (int)(sizeof(workloads) / sizeof(workloads[0]))
+
+typedef struct {
+    char name[128];
+    char path[4096];           // Empty for a workload, which is generated
+    int workload;
+    long bytes;
+    double scanner;            // ms
+    double parser;
+    double baseline_scanner;   // Calibration units, negative if the baseline does not have the program
+    double baseline_parser;
+} Program;
+
+static Program programs[MAX_PROGRAMS];
+static int num_programs;
+static char directory[] = "/tmp/core_perf_gate.XXXXXX";
+static double unit_ms = 1e30;
+static const char *build_type = DEFAULT_BUILD_TYPE;
+
+static double now_ms(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+// Runs a fixed mix of arithmetic, branches and memory accesses, the fastest run is the unit
+CALIBRATION_BUILD static void calibrate(int runs) {
+    static uint32_t table[1 << 16];
+    for (int r = 0; r < runs; r++) {
+        double start = now_ms();
+        uint64_t state = 88172645463325252ull;
+        uint32_t sum = 0;
+        for (int i = 0; i < 4000000; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            uint32_t slot = (uint32_t)state & ((1 << 16) - 1);
+            if (table[slot] & 1) {
+                sum += table[slot] >> 1;
+            } else {
+                sum ^= (uint32_t)(state >> 32);
+            }
+            table[slot] = sum;
+        }
+        double ms = now_ms() - start;
+        if (ms < unit_ms) {
+            unit_ms = ms;
+        }
+        // Keeps the loop from being optimized away
+        if (sum == 42) {
+            putchar(' ');
+        }
+    }
+}
+
+// Runs argv in the scratch directory with stdout going to output, false if it did not exit
+static bool run(char *argv[], const char *output, double *ms) {
+    fflush(stdout);
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int null = open("/dev/null", O_WRONLY);
+        if (fd < 0 || null < 0 || chdir(directory) != 0) {
+            _exit(127);
+        }
+        dup2(fd, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        close(fd);
+        close(null);
+        unsetenv("CORE_STATS");
+        unsetenv("CORE_LOG");
+        alarm(TIMEOUT_SECONDS);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return false;
+    }
+    *ms = now_ms() - start;
+    // The parser exits with 1 on the invalid test programs, which is expected
+    if (!WIFEXITED(status) || WEXITSTATUS(status) > 1) {
+        fprintf(stderr, "Error: %s failed\n", argv[0]);
+        return false;
+    }
+    return true;
+}
+
+static bool fastest(char *argv[], double *fastest_ms) {
+    double best = 1e30;
+    for (int r = 0; r < RUNS; r++) {
+        double ms;
+        if (!run(argv, "/dev/null", &ms)) {
+            return false;
+        }
+        if (ms < best) {
+            best = ms;
+        }
+    }
+    *fastest_ms = best;
+    return true;
+}
+
+static void add_program(const char *name, const char *path, int workload) {
+    if (num_programs == MAX_PROGRAMS) {
+        return;
+    }
+    Program *p = &programs[num_programs++];
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    snprintf(p->path, sizeof(p->path), "%s", path);
+    p->workload = workload;
+    p->baseline_scanner = p->baseline_parser = -1;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(((const Program *)a)->name, ((const Program *)b)->name);
+}
+
+// The .core files of a test directory, sorted so the report is always in the same order
+static void find_programs(const char *source_dir, const char *test_dir) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", source_dir, test_dir);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    int first = num_programs;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *dot = strrchr(entry->d_name, '.');
+        if (dot != NULL && strcmp(dot, ".core") == 0) {
+            char name[128], file[4096 + 256];
+            snprintf(name, sizeof(name), "%.16s/%.100s", test_dir, entry->d_name);
+            snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+            add_program(name, file, -1);
+        }
+    }
+    closedir(dir);
+    qsort(&programs[first], num_programs - first, sizeof(Program), compare_names);
+}
+
+static bool copy_file(const char *from, const char *to) {
+    FILE *in = fopen(from, "rb");
+    FILE *out = fopen(to, "wb");
+    char buffer[65536];
+    size_t read;
+    bool ok = in != NULL && out != NULL;
+    while (ok && (read = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = fwrite(buffer, 1, read, out) == read;
+    }
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out != NULL) {
+        ok = fclose(out) == 0 && ok;
+    }
+    return ok;
+}
+
+static bool measure(char *scanner, char *parser, char *generator, Program *p) {
+    char input[sizeof(directory) + 32];
+    snprintf(input, sizeof(input), "%s/program.core", directory);
+    if (p->workload >= 0) {
+        char size[16];
+        snprintf(size, sizeof(size), "%d", workloads[p->workload].size);
+        char *generate[] = { generator, "-s", (char *)workloads[p->workload].shape, "-n", size, NULL };
+        double ms;
+        if (!run(generate, input, &ms)) {
+            return false;
+        }
+    } else if (!copy_file(p->path, input)) {
+        fprintf(stderr, "Error: cannot copy %s\n", p->path);
+        return false;
+    }
+    FILE *file = fopen(input, "r");
+    if (file == NULL) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    p->bytes = ftell(file);
+    fclose(file);
+
+    char *scan[] = { scanner, "-q", "program.core", NULL };
+    char *parse[] = { parser, "-q", NULL };
+    bool ok = fastest(scan, &p->scanner) && fastest(parse, &p->parser);
+    remove(input);
+    return ok;
+}
+
+static bool read_baseline(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: cannot read %s, record one with -u\n", path);
+        return false;
+    }
+    char line[512];
+    char recorded[64] = DEFAULT_BUILD_TYPE;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char name[128];
+        long bytes;
+        double scanner, parser;
+        if (sscanf(line, "# build type: %63s", recorded) == 1 ||
+            line[0] == '#' || sscanf(line, "%127s %ld %lf %lf", name, &bytes, &scanner, &parser) != 4) {
+            continue;
+        }
+        for (int p = 0; p < num_programs; p++) {
+            if (strcmp(programs[p].name, name) == 0) {
+                programs[p].baseline_scanner = scanner;
+                programs[p].baseline_parser = parser;
+            }
+        }
+    }
+    fclose(file);
+    if (strcmp(recorded, build_type) != 0) {
+        fprintf(stderr, "Error: %s was recorded from a %s build, the tools are a %s build; "
+                "record a baseline for it with -u\n", path, recorded, build_type);
+        return false;
+    }
+    return true;
+}
+
+static bool write_baseline(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        return false;
+    }
+    fprintf(file, "# Baseline of bench/perf_gate.c: fastest of %d runs in calibration units,\n", RUNS);
+    fprintf(file, "# one unit was %.3f ms where it was recorded\n", unit_ms);
+    fprintf(file, "# build type: %s\n", build_type);
+    fprintf(file, "# %-36s %10s %12s %12s\n", "program", "bytes", "scanner", "parser");
+    for (int p = 0; p < num_programs; p++) {
+        fprintf(file, "%-38s %10ld %12.5f %12.5f\n", programs[p].name, programs[p].bytes,
+                programs[p].scanner / unit_ms, programs[p].parser / unit_ms);
+    }
+    fclose(file);
+    return true;
+}
+
+// Percent change of a time in ms against the baseline in units, and whether it is a regression
+static bool compare(double ms, double baseline, double threshold, double *change) {
+    double now = ms / unit_ms;
+    *change = baseline > 0 ? (now / baseline - 1) * 100 : 0;
+    return baseline > 0 && *change > threshold && (now - baseline) * unit_ms > NOISE_MS;
+}
+
+static bool regressed(const Program *p, double threshold) {
+    double change;
+    return compare(p->scanner, p->baseline_scanner, threshold, &change) ||
+           compare(p->parser, p->baseline_parser, threshold, &change);
+}
+
+// Measures the programs that look slower again, noise only ever makes a run slower
+static bool retry_regressions(char *tools[], double threshold) {
+    for (int retry = 0; retry < RETRIES; retry++) {
+        for (int p = 0; p < num_programs; p++) {
+            if (!regressed(&programs[p], threshold)) {
+                continue;
+            }
+            Program again = programs[p];
+            if (!measure(tools[0], tools[1], tools[2], &again)) {
+                return false;
+            }
+            calibrate(1);
+            if (again.scanner < programs[p].scanner) {
+                programs[p].scanner = again.scanner;
+            }
+            if (again.parser < programs[p].parser) {
+                programs[p].parser = again.parser;
+            }
+        }
+    }
+    return true;
+}
+
+static bool report(double threshold) {
+    int regressions = 0;
+    double totals[2] = { 0 }, baselines[2] = { 0 };
+    long bytes = 0;
+    printf("%-38s %10s %10s %8s %10s %8s\n", "program", "bytes", "scan ms", "change", "parse ms", "change");
+    for (int p = 0; p < num_programs; p++) {
+        const Program *program = &programs[p];
+        double scan_change, parse_change;
+        bool slow_scan = compare(program->scanner, program->baseline_scanner, threshold, &scan_change);
+        bool slow_parse = compare(program->parser, program->baseline_parser, threshold, &parse_change);
+        printf("%-38s %10ld %10.2f %+7.0f%% %10.2f %+7.0f%%%s%s\n", program->name, program->bytes,
+               program->scanner, scan_change, program->parser, parse_change,
+               program->baseline_scanner < 0 ? "  (new)" : "", slow_scan || slow_parse ? "  REGRESSION" : "");
+        regressions += slow_scan + slow_parse;
+        if (program->baseline_scanner >= 0) {
+            totals[0] += program->scanner;
+            totals[1] += program->parser;
+            baselines[0] += program->baseline_scanner;
+            baselines[1] += program->baseline_parser;
+            bytes += program->bytes;
+        }
+    }
+
+    const char *tools[] = { "scanner", "parser" };
+    printf("\nCalibration unit: %.3f ms\n", unit_ms);
+    for (int t = 0; t < 2; t++) {
+        double change;
+        bool slow = compare(totals[t], baselines[t], threshold, &change);
+        printf("%-8s %8.1f KB/s, %+.0f%% time against the baseline%s\n", tools[t],
+               totals[t] > 0 ? bytes / 1024.0 / (totals[t] / 1e3) : 0.0, change,
+               slow ? "  REGRESSION" : "");
+        regressions += slow;
+    }
+    if (regressions > 0) {
+        printf("\n%d regressions of more than %.0f%%\n", regressions, threshold);
+        return false;
+    }
+    printf("\nNo regressions of more than %.0f%%\n", threshold);
+    return true;
+}
+
+int main(int argc, char* argv[argc + 1]) {
+    bool update = false;
+    double threshold = DEFAULT_THRESHOLD;
+    char *arguments[5];
+    int num_arguments = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-u") == 0) {
+            update = true;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            // Without a build type CMake builds without optimization, like the default one
+            build_type = argv[++i][0] != '\0' ? argv[i] : DEFAULT_BUILD_TYPE;
+        } else if (num_arguments < 5) {
+            arguments[num_arguments++] = argv[i];
+        } else {
+            num_arguments = 0;
+            break;
+        }
+    }
+    if (num_arguments != 5) {
+        printf("Usage: ./%s [-u] [-t percent] [-b build type] <scanner> <parser> <core_gen> <source dir> <baseline file>\n", argv[0]);
+        return 1;
+    }
+    char *tools[3];
+    for (int t = 0; t < 3; t++) {
+        tools[t] = realpath(arguments[t], NULL);
+        if (tools[t] == NULL) {
+            fprintf(stderr, "Error: cannot find %s\n", arguments[t]);
+            return 1;
+        }
+    }
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    find_programs(arguments[3], "test_lexer");
+    find_programs(arguments[3], "test_parser");
+    for (int w = 0; w < NUM_WORKLOADS; w++) {
+        char name[128];
+        snprintf(name, sizeof(name), "core_gen:%s:%d", workloads[w].shape, workloads[w].size);
+        add_program(name, "", w);
+    }
+    if (!update && !read_baseline(arguments[4])) {
+        rmdir(directory);
+        return 1;
+    }
+
+    calibrate(RUNS);
+    bool ok = true;
+    for (int p = 0; p < num_programs && ok; p++) {
+        ok = measure(tools[0], tools[1], tools[2], &programs[p]);
+        calibrate(1);
+    }
+    if (ok && !update) {
+        ok = retry_regressions(tools, threshold);
+    }
+    char leftover[sizeof(directory) + 32];
+    snprintf(leftover, sizeof(leftover), "%s/symbol_table.txt", directory);
+    remove(leftover);
+    snprintf(leftover, sizeof(leftover), "%s/parse_tree_output.ebnf", directory);
+    remove(leftover);
+    rmdir(directory);
+    if (!ok) {
+        return 1;
+    }
+
+    if (update) {
+        if (!write_baseline(arguments[4])) {
+            return 1;
+        }
+        printf("Baseline of %d programs written to %s\n", num_programs, arguments[4]);
+        return 0;
+    }
+    return report(threshold) ? 0 : 1;
+}
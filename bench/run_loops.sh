@@ -0,0 +1,67 @@
+#!/bin/sh
+# Runs the loop benchmarks with and without the loop optimizations and compares them, and
+# compares the vector kernels picked by the CPU with the scalar ones (CORE_VECTOR=scalar) and
+# the threads of parallel loops with one thread (CORE_THREADS=1).
+# Usage: bench/run_loops.sh <scanner> <parser>
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <scanner> <parser>"
+    exit 1
+fi
+
+scanner=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+parser=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+bench_dir=$(cd "$(dirname "$0")" && pwd)
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+cd "$work_dir" || exit 1
+
+# Program output, without the parser's own messages
+program_output() {
+    grep -v -e '^Parsing token' -e '^PARSING!' -e '^Parsing successful!' -e '^Dead code elimination' \
+            -e '^Loop optimization' -e '^Inlin' -e '^Memoization' -e '^Bounds checks' -e '^$' "$1"
+}
+
+# Field of the "Program returned" line: 4 for instructions, 6 for milliseconds
+run_stat() {
+    sed -n 's/^Program returned [-0-9]* (\([0-9]*\) IR instructions, \([0-9.]*\) ms)$/\1 \2/p' "$1" |
+        cut -d ' ' -f "$2"
+}
+
+status=0
+printf "%-16s %14s %14s %9s %10s %10s %8s %10s %8s %10s %8s\n" "benchmark" "instructions" "optimized" "ratio" "ms" \
+       "opt ms" "speedup" "scalar ms" "vector" "1 thr ms" "threads"
+for program in "$bench_dir"/loops/*.core; do
+    name=$(basename "$program" .core)
+    "$scanner" "$program" > /dev/null
+    "$parser" --run > base.out 2> base.err
+    "$parser" -O --run > opt.out 2> opt.err
+    CORE_VECTOR=scalar "$parser" -O --run > scalar.out 2> scalar.err
+    CORE_THREADS=1 "$parser" -O --run > serial.out 2> serial.err
+
+    if ! program_output base.out > base.txt || ! program_output opt.out > opt.txt || ! cmp -s base.txt opt.txt ||
+       ! program_output scalar.out > scalar.txt || ! cmp -s base.txt scalar.txt ||
+       ! program_output serial.out > serial.txt || ! cmp -s base.txt serial.txt; then
+        echo "$name: optimized output differs"
+        status=1
+        continue
+    fi
+    base_count=$(run_stat base.err 1)
+    opt_count=$(run_stat opt.err 1)
+    base_ms=$(run_stat base.err 2)
+    opt_ms=$(run_stat opt.err 2)
+    scalar_ms=$(run_stat scalar.err 2)
+    serial_ms=$(run_stat serial.err 2)
+    if [ -z "$base_count" ] || [ -z "$opt_count" ]; then
+        echo "$name: run failed"
+        cat base.err opt.err
+        status=1
+        continue
+    fi
+    awk -v name="$name" -v bc="$base_count" -v oc="$opt_count" -v bm="$base_ms" -v om="$opt_ms" -v sm="$scalar_ms" \
+            -v tm="$serial_ms" 'BEGIN {
+        printf "%-16s %14d %14d %8.2fx %10.2f %10.2f %7.2fx %10.2f %7.2fx %10.2f %7.2fx\n", name, bc, oc, bc / oc,
+               bm, om, (om > 0 ? bm / om : 0), sm, (om > 0 ? sm / om : 0), tm, (om > 0 ? tm / om : 0)
+    }'
+done
+exit $status
@@ -0,0 +1,1625 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include "ir.h"
+
+// x86-64 code generation from the SSA IR
+//
+// Emits GNU assembler source (Intel syntax) for the System V ABI, to be linked with libc:
+//   gcc output.s -o program -lm
+// Each function is first translated to a machine-level instruction list where phis are
+// replaced by copies at the end of their predecessors (critical edges get a block of their
+// own). Registers are then assigned by linear scan over the live intervals of the values:
+// values live across a call only get callee-saved registers, float values live across a
+// call are spilled since SysV has no callee-saved xmm registers. Each instruction is then
+// expanded to assembly, with rax, rcx, rdx, r10, r11, xmm0 and xmm1 as scratch registers.
+// Like the interpreter, ints are 64 bits wide and every array element takes 8 bytes.
+
+#define MIR_MOVE IR_OPCODE_COUNT
+
+// Allocatable registers, the caller-saved ones first
+static const char *gpr_names[] = { "rsi", "rdi", "r8", "r9", "rbx", "r12", "r13", "r14", "r15" };
+#define NUM_GPRS 9
+#define FIRST_CALLEE_SAVED 4
+static const char *xmm_names[] = { "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8",
+                                   "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15" };
+#define NUM_XMMS 14
+
+static const char *int_arg_registers[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+#define NUM_INT_ARG_REGISTERS 6
+#define NUM_FLOAT_ARG_REGISTERS 8
+
+typedef struct {
+    int op;             // IrOpcode or MIR_MOVE
+    int dst;            // Virtual register, IR_NONE if nothing is defined
+    int operands;       // Start in mir_operands
+    int num_operands;
+    int ir;             // The IR instruction, IR_NONE for copies
+    int targets[2];     // Machine blocks
+} MInstr;
+
+typedef struct {
+    int first, count;
+} MBlock;
+
+// A block created on a critical edge, holding the phi copies of that edge
+typedef struct {
+    int pred, succ;     // IR blocks
+    int block;          // Machine block
+} SplitEdge;
+
+// Argument of a call, a virtual register or an address computed with lea
+typedef struct {
+    bool is_float;
+    int vreg;
+    char address[64];
+} CallArg;
+
+static const IrModule *module;
+static bool jit_mode;           // Compiling one function for jit.c rather than a whole program
+static const IrFunction *fn;
+static int fn_index;
+static FILE *out;
+
+static MInstr *mir;
+static int num_mir, mir_capacity;
+static int *mir_operands;
+static int num_mir_operands, mir_operands_capacity;
+static MBlock *mblocks;
+static int num_mblocks;
+static int *mblock_of;      // IR block -> machine block
+static SplitEdge *splits;
+static int num_splits;
+
+// Per virtual register, the IR values first, then the temporaries of the phi copies
+static int num_vregs, vregs_capacity;
+static bool *vreg_is_float;
+static int *interval_start, *interval_end;
+static int *vreg_register;  // IR_NONE when spilled
+static int *vreg_slot;      // Frame offset when spilled
+
+// Values live on entry to each machine block
+static uint64_t *live_in;
+static int live_words;
+
+static int *call_positions;
+static int num_calls;
+
+static bool used_callee_saved[NUM_GPRS];
+static int frame_size;      // Bytes below the saved registers
+static int saved_bytes;
+static int stack_bytes;     // Allocated by the prologue below the saved registers
+static int *param_offsets;
+static int scan_offset;
+
+static int next_label;
+static int num_float_constants;
+static double *float_constants;
+static int float_constants_capacity;
+
+typedef struct {
+    int label;
+    bool is_division;
+    char index[8];
+    int length;
+    int line;
+} ErrorStub;
+
+static ErrorStub *stubs;
+static int num_stubs, stubs_capacity;
+
+/******************************************************/
+/* Output helpers */
+
+static void emit(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fputs("    ", out);
+    vfprintf(out, format, args);
+    fputc('\n', out);
+    va_end(args);
+}
+
+static void emit_label(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(out, format, args);
+    fputs(":\n", out);
+    va_end(args);
+}
+
+static void emit_string(const char *bytes, int length) {
+    fputs("    .string \"", out);
+    for (int i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)bytes[i];
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 32 || c >= 127) {
+            fprintf(out, "\\%03o", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputs("\"\n", out);
+}
+
+static int add_float_constant(double value) {
+    if (num_float_constants == float_constants_capacity) {
+        float_constants_capacity = float_constants_capacity ? float_constants_capacity * 2 : 16;
+        float_constants = realloc(float_constants, sizeof(double) * float_constants_capacity);
+    }
+    float_constants[num_float_constants] = value;
+    return num_float_constants++;
+}
+
+static int add_stub(bool is_division, const char *index, int length, int line) {
+    if (num_stubs == stubs_capacity) {
+        stubs_capacity = stubs_capacity ? stubs_capacity * 2 : 16;
+        stubs = realloc(stubs, sizeof(ErrorStub) * stubs_capacity);
+    }
+    ErrorStub *stub = &stubs[num_stubs++];
+    stub->label = next_label++;
+    stub->is_division = is_division;
+    snprintf(stub->index, sizeof(stub->index), "%s", index ? index : "");
+    stub->length = length;
+    stub->line = line;
+    return stub->label;
+}
+
+static void function_label(char *buffer, size_t size, int id) {
+    if (id == module->init_function) {
+        snprintf(buffer, size, "__core_init");
+    } else {
+        snprintf(buffer, size, "core_%s", module->functions[id].name);
+    }
+}
+
+/******************************************************/
+/* Machine instructions */
+
+static int new_vreg(bool is_float) {
+    if (num_vregs == vregs_capacity) {
+        vregs_capacity = vregs_capacity ? vregs_capacity * 2 : 64;
+        vreg_is_float = realloc(vreg_is_float, sizeof(bool) * vregs_capacity);
+    }
+    vreg_is_float[num_vregs] = is_float;
+    return num_vregs++;
+}
+
+static int add_mir(int op, int dst, int ir) {
+    if (num_mir == mir_capacity) {
+        mir_capacity = mir_capacity ? mir_capacity * 2 : 256;
+        mir = realloc(mir, sizeof(MInstr) * mir_capacity);
+    }
+    MInstr *m = &mir[num_mir];
+    m->op = op;
+    m->dst = dst;
+    m->operands = num_mir_operands;
+    m->num_operands = 0;
+    m->ir = ir;
+    m->targets[0] = m->targets[1] = IR_NONE;
+    return num_mir++;
+}
+
+static void add_mir_operand(int m, int vreg) {
+    if (num_mir_operands == mir_operands_capacity) {
+        mir_operands_capacity = mir_operands_capacity ? mir_operands_capacity * 2 : 256;
+        mir_operands = realloc(mir_operands, sizeof(int) * mir_operands_capacity);
+    }
+    mir_operands[num_mir_operands++] = vreg;
+    mir[m].num_operands++;
+}
+
+static int operand(const MInstr *m, int k) {
+    return mir_operands[m->operands + k];
+}
+
+static void add_move(int dst, int src) {
+    int m = add_mir(MIR_MOVE, dst, IR_NONE);
+    add_mir_operand(m, src);
+}
+
+// The copies replacing the phis of succ on the edge from pred, done as a parallel copy
+static void add_phi_copies(int pred, int succ) {
+    int k = ir_pred_index(fn, succ, pred);
+    int dsts[64], srcs[64];
+    int count = 0;
+    for (int phi = fn->blocks[succ].first; phi != IR_NONE && fn->instrs[phi].op == IR_PHI;
+         phi = fn->instrs[phi].next) {
+        int src = ir_operand(fn, phi, k);
+        if (src == phi) {
+            continue;
+        }
+        if (count == 64) {
+            // More phis than the buffer, copy the ones collected so far through temporaries
+            for (int c = 0; c < count; c++) {
+                int temp = new_vreg(vreg_is_float[dsts[c]]);
+                add_move(temp, srcs[c]);
+                srcs[c] = temp;
+            }
+            for (int c = 0; c < count; c++) {
+                add_move(dsts[c], srcs[c]);
+            }
+            count = 0;
+        }
+        dsts[count] = phi;
+        srcs[count] = src;
+        count++;
+    }
+
+    // A phi read by another copy of the same edge is saved first
+    bool overlap = false;
+    for (int c = 0; c < count && !overlap; c++) {
+        for (int d = 0; d < count; d++) {
+            if (c != d && srcs[c] == dsts[d]) {
+                overlap = true;
+                break;
+            }
+        }
+    }
+    if (overlap) {
+        for (int c = 0; c < count; c++) {
+            int temp = new_vreg(vreg_is_float[dsts[c]]);
+            add_move(temp, srcs[c]);
+            srcs[c] = temp;
+        }
+    }
+    for (int c = 0; c < count; c++) {
+        add_move(dsts[c], srcs[c]);
+    }
+}
+
+static bool has_phis(int block) {
+    int first = fn->blocks[block].first;
+    return first != IR_NONE && fn->instrs[first].op == IR_PHI;
+}
+
+static int edge_target(int pred, int succ) {
+    if (!has_phis(succ)) {
+        return mblock_of[succ];
+    }
+    splits = realloc(splits, sizeof(SplitEdge) * (num_splits + 1));
+    splits[num_splits] = (SplitEdge){ pred, succ, num_mblocks++ };
+    return splits[num_splits++].block;
+}
+
+static void build_mir(void) {
+    num_mir = 0;
+    num_mir_operands = 0;
+    num_splits = 0;
+    num_vregs = 0;
+    for (int i = 0; i < fn->num_instrs; i++) {
+        IrOpcode op = fn->instrs[i].op;
+        new_vreg(fn->instrs[i].type == IR_FLOAT && op != IR_ARRAY && op != IR_GLOBAL);
+    }
+
+    mblock_of = realloc(mblock_of, sizeof(int) * (fn->num_blocks + 1));
+    for (int b = 0; b < fn->num_blocks; b++) {
+        mblock_of[b] = IR_NONE;
+    }
+    num_mblocks = fn->rpo.count;
+    for (int k = 0; k < fn->rpo.count; k++) {
+        mblock_of[fn->pool[fn->rpo.start + k]] = k;
+    }
+    // Split edges may add up to two blocks per block
+    mblocks = realloc(mblocks, sizeof(MBlock) * (fn->rpo.count * 3 + 1));
+
+    for (int k = 0; k < fn->rpo.count; k++) {
+        int b = fn->pool[fn->rpo.start + k];
+        mblocks[k].first = num_mir;
+        IR_FOR_EACH_INSTR(fn, b, i) {
+            const IrInstr *in = &fn->instrs[i];
+            // Compiled loops run as they are, IR_VECTOR and IR_PARALLEL are for the interpreter
+            if (in->op == IR_PHI || in->op == IR_NOP || in->op == IR_VECTOR || in->op == IR_PARALLEL) {
+                continue;
+            }
+            if (in->op == IR_JUMP) {
+                add_phi_copies(b, in->targets[0]);
+                int m = add_mir(IR_JUMP, IR_NONE, i);
+                mir[m].targets[0] = mblock_of[in->targets[0]];
+                continue;
+            }
+            int m = add_mir(in->op, in->type != IR_VOID ? i : IR_NONE, i);
+            for (int o = 0; o < in->operands.count; o++) {
+                add_mir_operand(m, ir_operand(fn, i, o));
+            }
+            if (in->op == IR_BRANCH) {
+                mir[m].targets[0] = edge_target(b, in->targets[0]);
+                mir[m].targets[1] = edge_target(b, in->targets[1]);
+            }
+        }
+        mblocks[k].count = num_mir - mblocks[k].first;
+    }
+
+    for (int s = 0; s < num_splits; s++) {
+        MBlock *block = &mblocks[splits[s].block];
+        block->first = num_mir;
+        add_phi_copies(splits[s].pred, splits[s].succ);
+        int m = add_mir(IR_JUMP, IR_NONE, IR_NONE);
+        mir[m].targets[0] = mblock_of[splits[s].succ];
+        block->count = num_mir - block->first;
+    }
+}
+
+static bool is_call(const MInstr *m) {
+    return m->op == IR_CALL || m->op == IR_PRINTF || m->op == IR_SCANF ||
+           (m->op == IR_POW && vreg_is_float[m->dst]);
+}
+
+/******************************************************/
+/* Liveness and linear scan */
+
+static int num_succs(int block, int *succs) {
+    const MInstr *last = &mir[mblocks[block].first + mblocks[block].count - 1];
+    int n = 0;
+    if (last->op == IR_JUMP) {
+        succs[n++] = last->targets[0];
+    } else if (last->op == IR_BRANCH) {
+        succs[n++] = last->targets[0];
+        succs[n++] = last->targets[1];
+    }
+    return n;
+}
+
+static void compute_intervals(void) {
+    int words = (num_vregs + 63) / 64;
+    free(live_in);
+    live_in = calloc((size_t)num_mblocks * words, sizeof(uint64_t));
+    live_words = words;
+    uint64_t *live_out = calloc((size_t)num_mblocks * words, sizeof(uint64_t));
+    uint64_t *uses = calloc((size_t)num_mblocks * words, sizeof(uint64_t));
+    uint64_t *defs = calloc((size_t)num_mblocks * words, sizeof(uint64_t));
+
+    interval_start = realloc(interval_start, sizeof(int) * num_vregs);
+    interval_end = realloc(interval_end, sizeof(int) * num_vregs);
+    for (int v = 0; v < num_vregs; v++) {
+        interval_start[v] = INT_MAX;
+        interval_end[v] = -1;
+    }
+    call_positions = realloc(call_positions, sizeof(int) * (num_mir + 1));
+    num_calls = 0;
+
+    for (int b = 0; b < num_mblocks; b++) {
+        uint64_t *use = uses + (size_t)b * words;
+        uint64_t *def = defs + (size_t)b * words;
+        for (int i = mblocks[b].first; i < mblocks[b].first + mblocks[b].count; i++) {
+            const MInstr *m = &mir[i];
+            for (int o = 0; o < m->num_operands; o++) {
+                int v = operand(m, o);
+                if (!(def[v / 64] >> (v % 64) & 1)) {
+                    use[v / 64] |= 1ull << (v % 64);
+                }
+                if (i < interval_start[v]) interval_start[v] = i;
+                if (i > interval_end[v]) interval_end[v] = i;
+            }
+            if (m->dst != IR_NONE) {
+                int v = m->dst;
+                def[v / 64] |= 1ull << (v % 64);
+                if (i < interval_start[v]) interval_start[v] = i;
+                if (i > interval_end[v]) interval_end[v] = i;
+            }
+            if (is_call(m)) {
+                call_positions[num_calls++] = i;
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = num_mblocks - 1; b >= 0; b--) {
+            uint64_t *out_set = live_out + (size_t)b * words;
+            int succs[2];
+            int n = num_succs(b, succs);
+            for (int s = 0; s < n; s++) {
+                uint64_t *in_set = live_in + (size_t)succs[s] * words;
+                for (int w = 0; w < words; w++) {
+                    out_set[w] |= in_set[w];
+                }
+            }
+            uint64_t *in_set = live_in + (size_t)b * words;
+            uint64_t *use = uses + (size_t)b * words;
+            uint64_t *def = defs + (size_t)b * words;
+            for (int w = 0; w < words; w++) {
+                uint64_t value = use[w] | (out_set[w] & ~def[w]);
+                if (value != in_set[w]) {
+                    in_set[w] = value;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // One range per value, from its first to its last live position
+    for (int b = 0; b < num_mblocks; b++) {
+        int first = mblocks[b].first;
+        int last = first + mblocks[b].count - 1;
+        for (int w = 0; w < words; w++) {
+            uint64_t in_bits = live_in[(size_t)b * words + w];
+            uint64_t out_bits = live_out[(size_t)b * words + w];
+            for (int bit = 0; bit < 64; bit++) {
+                int v = w * 64 + bit;
+                if (in_bits >> bit & 1) {
+                    if (first < interval_start[v]) interval_start[v] = first;
+                    if (first > interval_end[v]) interval_end[v] = first;
+                }
+                if (out_bits >> bit & 1) {
+                    if (last < interval_start[v]) interval_start[v] = last;
+                    if (last > interval_end[v]) interval_end[v] = last;
+                }
+            }
+        }
+    }
+
+    free(live_out);
+    free(uses);
+    free(defs);
+}
+
+// Live when a call is made, the result of the call excepted
+static bool crosses_call(int v) {
+    for (int c = 0; c < num_calls; c++) {
+        int position = call_positions[c];
+        if (position >= interval_start[v] && position < interval_end[v] && mir[position].dst != v) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int *sorted_vregs;
+
+static int compare_start(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    if (interval_start[x] != interval_start[y]) {
+        return interval_start[x] < interval_start[y] ? -1 : 1;
+    }
+    return x - y;
+}
+
+static int spill_slot(void) {
+    frame_size += 8;
+    return frame_size;
+}
+
+static void allocate_registers(void) {
+    vreg_register = realloc(vreg_register, sizeof(int) * num_vregs);
+    vreg_slot = realloc(vreg_slot, sizeof(int) * num_vregs);
+    sorted_vregs = realloc(sorted_vregs, sizeof(int) * num_vregs);
+    int count = 0;
+    for (int v = 0; v < num_vregs; v++) {
+        vreg_register[v] = IR_NONE;
+        vreg_slot[v] = 0;
+        if (interval_end[v] >= 0) {
+            sorted_vregs[count++] = v;
+        }
+    }
+    qsort(sorted_vregs, count, sizeof(int), compare_start);
+
+    // Holder of each register, IR_NONE if free
+    int gpr_holder[NUM_GPRS], xmm_holder[NUM_XMMS];
+    for (int r = 0; r < NUM_GPRS; r++) gpr_holder[r] = IR_NONE;
+    for (int r = 0; r < NUM_XMMS; r++) xmm_holder[r] = IR_NONE;
+    memset(used_callee_saved, 0, sizeof(used_callee_saved));
+
+    for (int k = 0; k < count; k++) {
+        int v = sorted_vregs[k];
+        bool is_float = vreg_is_float[v];
+        int *holder = is_float ? xmm_holder : gpr_holder;
+        int num_registers = is_float ? NUM_XMMS : NUM_GPRS;
+
+        // Expire the intervals that ended
+        for (int r = 0; r < num_registers; r++) {
+            if (holder[r] != IR_NONE && interval_end[holder[r]] < interval_start[v]) {
+                holder[r] = IR_NONE;
+            }
+        }
+
+        bool across_call = crosses_call(v);
+        if (across_call && is_float) {
+            vreg_slot[v] = spill_slot();
+            continue;
+        }
+        int first = across_call ? FIRST_CALLEE_SAVED : 0;
+
+        int chosen = IR_NONE;
+        for (int r = first; r < num_registers; r++) {
+            if (holder[r] == IR_NONE) {
+                chosen = r;
+                break;
+            }
+        }
+        if (chosen == IR_NONE) {
+            // Spill whichever of the candidates lives the longest
+            int furthest = IR_NONE;
+            for (int r = first; r < num_registers; r++) {
+                if (furthest == IR_NONE || interval_end[holder[r]] > interval_end[holder[furthest]]) {
+                    furthest = r;
+                }
+            }
+            if (furthest != IR_NONE && interval_end[holder[furthest]] > interval_end[v]) {
+                int victim = holder[furthest];
+                vreg_register[victim] = IR_NONE;
+                vreg_slot[victim] = spill_slot();
+                chosen = furthest;
+            } else {
+                vreg_slot[v] = spill_slot();
+                continue;
+            }
+        }
+        holder[chosen] = v;
+        vreg_register[v] = chosen;
+        if (!is_float && chosen >= FIRST_CALLEE_SAVED) {
+            used_callee_saved[chosen] = true;
+        }
+    }
+}
+
+/******************************************************/
+/* Operands */
+
+// Address of a frame offset, below the saved registers
+static const char *frame_address(int offset) {
+    static char buffers[4][48];
+    static int next;
+    char *buffer = buffers[next++ % 4];
+    snprintf(buffer, 48, "QWORD PTR [rbp - %d]", saved_bytes + offset);
+    return buffer;
+}
+
+static const char *slot(int v) {
+    return frame_address(vreg_slot[v]);
+}
+
+static bool in_register(int v) {
+    return vreg_register[v] != IR_NONE;
+}
+
+static const char *register_name(int v) {
+    return vreg_is_float[v] ? xmm_names[vreg_register[v]] : gpr_names[vreg_register[v]];
+}
+
+// Register holding the value, loading a spilled value into scratch
+static const char *use(int v, const char *scratch) {
+    if (in_register(v)) {
+        return register_name(v);
+    }
+    emit("%s %s, %s", vreg_is_float[v] ? "movsd" : "mov", scratch, slot(v));
+    return scratch;
+}
+
+// Register to compute the value into, scratch if it is spilled
+static const char *def(int v, const char *scratch) {
+    return in_register(v) ? register_name(v) : scratch;
+}
+
+// Completes a def(), storing the value if it is spilled
+static void finish(int v, const char *reg) {
+    if (!in_register(v)) {
+        emit("%s %s, %s", vreg_is_float[v] ? "movsd" : "mov", slot(v), reg);
+    }
+}
+
+// Copies a register into the location of a value
+static void store_to(int v, const char *reg) {
+    if (in_register(v)) {
+        if (strcmp(register_name(v), reg) != 0) {
+            emit("%s %s, %s", vreg_is_float[v] ? "movapd" : "mov", register_name(v), reg);
+        }
+    } else {
+        emit("%s %s, %s", vreg_is_float[v] ? "movsd" : "mov", slot(v), reg);
+    }
+}
+
+static void move(int dst, int src) {
+    if (in_register(dst)) {
+        if (in_register(src)) {
+            if (vreg_register[dst] != vreg_register[src]) {
+                emit("%s %s, %s", vreg_is_float[dst] ? "movapd" : "mov", register_name(dst), register_name(src));
+            }
+        } else {
+            emit("%s %s, %s", vreg_is_float[dst] ? "movsd" : "mov", register_name(dst), slot(src));
+        }
+    } else {
+        store_to(dst, use(src, vreg_is_float[src] ? "xmm0" : "rax"));
+    }
+}
+
+static const IrInstr *ir_of(int v) {
+    return &fn->instrs[v];
+}
+
+static int array_length(int handle) {
+    const IrInstr *in = ir_of(handle);
+    return in->op == IR_ARRAY ? (int)in->imm : module->globals[in->imm].length;
+}
+
+/******************************************************/
+/* Calls */
+
+static void emit_epilogue(void);
+
+// Arguments of a function passed on the stack
+static int stack_params(const IrFunction *f) {
+    int int_params = 0, float_params = 0;
+    for (int p = 0; p < f->num_params; p++) {
+        int_params += f->param_types[p] != IR_FLOAT;
+        float_params += f->param_types[p] == IR_FLOAT;
+    }
+    return (int_params > NUM_INT_ARG_REGISTERS ? int_params - NUM_INT_ARG_REGISTERS : 0) +
+           (float_params > NUM_FLOAT_ARG_REGISTERS ? float_params - NUM_FLOAT_ARG_REGISTERS : 0);
+}
+
+// Passes the arguments and calls. A tail call leaves the frame first and jumps, so the callee
+// returns straight to the caller; its stack arguments replace those the function was called
+// with, which the caller of the function removes when it returns.
+static void emit_call(const char *target, CallArg *args, int num_args, bool varargs, bool tail) {
+    int int_regs = 0, float_regs = 0;
+    int reg_args[IR_MAX_PARAMS + 1], stack_args[IR_MAX_PARAMS + 1];
+    int num_reg_args = 0, num_stack_args = 0;
+    const char *targets[IR_MAX_PARAMS + 1];
+
+    for (int a = 0; a < num_args; a++) {
+        if (args[a].is_float && float_regs < NUM_FLOAT_ARG_REGISTERS) {
+            static const char *xmm_args[] = { "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7" };
+            targets[num_reg_args] = xmm_args[float_regs++];
+            reg_args[num_reg_args++] = a;
+        } else if (!args[a].is_float && int_regs < NUM_INT_ARG_REGISTERS) {
+            targets[num_reg_args] = int_arg_registers[int_regs++];
+            reg_args[num_reg_args++] = a;
+        } else {
+            stack_args[num_stack_args++] = a;
+        }
+    }
+
+    int pad = num_stack_args % 2 && !tail ? 8 : 0;
+    if (pad) {
+        emit("sub rsp, 8");
+    }
+
+    // Every argument goes through the stack, so no argument register is overwritten before it is read
+    for (int k = num_stack_args - 1; k >= 0; k--) {
+        CallArg *arg = &args[stack_args[k]];
+        if (arg->vreg == IR_NONE) {
+            emit("lea r10, %s", arg->address);
+            emit("push r10");
+        } else if (!in_register(arg->vreg)) {
+            emit("push %s", slot(arg->vreg));
+        } else if (arg->is_float) {
+            emit("sub rsp, 8");
+            emit("movsd QWORD PTR [rsp], %s", register_name(arg->vreg));
+        } else {
+            emit("push %s", register_name(arg->vreg));
+        }
+    }
+    for (int k = 0; k < num_reg_args; k++) {
+        CallArg *arg = &args[reg_args[k]];
+        if (arg->vreg == IR_NONE) {
+            emit("lea r10, %s", arg->address);
+            emit("push r10");
+        } else if (!in_register(arg->vreg)) {
+            emit("push %s", slot(arg->vreg));
+        } else if (arg->is_float) {
+            emit("sub rsp, 8");
+            emit("movsd QWORD PTR [rsp], %s", register_name(arg->vreg));
+        } else {
+            emit("push %s", register_name(arg->vreg));
+        }
+    }
+    for (int k = num_reg_args - 1; k >= 0; k--) {
+        if (args[reg_args[k]].is_float) {
+            emit("movsd %s, QWORD PTR [rsp]", targets[k]);
+            emit("add rsp, 8");
+        } else {
+            emit("pop %s", targets[k]);
+        }
+    }
+
+    if (varargs) {
+        emit("mov eax, %d", float_regs);
+    }
+    if (tail) {
+        for (int k = 0; k < num_stack_args; k++) {
+            emit("mov rax, QWORD PTR [rsp + %d]", 8 * k);
+            emit("mov QWORD PTR [rbp + %d], rax", 16 + 8 * k);
+        }
+        emit_epilogue();
+        emit("jmp %s", target);
+        return;
+    }
+    emit("call %s", target);
+    if (num_stack_args > 0 || pad) {
+        emit("add rsp, %d", num_stack_args * 8 + pad);
+    }
+}
+
+// Conversions of a format string: 'i' for ints, 'c' for chars, 'f' for floats, 's' for strings
+static int format_conversions(const char *format, int length, char *kinds) {
+    int count = 0;
+    for (int i = 0; i < length; i++) {
+        if (format[i] != '%') {
+            continue;
+        }
+        i++;
+        while (i < length && (strchr("-+ #0123456789.", format[i]) || format[i] == 'l' || format[i] == 'h')) {
+            i++;
+        }
+        if (i >= length || format[i] == '%') {
+            continue;
+        }
+        switch (format[i]) {
+            case 'c': kinds[count++] = 'c'; break;
+            case 's': kinds[count++] = 's'; break;
+            case 'f': case 'g': case 'e': kinds[count++] = 'f'; break;
+            default: kinds[count++] = 'i'; break;
+        }
+        if (count == IR_MAX_PARAMS) {
+            break;
+        }
+    }
+    return count;
+}
+
+// Rewrites a format string for the C library: long long for ints, and double for scanf floats
+static char *c_format(int string, bool for_scanf, int *c_length) {
+    int length;
+    const char *format = ir_string(module, string, &length);
+    char *result = malloc(length * 3 + 1);
+    int n = 0;
+    for (int i = 0; i < length; i++) {
+        result[n++] = format[i];
+        if (format[i] != '%') {
+            continue;
+        }
+        i++;
+        while (i < length && strchr("-+ #0123456789.", format[i])) {
+            result[n++] = format[i++];
+        }
+        while (i < length && (format[i] == 'l' || format[i] == 'h')) {
+            i++;
+        }
+        if (i >= length) {
+            break;
+        }
+        if (strchr("diux", format[i])) {
+            result[n++] = 'l';
+            result[n++] = 'l';
+        } else if (for_scanf && strchr("fge", format[i])) {
+            result[n++] = 'l';
+        }
+        result[n++] = format[i];
+    }
+    result[n] = '\0';
+    *c_length = n;
+    return result;
+}
+
+/******************************************************/
+/* Instructions */
+
+static void emit_binary_int(const MInstr *m, const char *op, bool commutative) {
+    int a = operand(m, 0), b = operand(m, 1);
+    if (in_register(m->dst)) {
+        const char *d = register_name(m->dst);
+        if (in_register(b) && vreg_register[b] == vreg_register[m->dst]) {
+            if (commutative) {
+                emit("%s %s, %s", op, d, in_register(a) ? register_name(a) : slot(a));
+                return;
+            }
+            emit("mov rax, %s", in_register(a) ? register_name(a) : slot(a));
+            emit("%s rax, %s", op, d);
+            emit("mov %s, rax", d);
+            return;
+        }
+        if (!in_register(a) || vreg_register[a] != vreg_register[m->dst]) {
+            emit("mov %s, %s", d, in_register(a) ? register_name(a) : slot(a));
+        }
+        emit("%s %s, %s", op, d, in_register(b) ? register_name(b) : slot(b));
+        return;
+    }
+    emit("mov rax, %s", in_register(a) ? register_name(a) : slot(a));
+    emit("%s rax, %s", op, in_register(b) ? register_name(b) : slot(b));
+    emit("mov %s, rax", slot(m->dst));
+}
+
+static void emit_binary_float(const MInstr *m, const char *op) {
+    const char *a = use(operand(m, 0), "xmm0");
+    if (strcmp(a, "xmm0") != 0) {
+        emit("movapd xmm0, %s", a);
+    }
+    int b = operand(m, 1);
+    emit("%s xmm0, %s", op, in_register(b) ? register_name(b) : slot(b));
+    store_to(m->dst, "xmm0");
+}
+
+static void emit_division(const MInstr *m, const IrInstr *in) {
+    if (vreg_is_float[m->dst]) {
+        emit_binary_float(m, "divsd");
+        return;
+    }
+    emit("mov r11, %s", in_register(operand(m, 1)) ? register_name(operand(m, 1)) : slot(operand(m, 1)));
+    emit("test r11, r11");
+    emit("jz .Lerror%d", add_stub(true, NULL, 0, in->line_number));
+    emit("mov rax, %s", in_register(operand(m, 0)) ? register_name(operand(m, 0)) : slot(operand(m, 0)));
+    // INT64_MIN / -1 would trap, it wraps around like in the interpreter
+    emit("cmp r11, -1");
+    emit("jne 1f");
+    emit(m->op == IR_DIV ? "neg rax" : "xor eax, eax");
+    emit("jmp 2f");
+    fputs("1:\n", out);
+    emit("cqo");
+    emit("idiv r11");
+    if (m->op == IR_MOD) {
+        emit("mov rax, rdx");
+    }
+    fputs("2:\n", out);
+    store_to(m->dst, "rax");
+}
+
+static void emit_int_power(const MInstr *m) {
+    emit("mov r10, %s", in_register(operand(m, 0)) ? register_name(operand(m, 0)) : slot(operand(m, 0)));
+    emit("mov r11, %s", in_register(operand(m, 1)) ? register_name(operand(m, 1)) : slot(operand(m, 1)));
+    emit("mov eax, 1");
+    emit("test r11, r11");
+    emit("js 3f");
+    fputs("1:\n", out);
+    emit("test r11, r11");
+    emit("jz 4f");
+    emit("test r11b, 1");
+    emit("jz 2f");
+    emit("imul rax, r10");
+    fputs("2:\n", out);
+    emit("imul r10, r10");
+    emit("shr r11, 1");
+    emit("jmp 1b");
+    // Negative exponents: 1 for 1, 1 or -1 for -1, otherwise 0
+    fputs("3:\n", out);
+    emit("cmp r10, 1");
+    emit("je 4f");
+    emit("xor eax, eax");
+    emit("cmp r10, -1");
+    emit("jne 4f");
+    emit("mov eax, 1");
+    emit("test r11b, 1");
+    emit("jz 4f");
+    emit("mov rax, -1");
+    fputs("4:\n", out);
+    store_to(m->dst, "rax");
+}
+
+static void emit_compare(const MInstr *m) {
+    int a = operand(m, 0), b = operand(m, 1);
+    if (!vreg_is_float[a]) {
+        const char *left = use(a, "r10");
+        emit("cmp %s, %s", left, in_register(b) ? register_name(b) : slot(b));
+        static const char *conditions[] = { "e", "ne", "l", "le", "g", "ge" };
+        emit("set%s al", conditions[m->op - IR_EQ]);
+    } else {
+        // ucomisd sets the parity flag for NaN, which compares unequal and unordered
+        bool swap = m->op == IR_LT || m->op == IR_LE;
+        const char *left = use(swap ? b : a, "xmm0");
+        int right = swap ? a : b;
+        emit("ucomisd %s, %s", left, in_register(right) ? register_name(right) : slot(right));
+        switch (m->op) {
+            case IR_EQ: emit("sete al"); emit("setnp cl"); emit("and al, cl"); break;
+            case IR_NE: emit("setne al"); emit("setp cl"); emit("or al, cl"); break;
+            case IR_GT: case IR_LT: emit("seta al"); break;
+            default: emit("setae al"); break;
+        }
+    }
+    emit("movzx eax, al");
+    store_to(m->dst, "rax");
+}
+
+static void emit_not(const MInstr *m) {
+    int a = operand(m, 0);
+    if (vreg_is_float[a]) {
+        emit("xorpd xmm1, xmm1");
+        emit("ucomisd %s, xmm1", use(a, "xmm0"));
+        emit("sete al");
+        emit("setnp cl");
+        emit("and al, cl");
+    } else {
+        if (in_register(a)) {
+            emit("test %s, %s", register_name(a), register_name(a));
+        } else {
+            emit("cmp %s, 0", slot(a));
+        }
+        emit("sete al");
+    }
+    emit("movzx eax, al");
+    store_to(m->dst, "rax");
+}
+
+// Element address of a load or store, with the bounds check unless the index is a constant in
+// range or range.c proved it in bounds
+static void element_address(const MInstr *m, const IrInstr *in, char *address, size_t size) {
+    int handle = operand(m, 0), index = operand(m, 1);
+    int length = array_length(handle);
+    const char *base = use(handle, "r10");
+    const IrInstr *index_in = ir_of(index);
+    if (index < fn->num_instrs && index_in->op == IR_CONST && index_in->imm >= 0 && index_in->imm < length) {
+        snprintf(address, size, "QWORD PTR [%s + %lld]", base, (long long)index_in->imm * 8);
+        return;
+    }
+    const char *i = use(index, "r11");
+    if (in->flags & IR_IN_BOUNDS) {
+        snprintf(address, size, "QWORD PTR [%s + %s*8]", base, i);
+        return;
+    }
+    emit("cmp %s, %d", i, length);
+    emit("jae .Lerror%d", add_stub(false, i, length, in->line_number));
+    snprintf(address, size, "QWORD PTR [%s + %s*8]", base, i);
+}
+
+static void emit_printf(const MInstr *m, const IrInstr *in) {
+    int length;
+    const char *format = ir_string(module, (int)in->imm, &length);
+    char kinds[IR_MAX_PARAMS];
+    int num_conversions = format_conversions(format, length, kinds);
+
+    CallArg args[IR_MAX_PARAMS + 1];
+    int num_args = 0;
+    args[num_args].is_float = false;
+    args[num_args].vreg = IR_NONE;
+    snprintf(args[num_args++].address, 64, "[rip + .LS%d_%d]", fn_index, (int)(m - mir));
+
+    for (int k = 0; k < m->num_operands && k < num_conversions; k++) {
+        int v = operand(m, k);
+        CallArg *arg = &args[num_args++];
+        arg->is_float = kinds[k] == 'f';
+        arg->vreg = v;
+        if (kinds[k] != 's') {
+            continue;
+        }
+        // Strings are copied into a byte buffer in the frame, up to the first zero element
+        int buffer_length = array_length(v) + 1;
+        frame_size += (buffer_length + 7) / 8 * 8;
+        int buffer = frame_size;
+        emit("mov r10, %s", in_register(v) ? register_name(v) : slot(v));
+        emit("lea r11, [rbp - %d]", saved_bytes + buffer);
+        emit("xor ecx, ecx");
+        fputs("1:\n", out);
+        emit("cmp rcx, %d", buffer_length - 1);
+        emit("jae 2f");
+        emit("mov rax, QWORD PTR [r10 + rcx*8]");
+        emit("test rax, rax");
+        emit("jz 2f");
+        emit("mov BYTE PTR [r11 + rcx], al");
+        emit("inc rcx");
+        emit("jmp 1b");
+        fputs("2:\n", out);
+        emit("mov BYTE PTR [r11 + rcx], 0");
+        arg->vreg = IR_NONE;
+        snprintf(arg->address, 64, "[rbp - %d]", saved_bytes + buffer);
+    }
+    emit_call("printf@PLT", args, num_args, true, false);
+}
+
+static void emit_scanf(const MInstr *m, const IrInstr *in) {
+    int length;
+    const char *format = ir_string(module, (int)in->imm, &length);
+    char kinds[IR_MAX_PARAMS];
+    int num_conversions = format_conversions(format, length, kinds);
+
+    emit("mov rdi, QWORD PTR [rip + stdout@GOTPCREL]");
+    emit("mov rdi, QWORD PTR [rdi]");
+    emit("call fflush@PLT");
+
+    CallArg args[IR_MAX_PARAMS + 1];
+    int num_args = 0;
+    args[num_args].is_float = false;
+    args[num_args].vreg = IR_NONE;
+    snprintf(args[num_args++].address, 64, "[rip + .LS%d_%d]", fn_index, (int)(m - mir));
+    for (int k = 0; k < num_conversions; k++) {
+        emit("mov %s, 0", frame_address(scan_offset - 8 * k));
+        args[num_args].is_float = false;
+        args[num_args].vreg = IR_NONE;
+        snprintf(args[num_args++].address, 64, "[rbp - %d]", saved_bytes + scan_offset - 8 * k);
+    }
+    emit_call("scanf@PLT", args, num_args, true, false);
+
+    // End of file counts as no conversion
+    emit("xor ecx, ecx");
+    emit("test eax, eax");
+    emit("cmovs eax, ecx");
+    emit("movsxd rax, eax");
+    store_to(m->dst, "rax");
+}
+
+static void emit_scan_value(const MInstr *m, const IrInstr *in) {
+    int scanf_value = operand(m, 0), old = operand(m, 1);
+    int k = (int)in->imm;
+    int length;
+    const char *format = ir_string(module, (int)ir_of(scanf_value)->imm, &length);
+    char kinds[IR_MAX_PARAMS];
+    format_conversions(format, length, kinds);
+    const char *result = frame_address(scan_offset - 8 * k);
+    bool is_float = vreg_is_float[m->dst];
+
+    emit("cmp %s, %d", use(scanf_value, "r10"), k);
+    emit("jle 1f");
+    if (kinds[k] == 'f') {
+        if (is_float) {
+            emit("movsd xmm0, %s", result);
+        } else {
+            emit("cvttsd2si rax, %s", result);
+        }
+    } else {
+        if (kinds[k] == 'c') {
+            emit("movzx eax, BYTE PTR [rbp - %d]", saved_bytes + scan_offset - 8 * k);
+        } else {
+            emit("mov rax, %s", result);
+        }
+        if (is_float) {
+            emit("cvtsi2sd xmm0, rax");
+        }
+    }
+    store_to(m->dst, is_float ? "xmm0" : "rax");
+    emit("jmp 2f");
+    fputs("1:\n", out);
+    move(m->dst, old);
+    fputs("2:\n", out);
+}
+
+static void emit_return(const MInstr *m) {
+    if (m->num_operands > 0) {
+        int v = operand(m, 0);
+        if (vreg_is_float[v]) {
+            const char *r = use(v, "xmm0");
+            if (strcmp(r, "xmm0") != 0) {
+                emit("movapd xmm0, %s", r);
+            }
+        } else {
+            const char *r = use(v, "rax");
+            if (strcmp(r, "rax") != 0) {
+                emit("mov rax, %s", r);
+            }
+        }
+    }
+    emit_epilogue();
+    emit("ret");
+}
+
+static void emit_epilogue(void) {
+    if (jit_mode) {
+        emit("mov r11, QWORD PTR [rip + __core_call_depth@GOTPCREL]");
+        emit("dec DWORD PTR [r11]");
+    }
+    if (saved_bytes > 0) {
+        emit("lea rsp, [rbp - %d]", saved_bytes);
+    } else {
+        emit("mov rsp, rbp");
+    }
+    for (int r = NUM_GPRS - 1; r >= FIRST_CALLEE_SAVED; r--) {
+        if (used_callee_saved[r]) {
+            emit("pop %s", gpr_names[r]);
+        }
+    }
+    emit("pop rbp");
+}
+
+// A call whose value is returned right away, with no more stack arguments than the function has
+static bool is_tail_call(int index) {
+    const MInstr *m = &mir[index];
+    const MInstr *next = &mir[index + 1];
+    if (index + 1 >= num_mir || next->op != IR_RETURN ||
+        (next->num_operands == 0 ? m->dst != IR_NONE : m->dst == IR_NONE || operand(next, 0) != m->dst)) {
+        return false;
+    }
+    return stack_params(&module->functions[fn->instrs[m->ir].imm]) <= stack_params(fn);
+}
+
+static void emit_instr(int index, int next_block) {
+    const MInstr *m = &mir[index];
+    const IrInstr *in = m->ir != IR_NONE ? &fn->instrs[m->ir] : NULL;
+    bool is_float = m->dst != IR_NONE && vreg_is_float[m->dst];
+
+    switch (m->op) {
+        case MIR_MOVE:
+            move(m->dst, operand(m, 0));
+            break;
+        case IR_CONST:
+            if (is_float) {
+                emit("movsd %s, QWORD PTR [rip + .LC%d]", def(m->dst, "xmm0"), add_float_constant(in->fimm));
+                finish(m->dst, "xmm0");
+            } else if (in->imm >= INT32_MIN && in->imm <= INT32_MAX) {
+                emit("mov %s, %lld", in_register(m->dst) ? register_name(m->dst) : slot(m->dst), (long long)in->imm);
+            } else {
+                emit("movabs %s, %lld", def(m->dst, "rax"), (long long)in->imm);
+                finish(m->dst, "rax");
+            }
+            break;
+        case IR_PARAM:
+            emit("%s %s, QWORD PTR [rbp %c %d]", is_float ? "movsd" : "mov", def(m->dst, is_float ? "xmm0" : "rax"),
+                 param_offsets[in->imm] < 0 ? '+' : '-', abs(param_offsets[in->imm]));
+            finish(m->dst, is_float ? "xmm0" : "rax");
+            break;
+        case IR_ADD:
+            if (is_float) emit_binary_float(m, "addsd");
+            else emit_binary_int(m, "add", true);
+            break;
+        case IR_SUB:
+            if (is_float) emit_binary_float(m, "subsd");
+            else emit_binary_int(m, "sub", false);
+            break;
+        case IR_MUL:
+            if (is_float) emit_binary_float(m, "mulsd");
+            else emit_binary_int(m, "imul", true);
+            break;
+        case IR_DIV:
+        case IR_MOD:
+            emit_division(m, in);
+            break;
+        case IR_POW:
+            if (is_float) {
+                CallArg args[2] = { { true, operand(m, 0), "" }, { true, operand(m, 1), "" } };
+                emit_call("pow@PLT", args, 2, false, false);
+                store_to(m->dst, "xmm0");
+            } else {
+                emit_int_power(m);
+            }
+            break;
+        case IR_NEG:
+            if (is_float) {
+                // Flips the sign bit, -0.0 and NaN included
+                emit("movq rax, %s", use(operand(m, 0), "xmm0"));
+                emit("btc rax, 63");
+                emit("movq xmm0, rax");
+                store_to(m->dst, "xmm0");
+            } else {
+                emit("mov rax, %s", use(operand(m, 0), "rax"));
+                emit("neg rax");
+                store_to(m->dst, "rax");
+            }
+            break;
+        case IR_NOT:
+            emit_not(m);
+            break;
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+            emit_compare(m);
+            break;
+        case IR_CONVERT:
+            if (is_float == vreg_is_float[operand(m, 0)]) {
+                move(m->dst, operand(m, 0));
+            } else if (is_float) {
+                emit("cvtsi2sd xmm0, %s", use(operand(m, 0), "rax"));
+                store_to(m->dst, "xmm0");
+            } else {
+                // Out of range values give INT64_MIN, like in the interpreter
+                emit("cvttsd2si rax, %s", use(operand(m, 0), "xmm0"));
+                store_to(m->dst, "rax");
+            }
+            break;
+        case IR_CALL: {
+            const IrFunction *callee = &module->functions[in->imm];
+            CallArg args[IR_MAX_PARAMS];
+            for (int k = 0; k < m->num_operands; k++) {
+                args[k].is_float = callee->param_types[k] == IR_FLOAT;
+                args[k].vreg = operand(m, k);
+            }
+            char label[IR_NAME_LENGTH + 16];
+            function_label(label, sizeof(label), (int)in->imm);
+            if (is_tail_call(index)) {
+                emit_call(label, args, m->num_operands, false, true);
+                break;
+            }
+            emit_call(label, args, m->num_operands, false, false);
+            if (m->dst != IR_NONE) {
+                store_to(m->dst, is_float ? "xmm0" : "rax");
+            }
+            break;
+        }
+        case IR_ARRAY: {
+            // Zeroed each time the declaration runs, like in the interpreter
+            frame_size += (int)in->imm * 8;
+            int offset = frame_size;
+            if (in->imm > 0) {
+                emit("lea r10, [rbp - %d]", saved_bytes + offset);
+                emit("mov r11, %lld", (long long)in->imm);
+                fputs("1:\n", out);
+                emit("mov QWORD PTR [r10], 0");
+                emit("add r10, 8");
+                emit("dec r11");
+                emit("jnz 1b");
+            }
+            emit("lea %s, [rbp - %d]", def(m->dst, "rax"), saved_bytes + offset);
+            finish(m->dst, "rax");
+            break;
+        }
+        case IR_GLOBAL:
+            // Compiled code uses the interpreter's globals, which can be anywhere in memory
+            if (jit_mode) {
+                emit("mov %s, QWORD PTR [rip + g_%s@GOTPCREL]", def(m->dst, "rax"), module->globals[in->imm].name);
+            } else {
+                emit("lea %s, [rip + g_%s]", def(m->dst, "rax"), module->globals[in->imm].name);
+            }
+            finish(m->dst, "rax");
+            break;
+        case IR_LOAD: {
+            char address[64];
+            element_address(m, in, address, sizeof(address));
+            const char *d = def(m->dst, is_float ? "xmm0" : "rax");
+            emit("%s %s, %s", is_float ? "movsd" : "mov", d, address);
+            finish(m->dst, d);
+            break;
+        }
+        case IR_STORE: {
+            char address[64];
+            element_address(m, in, address, sizeof(address));
+            int value = operand(m, 2);
+            emit("%s %s, %s", vreg_is_float[value] ? "movsd" : "mov", address,
+                 use(value, vreg_is_float[value] ? "xmm0" : "rax"));
+            break;
+        }
+        case IR_PRINTF:
+            emit_printf(m, in);
+            break;
+        case IR_SCANF:
+            emit_scanf(m, in);
+            break;
+        case IR_SCAN_VALUE:
+            emit_scan_value(m, in);
+            break;
+        case IR_JUMP:
+            if (m->targets[0] != next_block) {
+                emit("jmp .L%d_%d", fn_index, m->targets[0]);
+            }
+            break;
+        case IR_BRANCH: {
+            int cond = operand(m, 0);
+            if (in_register(cond)) {
+                emit("test %s, %s", register_name(cond), register_name(cond));
+            } else {
+                emit("cmp %s, 0", slot(cond));
+            }
+            if (m->targets[0] == next_block) {
+                emit("je .L%d_%d", fn_index, m->targets[1]);
+            } else {
+                emit("jne .L%d_%d", fn_index, m->targets[0]);
+                if (m->targets[1] != next_block) {
+                    emit("jmp .L%d_%d", fn_index, m->targets[1]);
+                }
+            }
+            break;
+        }
+        case IR_RETURN:
+            emit_return(m);
+            break;
+        default:
+            break;
+    }
+}
+
+/******************************************************/
+/* Functions */
+
+// For jit.c, a call counts itself in the interpreter's call depth, which fails past
+// IR_MAX_CALL_DEPTH like an interpreted call, and the epilogue takes it off
+static void emit_prologue(void) {
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    for (int r = FIRST_CALLEE_SAVED; r < NUM_GPRS; r++) {
+        if (used_callee_saved[r]) {
+            emit("push %s", gpr_names[r]);
+        }
+    }
+    if (stack_bytes > 0) {
+        emit("sub rsp, %d", stack_bytes);
+    }
+    if (jit_mode) {
+        emit("mov r11, QWORD PTR [rip + __core_call_depth@GOTPCREL]");
+        emit("inc DWORD PTR [r11]");
+        emit("cmp DWORD PTR [r11], %d", IR_MAX_CALL_DEPTH);
+        emit("jg .Loverflow%d", fn_index);
+    }
+}
+
+static void emit_strings(void) {
+    bool any = false;
+    for (int i = 0; i < num_mir; i++) {
+        if (mir[i].op != IR_PRINTF && mir[i].op != IR_SCANF) {
+            continue;
+        }
+        if (!any) {
+            fputs("    .section .rodata\n", out);
+            any = true;
+        }
+        int length;
+        char *format = c_format((int)fn->instrs[mir[i].ir].imm, mir[i].op == IR_SCANF, &length);
+        emit_label(".LS%d_%d", fn_index, i);
+        emit_string(format, length);
+        free(format);
+    }
+    if (any) {
+        fputs("    .text\n", out);
+    }
+}
+
+static void emit_function(int id) {
+    fn = &module->functions[id];
+    fn_index = id;
+    num_stubs = 0;
+
+    build_mir();
+    compute_intervals();
+    frame_size = 0;
+    allocate_registers();
+
+    saved_bytes = 0;
+    for (int r = FIRST_CALLEE_SAVED; r < NUM_GPRS; r++) {
+        if (used_callee_saved[r]) {
+            saved_bytes += 8;
+        }
+    }
+
+    // Incoming register arguments are stored in the frame, stack arguments are above the return address
+    param_offsets = realloc(param_offsets, sizeof(int) * (fn->num_params + 1));
+    const char *incoming[IR_MAX_PARAMS];
+    int int_regs = 0, float_regs = 0, stack_index = 0;
+    for (int p = 0; p < fn->num_params; p++) {
+        bool is_float = fn->param_types[p] == IR_FLOAT;
+        if (is_float && float_regs < NUM_FLOAT_ARG_REGISTERS) {
+            static const char *xmm_args[] = { "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7" };
+            incoming[p] = xmm_args[float_regs++];
+        } else if (!is_float && int_regs < NUM_INT_ARG_REGISTERS) {
+            incoming[p] = int_arg_registers[int_regs++];
+        } else {
+            incoming[p] = NULL;
+            param_offsets[p] = -(16 + 8 * stack_index++);
+            continue;
+        }
+        frame_size += 8;
+        param_offsets[p] = saved_bytes + frame_size;
+    }
+    scan_offset = 0;
+    for (int i = 0; i < num_mir; i++) {
+        if (mir[i].op == IR_SCANF) {
+            frame_size += 8 * IR_MAX_PARAMS;
+            scan_offset = frame_size;
+            break;
+        }
+    }
+
+    // Arrays and string buffers are sized while the body is emitted, so the body goes to a buffer first
+    char *body_text = NULL;
+    size_t body_size = 0;
+    FILE *file = out;
+    out = open_memstream(&body_text, &body_size);
+    for (int b = 0; b < num_mblocks; b++) {
+        emit_label(".L%d_%d", fn_index, b);
+        for (int i = mblocks[b].first; i < mblocks[b].first + mblocks[b].count; i++) {
+            emit_instr(i, b + 1);
+        }
+    }
+    for (int s = 0; s < num_stubs; s++) {
+        emit_label(".Lerror%d", stubs[s].label);
+        if (stubs[s].is_division) {
+            emit("mov edi, %d", stubs[s].line);
+            emit("call __core_division_error");
+        } else {
+            emit("mov rdi, %s", stubs[s].index);
+            emit("mov esi, %d", stubs[s].length);
+            emit("mov edx, %d", stubs[s].line);
+            emit("call __core_index_error");
+        }
+    }
+    if (jit_mode) {
+        emit_label(".Loverflow%d", fn_index);
+        emit("mov edi, %d", fn_index);
+        emit("call __core_stack_overflow");
+    }
+    fclose(out);
+    out = file;
+
+    char label[IR_NAME_LENGTH + 16];
+    function_label(label, sizeof(label), id);
+    emit_strings();
+    fprintf(out, "\n    .type %s, @function\n", label);
+    emit_label("%s", label);
+    stack_bytes = (frame_size + saved_bytes + 15) / 16 * 16 - saved_bytes;
+    emit_prologue();
+    for (int p = 0; p < fn->num_params; p++) {
+        if (incoming[p] != NULL) {
+            emit("%s QWORD PTR [rbp - %d], %s", fn->param_types[p] == IR_FLOAT ? "movsd" : "mov",
+                 param_offsets[p], incoming[p]);
+        }
+    }
+    fwrite(body_text, 1, body_size, out);
+    free(body_text);
+    fprintf(out, "    .size %s, .-%s\n", label, label);
+}
+
+// Entry points for jit.c: one taking the arguments from an array, and one per loop header
+// taking every value of the function, which moves a running loop over from the interpreter
+static void emit_jit_entries(int id) {
+    char label[IR_NAME_LENGTH + 16];
+    function_label(label, sizeof(label), id);
+
+    emit_label("__jit_entry");
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    emit("push rbx");
+    emit("push r12");
+    emit("mov rbx, rdi");
+    int int_regs = 0, float_regs = 0;
+    int stack_params[IR_MAX_PARAMS];
+    int num_stack_params = 0;
+    for (int p = 0; p < fn->num_params; p++) {
+        bool is_float = fn->param_types[p] == IR_FLOAT;
+        if (is_float ? float_regs == NUM_FLOAT_ARG_REGISTERS : int_regs == NUM_INT_ARG_REGISTERS) {
+            stack_params[num_stack_params++] = p;
+        } else if (is_float) {
+            emit("movsd xmm%d, QWORD PTR [rbx + %d]", float_regs++, 8 * p);
+        } else {
+            emit("mov %s, QWORD PTR [rbx + %d]", int_arg_registers[int_regs++], 8 * p);
+        }
+    }
+    if (num_stack_params % 2) {
+        emit("sub rsp, 8");
+    }
+    for (int k = num_stack_params - 1; k >= 0; k--) {
+        emit("push QWORD PTR [rbx + %d]", 8 * stack_params[k]);
+    }
+    emit("call %s", label);
+    emit("lea rsp, [rbp - 16]");
+    emit("pop r12");
+    emit("pop rbx");
+    emit("pop rbp");
+    emit("ret");
+
+    for (int k = 0; k < fn->rpo.count; k++) {
+        int header = fn->pool[fn->rpo.start + k];
+        bool is_header = false;
+        for (int p = 0; p < fn->blocks[header].preds.count; p++) {
+            if (fn->blocks[ir_pred(fn, header, p)].rpo_index >= k) {
+                is_header = true;
+            }
+        }
+        if (!is_header) {
+            continue;
+        }
+        emit_label("__jit_osr_%d", header);
+        emit_prologue();
+        emit("mov r11, rdi");
+        const uint64_t *live = live_in + (size_t)mblock_of[header] * live_words;
+        for (int v = 0; v < fn->num_instrs; v++) {
+            if (!(live[v / 64] >> (v % 64) & 1)) {
+                continue;
+            }
+            if (in_register(v)) {
+                emit("%s %s, QWORD PTR [r11 + %d]", vreg_is_float[v] ? "movsd" : "mov", register_name(v), 8 * v);
+            } else {
+                emit("mov rax, QWORD PTR [r11 + %d]", 8 * v);
+                emit("mov %s, rax", slot(v));
+            }
+        }
+        emit("jmp .L%d_%d", fn_index, mblock_of[header]);
+    }
+}
+
+static void emit_float_constants(void) {
+    if (num_float_constants > 0) {
+        fputs("\n    .section .rodata\n    .align 8\n", out);
+        for (int c = 0; c < num_float_constants; c++) {
+            uint64_t bits;
+            memcpy(&bits, &float_constants[c], sizeof(bits));
+            emit_label(".LC%d", c);
+            emit(".quad 0x%016llx", (unsigned long long)bits);
+        }
+        fputs("    .text\n", out);
+    }
+}
+
+static void emit_runtime(void) {
+    fputs("\n    .section .rodata\n", out);
+    emit_label(".Lindex_error_format");
+    const char *index_error = "Error: index %lld out of bounds of array of length %d at line %d\n";
+    emit_string(index_error, (int)strlen(index_error));
+    emit_label(".Ldivision_error_format");
+    const char *division_error = "Error: division by zero at line %d\n";
+    emit_string(division_error, (int)strlen(division_error));
+    fputs("    .text\n", out);
+
+    // Runtime errors print like the interpreter and exit with status 1
+    emit_label("__core_index_error");
+    emit("sub rsp, 8");
+    emit("mov r8d, edx");
+    emit("mov ecx, esi");
+    emit("mov rdx, rdi");
+    emit("lea rsi, [rip + .Lindex_error_format]");
+    emit("jmp 1f");
+    emit_label("__core_division_error");
+    emit("sub rsp, 8");
+    emit("mov edx, edi");
+    emit("lea rsi, [rip + .Ldivision_error_format]");
+    fputs("1:\n", out);
+    emit("mov rdi, QWORD PTR [rip + stdout@GOTPCREL]");
+    emit("mov rdi, QWORD PTR [rdi]");
+    emit("push rsi");
+    emit("push rdx");
+    emit("push rcx");
+    emit("push r8");
+    emit("call fflush@PLT");
+    emit("pop r8");
+    emit("pop rcx");
+    emit("pop rdx");
+    emit("pop rsi");
+    emit("mov rdi, QWORD PTR [rip + stderr@GOTPCREL]");
+    emit("mov rdi, QWORD PTR [rdi]");
+    emit("xor eax, eax");
+    emit("call fprintf@PLT");
+    emit("mov edi, 1");
+    emit("call exit@PLT");
+
+    // main() runs the global initializers first
+    const IrFunction *main_function = &module->functions[module->main_function];
+    fputs("\n    .globl main\n    .type main, @function\n", out);
+    emit_label("main");
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    if (module->init_function != IR_NONE) {
+        emit("call __core_init");
+    }
+    emit("call core_%s", main_function->name);
+    if (main_function->return_type == IR_FLOAT) {
+        emit("cvttsd2si rax, xmm0");
+    }
+    emit("pop rbp");
+    emit("ret");
+    fputs("    .size main, .-main\n", out);
+}
+
+// Writes the module as x86-64 assembly, returns false if there is no main() to start from
+bool ir_emit_x86_64(FILE *file, const IrModule *program) {
+    module = program;
+    jit_mode = false;
+    out = file;
+    next_label = 0;
+    num_float_constants = 0;
+    if (module->main_function == IR_NONE) {
+        fprintf(stderr, "Error: no main function to compile\n");
+        return false;
+    }
+
+    fputs("    .intel_syntax noprefix\n    .text\n", out);
+    for (int id = 0; id < module->num_functions; id++) {
+        if (module->functions[id].defined) {
+            emit_function(id);
+        }
+    }
+    emit_runtime();
+
+    emit_float_constants();
+    if (module->num_globals > 0) {
+        fputs("\n    .bss\n", out);
+        for (int g = 0; g < module->num_globals; g++) {
+            emit(".align %d", module->globals[g].is_array ? IR_ARRAY_ALIGNMENT : 8);
+            emit_label("g_%s", module->globals[g].name);
+            emit(".zero %d", module->globals[g].length * 8);
+        }
+    }
+    fputs("    .section .note.GNU-stack,\"\",@progbits\n", out);
+    return true;
+}
+
+// Writes one function for jit.c, with its entry points, calling everything else through slots
+void ir_emit_x86_64_jit(FILE *file, const IrModule *program, int function) {
+    module = program;
+    jit_mode = true;
+    out = file;
+    next_label = 0;
+    num_float_constants = 0;
+
+    fputs("    .intel_syntax noprefix\n    .text\n", out);
+    emit_function(function);
+    emit_jit_entries(function);
+    emit_float_constants();
+}
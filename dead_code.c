@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parse_tree.h"
+#include "alloc.h"
+
+// Dead code elimination over the parse tree
+//
+// Removes statements that can never run:
+//   - "if" statements whose condition is a constant, keeping only the taken branch
+//   - "while" loops whose condition is constant false
+//   - block items following a statement that always returns
+// and function declarations (prototypes and definitions) that are not reachable
+// from main() or from the initializers of global declarations in the call graph.
+
+static DeadCodeStats stats;
+
+// Call graph over the function declarations of the program
+typedef struct {
+    char *name;
+    int *callees;
+    int num_callees;
+    bool reachable;
+} CallGraphNode;
+
+static CallGraphNode *graph;
+static int graph_size;
+
+static void simplify_block(ParseTreeNode *block);
+static void simplify_tree(ParseTreeNode *node);
+
+// Returns the name of the <identifier> node
+static const char *identifier_name(ParseTreeNode *identifier) {
+    if (node_is(identifier, "Identifier") && identifier->num_children == 1 &&
+        identifier->children[0]->token != NULL) {
+        return identifier->children[0]->token->lexeme;
+    }
+    return NULL;
+}
+
+// Returns the <function_declaration> of a <declaration>, or NULL for variable and array declarations
+static ParseTreeNode *function_of(ParseTreeNode *declaration) {
+    if (declaration->num_children == 1 && node_is(declaration->children[0], "Function_Declaration")) {
+        return declaration->children[0];
+    }
+    return NULL;
+}
+
+// Evaluates a constant condition: 1 if always true, 0 if always false, -1 if not a constant
+static int constant_truth(ParseTreeNode *exp) {
+    while (node_is(exp, "Exp") && exp->num_children == 1) {
+        exp = exp->children[0];
+    }
+    if (!node_is(exp, "Factor")) {
+        return -1;
+    }
+
+    // "(" <exp> ")"
+    if (exp->num_children == 3 && node_is_token(exp->children[0], LEFT_PARENTHESIS)) {
+        return constant_truth(exp->children[1]);
+    }
+
+    // <const> ::= <int> | <float> | <char> | <bool>
+    if (exp->num_children == 1 && node_is(exp->children[0], "Const") &&
+        exp->children[0]->num_children == 1 && exp->children[0]->children[0]->num_children == 1) {
+        Token *token = exp->children[0]->children[0]->children[0]->token;
+        switch (token->type) {
+            case TRUE: return 1;
+            case FALSE: return 0;
+            case INTEGER_LITERAL: return token->value.integer != 0;
+            case FLOAT_LITERAL: return token->value.real != 0.0;
+            default: return -1;
+        }
+    }
+    return -1;
+}
+
+// Checks if control can never fall through the end of a statement or block item
+static bool always_returns(ParseTreeNode *node) {
+    if (node_is(node, "Block_Item") || node_is(node, "Statement")) {
+        return node->num_children == 1 && always_returns(node->children[0]);
+    }
+    if (node_is(node, "Return_Statement")) {
+        return true;
+    }
+    if (node_is(node, "Block")) {
+        for (int i = 0; i < node->num_children; i++) {
+            if (always_returns(node->children[i])) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (node_is(node, "If_Statement")) {
+        // Both the "if" block and the else clause must return
+        ParseTreeNode *else_clause = node->children[node->num_children - 1];
+        return node_is(else_clause, "Else_Clause") &&
+               always_returns(node->children[4]) &&
+               always_returns(else_clause->children[1]);
+    }
+    if (node_is(node, "While_Statement")) {
+        // There is no "break", an infinite loop can only be left with "return"
+        return constant_truth(node->children[2]) == 1;
+    }
+    return false;
+}
+
+// Replaces the single child of a <statement> and frees the old one
+static void replace_statement_child(ParseTreeNode *statement, ParseTreeNode *replacement) {
+    ParseTreeNode *old = statement->children[0];
+    for (int i = 0; i < old->num_children; i++) {
+        if (old->children[i] == replacement) {
+            old->children[i] = NULL;
+        }
+    }
+    free_parse_tree(old);
+    statement->children[0] = replacement;
+}
+
+// Simplifies a <statement> with a constant condition, returns false if the whole statement is dead
+static bool simplify_statement(ParseTreeNode *statement) {
+    while (statement->num_children == 1) {
+        ParseTreeNode *inner = statement->children[0];
+
+        if (node_is(inner, "If_Statement")) {
+            // "if" "(" <exp> ")" <block> [<else-clause>]
+            int truth = constant_truth(inner->children[2]);
+            if (truth == 1) {
+                replace_statement_child(statement, inner->children[4]);
+                stats.removed_statements++;
+                continue;
+            }
+            if (truth == 0) {
+                ParseTreeNode *else_clause = inner->children[inner->num_children - 1];
+                if (!node_is(else_clause, "Else_Clause")) {
+                    return false;
+                }
+                // "else" <block> | "else" <if_statement>
+                ParseTreeNode *taken = else_clause->children[1];
+                else_clause->children[1] = NULL;
+                replace_statement_child(statement, taken);
+                stats.removed_statements++;
+                continue;
+            }
+        } else if (node_is(inner, "While_Statement")) {
+            // "while" "(" <exp> ")" <block>
+            if (constant_truth(inner->children[2]) == 0) {
+                return false;
+            }
+        }
+        break;
+    }
+
+    simplify_tree(statement);
+    return true;
+}
+
+// Drops dead block items in place and simplifies the remaining ones
+static void simplify_block(ParseTreeNode *block) {
+    int kept = 0;
+    bool reachable = true;
+
+    for (int i = 0; i < block->num_children; i++) {
+        ParseTreeNode *child = block->children[i];
+
+        // Keep the braces
+        if (child->token != NULL) {
+            block->children[kept++] = child;
+            continue;
+        }
+
+        bool live = reachable;
+        if (live && node_is(child, "Block_Item") && node_is(child->children[0], "Statement")) {
+            live = simplify_statement(child->children[0]);
+        } else if (live) {
+            simplify_tree(child);
+        }
+
+        if (!live) {
+            free_parse_tree(child);
+            stats.removed_statements++;
+            continue;
+        }
+
+        block->children[kept++] = child;
+        if (always_returns(child)) {
+            reachable = false;
+        }
+    }
+    block->num_children = kept;
+}
+
+// Walks the tree looking for blocks to simplify
+static void simplify_tree(ParseTreeNode *node) {
+    if (node == NULL || node->token != NULL) {
+        return;
+    }
+    if (node_is(node, "Block")) {
+        simplify_block(node);
+        return;
+    }
+    for (int i = 0; i < node->num_children; i++) {
+        simplify_tree(node->children[i]);
+    }
+}
+
+static int find_function(const char *name) {
+    for (int i = 0; i < graph_size; i++) {
+        if (strcmp(graph[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Adds a call graph edge for every <identifier> "(" [<argument_list>] ")" factor below node
+static void collect_calls(ParseTreeNode *node, int caller) {
+    if (node == NULL || node->token != NULL) {
+        return;
+    }
+    if (node_is(node, "Factor") && node->num_children >= 2 &&
+        node_is(node->children[0], "Identifier") &&
+        node_is_token(node->children[1], LEFT_PARENTHESIS)) {
+        int callee = find_function(identifier_name(node->children[0]));
+        if (callee >= 0) {
+            CallGraphNode *from = &graph[caller];
+            from->callees = core_realloc(from->callees, sizeof(int) * (from->num_callees + 1));
+            from->callees[from->num_callees++] = callee;
+        }
+    }
+    for (int i = 0; i < node->num_children; i++) {
+        collect_calls(node->children[i], caller);
+    }
+}
+
+static void mark_reachable(int function) {
+    if (graph[function].reachable) {
+        return;
+    }
+    graph[function].reachable = true;
+    for (int i = 0; i < graph[function].num_callees; i++) {
+        mark_reachable(graph[function].callees[i]);
+    }
+}
+
+// Removes the declarations of functions that no reachable code calls
+static void remove_unused_functions(ParseTreeNode *program) {
+    graph = NULL;
+    graph_size = 0;
+
+    // One call graph node per function name, prototypes share the node of their definition
+    for (int i = 0; i < program->num_children; i++) {
+        ParseTreeNode *function = function_of(program->children[i]);
+        if (function == NULL) {
+            continue;
+        }
+        const char *name = identifier_name(function->children[1]);
+        if (name != NULL && find_function(name) < 0) {
+            graph = core_realloc(graph, sizeof(CallGraphNode) * (graph_size + 1));
+            graph[graph_size++] = (CallGraphNode){ .name = core_strdup(name) };
+        }
+    }
+
+    // Without a main() every function is an entry point
+    int main_function = find_function("main");
+    if (main_function < 0) {
+        goto cleanup;
+    }
+
+    // A pseudo caller for the global declarations, initializers may call functions
+    graph = core_realloc(graph, sizeof(CallGraphNode) * (graph_size + 1));
+    graph[graph_size] = (CallGraphNode){ .name = core_strdup("") };
+    int globals = graph_size++;
+
+    for (int i = 0; i < program->num_children; i++) {
+        ParseTreeNode *function = function_of(program->children[i]);
+        if (function == NULL) {
+            collect_calls(program->children[i], globals);
+        } else {
+            const char *name = identifier_name(function->children[1]);
+            if (name != NULL) {
+                collect_calls(function, find_function(name));
+            }
+        }
+    }
+
+    mark_reachable(main_function);
+    mark_reachable(globals);
+
+    int kept = 0;
+    for (int i = 0; i < program->num_children; i++) {
+        ParseTreeNode *declaration = program->children[i];
+        ParseTreeNode *function = function_of(declaration);
+        if (function != NULL) {
+            const char *name = identifier_name(function->children[1]);
+            if (name != NULL && !graph[find_function(name)].reachable) {
+                free_parse_tree(declaration);
+                stats.removed_functions++;
+                continue;
+            }
+        }
+        program->children[kept++] = declaration;
+    }
+    program->num_children = kept;
+
+cleanup:
+    for (int i = 0; i < graph_size; i++) {
+        core_free(graph[i].name);
+        core_free(graph[i].callees);
+    }
+    core_free(graph);
+    graph = NULL;
+    graph_size = 0;
+}
+
+// Runs the pass over a whole <program>, freeing every removed subtree
+DeadCodeStats eliminate_dead_code(ParseTreeNode *program) {
+    stats = (DeadCodeStats){0};
+    simplify_tree(program);
+    remove_unused_functions(program);
+    return stats;
+}
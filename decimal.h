@@ -0,0 +1,18 @@
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Decimal to binary conversion of number literals (decimal.c)
+//
+// The scanner reads the digits of a FLOAT_LITERAL once, keeping the first 19 significant
+// ones as an integer mantissa and counting the power of ten they are scaled by, and hands
+// them here. Small cases are exact in one double operation (Clinger); the rest go through
+// the Eisel-Lemire algorithm ("Number Parsing at a Gigabyte per Second", Lemire 2021), which
+// multiplies by a 128-bit power of five and is correctly rounded. Only a mantissa that was
+// cut short and lies too close to a rounding boundary falls back to strtod() on the text.
+
+double decimal_to_double(uint64_t mantissa, int exponent, bool truncated, const char *text);
+
+#endif //DECIMAL_H
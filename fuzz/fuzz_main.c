@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Driver for the fuzz targets when they are not built with libFuzzer
+//
+// Runs LLVMFuzzerTestOneInput() once for every file named on the command line and every
+// file in a named directory, or once for stdin without arguments. This is also the form AFL
+// expects: afl-fuzz -i corpus -o findings -- ./fuzz_parser @@
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int num_inputs;
+
+static void run_stream(FILE *in, const char *name) {
+    size_t capacity = 4096, size = 0, read;
+    uint8_t *data = malloc(capacity);
+    while (data != NULL && (read = fread(data + size, 1, capacity - size, in)) > 0) {
+        size += read;
+        if (size == capacity) {
+            capacity *= 2;
+            uint8_t *larger = realloc(data, capacity);
+            if (larger == NULL) {
+                free(data);
+            }
+            data = larger;
+        }
+    }
+    if (data == NULL) {
+        fprintf(stderr, "Error: out of memory reading %s\n", name);
+        exit(1);
+    }
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    num_inputs++;
+}
+
+static void run_path(const char *path) {
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        exit(1);
+    }
+    if (S_ISDIR(info.st_mode)) {
+        DIR *dir = opendir(path);
+        struct dirent *entry;
+        while (dir != NULL && (entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] != '.') {
+                char child[4096];
+                snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+                run_path(child);
+            }
+        }
+        if (dir != NULL) {
+            closedir(dir);
+        }
+        return;
+    }
+    FILE *in = fopen(path, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        exit(1);
+    }
+    run_stream(in, path);
+    fclose(in);
+}
+
+int main(int argc, char *argv[argc + 1]) {
+    if (argc == 1) {
+        run_stream(stdin, "stdin");
+    }
+    for (int i = 1; i < argc; i++) {
+        run_path(argv[i]);
+    }
+    fprintf(stderr, "%d inputs run\n", num_inputs);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../scanner.h"
+#include "../parse_tree.h"
+#include "../logger.h"
+
+// Fuzz target for the scanner and the parser together, for libFuzzer or fuzz_main.c
+//
+// The input is scanned into an in-memory symbol table, which is then parsed. Syntax errors are
+// expected; a crash, a sanitizer report or a parse that does not end is a bug.
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    log_categories = 0;
+
+    char *table = NULL;
+    size_t length;
+    FILE *out = open_memstream(&table, &length);
+    if (out == NULL) {
+        abort();
+    }
+    scan_buffer((const char *)data, size, out);
+    fclose(out);
+
+    FILE *symbols = fmemopen(table, length, "r");
+    if (symbols == NULL) {
+        abort();
+    }
+    int num_errors;
+    ParseTreeNode *program = parse_symbol_table(symbols, &num_errors);
+    free_parse_tree(program);
+    free(table);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../scanner.h"
+#include "../logger.h"
+#include "../token.h"
+
+// Fuzz target for the scanner, for libFuzzer or fuzz_main.c
+//
+// Scans the input from memory, the way the scanner does, and again with the fgetc() reference
+// (differential mode). A crash, a sanitizer report or two different symbol tables is a bug, and
+// so is a number whose value in the table is not what strtoll() or strtod() make of its lexeme.
+
+// Symbol table of the input as a string, read through a stream if reference is set
+static char *scan_to_string(const uint8_t *data, size_t size, bool reference, size_t *length) {
+    char *table = NULL;
+    FILE *out = open_memstream(&table, length);
+    if (out == NULL) {
+        abort();
+    }
+    if (reference) {
+        // An empty input can come without a buffer
+        static char empty[1];
+        FILE *in = fmemopen(size > 0 ? (void *)data : empty, size, "rb");
+        if (in == NULL) {
+            abort();
+        }
+        scan_file(in, out);
+        fclose(in);
+    } else {
+        scan_buffer((const char *)data, size, out);
+    }
+    fclose(out);
+    return table;
+}
+
+// Checks the VALUE column of the number rows against the C library
+static void check_values(const char *table) {
+    for (const char *line = table; line != NULL && *line != '\0'; line = strchr(line, '\n'), line += line != NULL) {
+        int code, line_number, column;
+        char name[50], value[64], lexeme[MAX_LEXEME_LENGTH];
+        if (sscanf(line, "%d | %49[^|] | %d | %d | %63[^|] | %499[^\n]", &code, name, &line_number, &column, value,
+                   lexeme) != 6) {
+            continue;
+        }
+        bool wrong = false;
+        if (code == INTEGER_LITERAL) {
+            wrong = strtoll(value, NULL, 10) != strtoll(lexeme, NULL, 10);
+        }
+        else if (code == FLOAT_LITERAL) {
+            double converted = strtod(value, NULL), expected = strtod(lexeme, NULL);
+            wrong = memcmp(&converted, &expected, sizeof(double)) != 0;
+        }
+        if (wrong) {
+            fprintf(stderr, "Wrong value %s for %s at line %d\n", value, lexeme, line_number);
+            abort();
+        }
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    log_categories = 0;
+
+    size_t fast_length, reference_length;
+    char *fast = scan_to_string(data, size, false, &fast_length);
+    char *reference = scan_to_string(data, size, true, &reference_length);
+    if (fast_length != reference_length || memcmp(fast, reference, fast_length) != 0) {
+        fprintf(stderr, "Symbol tables differ\n--- scan_buffer\n%s\n--- scan_file\n%s\n", fast, reference);
+        abort();
+    }
+    check_values(fast);
+    free(fast);
+    free(reference);
+    return 0;
+}
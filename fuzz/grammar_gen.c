@@ -0,0 +1,604 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <limits.h>
+
+// Grammar-aware generator of .core inputs for the fuzz targets
+//
+// Reads an EBNF grammar such as implemented_grammar.ebnf and writes random derivations of its
+// first rule. Nonterminals are <name>, terminals are quoted, and a bare upper case name like
+// IDENTIFIER or STRING is a token class that gets a random lexeme, including the tricky
+// ones: digit separators, character escapes and string escapes. Past the depth limit only
+// the shallowest alternatives are taken, so every derivation ends. With -m the tokens of
+// each program are mutated afterwards to reach the error paths of the scanner and parser.
+//
+//   grammar_gen [-s seed] [-d depth] [-m mutations] [-n count -o directory] grammar.ebnf
+
+#define MAX_TOKENS 200000
+
+typedef enum {
+    EXPR_SEQUENCE,
+    EXPR_CHOICE,
+    EXPR_OPTIONAL,      // [ ... ]
+    EXPR_REPEAT,        // { ... }
+    EXPR_RULE,          // <name>
+    EXPR_TERMINAL,      // "text"
+    EXPR_TOKEN          // IDENTIFIER, STRING, ...
+} ExprKind;
+
+typedef struct Expr {
+    ExprKind kind;
+    char *text;
+    int rule;
+    struct Expr **items;
+    int num_items;
+    int min_depth;      // Fewest rule expansions needed to derive only terminals
+} Expr;
+
+typedef struct {
+    char *name;
+    Expr *body;
+} Rule;
+
+// The grammar file split into symbols
+typedef enum { SYM_RULE, SYM_TERMINAL, SYM_TOKEN, SYM_DEFINE, SYM_PUNCT, SYM_END } SymbolKind;
+
+typedef struct {
+    SymbolKind kind;
+    char *text;
+} Symbol;
+
+static Symbol *symbols;
+static int num_symbols;
+static int position;
+
+static Rule *rules;
+static int num_rules;
+
+static uint64_t rng_state;
+static int max_depth = 12;
+
+static char *out_tokens[MAX_TOKENS];
+static int num_out_tokens;
+
+static uint32_t rng(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 2685821657736338717ull) >> 32);
+}
+
+static int random_below(int n) {
+    return (int)(rng() % (uint32_t)n);
+}
+
+static void *allocate(size_t size) {
+    void *memory = calloc(1, size);
+    if (memory == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    return memory;
+}
+
+static char *copy_text(const char *start, size_t length) {
+    char *text = allocate(length + 1);
+    memcpy(text, start, length);
+    return text;
+}
+
+/******************************************************/
+/* Reading the grammar */
+
+static void add_symbol(SymbolKind kind, char *text) {
+    static int capacity;
+    if (num_symbols == capacity) {
+        capacity = capacity ? 2 * capacity : 256;
+        symbols = realloc(symbols, sizeof(Symbol) * capacity);
+        if (symbols == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+    }
+    symbols[num_symbols++] = (Symbol){ kind, text };
+}
+
+// Quotes may be plain or the typographic ones grammar.ebnf uses
+static size_t quote_length(const char *p) {
+    if (*p == '"') {
+        return 1;
+    }
+    if (strncmp(p, "“", 3) == 0 || strncmp(p, "”", 3) == 0) {
+        return 3;
+    }
+    return 0;
+}
+
+static void split_symbols(const char *p) {
+    while (*p != '\0') {
+        size_t quote;
+        if (isspace((unsigned char)*p)) {
+            p++;
+        } else if (strncmp(p, "::=", 3) == 0) {
+            add_symbol(SYM_DEFINE, NULL);
+            p += 3;
+        } else if (*p == '<') {
+            const char *end = strchr(p, '>');
+            if (end == NULL) {
+                fprintf(stderr, "Error: unterminated <name> in grammar\n");
+                exit(1);
+            }
+            add_symbol(SYM_RULE, copy_text(p + 1, end - p - 1));
+            p = end + 1;
+        } else if ((quote = quote_length(p)) > 0) {
+            const char *start = p + quote, *end = start;
+            while (*end != '\0' && quote_length(end) == 0) {
+                end++;
+            }
+            add_symbol(SYM_TERMINAL, copy_text(start, end - start));
+            p = *end ? end + quote_length(end) : end;
+        } else if (isalpha((unsigned char)*p) || *p == '_') {
+            const char *end = p;
+            while (isalnum((unsigned char)*end) || *end == '_') {
+                end++;
+            }
+            add_symbol(SYM_TOKEN, copy_text(p, end - p));
+            p = end;
+        } else if (strchr("|[]{}()", *p) != NULL) {
+            add_symbol(SYM_PUNCT, copy_text(p, 1));
+            p++;
+        } else {
+            fprintf(stderr, "Error: unexpected character '%c' in grammar\n", *p);
+            exit(1);
+        }
+    }
+    add_symbol(SYM_END, NULL);
+}
+
+static int find_rule(const char *name) {
+    for (int r = 0; r < num_rules; r++) {
+        if (strcmp(rules[r].name, name) == 0) {
+            return r;
+        }
+    }
+    return -1;
+}
+
+static int add_rule(const char *name) {
+    int r = find_rule(name);
+    if (r < 0) {
+        rules = realloc(rules, sizeof(Rule) * (num_rules + 1));
+        if (rules == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        rules[num_rules] = (Rule){ copy_text(name, strlen(name)), NULL };
+        r = num_rules++;
+    }
+    return r;
+}
+
+static Expr *new_expr(ExprKind kind) {
+    Expr *expr = allocate(sizeof(Expr));
+    expr->kind = kind;
+    return expr;
+}
+
+static void add_item(Expr *expr, Expr *item) {
+    expr->items = realloc(expr->items, sizeof(Expr *) * (expr->num_items + 1));
+    if (expr->items == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    expr->items[expr->num_items++] = item;
+}
+
+static bool at_punct(char c) {
+    return symbols[position].kind == SYM_PUNCT && symbols[position].text[0] == c;
+}
+
+// A <name> followed by ::= starts the next rule
+static bool at_rule_start(void) {
+    return symbols[position].kind == SYM_RULE && symbols[position + 1].kind == SYM_DEFINE;
+}
+
+static Expr *parse_choice(void);
+
+static void expect_punct(char c) {
+    if (!at_punct(c)) {
+        fprintf(stderr, "Error: expected '%c' in grammar\n", c);
+        exit(1);
+    }
+    position++;
+}
+
+static Expr *parse_sequence(void) {
+    Expr *sequence = new_expr(EXPR_SEQUENCE);
+    while (!at_rule_start()) {
+        Symbol *symbol = &symbols[position];
+        Expr *item;
+        if (symbol->kind == SYM_RULE) {
+            item = new_expr(EXPR_RULE);
+            item->rule = add_rule(symbol->text);
+            position++;
+        } else if (symbol->kind == SYM_TERMINAL) {
+            item = new_expr(EXPR_TERMINAL);
+            item->text = symbol->text;
+            position++;
+        } else if (symbol->kind == SYM_TOKEN) {
+            item = new_expr(EXPR_TOKEN);
+            item->text = symbol->text;
+            position++;
+        } else if (at_punct('[') || at_punct('{') || at_punct('(')) {
+            char open = symbol->text[0];
+            position++;
+            Expr *inner = parse_choice();
+            if (open == '(') {
+                item = inner;
+                expect_punct(')');
+            } else {
+                item = new_expr(open == '[' ? EXPR_OPTIONAL : EXPR_REPEAT);
+                add_item(item, inner);
+                expect_punct(open == '[' ? ']' : '}');
+            }
+        } else {
+            break;
+        }
+        add_item(sequence, item);
+    }
+    return sequence;
+}
+
+static Expr *parse_choice(void) {
+    Expr *choice = new_expr(EXPR_CHOICE);
+    add_item(choice, parse_sequence());
+    while (at_punct('|')) {
+        position++;
+        add_item(choice, parse_sequence());
+    }
+    return choice;
+}
+
+static void read_grammar(const char *path) {
+    FILE *in = fopen(path, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        exit(1);
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+    char *text = allocate(size + 1);
+    if (fread(text, 1, size, in) != (size_t)size) {
+        fprintf(stderr, "Error: cannot read %s\n", path);
+        exit(1);
+    }
+    fclose(in);
+
+    split_symbols(text);
+    free(text);
+    while (symbols[position].kind != SYM_END) {
+        if (!at_rule_start()) {
+            fprintf(stderr, "Error: expected <name> ::= in grammar\n");
+            exit(1);
+        }
+        int r = add_rule(symbols[position].text);
+        position += 2;
+        // Not in one statement: parse_choice() can move rules
+        Expr *body = parse_choice();
+        rules[r].body = body;
+    }
+    for (int r = 0; r < num_rules; r++) {
+        if (rules[r].body == NULL) {
+            fprintf(stderr, "Warning: <%s> is used but not defined, it derives nothing\n", rules[r].name);
+            rules[r].body = new_expr(EXPR_SEQUENCE);
+        }
+    }
+}
+
+/******************************************************/
+/* Minimal depths */
+
+// One pass of the fixed point, true if anything got smaller
+static bool update_depth(Expr *expr) {
+    bool changed = false;
+    for (int i = 0; i < expr->num_items; i++) {
+        changed |= update_depth(expr->items[i]);
+    }
+    int depth = 0;
+    switch (expr->kind) {
+        case EXPR_SEQUENCE:
+            for (int i = 0; i < expr->num_items; i++) {
+                if (expr->items[i]->min_depth > depth) {
+                    depth = expr->items[i]->min_depth;
+                }
+            }
+            break;
+        case EXPR_CHOICE:
+            depth = INT_MAX;
+            for (int i = 0; i < expr->num_items; i++) {
+                if (expr->items[i]->min_depth < depth) {
+                    depth = expr->items[i]->min_depth;
+                }
+            }
+            break;
+        case EXPR_RULE: {
+            int body = rules[expr->rule].body->min_depth;
+            depth = body == INT_MAX ? INT_MAX : body + 1;
+            break;
+        }
+        default:
+            // Terminals and tokens, and [ ] and { } which can be left out
+            break;
+    }
+    if (depth < expr->min_depth) {
+        expr->min_depth = depth;
+        changed = true;
+    }
+    return changed;
+}
+
+static void reset_depth(Expr *expr) {
+    expr->min_depth = INT_MAX;
+    for (int i = 0; i < expr->num_items; i++) {
+        reset_depth(expr->items[i]);
+    }
+}
+
+static void compute_depths(void) {
+    for (int r = 0; r < num_rules; r++) {
+        reset_depth(rules[r].body);
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int r = 0; r < num_rules; r++) {
+            changed |= update_depth(rules[r].body);
+        }
+    }
+    for (int r = 0; r < num_rules; r++) {
+        if (rules[r].body->min_depth == INT_MAX) {
+            fprintf(stderr, "Error: <%s> never derives only terminals\n", rules[r].name);
+            exit(1);
+        }
+    }
+}
+
+/******************************************************/
+/* Lexemes */
+
+static void emit(const char *text) {
+    if (num_out_tokens < MAX_TOKENS) {
+        out_tokens[num_out_tokens++] = copy_text(text, strlen(text));
+    }
+}
+
+static void digits(char *buffer, int count) {
+    size_t length = strlen(buffer);
+    for (int i = 0; i < count; i++) {
+        buffer[length++] = (char)('0' + random_below(10));
+    }
+    buffer[length] = '\0';
+}
+
+// An integer, at times with ' or ` separators between groups of three digits
+static void random_integer(char *buffer) {
+    buffer[0] = '\0';
+    digits(buffer, 1 + random_below(3));
+    if (random_below(4) == 0) {
+        for (int groups = 1 + random_below(3); groups > 0; groups--) {
+            strcat(buffer, random_below(2) ? "'" : "`");
+            digits(buffer, 3);
+        }
+    }
+}
+
+static void random_token(const char *token_class) {
+    static const char *names[] = { "a", "b", "x", "count", "_tmp", "value1", "main", "sum_of_all" };
+    static const char *characters[] = { "'a'", "'Z'", "'0'", "' '", "'\\n'", "'\\t'", "'\\''", "'\\\\'" };
+    static const char *strings[] = {
+        "\"\"", "\"hello\"", "\"%d\\n\"", "\"a \\\"quoted\\\" word\"", "\"tab\\tand\\\\slash\"", "\"%d %f %c\""
+    };
+    char buffer[64];
+    if (strcmp(token_class, "IDENTIFIER") == 0) {
+        emit(names[random_below(sizeof(names) / sizeof(names[0]))]);
+    } else if (strcmp(token_class, "INTEGER_LITERAL") == 0) {
+        random_integer(buffer);
+        emit(buffer);
+    } else if (strcmp(token_class, "FLOAT_LITERAL") == 0) {
+        switch (random_below(4)) {
+            case 0: strcpy(buffer, "."); digits(buffer, 1 + random_below(3)); break;
+            case 1: random_integer(buffer); strcat(buffer, "."); break;
+            default: random_integer(buffer); strcat(buffer, "."); digits(buffer, 1 + random_below(4)); break;
+        }
+        emit(buffer);
+    } else if (strcmp(token_class, "CHARACTER_LITERAL") == 0) {
+        emit(characters[random_below(sizeof(characters) / sizeof(characters[0]))]);
+    } else if (strcmp(token_class, "STRING") == 0) {
+        emit(strings[random_below(sizeof(strings) / sizeof(strings[0]))]);
+    } else {
+        // Unknown classes are written as they are
+        emit(token_class);
+    }
+}
+
+/******************************************************/
+/* Derivation */
+
+static void generate(const Expr *expr, int depth) {
+    bool deep = depth >= max_depth;
+    switch (expr->kind) {
+        case EXPR_SEQUENCE:
+            for (int i = 0; i < expr->num_items; i++) {
+                generate(expr->items[i], depth);
+            }
+            break;
+        case EXPR_CHOICE: {
+            const Expr *pick = expr->items[random_below(expr->num_items)];
+            if (deep) {
+                // The first of the shallowest alternatives, so the derivation ends
+                for (int i = 0; i < expr->num_items; i++) {
+                    if (expr->items[i]->min_depth == expr->min_depth) {
+                        pick = expr->items[i];
+                        break;
+                    }
+                }
+            }
+            generate(pick, depth);
+            break;
+        }
+        case EXPR_OPTIONAL:
+            if (!deep && random_below(2)) {
+                generate(expr->items[0], depth);
+            }
+            break;
+        case EXPR_REPEAT:
+            if (!deep) {
+                for (int n = random_below(4); n > 0; n--) {
+                    generate(expr->items[0], depth);
+                }
+            }
+            break;
+        case EXPR_RULE:
+            generate(rules[expr->rule].body, depth + 1);
+            break;
+        case EXPR_TERMINAL:
+            emit(expr->text);
+            break;
+        case EXPR_TOKEN:
+            random_token(expr->text);
+            break;
+    }
+}
+
+// Token edits that make the program wrong in the ways people get it wrong
+static void mutate(int mutations) {
+    static const char *inserts[] = { ";", "(", ")", "{", "}", "[", "]", ",", "=", "int", "if", "else", "\"", "'",
+                                     "1'00", "`", "//", "@", "3.", "'\\" };
+    for (int m = 0; m < mutations && num_out_tokens > 0; m++) {
+        int at = random_below(num_out_tokens);
+        switch (random_below(4)) {
+            case 0:
+                // Delete
+                free(out_tokens[at]);
+                memmove(&out_tokens[at], &out_tokens[at + 1], sizeof(char *) * (num_out_tokens - at - 1));
+                num_out_tokens--;
+                break;
+            case 1:
+                // Insert
+                if (num_out_tokens < MAX_TOKENS) {
+                    const char *text = inserts[random_below(sizeof(inserts) / sizeof(inserts[0]))];
+                    memmove(&out_tokens[at + 1], &out_tokens[at], sizeof(char *) * (num_out_tokens - at));
+                    out_tokens[at] = copy_text(text, strlen(text));
+                    num_out_tokens++;
+                }
+                break;
+            case 2: {
+                // Swap with the next one
+                if (at + 1 < num_out_tokens) {
+                    char *swap = out_tokens[at];
+                    out_tokens[at] = out_tokens[at + 1];
+                    out_tokens[at + 1] = swap;
+                }
+                break;
+            }
+            default: {
+                // Cut the token short, e.g. a string without its closing quote
+                size_t length = strlen(out_tokens[at]);
+                if (length > 1) {
+                    out_tokens[at][random_below((int)length - 1) + 1] = '\0';
+                }
+                break;
+            }
+        }
+    }
+}
+
+static void write_program(FILE *out) {
+    int indent = 0;
+    bool line_start = true;
+    for (int t = 0; t < num_out_tokens; t++) {
+        const char *text = out_tokens[t];
+        if (strcmp(text, "}") == 0 && indent > 0) {
+            indent--;
+        }
+        if (line_start) {
+            for (int i = 0; i < indent; i++) {
+                fputs("    ", out);
+            }
+        } else {
+            fputc(' ', out);
+        }
+        fputs(text, out);
+        line_start = strcmp(text, ";") == 0 || strcmp(text, "{") == 0 || strcmp(text, "}") == 0;
+        if (strcmp(text, "{") == 0) {
+            indent++;
+        }
+        if (line_start) {
+            fputc('\n', out);
+        }
+        free(out_tokens[t]);
+    }
+    if (!line_start) {
+        fputc('\n', out);
+    }
+    num_out_tokens = 0;
+}
+
+int main(int argc, char *argv[argc + 1]) {
+    unsigned long long seed = 1;
+    int mutations = 0;
+    int count = 1;
+    const char *directory = NULL;
+    const char *grammar = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            max_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            mutations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (grammar == NULL && argv[i][0] != '-') {
+            grammar = argv[i];
+        } else {
+            grammar = NULL;
+            break;
+        }
+    }
+    if (grammar == NULL || count < 1 || (count > 1 && directory == NULL)) {
+        fprintf(stderr, "Usage: %s [-s seed] [-d depth] [-m mutations] [-n count -o directory] grammar.ebnf\n",
+                argv[0]);
+        return 1;
+    }
+
+    read_grammar(grammar);
+    compute_depths();
+    rng_state = seed * 0x9E3779B97F4A7C15ull + 1;
+
+    for (int n = 0; n < count; n++) {
+        generate(rules[0].body, 0);
+        mutate(mutations);
+        if (directory == NULL) {
+            write_program(stdout);
+            continue;
+        }
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/gen_%05d.core", directory, n);
+        FILE *out = fopen(path, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Error: cannot write %s\n", path);
+            return 1;
+        }
+        write_program(out);
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Runs the fuzz targets over the test programs and over programs from grammar_gen, both
+# as the grammar derives them and with their tokens mutated. Fails on the first crash,
+# sanitizer report or scanner mismatch, and when a target runs for more than 10 minutes.
+# Usage: fuzz/run_fuzz.sh <grammar_gen> <fuzz_scanner> <fuzz_parser> [programs] [seed]
+
+if [ $# -lt 3 ]; then
+    echo "Usage: $0 <grammar_gen> <fuzz_scanner> <fuzz_parser> [programs] [seed]"
+    exit 1
+fi
+
+generator=$1
+fuzz_scanner=$2
+fuzz_parser=$3
+count=${4:-500}
+seed=${5:-1}
+fuzz_dir=$(cd "$(dirname "$0")" && pwd)
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+grammar="$fuzz_dir/../implemented_grammar.ebnf"
+mkdir "$work_dir/valid" "$work_dir/mutated"
+"$generator" -s "$seed" -n "$count" -o "$work_dir/valid" "$grammar" || exit 1
+"$generator" -s "$seed" -m 6 -n "$count" -o "$work_dir/mutated" "$grammar" || exit 1
+
+# Files are passed one by one so a libFuzzer build runs them instead of fuzzing
+inputs=$(ls "$fuzz_dir"/../test_lexer/*.core "$fuzz_dir"/../test_parser/*.core \
+            "$work_dir"/valid/*.core "$work_dir"/mutated/*.core)
+for target in "$fuzz_scanner" "$fuzz_parser"; do
+    echo "$(basename "$target"):"
+    # Diagnostics of the scanner are expected, only the target's own report is kept
+    if ! timeout 600 "$target" $inputs 2> "$work_dir/err"; then
+        grep -v '^ERROR: Invalid noise separators' "$work_dir/err"
+        exit 1
+    fi
+    tail -n 1 "$work_dir/err"
+done
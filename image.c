@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ir.h"
+
+// Precompiled program images (.corec)
+//
+// An image holds a lowered, and usually optimized, module in the layout the IR has in memory:
+// a header, a record per function, then the instructions, blocks and operand pool of each
+// function, the globals and the interned strings, every table aligned to IMAGE_ALIGNMENT
+// bytes from the start of the file. Nothing in these tables points into memory (see ir.h), so
+// once the file is mapped they are used where they are: loading is one read-only mmap, a check
+// of the header and of every index, and an IrFunction per function pointing into the mapping.
+// The pages are never written, so processes running the same image share them. The line and
+// column of each instruction, which runtime errors and the profiler report, are part of its
+// record and serve as the debug line table.
+//
+// The header has IR_IMAGE_VERSION, the byte order and the sizes of the tables' records, and an
+// image that another build wrote with a different layout is rejected. The checks keep every
+// index inside the table it refers to, so a damaged file cannot make the loader or the engines
+// read outside the mapping; what the instructions compute is trusted as the compiler wrote it.
+
+#define IMAGE_MAGIC "\177COREC\r\n"
+#define IMAGE_ALIGNMENT 64
+#define IMAGE_BYTE_ORDER 0x01020304u
+#define IMAGE_LAYOUT ((uint32_t)sizeof(IrInstr) | (uint32_t)sizeof(IrBlock) << 8 | \
+                      (uint32_t)sizeof(IrGlobal) << 16 | (uint32_t)IR_OPCODE_COUNT << 24)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t layout;
+    int32_t num_functions, num_globals, num_strings, string_size;
+    int32_t init_function, main_function;
+    uint64_t size;      // Of the file
+    // Offsets of the tables
+    uint64_t functions, globals, string_offsets, string_lengths, string_data;
+} ImageHeader;
+
+typedef struct {
+    char name[IR_NAME_LENGTH];
+    int32_t return_type;
+    int32_t num_params;
+    int32_t param_types[IR_MAX_PARAMS];
+    int32_t defined, memoize;
+    int32_t entry;
+    int32_t num_instrs, num_blocks, pool_size;
+    int32_t rpo_start, rpo_count;
+    uint64_t instrs, blocks, pool;      // Offsets of the tables
+} ImageFunction;
+
+static uint64_t place(uint64_t *end, size_t bytes) {
+    uint64_t offset = (*end + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+    *end = offset + bytes;
+    return offset;
+}
+
+// Writes a table at its offset, after zeros up to it
+static bool write_table(FILE *file, uint64_t *written, uint64_t offset, const void *data, size_t bytes) {
+    static const char zeros[IMAGE_ALIGNMENT];
+    while (*written < offset) {
+        size_t padding = offset - *written < IMAGE_ALIGNMENT ? (size_t)(offset - *written) : IMAGE_ALIGNMENT;
+        if (fwrite(zeros, 1, padding, file) != padding) {
+            return false;
+        }
+        *written += padding;
+    }
+    if (bytes > 0 && fwrite(data, 1, bytes, file) != bytes) {
+        return false;
+    }
+    *written += bytes;
+    return true;
+}
+
+/******************************************************/
+/* Checks */
+
+static const char *image_path;
+static size_t image_size;
+
+static bool reject(const char *reason) {
+    fprintf(stderr, "Error: %s is not a usable program image: %s\n", image_path, reason);
+    return false;
+}
+
+// Checks that count records of size bytes at offset are inside the image and aligned
+static bool in_image(uint64_t offset, int64_t count, size_t size) {
+    return count >= 0 && offset % IMAGE_ALIGNMENT == 0 && offset <= image_size &&
+           (uint64_t)count <= (image_size - offset) / size;
+}
+
+static bool in_range(int64_t value, int64_t end) {
+    return value >= 0 && value < end;
+}
+
+static bool list_in_pool(const IrFunction *f, IrList list) {
+    return list.count >= 0 && list.start >= 0 && list.start <= f->pool_size - list.count;
+}
+
+// Operands an instruction reads without looking at how many it has
+static int min_operands(IrOpcode op) {
+    switch (op) {
+        case IR_STORE:
+            return 3;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+        case IR_POW:
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+        case IR_LOAD:
+        case IR_PARALLEL:
+            return 2;
+        case IR_NEG:
+        case IR_NOT:
+        case IR_CONVERT:
+        case IR_SCAN_VALUE:
+        case IR_BRANCH:
+            return 1;
+        case IR_VECTOR:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static bool check_instr(const IrModule *module, const IrFunction *f, int i) {
+    const IrInstr *in = &f->instrs[i];
+    if (in->op >= IR_OPCODE_COUNT || in->type > IR_FLOAT) {
+        return reject("unknown opcode or type");
+    }
+    if (!in_range(in->block, f->num_blocks) && in->block != IR_NONE) {
+        return reject("instruction in no block");
+    }
+    if ((!in_range(in->prev, f->num_instrs) && in->prev != IR_NONE) ||
+        (!in_range(in->next, f->num_instrs) && in->next != IR_NONE)) {
+        return reject("instruction list out of range");
+    }
+    if (!list_in_pool(f, in->operands) || in->operands.count < min_operands(in->op)) {
+        return reject("operand list out of range");
+    }
+    for (int k = 0; k < in->operands.count; k++) {
+        if (!in_range(ir_operand(f, i, k), f->num_instrs)) {
+            return reject("operand out of range");
+        }
+    }
+
+    switch ((IrOpcode)in->op) {
+        case IR_PHI:
+            if (!in_range(in->block, f->num_blocks) || in->operands.count != f->blocks[in->block].preds.count) {
+                return reject("phi without an operand per predecessor");
+            }
+            break;
+        case IR_PARAM:
+            return in_range(in->imm, f->num_params) || reject("parameter out of range");
+        case IR_CALL:
+            if (!in_range(in->imm, module->num_functions) || !module->functions[in->imm].defined ||
+                in->operands.count != module->functions[in->imm].num_params) {
+                return reject("call of an unknown function");
+            }
+            break;
+        case IR_ARRAY:
+            return in_range(in->imm, INT32_MAX) || reject("array length out of range");
+        case IR_GLOBAL:
+            return in_range(in->imm, module->num_globals) || reject("global out of range");
+        case IR_PRINTF:
+        case IR_SCANF:
+            return in_range(in->imm, module->num_strings) || reject("string out of range");
+        case IR_SCAN_VALUE:
+            return in_range(in->imm, IR_MAX_PARAMS) || reject("scanned value out of range");
+        case IR_BRANCH:
+        case IR_VECTOR:
+        case IR_PARALLEL:
+            if (!in_range(in->targets[1], f->num_blocks)) {
+                return reject("branch target out of range");
+            }
+            // fallthrough
+        case IR_JUMP:
+            if (!in_range(in->targets[0], f->num_blocks)) {
+                return reject("branch target out of range");
+            }
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+static bool check_function(const IrModule *module, const IrFunction *f) {
+    if (memchr(f->name, '\0', IR_NAME_LENGTH) == NULL || f->return_type > IR_FLOAT ||
+        f->num_params < 0 || f->num_params > IR_MAX_PARAMS) {
+        return reject("bad function record");
+    }
+    if (!f->defined) {
+        return f->num_instrs == 0 || reject("instructions in a prototype");
+    }
+    if (!in_range(f->entry, f->num_blocks) || !list_in_pool(f, f->rpo)) {
+        return reject("entry block or block order out of range");
+    }
+    for (int k = 0; k < f->rpo.count; k++) {
+        if (!in_range(f->pool[f->rpo.start + k], f->num_blocks)) {
+            return reject("block order out of range");
+        }
+    }
+    for (int b = 0; b < f->num_blocks; b++) {
+        const IrBlock *block = &f->blocks[b];
+        if ((!in_range(block->first, f->num_instrs) && block->first != IR_NONE) ||
+            (!in_range(block->last, f->num_instrs) && block->last != IR_NONE) ||
+            (!in_range(block->idom, f->num_blocks) && block->idom != IR_NONE) || !list_in_pool(f, block->preds)) {
+            return reject("block out of range");
+        }
+        for (int k = 0; k < block->preds.count; k++) {
+            if (!in_range(ir_pred(f, b, k), f->num_blocks)) {
+                return reject("predecessor out of range");
+            }
+        }
+    }
+    for (int i = 0; i < f->num_instrs; i++) {
+        if (!check_instr(module, f, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Points the module at the tables of a mapped image after checking them
+static bool open_image(IrModule *module, const unsigned char *image) {
+    ImageHeader header;
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0) {
+        return reject("no .corec header");
+    }
+    if (header.version != IR_IMAGE_VERSION || header.byte_order != IMAGE_BYTE_ORDER ||
+        header.layout != IMAGE_LAYOUT) {
+        return reject("written by another version, recompile it");
+    }
+    if (header.size != image_size || !in_image(header.functions, header.num_functions, sizeof(ImageFunction)) ||
+        !in_image(header.globals, header.num_globals, sizeof(IrGlobal)) ||
+        !in_image(header.string_offsets, header.num_strings, sizeof(int)) ||
+        !in_image(header.string_lengths, header.num_strings, sizeof(int)) ||
+        !in_image(header.string_data, header.string_size, 1)) {
+        return reject("truncated or damaged");
+    }
+
+    module->num_functions = module->functions_capacity = header.num_functions;
+    module->globals = (IrGlobal *)(image + header.globals);
+    module->num_globals = module->globals_capacity = header.num_globals;
+    module->string_data = (char *)(image + header.string_data);
+    module->string_size = module->string_capacity = header.string_size;
+    module->string_offsets = (int *)(image + header.string_offsets);
+    module->string_lengths = (int *)(image + header.string_lengths);
+    module->num_strings = module->strings_capacity = header.num_strings;
+    module->init_function = header.init_function;
+    module->main_function = header.main_function;
+    module->functions = ir_arena_alloc(&module->arena, sizeof(IrFunction) * (header.num_functions + 1));
+
+    for (int id = 0; id < header.num_functions; id++) {
+        ImageFunction record;
+        memcpy(&record, image + header.functions + sizeof(record) * id, sizeof(record));
+        if (!in_image(record.instrs, record.num_instrs, sizeof(IrInstr)) ||
+            !in_image(record.blocks, record.num_blocks, sizeof(IrBlock)) ||
+            !in_image(record.pool, record.pool_size, sizeof(int))) {
+            return reject("truncated or damaged");
+        }
+        IrFunction *f = &module->functions[id];
+        memset(f, 0, sizeof(*f));
+        memcpy(f->name, record.name, IR_NAME_LENGTH);
+        f->return_type = record.return_type;
+        f->num_params = record.num_params;
+        for (int p = 0; p < IR_MAX_PARAMS; p++) {
+            f->param_types[p] = record.param_types[p];
+        }
+        f->defined = record.defined != 0;
+        f->memoize = record.memoize != 0;
+        f->arena = &module->arena;
+        f->instrs = (IrInstr *)(image + record.instrs);
+        f->num_instrs = f->instrs_capacity = record.num_instrs;
+        f->blocks = (IrBlock *)(image + record.blocks);
+        f->num_blocks = f->blocks_capacity = record.num_blocks;
+        f->pool = (int *)(image + record.pool);
+        f->pool_size = f->pool_capacity = record.pool_size;
+        f->entry = record.entry;
+        f->rpo = (IrList){ record.rpo_start, record.rpo_count, record.rpo_count };
+    }
+
+    for (int id = 0; id < module->num_functions; id++) {
+        if (!check_function(module, &module->functions[id])) {
+            return false;
+        }
+    }
+    for (int g = 0; g < module->num_globals; g++) {
+        const IrGlobal *global = &module->globals[g];
+        if (memchr(global->name, '\0', IR_NAME_LENGTH) == NULL || global->type > IR_FLOAT || global->length < 0) {
+            return reject("bad global record");
+        }
+    }
+    for (int s = 0; s < module->num_strings; s++) {
+        int offset = module->string_offsets[s], length = module->string_lengths[s];
+        if (offset < 0 || length < 0 || offset > module->string_size - length) {
+            return reject("string out of range");
+        }
+    }
+    if (!in_range(module->main_function, module->num_functions) ||
+        !module->functions[module->main_function].defined ||
+        (module->init_function != IR_NONE && (!in_range(module->init_function, module->num_functions) ||
+                                              !module->functions[module->init_function].defined))) {
+        return reject("no main function");
+    }
+    return true;
+}
+
+/******************************************************/
+
+bool ir_save_image(const IrModule *module, const char *path) {
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IR_IMAGE_VERSION;
+    header.byte_order = IMAGE_BYTE_ORDER;
+    header.layout = IMAGE_LAYOUT;
+    header.num_functions = module->num_functions;
+    header.num_globals = module->num_globals;
+    header.num_strings = module->num_strings;
+    header.string_size = module->string_size;
+    header.init_function = module->init_function;
+    header.main_function = module->main_function;
+
+    uint64_t end = sizeof(header);
+    header.functions = place(&end, sizeof(ImageFunction) * module->num_functions);
+    ImageFunction *records = calloc(module->num_functions + 1, sizeof(ImageFunction));
+    if (!records) {
+        fprintf(stderr, "Error: Memory allocation failed in ir_save_image\n");
+        exit(1);
+    }
+    for (int id = 0; id < module->num_functions; id++) {
+        const IrFunction *f = &module->functions[id];
+        ImageFunction *record = &records[id];
+        memcpy(record->name, f->name, IR_NAME_LENGTH);
+        record->return_type = f->return_type;
+        record->num_params = f->num_params;
+        for (int p = 0; p < IR_MAX_PARAMS; p++) {
+            record->param_types[p] = f->param_types[p];
+        }
+        record->defined = f->defined;
+        record->memoize = f->memoize;
+        record->entry = f->entry;
+        record->num_instrs = f->num_instrs;
+        record->num_blocks = f->num_blocks;
+        record->pool_size = f->pool_size;
+        record->rpo_start = f->rpo.start;
+        record->rpo_count = f->rpo.count;
+        record->instrs = place(&end, sizeof(IrInstr) * f->num_instrs);
+        record->blocks = place(&end, sizeof(IrBlock) * f->num_blocks);
+        record->pool = place(&end, sizeof(int) * f->pool_size);
+    }
+    header.globals = place(&end, sizeof(IrGlobal) * module->num_globals);
+    header.string_offsets = place(&end, sizeof(int) * module->num_strings);
+    header.string_lengths = place(&end, sizeof(int) * module->num_strings);
+    header.string_data = place(&end, module->string_size);
+    header.size = end;
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: cannot write program image %s\n", path);
+        free(records);
+        return false;
+    }
+    uint64_t written = 0;
+    bool ok = write_table(file, &written, 0, &header, sizeof(header)) &&
+              write_table(file, &written, header.functions, records, sizeof(ImageFunction) * module->num_functions);
+    for (int id = 0; ok && id < module->num_functions; id++) {
+        const IrFunction *f = &module->functions[id];
+        ok = write_table(file, &written, records[id].instrs, f->instrs, sizeof(IrInstr) * f->num_instrs) &&
+             write_table(file, &written, records[id].blocks, f->blocks, sizeof(IrBlock) * f->num_blocks) &&
+             write_table(file, &written, records[id].pool, f->pool, sizeof(int) * f->pool_size);
+    }
+    size_t string_table_bytes = sizeof(int) * module->num_strings;
+    ok = ok && write_table(file, &written, header.globals, module->globals, sizeof(IrGlobal) * module->num_globals) &&
+         write_table(file, &written, header.string_offsets, module->string_offsets, string_table_bytes) &&
+         write_table(file, &written, header.string_lengths, module->string_lengths, string_table_bytes) &&
+         write_table(file, &written, header.string_data, module->string_data, module->string_size);
+    free(records);
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "Error: cannot write program image %s\n", path);
+        remove(path);
+        return false;
+    }
+    return true;
+}
+
+bool ir_load_image(IrModule *module, const char *path) {
+    ir_module_init(module);
+    image_path = path;
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Error: cannot open program image %s\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    image_size = (size_t)info.st_size;
+    if (image_size < sizeof(ImageHeader)) {
+        close(fd);
+        return reject("too short");
+    }
+    void *image = mmap(NULL, image_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return reject("cannot be mapped");
+    }
+    module->image = image;
+    module->image_size = image_size;
+    if (!open_image(module, image)) {
+        ir_module_free(module);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+#include "logger.h"
+
+// Function inlining over the SSA IR
+//
+// A call to a small function that is not recursive is replaced by a copy of the callee's
+// blocks: the block of the call is split after it, parameters become the arguments, and
+// every return jumps to the second half, where a phi joins the returned values. Values and
+// blocks of the copy get new ids in the caller, so the callee's locals keep apart from the
+// caller's and from other copies of the same function.
+//
+// Inlining runs before the program does, so the profile of a call site is where it lies:
+// calls inside loops are the hot ones, they are inlined first and may bring larger callees.
+// Callees are handled before their callers, a helper of a helper is already in place when
+// the outer helper is copied. Each caller stops growing at a size budget.
+
+#define HOT_CALLEE_SIZE 60      // Instructions of a callee inlined at a call inside a loop
+#define COLD_CALLEE_SIZE 12     // Elsewhere, about what the call itself costs
+#define CALLER_SIZE_BUDGET 4000 // Instructions a caller may grow to by inlining
+
+typedef struct {
+    int call;
+    int depth;          // Loop nesting of the call
+} CallSite;
+
+static IrModule *module;
+static IrFunction *fn;
+static IrInlineStats stats;
+
+static int *sizes;      // Per function, instructions that are not constants or parameters
+static bool *inlinable; // Per function, a candidate callee whatever the call site
+
+/******************************************************/
+/* Candidates */
+
+static int function_size(const IrFunction *f) {
+    int size = 0;
+    for (int b = 0; b < f->num_blocks; b++) {
+        IR_FOR_EACH_INSTR(f, b, i) {
+            if (f->instrs[i].op != IR_CONST && f->instrs[i].op != IR_PARAM) {
+                size++;
+            }
+        }
+    }
+    return size;
+}
+
+// Visits the callees of a function before the function itself
+static void order_calls(int id, bool *visited, int *order, int *num_ordered) {
+    visited[id] = true;
+    const IrFunction *f = &module->functions[id];
+    for (int b = 0; b < f->num_blocks; b++) {
+        IR_FOR_EACH_INSTR(f, b, i) {
+            if (f->instrs[i].op == IR_CALL && !visited[f->instrs[i].imm]) {
+                order_calls((int)f->instrs[i].imm, visited, order, num_ordered);
+            }
+        }
+    }
+    order[(*num_ordered)++] = id;
+}
+
+// Whether the function can end up calling itself
+static bool is_recursive(int id) {
+    int n = module->num_functions;
+    bool *seen = calloc(n, sizeof(bool));
+    int *stack = malloc(sizeof(int) * (n + 1));
+    int top = 0;
+    stack[top++] = id;
+    bool recursive = false;
+    while (top > 0 && !recursive) {
+        const IrFunction *f = &module->functions[stack[--top]];
+        for (int b = 0; b < f->num_blocks; b++) {
+            IR_FOR_EACH_INSTR(f, b, i) {
+                int callee = (int)f->instrs[i].imm;
+                if (f->instrs[i].op != IR_CALL || seen[callee]) {
+                    continue;
+                }
+                recursive |= callee == id;
+                seen[callee] = true;
+                stack[top++] = callee;
+            }
+        }
+    }
+    free(seen);
+    free(stack);
+    return recursive;
+}
+
+// A function can be copied into its callers when it has a body, is not part of a cycle of
+// calls, and keeps no arrays, whose frame space would stay in the caller for good
+static bool can_inline(int id) {
+    const IrFunction *f = &module->functions[id];
+    if (!f->defined || is_recursive(id) || id == module->main_function || id == module->init_function ||
+        f->blocks[f->entry].preds.count > 0) {
+        return false;
+    }
+    bool returns = false;
+    for (int b = 0; b < f->num_blocks; b++) {
+        IR_FOR_EACH_INSTR(f, b, i) {
+            if (f->instrs[i].op == IR_ARRAY) {
+                return false;
+            }
+            returns |= f->instrs[i].op == IR_RETURN;
+        }
+    }
+    return returns;
+}
+
+/******************************************************/
+/* Call sites */
+
+// Loop nesting depth of every block, from the natural loops of the back edges
+static int *loop_depths(void) {
+    int *depth = calloc(fn->num_blocks, sizeof(int));
+    bool *in_loop = malloc(sizeof(bool) * fn->num_blocks);
+    int *stack = malloc(sizeof(int) * (fn->num_blocks + 1));
+    for (int r = 0; r < fn->rpo.count; r++) {
+        int header = fn->pool[fn->rpo.start + r];
+        bool is_header = false;
+        for (int k = 0; k < fn->blocks[header].preds.count; k++) {
+            int latch = ir_pred(fn, header, k);
+            if (!ir_dominates(fn, header, latch)) {
+                continue;
+            }
+            if (!is_header) {
+                memset(in_loop, 0, sizeof(bool) * fn->num_blocks);
+                in_loop[header] = true;
+                is_header = true;
+            }
+            int top = 0;
+            if (!in_loop[latch]) {
+                in_loop[latch] = true;
+                stack[top++] = latch;
+            }
+            while (top > 0) {
+                int b = stack[--top];
+                for (int p = 0; p < fn->blocks[b].preds.count; p++) {
+                    int above = ir_pred(fn, b, p);
+                    if (!in_loop[above] && fn->blocks[above].rpo_index != IR_NONE) {
+                        in_loop[above] = true;
+                        stack[top++] = above;
+                    }
+                }
+            }
+        }
+        if (is_header) {
+            for (int b = 0; b < fn->num_blocks; b++) {
+                depth[b] += in_loop[b];
+            }
+        }
+    }
+    free(in_loop);
+    free(stack);
+    return depth;
+}
+
+static int compare_depth(const void *a, const void *b) {
+    const CallSite *x = a, *y = b;
+    if (x->depth != y->depth) {
+        return y->depth - x->depth;
+    }
+    return x->call - y->call;
+}
+
+/******************************************************/
+/* Copying a callee */
+
+// Points the predecessor lists of the successors of block from old_pred to it, phi operands stay in place
+static void move_edges(int block, int old_pred) {
+    for (int k = 0; k < ir_num_succs(fn, block); k++) {
+        int s = ir_succ(fn, block, k);
+        for (int p = 0; p < fn->blocks[s].preds.count; p++) {
+            if (ir_pred(fn, s, p) == old_pred) {
+                fn->pool[fn->blocks[s].preds.start + p] = block;
+            }
+        }
+    }
+}
+
+// Replaces the call with the body of its callee
+static void inline_call(int call) {
+    const IrFunction *callee = &module->functions[fn->instrs[call].imm];
+    int block = fn->instrs[call].block;
+
+    // The rest of the block continues after the inlined body
+    int after = ir_add_block(fn);
+    while (fn->instrs[call].next != IR_NONE) {
+        int i = fn->instrs[call].next;
+        ir_unlink(fn, i);
+        ir_append(fn, after, i);
+    }
+    move_edges(after, block);
+
+    int *block_map = malloc(sizeof(int) * callee->num_blocks);
+    int *value_map = malloc(sizeof(int) * callee->num_instrs);
+    for (int b = 0; b < callee->num_blocks; b++) {
+        block_map[b] = IR_NONE;
+    }
+    for (int r = 0; r < callee->rpo.count; r++) {
+        block_map[callee->pool[callee->rpo.start + r]] = ir_add_block(fn);
+    }
+
+    // Instructions first, operands once every value has its copy
+    int num_returns = 0;
+    for (int r = 0; r < callee->rpo.count; r++) {
+        int b = callee->pool[callee->rpo.start + r];
+        IR_FOR_EACH_INSTR(callee, b, i) {
+            const IrInstr *in = &callee->instrs[i];
+            value_map[i] = IR_NONE;
+            if (in->op == IR_PARAM) {
+                value_map[i] = ir_operand(fn, call, (int)in->imm);
+                continue;
+            }
+            int copy;
+            if (in->op == IR_RETURN) {
+                copy = ir_new_instr(fn, IR_JUMP, IR_VOID);
+                fn->instrs[copy].targets[0] = after;
+                ir_add_pred(fn, after, block_map[b]);
+                num_returns++;
+            } else {
+                copy = ir_new_instr(fn, in->op, in->type);
+                IrInstr *out = &fn->instrs[copy];
+                out->flags = in->flags;
+                out->imm = in->imm;
+                for (int t = 0; t < 2; t++) {
+                    out->targets[t] = in->targets[t] == IR_NONE ? IR_NONE : block_map[in->targets[t]];
+                }
+            }
+            fn->instrs[copy].line_number = in->line_number;
+            fn->instrs[copy].column_number = in->column_number;
+            ir_append(fn, block_map[b], copy);
+            value_map[i] = copy;
+        }
+    }
+
+    IrType type = fn->instrs[call].type;
+    int result = IR_NONE;
+    bool join = type != IR_VOID && num_returns > 1;
+    if (join) {
+        result = ir_new_instr(fn, IR_PHI, type);
+        ir_prepend(fn, after, result);
+    }
+    for (int r = 0; r < callee->rpo.count; r++) {
+        int b = callee->pool[callee->rpo.start + r];
+        for (int k = 0; k < callee->blocks[b].preds.count; k++) {
+            ir_add_pred(fn, block_map[b], block_map[ir_pred(callee, b, k)]);
+        }
+        IR_FOR_EACH_INSTR(callee, b, i) {
+            if (callee->instrs[i].op == IR_PARAM) {
+                continue;
+            }
+            if (callee->instrs[i].op == IR_RETURN) {
+                // The phi takes the returned values in the order the returns were added as preds
+                if (callee->instrs[i].operands.count == 0 || type == IR_VOID) {
+                    continue;
+                }
+                int value = value_map[ir_operand(callee, i, 0)];
+                if (join) {
+                    ir_add_operand(fn, result, value);
+                } else {
+                    result = value;
+                }
+                continue;
+            }
+            for (int k = 0; k < callee->instrs[i].operands.count; k++) {
+                ir_add_operand(fn, value_map[i], value_map[ir_operand(callee, i, k)]);
+            }
+        }
+    }
+
+    int jump = ir_new_instr(fn, IR_JUMP, IR_VOID);
+    fn->instrs[jump].targets[0] = block_map[callee->entry];
+    ir_append(fn, block, jump);
+    ir_add_pred(fn, block_map[callee->entry], block);
+
+    ir_unlink(fn, call);
+    if (result != IR_NONE) {
+        ir_replace_uses(fn, call, result);
+    }
+    fn->instrs[call].op = IR_NOP;
+
+    free(block_map);
+    free(value_map);
+}
+
+// Joins a block to the one before it when it is that block's only successor and has no other predecessor
+static void merge_blocks(void) {
+    for (int r = 0; r < fn->rpo.count; r++) {
+        int block = fn->pool[fn->rpo.start + r];
+        if (fn->blocks[block].first == IR_NONE) {
+            continue;
+        }
+        for (;;) {
+            int jump = ir_terminator(fn, block);
+            if (jump == IR_NONE || fn->instrs[jump].op != IR_JUMP) {
+                break;
+            }
+            int next = fn->instrs[jump].targets[0];
+            if (next == block || next == fn->entry || fn->blocks[next].preds.count != 1 ||
+                fn->instrs[fn->blocks[next].first].op == IR_PHI) {
+                break;
+            }
+            ir_unlink(fn, jump);
+            fn->instrs[jump].op = IR_NOP;
+            while (fn->blocks[next].first != IR_NONE) {
+                int i = fn->blocks[next].first;
+                ir_unlink(fn, i);
+                ir_append(fn, block, i);
+            }
+            fn->blocks[next].preds.count = 0;
+            move_edges(block, next);
+        }
+    }
+}
+
+/******************************************************/
+
+static void inline_calls(int caller) {
+    fn = &module->functions[caller];
+    if (!fn->defined) {
+        return;
+    }
+    ir_compute_dominators(fn);
+    int *depth = loop_depths();
+
+    CallSite *sites = NULL;
+    int num_sites = 0;
+    for (int r = 0; r < fn->rpo.count; r++) {
+        int b = fn->pool[fn->rpo.start + r];
+        IR_FOR_EACH_INSTR(fn, b, i) {
+            if (fn->instrs[i].op == IR_CALL && inlinable[fn->instrs[i].imm]) {
+                sites = realloc(sites, sizeof(CallSite) * (num_sites + 1));
+                sites[num_sites++] = (CallSite){ i, depth[b] };
+            }
+        }
+    }
+    free(depth);
+    if (num_sites == 0) {
+        return;
+    }
+
+    // The hottest calls get the budget first
+    qsort(sites, num_sites, sizeof(CallSite), compare_depth);
+    int size = sizes[caller];
+    bool changed = false;
+    for (int s = 0; s < num_sites; s++) {
+        int callee = (int)fn->instrs[sites[s].call].imm;
+        int limit = sites[s].depth > 0 ? HOT_CALLEE_SIZE : COLD_CALLEE_SIZE;
+        if (sizes[callee] > limit || size + sizes[callee] > CALLER_SIZE_BUDGET) {
+            stats.skipped++;
+            continue;
+        }
+        log_debug(LOG_IR, "Inlined %s into %s at line %d (%d instructions%s)\n", module->functions[callee].name,
+                  fn->name, fn->instrs[sites[s].call].line_number, sizes[callee],
+                  sites[s].depth > 0 ? ", in a loop" : "");
+        inline_call(sites[s].call);
+        size += sizes[callee];
+        stats.inlined++;
+        stats.added += sizes[callee];
+        changed = true;
+    }
+    free(sites);
+
+    if (changed) {
+        ir_remove_trivial_phis(fn);
+        ir_compute_dominators(fn);
+        merge_blocks();
+        ir_remove_unreachable_blocks(fn);
+        ir_compute_dominators(fn);
+        sizes[caller] = function_size(fn);
+    }
+}
+
+// Inlines small functions at their call sites, callees before callers
+IrInlineStats ir_inline_functions(IrModule *program) {
+    module = program;
+    stats = (IrInlineStats){0};
+    int n = module->num_functions;
+    bool *visited = calloc(n, sizeof(bool));
+    int *order = malloc(sizeof(int) * (n + 1));
+    int num_ordered = 0;
+    sizes = malloc(sizeof(int) * (n + 1));
+    inlinable = malloc(sizeof(bool) * (n + 1));
+
+    for (int f = 0; f < n; f++) {
+        if (!visited[f]) {
+            order_calls(f, visited, order, &num_ordered);
+        }
+        sizes[f] = function_size(&module->functions[f]);
+        inlinable[f] = can_inline(f);
+    }
+    for (int k = 0; k < num_ordered; k++) {
+        inline_calls(order[k]);
+    }
+
+    free(visited);
+    free(order);
+    free(sizes);
+    free(inlinable);
+    sizes = NULL;
+    inlinable = NULL;
+    return stats;
+}
@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+#include "decimal.h"
+
+// Buffered input of running programs (see input.h)
+
+#define INPUT_BUFFER_SIZE (64 * 1024)
+#define MAX_TARGETS 16                  // IR_MAX_PARAMS, the most targets a scanf has
+#define MAX_EXPONENT 100000             // Larger exponents are all zero or infinity
+
+static unsigned char read_buffer[INPUT_BUFFER_SIZE];
+static const unsigned char *input;      // read_buffer, or stdin mapped whole
+static size_t position, length;
+static bool started, mapped, end_of_input;
+
+// Text of the float being read, for the rare conversions decimal.c leaves to strtod()
+static char *token;
+static size_t token_length, token_capacity;
+
+// Plans compiled for input_scanf(), open addressing on the address of the format
+typedef struct {
+    const char *key;
+    ScanPlan *plan;
+} CompiledPlan;
+
+static CompiledPlan *compiled;
+static int num_compiled, compiled_capacity;
+
+/******************************************************/
+/* Compiling formats */
+
+ScanPlan *scan_plan_compile(const char *format, int format_length) {
+    ScanPlan *plan = malloc(sizeof(ScanPlan));
+    ScanStep *steps = malloc(sizeof(ScanStep) * (format_length + 1));
+    if (plan == NULL || steps == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed in scan_plan_compile\n");
+        exit(1);
+    }
+    *plan = (ScanPlan){ steps, 0, 0 };
+
+    for (int i = 0; i < format_length; i++) {
+        char c = format[i];
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            if (plan->num_steps == 0 || steps[plan->num_steps - 1].kind != SCAN_SPACE) {
+                steps[plan->num_steps++] = (ScanStep){ SCAN_SPACE, 0, 0, false, 0 };
+            }
+            continue;
+        }
+        if (c != '%') {
+            steps[plan->num_steps++] = (ScanStep){ SCAN_MATCH, c, 0, false, 0 };
+            continue;
+        }
+
+        i++;
+        int width = 0;
+        while (i < format_length && format[i] >= '0' && format[i] <= '9') {
+            width = width < 100000 ? width * 10 + (format[i] - '0') : width;
+            i++;
+        }
+        while (i < format_length && (format[i] == 'l' || format[i] == 'h')) {
+            i++;
+        }
+        if (i >= format_length) {
+            break;
+        }
+        ScanStep step = { SCAN_INT, 0, 10, false, width };
+        switch (format[i]) {
+            case '%':
+                // "%%" skips white space like a conversion, then matches the '%'
+                steps[plan->num_steps++] = (ScanStep){ SCAN_SPACE, 0, 0, false, 0 };
+                step = (ScanStep){ SCAN_MATCH, '%', 0, false, 0 };
+                break;
+            case 'd': break;
+            case 'u': step.is_unsigned = true; break;
+            case 'x': step.base = 16; break;
+            case 'i': step.base = 0; break;
+            case 'f': case 'g': case 'e': step.kind = SCAN_FLOAT; break;
+            case 'c': step.kind = SCAN_CHAR; break;
+            default: step.kind = SCAN_FAIL; break;        // Flags, which scanf does not have
+        }
+        steps[plan->num_steps++] = step;
+        plan->num_targets += step.kind == SCAN_INT || step.kind == SCAN_FLOAT || step.kind == SCAN_CHAR;
+        if (step.kind == SCAN_FAIL) {
+            break;
+        }
+    }
+    return plan;
+}
+
+void scan_plan_free(ScanPlan *plan) {
+    if (plan != NULL) {
+        free(plan->steps);
+        free(plan);
+    }
+}
+
+/******************************************************/
+/* Reading */
+
+static void start_input(void) {
+    started = true;
+    input = read_buffer;
+    position = length = 0;
+    // A regular file is mapped whole and read from where stdin is now
+    struct stat info;
+    if (fstat(STDIN_FILENO, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        return;
+    }
+    off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    if (offset < 0 || offset >= info.st_size) {
+        return;
+    }
+    void *memory = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+    if (memory == MAP_FAILED) {
+        return;
+    }
+    madvise(memory, (size_t)info.st_size, MADV_SEQUENTIAL);
+    input = memory;
+    position = (size_t)offset;
+    length = (size_t)info.st_size;
+    mapped = true;
+}
+
+static bool refill(void) {
+    if (mapped || end_of_input) {
+        return false;
+    }
+    ssize_t got;
+    do {
+        got = read(STDIN_FILENO, read_buffer, sizeof(read_buffer));
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0) {
+        end_of_input = true;
+        return false;
+    }
+    position = 0;
+    length = (size_t)got;
+    return true;
+}
+
+// Next character, EOF at the end of the input, or when width characters have been read
+static inline int peek(const int *remaining) {
+    if (*remaining == 0) {
+        return EOF;
+    }
+    if (position == length && !refill()) {
+        return EOF;
+    }
+    return input[position];
+}
+
+static inline void advance(int *remaining) {
+    position++;
+    (*remaining)--;
+}
+
+static void skip_space(void) {
+    int unlimited = -1;
+    for (int c = peek(&unlimited); c == ' ' || (c >= '\t' && c <= '\r'); c = peek(&unlimited)) {
+        position++;
+    }
+}
+
+static int digit_value(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+    return 99;
+}
+
+// Like strtoll(), or strtoull() for %u, over as much as the width allows
+static bool scan_int(const ScanStep *step, long long *target) {
+    int remaining = step->width > 0 ? step->width : -1;
+    int base = step->base;
+    int c = peek(&remaining);
+    bool negative = c == '-';
+    if (c == '-' || c == '+') {
+        advance(&remaining);
+        c = peek(&remaining);
+    }
+
+    bool digits = false;
+    if (c == '0' && (base == 0 || base == 16)) {
+        // A "0x" prefix for %x and %i, a leading zero is octal for %i
+        digits = true;
+        advance(&remaining);
+        c = peek(&remaining);
+        if (c == 'x' || c == 'X') {
+            base = 16;
+            advance(&remaining);
+            c = peek(&remaining);
+        } else if (base == 0) {
+            base = 8;
+        }
+    }
+    if (base == 0) {
+        base = 10;
+    }
+
+    uint64_t magnitude = 0;
+    bool overflow = false;
+    for (int d = digit_value(c); c != EOF && d < base; d = digit_value(c)) {
+        if (magnitude > (UINT64_MAX - (uint64_t)d) / (uint64_t)base) {
+            overflow = true;
+        } else {
+            magnitude = magnitude * (uint64_t)base + (uint64_t)d;
+        }
+        digits = true;
+        advance(&remaining);
+        c = peek(&remaining);
+    }
+    if (!digits) {
+        return false;
+    }
+
+    if (step->is_unsigned) {
+        *target = (long long)(overflow ? UINT64_MAX : negative ? 0 - magnitude : magnitude);
+    } else if (negative) {
+        *target = overflow || magnitude > (uint64_t)INT64_MAX + 1 ? INT64_MIN : (long long)(0 - magnitude);
+    } else {
+        *target = overflow || magnitude > INT64_MAX ? INT64_MAX : (long long)magnitude;
+    }
+    return true;
+}
+
+static void keep(int c) {
+    if (token_length + 2 > token_capacity) {
+        token_capacity = token_capacity ? token_capacity * 2 : 256;
+        token = realloc(token, token_capacity);
+        if (token == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed in scan_float\n");
+            exit(1);
+        }
+    }
+    token[token_length++] = (char)c;
+    token[token_length] = '\0';
+}
+
+// Matches the letters of a word in any case, what was read is gone when it does not match
+static bool match_word(const char *word, int *remaining) {
+    for (; *word != '\0'; word++) {
+        int c = peek(remaining);
+        if (c == EOF || (c | 0x20) != *word) {
+            return false;
+        }
+        advance(remaining);
+    }
+    return true;
+}
+
+// Like strtod(): decimal with an exponent, hexadecimal, inf, infinity and nan. An exponent
+// without digits is read and left out, as the C library does.
+static bool scan_float(const ScanStep *step, double *target) {
+    int remaining = step->width > 0 ? step->width : -1;
+    int c = peek(&remaining);
+    bool negative = c == '-';
+    if (c == '-' || c == '+') {
+        advance(&remaining);
+        c = peek(&remaining);
+    }
+
+    double value;
+    if (c == 'i' || c == 'I') {
+        if (!match_word("inf", &remaining)) {
+            return false;
+        }
+        c = peek(&remaining);
+        if ((c == 'i' || c == 'I') && !match_word("inity", &remaining)) {
+            return false;
+        }
+        value = INFINITY;
+    } else if (c == 'n' || c == 'N') {
+        if (!match_word("nan", &remaining)) {
+            return false;
+        }
+        value = NAN;
+    } else {
+        token_length = 0;
+        bool digits = false;
+        if (c == '0') {
+            digits = true;
+            keep(c);
+            advance(&remaining);
+            c = peek(&remaining);
+            if (c == 'x' || c == 'X') {
+                // Hexadecimal is exact, strtod() converts what is read
+                keep(c);
+                advance(&remaining);
+                c = peek(&remaining);
+                digits = false;
+                bool point = false;
+                while (c != EOF && (digit_value(c) < 16 || (c == '.' && !point))) {
+                    digits |= c != '.';
+                    point |= c == '.';
+                    keep(c);
+                    advance(&remaining);
+                    c = peek(&remaining);
+                }
+                if (!digits) {
+                    return false;
+                }
+                if (c == 'p' || c == 'P') {
+                    keep(c);
+                    advance(&remaining);
+                    c = peek(&remaining);
+                    if (c == '-' || c == '+') {
+                        keep(c);
+                        advance(&remaining);
+                        c = peek(&remaining);
+                    }
+                    while (c >= '0' && c <= '9') {
+                        keep(c);
+                        advance(&remaining);
+                        c = peek(&remaining);
+                    }
+                }
+                value = strtod(token, NULL);
+                *target = negative ? -value : value;
+                return true;
+            }
+        }
+
+        // The first 19 significant digits and the power of ten, as in the scanner
+        uint64_t mantissa = 0;
+        int significant = 0, exponent = 0;
+        bool point = false, truncated = false;
+        while ((c >= '0' && c <= '9') || (c == '.' && !point)) {
+            keep(c);
+            if (c == '.') {
+                point = true;
+            } else {
+                int digit = c - '0';
+                digits = true;
+                if (mantissa == 0 && digit == 0) {
+                    exponent -= point;
+                } else if (significant < 19) {
+                    mantissa = mantissa * 10 + (uint64_t)digit;
+                    significant++;
+                    exponent -= point;
+                } else {
+                    exponent += !point;
+                    truncated |= digit != 0;
+                }
+            }
+            advance(&remaining);
+            c = peek(&remaining);
+        }
+        if (!digits) {
+            return false;
+        }
+        if (c == 'e' || c == 'E') {
+            keep(c);
+            advance(&remaining);
+            c = peek(&remaining);
+            bool negative_exponent = c == '-';
+            if (c == '-' || c == '+') {
+                keep(c);
+                advance(&remaining);
+                c = peek(&remaining);
+            }
+            int explicit_exponent = 0;
+            while (c >= '0' && c <= '9') {
+                keep(c);
+                if (explicit_exponent < MAX_EXPONENT) {
+                    explicit_exponent = explicit_exponent * 10 + (c - '0');
+                }
+                advance(&remaining);
+                c = peek(&remaining);
+            }
+            exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+        }
+        value = decimal_to_double(mantissa, exponent, truncated, token);
+    }
+    *target = negative ? -value : value;
+    return true;
+}
+
+int input_scan(const ScanPlan *plan, ScanTarget *targets) {
+    if (!started) {
+        start_input();
+    }
+    int stored = 0;
+    for (int s = 0; s < plan->num_steps; s++) {
+        const ScanStep *step = &plan->steps[s];
+        if (step->kind == SCAN_SPACE) {
+            skip_space();
+            continue;
+        }
+        if (step->kind == SCAN_FAIL) {
+            return stored;
+        }
+        if (step->kind != SCAN_MATCH && step->kind != SCAN_CHAR) {
+            skip_space();
+        }
+        int unlimited = -1;
+        if (peek(&unlimited) == EOF) {
+            return stored == 0 ? -1 : stored;
+        }
+
+        bool done;
+        switch (step->kind) {
+            case SCAN_MATCH:
+                done = input[position] == (unsigned char)step->character;
+                position += done;
+                if (!done) {
+                    return stored;
+                }
+                continue;
+            case SCAN_CHAR: {
+                // Only the first of a wider %c has somewhere to go
+                *(char *)targets[stored] = (char)input[position++];
+                for (int k = 1; k < step->width && peek(&unlimited) != EOF; k++) {
+                    position++;
+                }
+                done = true;
+                break;
+            }
+            case SCAN_INT:
+                done = scan_int(step, targets[stored]);
+                break;
+            default:
+                done = scan_float(step, targets[stored]);
+                break;
+        }
+        if (!done) {
+            return stored;
+        }
+        stored++;
+    }
+    return stored;
+}
+
+/******************************************************/
+/* Library function for compiled code */
+
+static ScanPlan *compiled_plan(const char *format) {
+    if (2 * (num_compiled + 1) > compiled_capacity) {
+        CompiledPlan *old = compiled;
+        int old_capacity = compiled_capacity;
+        compiled_capacity = compiled_capacity ? compiled_capacity * 2 : 16;
+        compiled = calloc((size_t)compiled_capacity, sizeof(CompiledPlan));
+        if (compiled == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed in compiled_plan\n");
+            exit(1);
+        }
+        num_compiled = 0;
+        for (int i = 0; i < old_capacity; i++) {
+            if (old[i].key != NULL) {
+                int slot = (int)(((uintptr_t)old[i].key >> 4) & (uintptr_t)(compiled_capacity - 1));
+                while (compiled[slot].key != NULL) {
+                    slot = (slot + 1) & (compiled_capacity - 1);
+                }
+                compiled[slot] = old[i];
+                num_compiled++;
+            }
+        }
+        free(old);
+    }
+
+    int slot = (int)(((uintptr_t)format >> 4) & (uintptr_t)(compiled_capacity - 1));
+    while (compiled[slot].key != NULL && compiled[slot].key != format) {
+        slot = (slot + 1) & (compiled_capacity - 1);
+    }
+    if (compiled[slot].key == NULL) {
+        compiled[slot].key = format;
+        compiled[slot].plan = scan_plan_compile(format, (int)strlen(format));
+        num_compiled++;
+    }
+    return compiled[slot].plan;
+}
+
+int input_scanf(const char *format, ...) {
+    const ScanPlan *plan = compiled_plan(format);
+    ScanTarget targets[MAX_TARGETS];
+    va_list list;
+    va_start(list, format);
+    for (int k = 0; k < plan->num_targets && k < MAX_TARGETS; k++) {
+        targets[k] = va_arg(list, void *);
+    }
+    va_end(list);
+    return input_scan(plan, targets);
+}
+
+void input_end(void) {
+    if (mapped) {
+        // Whoever reads stdin next starts after what the program read
+        lseek(STDIN_FILENO, (off_t)position, SEEK_SET);
+        munmap((void *)input, length);
+    }
+    started = mapped = end_of_input = false;
+    input = NULL;
+    position = length = 0;
+    free(token);
+    token = NULL;
+    token_length = token_capacity = 0;
+    for (int i = 0; i < compiled_capacity; i++) {
+        scan_plan_free(compiled[i].plan);
+    }
+    free(compiled);
+    compiled = NULL;
+    num_compiled = compiled_capacity = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+
+// Buffered input of running programs (input.c)
+//
+// A scanf format is compiled once into a plan: skip white space, match a character, or
+// convert an int, a float or a char into the next target. Plans run over standard input
+// mapped whole when it is a regular file, or read through a 64 KB buffer otherwise, with
+// hand-written number parsers; floats go through decimal.c and are correctly rounded. What
+// is read and returned follows the C library: a conversion skips white space before it, a
+// failed one leaves its target alone and ends the scanf, and the result is the number of
+// targets stored, or -1 if input ended before the first one.
+//
+// The IR interpreter compiles the formats of its module. Code compiled by the JIT calls
+// input_scanf() with the format codegen.c made for the C library, compiled the first time
+// and found by its address after that.
+
+typedef enum {
+    SCAN_SPACE,         // Any amount of white space, also none
+    SCAN_MATCH,         // One given character
+    SCAN_INT,
+    SCAN_FLOAT,
+    SCAN_CHAR,
+    SCAN_FAIL,          // A specification the C library does not take, ends the scanf
+} ScanStepKind;
+
+typedef struct {
+    ScanStepKind kind;
+    char character;     // SCAN_MATCH
+    int base;           // SCAN_INT: 10, 16, 8 or 0 to go by the prefix like %i
+    bool is_unsigned;   // SCAN_INT for %u, negative numbers wrap around
+    int width;          // Most characters read, 0 for no limit
+} ScanStep;
+
+typedef struct {
+    ScanStep *steps;
+    int num_steps;
+    int num_targets;
+} ScanPlan;
+
+// Where a conversion stores its value: long long for SCAN_INT, double for SCAN_FLOAT, char for SCAN_CHAR
+typedef void *ScanTarget;
+
+ScanPlan *scan_plan_compile(const char *format, int length);
+void scan_plan_free(ScanPlan *plan);
+int input_scan(const ScanPlan *plan, ScanTarget *targets);
+// Gives back what a mapped stdin did not read and forgets the formats of input_scanf()
+void input_end(void);
+
+// Library function for compiled code
+int input_scanf(const char *format, ...);
+
+#endif //INPUT_H
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "instrument.h"
+
+// Phase timers and counters, written as JSON at exit (see instrument.h)
+
+#ifdef CORE_STATS
+
+#define MAX_PHASES 32
+#define MAX_RULES 64
+
+typedef struct {
+    const char *name;
+    int calls;
+    double wall;
+    double cpu;
+} Phase;
+
+unsigned long long stat_counters[STAT_COUNTER_COUNT];
+unsigned long long stat_rule_calls[MAX_RULES + 1];     // The last one collects rules past MAX_RULES
+
+static const char *counter_names[STAT_COUNTER_COUNT] = {
+    "bytes", "lines", "tokens", "comments", "lexical_errors", "nodes", "allocations",
+    "allocated_bytes", "frees", "ir_instructions", "executed_instructions", "memo_calls", "memo_hits"
+};
+
+static const char *tool_name;
+static StatTime process_start;
+static Phase phases[MAX_PHASES];
+static int num_phases;
+static const char *rule_names[MAX_RULES];
+static int num_rules;
+
+static double seconds(clockid_t clock) {
+    struct timespec time;
+    clock_gettime(clock, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+StatTime stats_now(void) {
+    return (StatTime){ seconds(CLOCK_MONOTONIC), seconds(CLOCK_PROCESS_CPUTIME_ID) };
+}
+
+// Adds the time since start to the phase, a phase that runs more than once adds up
+void stats_phase(const char *name, StatTime start) {
+    StatTime end = stats_now();
+    int p = 0;
+    while (p < num_phases && strcmp(phases[p].name, name) != 0) {
+        p++;
+    }
+    if (p == num_phases) {
+        if (num_phases == MAX_PHASES) {
+            return;
+        }
+        phases[num_phases++].name = name;
+    }
+    phases[p].calls++;
+    phases[p].wall += end.wall - start.wall;
+    phases[p].cpu += end.cpu - start.cpu;
+}
+
+int stats_register_rule(const char *name) {
+    if (num_rules == MAX_RULES) {
+        return MAX_RULES;
+    }
+    rule_names[num_rules] = name;
+    return num_rules++;
+}
+
+static void dump(void) {
+    const char *path = getenv("CORE_STATS");
+    if (path == NULL || *path == '\0') {
+        return;
+    }
+    StatTime end = stats_now();
+    FILE *out = strcmp(path, "-") == 0 ? stderr : fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Error: cannot write statistics to %s\n", path);
+        return;
+    }
+
+    fprintf(out, "{\n  \"tool\": \"%s\",\n", tool_name);
+    fprintf(out, "  \"wall_ms\": %.3f,\n  \"cpu_ms\": %.3f,\n",
+            (end.wall - process_start.wall) * 1e3, (end.cpu - process_start.cpu) * 1e3);
+    fputs("  \"phases\": [", out);
+    for (int p = 0; p < num_phases; p++) {
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"calls\": %d, \"wall_ms\": %.3f, \"cpu_ms\": %.3f}",
+                p ? "," : "", phases[p].name, phases[p].calls, phases[p].wall * 1e3, phases[p].cpu * 1e3);
+    }
+    fputs(num_phases ? "\n  ],\n" : "],\n", out);
+    fputs("  \"counters\": {", out);
+    bool first = true;
+    for (int c = 0; c < STAT_COUNTER_COUNT; c++) {
+        if (stat_counters[c] != 0) {
+            fprintf(out, "%s\n    \"%s\": %llu", first ? "" : ",", counter_names[c], stat_counters[c]);
+            first = false;
+        }
+    }
+    fputs(first ? "},\n" : "\n  },\n", out);
+    fputs("  \"rules\": {", out);
+    for (int r = 0; r < num_rules; r++) {
+        fprintf(out, "%s\n    \"%s\": %llu", r ? "," : "", rule_names[r], stat_rule_calls[r]);
+    }
+    if (stat_rule_calls[MAX_RULES] != 0) {
+        fprintf(out, "%s\n    \"other\": %llu", num_rules ? "," : "", stat_rule_calls[MAX_RULES]);
+    }
+    fputs(num_rules ? "\n  }\n}\n" : "}\n}\n", out);
+    if (out != stderr) {
+        fclose(out);
+    }
+}
+
+// Starts the clock for the whole run and writes the statistics at exit
+void stats_init(const char *tool) {
+    tool_name = tool;
+    process_start = stats_now();
+    atexit(dump);
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+// Phase timers and counters shared by the scanner and the parser (instrument.c)
+//
+// Built with CORE_STATS defined (the default, see CMakeLists.txt) every tool keeps wall and
+// CPU time per phase, a few counters and how often each parse_* rule was called. A counter
+// is one add to a global and a phase two clock reads, so they stay on all the time. The
+// numbers are only written, as JSON, when the program exits with CORE_STATS set in the
+// environment to a file name, or to "-" for stderr. Without CORE_STATS defined all of it
+// compiles to nothing.
+
+typedef enum {
+    STAT_BYTES,                 // Source characters read by the scanner
+    STAT_LINES,
+    STAT_TOKENS,
+    STAT_COMMENTS,
+    STAT_LEXICAL_ERRORS,
+    STAT_NODES,                 // Parse tree nodes created
+    STAT_ALLOCATIONS,
+    STAT_ALLOCATED_BYTES,
+    STAT_FREES,
+    STAT_IR_INSTRUCTIONS,
+    STAT_EXECUTED_INSTRUCTIONS,
+    STAT_MEMO_CALLS,            // Interpreted calls of memoized functions
+    STAT_MEMO_HITS,             // Of them answered from the cache
+    STAT_COUNTER_COUNT
+} StatCounter;
+
+typedef struct {
+    double wall;
+    double cpu;
+} StatTime;
+
+#ifdef CORE_STATS
+
+extern unsigned long long stat_counters[STAT_COUNTER_COUNT];
+extern unsigned long long stat_rule_calls[];
+
+void stats_init(const char *tool);
+StatTime stats_now(void);
+void stats_phase(const char *name, StatTime start);
+int stats_register_rule(const char *name);
+
+#define STAT_ADD(counter, n) (stat_counters[counter] += (unsigned long long)(n))
+#define STAT_SET(counter, n) (stat_counters[counter] = (unsigned long long)(n))
+
+// Counts a call of the enclosing parse_* function, the rule is registered on its first call
+#define STAT_RULE()                                         \
+    do {                                                    \
+        static int stat_rule_ = -1;                         \
+        if (stat_rule_ < 0) {                               \
+            stat_rule_ = stats_register_rule(__func__);     \
+        }                                                   \
+        stat_rule_calls[stat_rule_]++;                      \
+    } while (0)
+
+#else
+
+static inline void stats_init(const char *tool) { (void)tool; }
+static inline StatTime stats_now(void) { return (StatTime){ 0, 0 }; }
+static inline void stats_phase(const char *name, StatTime start) { (void)name; (void)start; }
+
+#define STAT_ADD(counter, n) ((void)0)
+#define STAT_SET(counter, n) ((void)0)
+#define STAT_RULE() ((void)0)
+
+#endif
+
+#endif //INSTRUMENT_H
@@ -0,0 +1,717 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "ir.h"
+
+#define IR_ARENA_CHUNK_SIZE (64 * 1024)
+
+static const char *opcode_names[IR_OPCODE_COUNT] = {
+    [IR_NOP] = "nop",
+    [IR_CONST] = "const",
+    [IR_PARAM] = "param",
+    [IR_PHI] = "phi",
+    [IR_ADD] = "add",
+    [IR_SUB] = "sub",
+    [IR_MUL] = "mul",
+    [IR_DIV] = "div",
+    [IR_MOD] = "mod",
+    [IR_POW] = "pow",
+    [IR_NEG] = "neg",
+    [IR_NOT] = "not",
+    [IR_EQ] = "eq",
+    [IR_NE] = "ne",
+    [IR_LT] = "lt",
+    [IR_LE] = "le",
+    [IR_GT] = "gt",
+    [IR_GE] = "ge",
+    [IR_CONVERT] = "convert",
+    [IR_CALL] = "call",
+    [IR_ARRAY] = "array",
+    [IR_GLOBAL] = "global",
+    [IR_LOAD] = "load",
+    [IR_STORE] = "store",
+    [IR_PRINTF] = "printf",
+    [IR_SCANF] = "scanf",
+    [IR_SCAN_VALUE] = "scan_value",
+    [IR_VECTOR] = "vector",
+    [IR_PARALLEL] = "parallel",
+    [IR_JUMP] = "jump",
+    [IR_BRANCH] = "branch",
+    [IR_RETURN] = "return",
+};
+
+static const char *type_names[] = { "void", "int", "float" };
+
+/******************************************************/
+/* Arena */
+
+void *ir_arena_alloc(IrArena *arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    IrArenaChunk *chunk = arena->chunks;
+    if (chunk == NULL || chunk->used + size > chunk->size) {
+        size_t chunk_size = size > IR_ARENA_CHUNK_SIZE ? size : IR_ARENA_CHUNK_SIZE;
+        chunk = malloc(sizeof(IrArenaChunk) + chunk_size);
+        if (!chunk) {
+            fprintf(stderr, "Error: Memory allocation failed in ir_arena_alloc\n");
+            exit(1);
+        }
+        chunk->next = arena->chunks;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        arena->chunks = chunk;
+        arena->total_bytes += sizeof(IrArenaChunk) + chunk_size;
+    }
+    void *memory = chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+// Grows a table inside the arena, the old copy stays allocated until the module is freed
+static void *arena_grow(IrArena *arena, void *old, size_t old_size, size_t new_size) {
+    void *memory = ir_arena_alloc(arena, new_size);
+    if (old_size > 0) {
+        memcpy(memory, old, old_size);
+    }
+    return memory;
+}
+
+#define GROW_TABLE(arena, table, count, capacity) \
+    do { \
+        if ((count) == (capacity)) { \
+            int new_capacity = (capacity) ? (capacity) * 2 : 8; \
+            (table) = arena_grow((arena), (table), sizeof(*(table)) * (capacity), \
+                                 sizeof(*(table)) * new_capacity); \
+            (capacity) = new_capacity; \
+        } \
+    } while (0)
+
+void ir_module_init(IrModule *module) {
+    memset(module, 0, sizeof(*module));
+    module->init_function = IR_NONE;
+    module->main_function = IR_NONE;
+}
+
+void ir_module_free(IrModule *module) {
+    IrArenaChunk *chunk = module->arena.chunks;
+    while (chunk) {
+        IrArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    if (module->image != NULL) {
+        munmap(module->image, module->image_size);
+    }
+    memset(module, 0, sizeof(*module));
+}
+
+/******************************************************/
+/* Module tables */
+
+int ir_add_function(IrModule *module, const char *name, IrType return_type, int num_params) {
+    GROW_TABLE(&module->arena, module->functions, module->num_functions, module->functions_capacity);
+    IrFunction *f = &module->functions[module->num_functions];
+    memset(f, 0, sizeof(*f));
+    strncpy(f->name, name, IR_NAME_LENGTH - 1);
+    f->return_type = return_type;
+    f->num_params = num_params;
+    f->arena = &module->arena;
+    f->entry = IR_NONE;
+    return module->num_functions++;
+}
+
+int ir_find_function(const IrModule *module, const char *name) {
+    for (int i = 0; i < module->num_functions; i++) {
+        if (strcmp(module->functions[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return IR_NONE;
+}
+
+int ir_add_global(IrModule *module, const char *name, IrType type, int length, bool is_array) {
+    GROW_TABLE(&module->arena, module->globals, module->num_globals, module->globals_capacity);
+    IrGlobal *global = &module->globals[module->num_globals];
+    memset(global, 0, sizeof(*global));
+    strncpy(global->name, name, IR_NAME_LENGTH - 1);
+    global->type = type;
+    global->length = length;
+    global->is_array = is_array;
+    return module->num_globals++;
+}
+
+int ir_add_string(IrModule *module, const char *bytes, int length) {
+    while (module->string_size + length + 1 > module->string_capacity) {
+        int new_capacity = module->string_capacity ? module->string_capacity * 2 : 256;
+        module->string_data = arena_grow(&module->arena, module->string_data,
+                                         module->string_capacity, new_capacity);
+        module->string_capacity = new_capacity;
+    }
+    if (module->num_strings == module->strings_capacity) {
+        int new_capacity = module->strings_capacity ? module->strings_capacity * 2 : 8;
+        module->string_offsets = arena_grow(&module->arena, module->string_offsets,
+                                            sizeof(int) * module->strings_capacity, sizeof(int) * new_capacity);
+        module->string_lengths = arena_grow(&module->arena, module->string_lengths,
+                                            sizeof(int) * module->strings_capacity, sizeof(int) * new_capacity);
+        module->strings_capacity = new_capacity;
+    }
+
+    // Keep a terminating NUL so strings can also be used with C functions
+    memcpy(module->string_data + module->string_size, bytes, length);
+    module->string_data[module->string_size + length] = '\0';
+    module->string_offsets[module->num_strings] = module->string_size;
+    module->string_lengths[module->num_strings] = length;
+    module->string_size += length + 1;
+    return module->num_strings++;
+}
+
+const char *ir_string(const IrModule *module, int id, int *length) {
+    if (length) {
+        *length = module->string_lengths[id];
+    }
+    return module->string_data + module->string_offsets[id];
+}
+
+/******************************************************/
+/* Blocks and instructions */
+
+int ir_add_block(IrFunction *f) {
+    GROW_TABLE(f->arena, f->blocks, f->num_blocks, f->blocks_capacity);
+    f->blocks[f->num_blocks] = (IrBlock){
+        .first = IR_NONE,
+        .last = IR_NONE,
+        .idom = IR_NONE,
+        .rpo_index = IR_NONE,
+    };
+    return f->num_blocks++;
+}
+
+int ir_new_instr(IrFunction *f, IrOpcode op, IrType type) {
+    GROW_TABLE(f->arena, f->instrs, f->num_instrs, f->instrs_capacity);
+    f->instrs[f->num_instrs] = (IrInstr){
+        .op = op,
+        .type = type,
+        .block = IR_NONE,
+        .prev = IR_NONE,
+        .next = IR_NONE,
+        .targets = { IR_NONE, IR_NONE },
+    };
+    return f->num_instrs++;
+}
+
+static int pool_reserve(IrFunction *f, int count) {
+    while (f->pool_size + count > f->pool_capacity) {
+        int new_capacity = f->pool_capacity ? f->pool_capacity * 2 : 64;
+        f->pool = arena_grow(f->arena, f->pool, sizeof(int) * f->pool_capacity, sizeof(int) * new_capacity);
+        f->pool_capacity = new_capacity;
+    }
+    int start = f->pool_size;
+    f->pool_size += count;
+    return start;
+}
+
+static void list_push(IrFunction *f, IrList *list, int value) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 2;
+        int start = pool_reserve(f, capacity);
+        memmove(&f->pool[start], &f->pool[list->start], sizeof(int) * list->count);
+        list->start = start;
+        list->capacity = capacity;
+    }
+    f->pool[list->start + list->count++] = value;
+}
+
+static void list_remove_at(IrFunction *f, IrList *list, int k) {
+    int *items = &f->pool[list->start];
+    memmove(&items[k], &items[k + 1], sizeof(int) * (list->count - k - 1));
+    list->count--;
+}
+
+void ir_append(IrFunction *f, int block, int instr) {
+    IrBlock *b = &f->blocks[block];
+    IrInstr *in = &f->instrs[instr];
+    in->block = block;
+    in->prev = b->last;
+    in->next = IR_NONE;
+    if (b->last != IR_NONE) {
+        f->instrs[b->last].next = instr;
+    } else {
+        b->first = instr;
+    }
+    b->last = instr;
+}
+
+void ir_prepend(IrFunction *f, int block, int instr) {
+    IrBlock *b = &f->blocks[block];
+    if (b->first == IR_NONE) {
+        ir_append(f, block, instr);
+        return;
+    }
+    ir_insert_before(f, b->first, instr);
+}
+
+void ir_insert_before(IrFunction *f, int before, int instr) {
+    IrInstr *at = &f->instrs[before];
+    IrInstr *in = &f->instrs[instr];
+    in->block = at->block;
+    in->next = before;
+    in->prev = at->prev;
+    if (at->prev != IR_NONE) {
+        f->instrs[at->prev].next = instr;
+    } else {
+        f->blocks[at->block].first = instr;
+    }
+    at->prev = instr;
+}
+
+void ir_unlink(IrFunction *f, int instr) {
+    IrInstr *in = &f->instrs[instr];
+    IrBlock *b = &f->blocks[in->block];
+    if (in->prev != IR_NONE) {
+        f->instrs[in->prev].next = in->next;
+    } else {
+        b->first = in->next;
+    }
+    if (in->next != IR_NONE) {
+        f->instrs[in->next].prev = in->prev;
+    } else {
+        b->last = in->prev;
+    }
+    in->prev = in->next = IR_NONE;
+    in->block = IR_NONE;
+}
+
+void ir_add_operand(IrFunction *f, int instr, int value) {
+    list_push(f, &f->instrs[instr].operands, value);
+}
+
+void ir_set_operand(IrFunction *f, int instr, int k, int value) {
+    f->pool[f->instrs[instr].operands.start + k] = value;
+}
+
+void ir_add_pred(IrFunction *f, int block, int pred) {
+    list_push(f, &f->blocks[block].preds, pred);
+}
+
+// Removes an edge from the predecessor list along with the matching phi operands
+void ir_remove_pred(IrFunction *f, int block, int pred) {
+    int k = ir_pred_index(f, block, pred);
+    if (k == IR_NONE) {
+        return;
+    }
+    list_remove_at(f, &f->blocks[block].preds, k);
+    IR_FOR_EACH_INSTR(f, block, i) {
+        if (f->instrs[i].op != IR_PHI) {
+            break;
+        }
+        list_remove_at(f, &f->instrs[i].operands, k);
+    }
+}
+
+int ir_terminator(const IrFunction *f, int block) {
+    int last = f->blocks[block].last;
+    if (last != IR_NONE && ir_is_terminator(f->instrs[last].op)) {
+        return last;
+    }
+    return IR_NONE;
+}
+
+int ir_num_succs(const IrFunction *f, int block) {
+    int terminator = ir_terminator(f, block);
+    if (terminator == IR_NONE) {
+        return 0;
+    }
+    switch (f->instrs[terminator].op) {
+        case IR_JUMP: return 1;
+        case IR_BRANCH: return 2;
+        default: return 0;
+    }
+}
+
+int ir_succ(const IrFunction *f, int block, int k) {
+    return f->instrs[ir_terminator(f, block)].targets[k];
+}
+
+int ir_pred_index(const IrFunction *f, int block, int pred) {
+    for (int k = 0; k < f->blocks[block].preds.count; k++) {
+        if (ir_pred(f, block, k) == pred) {
+            return k;
+        }
+    }
+    return IR_NONE;
+}
+
+/******************************************************/
+/* Cleanups */
+
+void ir_replace_uses(IrFunction *f, int old_value, int new_value) {
+    for (int b = 0; b < f->num_blocks; b++) {
+        IR_FOR_EACH_INSTR(f, b, i) {
+            IrInstr *in = &f->instrs[i];
+            for (int k = 0; k < in->operands.count; k++) {
+                if (f->pool[in->operands.start + k] == old_value) {
+                    f->pool[in->operands.start + k] = new_value;
+                }
+            }
+        }
+    }
+}
+
+// Removes phis whose operands are all the same value or the phi itself,
+// the SSA construction in lower.c creates them freely while sealing blocks
+void ir_remove_trivial_phis(IrFunction *f) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 0; b < f->num_blocks; b++) {
+            int i = f->blocks[b].first;
+            while (i != IR_NONE && f->instrs[i].op == IR_PHI) {
+                int next = f->instrs[i].next;
+                int same = IR_NONE;
+                bool trivial = true;
+                for (int k = 0; k < f->instrs[i].operands.count; k++) {
+                    int value = ir_operand(f, i, k);
+                    if (value == i || value == same) {
+                        continue;
+                    }
+                    if (same != IR_NONE) {
+                        trivial = false;
+                        break;
+                    }
+                    same = value;
+                }
+                if (trivial) {
+                    if (same == IR_NONE) {
+                        // Only reachable through itself, the value is never defined
+                        same = ir_new_instr(f, IR_CONST, f->instrs[i].type);
+                        ir_prepend(f, f->entry, same);
+                    }
+                    ir_unlink(f, i);
+                    f->instrs[i].op = IR_NOP;
+                    ir_replace_uses(f, i, same);
+                    changed = true;
+                }
+                i = next;
+            }
+        }
+    }
+}
+
+// Empties the blocks that cannot be reached from the entry block, the block ids stay valid
+// Removes instructions whose value is never used and that have no side effects
+void ir_remove_dead_values(IrFunction *f) {
+    int *uses = calloc(f->num_instrs + 1, sizeof(int));
+    for (int b = 0; b < f->num_blocks; b++) {
+        IR_FOR_EACH_INSTR(f, b, i) {
+            for (int k = 0; k < f->instrs[i].operands.count; k++) {
+                uses[ir_operand(f, i, k)]++;
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 0; b < f->num_blocks; b++) {
+            int i = f->blocks[b].first;
+            while (i != IR_NONE) {
+                int next = f->instrs[i].next;
+                IrInstr *in = &f->instrs[i];
+                bool has_effect = in->op == IR_CALL || in->op == IR_STORE || in->op == IR_PRINTF ||
+                                  in->op == IR_SCANF || in->op == IR_DIV || in->op == IR_MOD ||
+                                  in->op == IR_LOAD || in->op == IR_VECTOR || in->op == IR_PARALLEL ||
+                                  ir_is_terminator(in->op);
+                if (uses[i] == 0 && !has_effect) {
+                    for (int k = 0; k < in->operands.count; k++) {
+                        uses[ir_operand(f, i, k)]--;
+                    }
+                    ir_unlink(f, i);
+                    f->instrs[i].op = IR_NOP;
+                    changed = true;
+                }
+                i = next;
+            }
+        }
+    }
+    free(uses);
+}
+
+void ir_remove_unreachable_blocks(IrFunction *f) {
+    bool *reachable = calloc(f->num_blocks, sizeof(bool));
+    int *stack = malloc(sizeof(int) * (f->num_blocks + 1));
+    int top = 0;
+    stack[top++] = f->entry;
+    reachable[f->entry] = true;
+    while (top > 0) {
+        int b = stack[--top];
+        for (int k = 0; k < ir_num_succs(f, b); k++) {
+            int s = ir_succ(f, b, k);
+            if (!reachable[s]) {
+                reachable[s] = true;
+                stack[top++] = s;
+            }
+        }
+    }
+
+    for (int b = 0; b < f->num_blocks; b++) {
+        if (reachable[b]) {
+            continue;
+        }
+        for (int k = 0; k < ir_num_succs(f, b); k++) {
+            int s = ir_succ(f, b, k);
+            if (reachable[s]) {
+                ir_remove_pred(f, s, b);
+            }
+        }
+        while (f->blocks[b].first != IR_NONE) {
+            int i = f->blocks[b].first;
+            ir_unlink(f, i);
+            f->instrs[i].op = IR_NOP;
+        }
+        f->blocks[b].preds.count = 0;
+    }
+
+    free(reachable);
+    free(stack);
+}
+
+/******************************************************/
+/* Dominators */
+
+static int intersect(const IrFunction *f, int a, int b) {
+    while (a != b) {
+        while (f->blocks[a].rpo_index > f->blocks[b].rpo_index) {
+            a = f->blocks[a].idom;
+        }
+        while (f->blocks[b].rpo_index > f->blocks[a].rpo_index) {
+            b = f->blocks[b].idom;
+        }
+    }
+    return a;
+}
+
+// Computes the reverse postorder and the dominator tree,
+// using the iterative algorithm by Cooper, Harvey and Kennedy
+void ir_compute_dominators(IrFunction *f) {
+    int n = f->num_blocks;
+    int *postorder = malloc(sizeof(int) * n);
+    int *stack = malloc(sizeof(int) * n);
+    int *next_succ = calloc(n, sizeof(int));
+    bool *visited = calloc(n, sizeof(bool));
+    int count = 0, top = 0;
+
+    for (int b = 0; b < n; b++) {
+        f->blocks[b].idom = IR_NONE;
+        f->blocks[b].rpo_index = IR_NONE;
+        f->blocks[b].dom_depth = 0;
+    }
+
+    // Iterative depth-first search, deep nesting must not overflow the C stack
+    stack[top++] = f->entry;
+    visited[f->entry] = true;
+    while (top > 0) {
+        int b = stack[top - 1];
+        if (next_succ[b] < ir_num_succs(f, b)) {
+            int s = ir_succ(f, b, next_succ[b]++);
+            if (!visited[s]) {
+                visited[s] = true;
+                stack[top++] = s;
+            }
+        } else {
+            postorder[count++] = b;
+            top--;
+        }
+    }
+
+    f->rpo = (IrList){ .start = pool_reserve(f, count), .count = count, .capacity = count };
+    for (int k = 0; k < count; k++) {
+        int b = postorder[count - 1 - k];
+        f->pool[f->rpo.start + k] = b;
+        f->blocks[b].rpo_index = k;
+    }
+
+    f->blocks[f->entry].idom = f->entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 1; k < count; k++) {
+            int b = f->pool[f->rpo.start + k];
+            int new_idom = IR_NONE;
+            for (int p = 0; p < f->blocks[b].preds.count; p++) {
+                int pred = ir_pred(f, b, p);
+                if (f->blocks[pred].idom == IR_NONE) {
+                    continue;
+                }
+                new_idom = new_idom == IR_NONE ? pred : intersect(f, pred, new_idom);
+            }
+            if (new_idom != f->blocks[b].idom) {
+                f->blocks[b].idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (int k = 1; k < count; k++) {
+        int b = f->pool[f->rpo.start + k];
+        f->blocks[b].dom_depth = f->blocks[f->blocks[b].idom].dom_depth + 1;
+    }
+    f->blocks[f->entry].idom = IR_NONE;
+
+    free(postorder);
+    free(stack);
+    free(next_succ);
+    free(visited);
+}
+
+bool ir_dominates(const IrFunction *f, int a, int b) {
+    if (f->blocks[a].rpo_index == IR_NONE || f->blocks[b].rpo_index == IR_NONE) {
+        return false;
+    }
+    while (f->blocks[b].dom_depth > f->blocks[a].dom_depth) {
+        b = f->blocks[b].idom;
+    }
+    return a == b;
+}
+
+/******************************************************/
+/* Printing */
+
+const char *ir_opcode_name(IrOpcode op) {
+    return opcode_names[op];
+}
+
+static void print_string(FILE *out, const IrModule *module, int id) {
+    int length;
+    const char *s = ir_string(module, id, &length);
+    fputc('"', out);
+    for (int i = 0; i < length; i++) {
+        switch (s[i]) {
+            case '\n': fputs("\\n", out); break;
+            case '\t': fputs("\\t", out); break;
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            default:
+                if ((unsigned char)s[i] < 32) {
+                    fprintf(out, "\\x%02x", (unsigned char)s[i]);
+                } else {
+                    fputc(s[i], out);
+                }
+        }
+    }
+    fputc('"', out);
+}
+
+static void print_instr(FILE *out, const IrModule *module, const IrFunction *f, int i) {
+    const IrInstr *in = &f->instrs[i];
+    fprintf(out, "    ");
+    if (in->type != IR_VOID) {
+        fprintf(out, "v%d = ", i);
+    }
+    fprintf(out, "%s", opcode_names[in->op]);
+    if (in->type != IR_VOID) {
+        fprintf(out, ".%s", type_names[in->type]);
+    }
+
+    switch (in->op) {
+        case IR_CONST:
+            if (in->type == IR_FLOAT) {
+                fprintf(out, " %.17g", in->fimm);
+            } else {
+                fprintf(out, " %lld", (long long)in->imm);
+            }
+            break;
+        case IR_PARAM:
+        case IR_SCAN_VALUE:
+            fprintf(out, " #%lld", (long long)in->imm);
+            break;
+        case IR_ARRAY:
+            fprintf(out, " [%lld]", (long long)in->imm);
+            break;
+        case IR_GLOBAL:
+            fprintf(out, " @%s", module->globals[in->imm].name);
+            break;
+        case IR_CALL:
+            fprintf(out, " %s", module->functions[in->imm].name);
+            break;
+        case IR_PRINTF:
+        case IR_SCANF:
+            fputc(' ', out);
+            print_string(out, module, (int)in->imm);
+            break;
+        case IR_VECTOR:
+            // The operation, then which phis of the header are i and acc
+            fprintf(out, " %s%s #%d", in->flags & IR_VECTOR_REDUCE ? "sum " : "",
+                    opcode_names[IR_VECTOR_OP(in->imm)], IR_VECTOR_COUNTER(in->imm));
+            if (in->flags & IR_VECTOR_REDUCE) {
+                fprintf(out, " #%d", IR_VECTOR_ACC(in->imm));
+            }
+            fputc(',', out);
+            break;
+        case IR_PARALLEL: {
+            // What each phi of the header is, in order
+            static const char *const kinds[] = { "i", "step", "+", "*", "&&", "||" };
+            const IrBlock *header = &f->blocks[in->targets[0]];
+            int k = 0;
+            for (int p = header->first; p != IR_NONE && f->instrs[p].op == IR_PHI; p = f->instrs[p].next) {
+                fprintf(out, " %s", kinds[IR_PARALLEL_KIND(in->imm, k++)]);
+            }
+            fputc(',', out);
+            break;
+        }
+        default:
+            break;
+    }
+
+    for (int k = 0; k < in->operands.count; k++) {
+        fprintf(out, "%s v%d", k == 0 && in->op != IR_PRINTF && in->op != IR_SCANF &&
+                               in->op != IR_CALL ? "" : ",", ir_operand(f, i, k));
+    }
+    if (in->flags & IR_IN_BOUNDS) {
+        fprintf(out, " in_bounds");
+    }
+    if (in->op == IR_JUMP) {
+        fprintf(out, " b%d", in->targets[0]);
+    } else if (in->op == IR_BRANCH || in->op == IR_VECTOR || in->op == IR_PARALLEL) {
+        fprintf(out, ", b%d, b%d", in->targets[0], in->targets[1]);
+    }
+    fprintf(out, "\n");
+}
+
+void ir_print_module(FILE *out, const IrModule *module) {
+    for (int g = 0; g < module->num_globals; g++) {
+        const IrGlobal *global = &module->globals[g];
+        if (global->is_array) {
+            fprintf(out, "global %s %s[%d]\n", type_names[global->type], global->name, global->length);
+        } else {
+            fprintf(out, "global %s %s\n", type_names[global->type], global->name);
+        }
+    }
+    if (module->num_globals > 0) {
+        fprintf(out, "\n");
+    }
+
+    for (int fn = 0; fn < module->num_functions; fn++) {
+        const IrFunction *f = &module->functions[fn];
+        fprintf(out, "function %s %s(%d params)%s\n", type_names[f->return_type], f->name,
+                f->num_params, !f->defined ? " declared" : f->memoize ? " memoized" : "");
+        if (!f->defined) {
+            fprintf(out, "\n");
+            continue;
+        }
+        for (int k = 0; k < f->rpo.count; k++) {
+            int b = f->pool[f->rpo.start + k];
+            fprintf(out, "  b%d:", b);
+            fprintf(out, "%*s; preds:", b < 10 ? 10 : 9, "");
+            for (int p = 0; p < f->blocks[b].preds.count; p++) {
+                fprintf(out, " b%d", ir_pred(f, b, p));
+            }
+            if (f->blocks[b].idom != IR_NONE) {
+                fprintf(out, ", idom: b%d", f->blocks[b].idom);
+            }
+            fprintf(out, "\n");
+            IR_FOR_EACH_INSTR(f, b, i) {
+                print_instr(out, module, f, i);
+            }
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,356 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "parse_tree.h"
+
+// SSA intermediate representation
+//
+// A module holds functions, each function is a control-flow graph of basic blocks.
+// Every instruction defines at most one value, and the value id of an instruction is
+// its index in the function's instruction table, so value ids are dense per function.
+// Nothing in the IR points into memory: blocks, values, operand lists and names are all
+// integer ids or offsets, and every table is allocated from the module's arena, or used in
+// place in the mapping of a precompiled image (image.c).
+
+#define IR_NAME_LENGTH 32
+#define IR_MAX_PARAMS 16
+#define IR_NONE (-1)
+#define IR_ARRAY_ALIGNMENT 32   // Of the elements of arrays, in the interpreter and in the globals of output.s
+
+// Flags of an instruction
+#define IR_IN_BOUNDS 1      // IR_LOAD or IR_STORE whose index is always in bounds, set by range.c
+#define IR_VECTOR_REDUCE 2  // IR_VECTOR of a sum instead of a store
+#define IR_VECTOR_X_ARRAY 4 // IR_VECTOR whose x is an array, read at the index
+#define IR_VECTOR_Y_ARRAY 8
+
+// An IR_VECTOR is the last instruction before the jump of a loop preheader, set by loop_opt.c.
+// The loop counts i up by one from start while i < bound, and each time does dst[i] = x op y,
+// or acc = acc + (x op y) with IR_VECTOR_REDUCE, where op is IR_ADD, IR_SUB, IR_MUL or IR_NOP
+// for x alone. operands = start, bound, dst or the initial acc, x, then y unless op is IR_NOP.
+// targets = the header and the exit of the loop, imm = op and the positions of the phis of i
+// and acc among the phis of the header. Running the instruction is optional: an engine may
+// run the whole loop at once, give the header phis their values at the exit and go there.
+#define IR_VECTOR_IMM(op, counter, acc) ((int64_t)(op) | (int64_t)(counter) << 8 | (int64_t)(acc) << 16)
+#define IR_VECTOR_OP(imm) ((IrOpcode)((imm) & 0xff))
+#define IR_VECTOR_COUNTER(imm) ((int)((imm) >> 8 & 0xff))
+#define IR_VECTOR_ACC(imm) ((int)((imm) >> 16 & 0xff))
+
+// An IR_PARALLEL is in the same place as an IR_VECTOR, for a loop whose iterations can run in any
+// order, or at the same time. The loop counts i up by one from start while i < bound, each other
+// phi of its header is an induction variable, stepped by a value that does not change in the
+// loop, or a reduction: acc + x, acc * x of ints, or acc && x, acc || x, where x does not depend
+// on acc and can be computed even when && or || would skip it. Its arrays are either
+// only read, or read and written at i. operands = start, bound, targets = the header and the exit
+// of the loop, imm = the IR_REDUCE_* of each phi of the header in order, IR_PARALLEL_BITS each.
+// Running the instruction is optional, like with IR_VECTOR.
+typedef enum {
+    IR_REDUCE_COUNTER,  // i
+    IR_REDUCE_STEP,     // An induction variable, start + k * step in iteration k
+    IR_REDUCE_ADD,
+    IR_REDUCE_MUL,
+    IR_REDUCE_AND,
+    IR_REDUCE_OR
+} IrReduction;
+
+#define IR_PARALLEL_BITS 3
+#define IR_PARALLEL_MAX_PHIS 21
+#define IR_PARALLEL_KIND(imm, k) ((IrReduction)((imm) >> IR_PARALLEL_BITS * (k) & 7))
+
+typedef enum {
+    IR_VOID,
+    IR_INT,     // int, char and bool
+    IR_FLOAT
+} IrType;
+
+typedef enum {
+    IR_NOP,         // A removed instruction
+
+    // Values
+    IR_CONST,       // imm / fimm
+    IR_PARAM,       // imm = parameter index
+    IR_PHI,         // operands = one value per predecessor, in the order of the block's preds
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MOD,
+    IR_POW,
+    IR_NEG,
+    IR_NOT,
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_GE,
+    IR_CONVERT,     // operand converted to the instruction's type
+    IR_CALL,        // imm = function id, operands = arguments
+    IR_ARRAY,       // local array, imm = length, elements of the instruction's type
+    IR_GLOBAL,      // imm = global id, a handle usable by IR_LOAD and IR_STORE
+    IR_LOAD,        // operands = array, index
+    IR_STORE,       // operands = array, index, value
+    IR_PRINTF,      // imm = string id, operands = arguments
+    IR_SCANF,       // imm = string id, value = number of conversions done
+    IR_SCAN_VALUE,  // imm = conversion index, operands = the IR_SCANF
+    IR_VECTOR,      // The loop after it as one kernel, see above
+    IR_PARALLEL,    // The loop after it split across threads, see above
+
+    // Terminators
+    IR_JUMP,        // targets[0]
+    IR_BRANCH,      // operands = condition, targets[0] if true, targets[1] if false
+    IR_RETURN,      // operands = value, none for void functions
+
+    IR_OPCODE_COUNT
+} IrOpcode;
+
+// A range of ints in the function's pool, used for operand and predecessor lists
+typedef struct {
+    int start;
+    int count;
+    int capacity;
+} IrList;
+
+typedef struct {
+    uint8_t op;
+    uint8_t type;
+    uint16_t flags;     // IR_IN_BOUNDS, IR_VECTOR_*
+    int block;
+    int prev, next;     // Instruction list of the block
+    IrList operands;
+    int targets[2];
+    union {
+        int64_t imm;
+        double fimm;
+    };
+    int line_number;
+    int column_number;
+} IrInstr;
+
+typedef struct {
+    int first, last;    // Instruction list, phis first, terminator last
+    IrList preds;
+    int idom;           // Immediate dominator, IR_NONE for the entry block and unreachable blocks
+    int dom_depth;
+    int rpo_index;      // Position in reverse postorder, IR_NONE if unreachable
+} IrBlock;
+
+typedef struct IrArena IrArena;
+
+typedef struct {
+    char name[IR_NAME_LENGTH];
+    IrType return_type;
+    int num_params;
+    IrType param_types[IR_MAX_PARAMS];
+    bool defined;       // false for prototypes without a body
+    bool memoize;       // Results may be kept by arguments, set by purity.c
+    IrArena *arena;     // The module's arena, the tables below grow inside it
+
+    IrInstr *instrs;
+    int num_instrs, instrs_capacity;
+    IrBlock *blocks;
+    int num_blocks, blocks_capacity;
+    int *pool;
+    int pool_size, pool_capacity;
+    int entry;
+    IrList rpo;         // Reachable blocks in reverse postorder, set by ir_compute_dominators()
+} IrFunction;
+
+typedef struct {
+    char name[IR_NAME_LENGTH];
+    IrType type;
+    int length;         // 1 for scalars
+    bool is_array;
+} IrGlobal;
+
+// Bump allocator owning all of a module's memory
+typedef struct IrArenaChunk {
+    struct IrArenaChunk *next;
+    size_t used, size;
+    _Alignas(16) unsigned char data[];
+} IrArenaChunk;
+
+struct IrArena {
+    IrArenaChunk *chunks;
+    size_t total_bytes;
+};
+
+typedef struct {
+    IrArena arena;
+    IrFunction *functions;
+    int num_functions, functions_capacity;
+    IrGlobal *globals;
+    int num_globals, globals_capacity;
+
+    // Decoded string literals, string i is string_data[string_offsets[i]] with string_lengths[i] bytes
+    char *string_data;
+    int string_size, string_capacity;
+    int *string_offsets;
+    int *string_lengths;
+    int num_strings, strings_capacity;
+
+    int init_function;  // Runs the global initializers, IR_NONE if there are none
+    int main_function;
+
+    // Set by ir_load_image(): the tables above are in this read-only mapping of the image
+    void *image;
+    size_t image_size;
+} IrModule;
+
+#define IR_FOR_EACH_INSTR(f, b, i) \
+    for (int i = (f)->blocks[b].first; i != IR_NONE; i = (f)->instrs[i].next)
+
+static inline int ir_operand(const IrFunction *f, int instr, int k) {
+    return f->pool[f->instrs[instr].operands.start + k];
+}
+
+static inline int ir_pred(const IrFunction *f, int block, int k) {
+    return f->pool[f->blocks[block].preds.start + k];
+}
+
+static inline bool ir_is_terminator(IrOpcode op) {
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN;
+}
+
+// ir.c
+void *ir_arena_alloc(IrArena *arena, size_t size);
+void ir_module_init(IrModule *module);
+void ir_module_free(IrModule *module);
+
+int ir_add_function(IrModule *module, const char *name, IrType return_type, int num_params);
+int ir_find_function(const IrModule *module, const char *name);
+int ir_add_global(IrModule *module, const char *name, IrType type, int length, bool is_array);
+int ir_add_string(IrModule *module, const char *bytes, int length);
+const char *ir_string(const IrModule *module, int id, int *length);
+
+int ir_add_block(IrFunction *f);
+int ir_new_instr(IrFunction *f, IrOpcode op, IrType type);
+void ir_append(IrFunction *f, int block, int instr);
+void ir_prepend(IrFunction *f, int block, int instr);
+void ir_insert_before(IrFunction *f, int before, int instr);
+void ir_unlink(IrFunction *f, int instr);
+void ir_add_operand(IrFunction *f, int instr, int value);
+void ir_set_operand(IrFunction *f, int instr, int k, int value);
+void ir_add_pred(IrFunction *f, int block, int pred);
+void ir_remove_pred(IrFunction *f, int block, int pred);
+int ir_terminator(const IrFunction *f, int block);
+int ir_num_succs(const IrFunction *f, int block);
+int ir_succ(const IrFunction *f, int block, int k);
+int ir_pred_index(const IrFunction *f, int block, int pred);
+
+void ir_replace_uses(IrFunction *f, int old_value, int new_value);
+void ir_remove_trivial_phis(IrFunction *f);
+void ir_remove_unreachable_blocks(IrFunction *f);
+void ir_compute_dominators(IrFunction *f);
+bool ir_dominates(const IrFunction *f, int a, int b);
+
+const char *ir_opcode_name(IrOpcode op);
+void ir_print_module(FILE *out, const IrModule *module);
+
+void ir_remove_dead_values(IrFunction *f);
+
+// lower.c
+bool ir_lower_program(IrModule *module, ParseTreeNode *program);
+
+// loop_opt.c
+typedef struct {
+    int hoisted;                // Loop-invariant instructions moved to a preheader
+    int reduced_multiplications;
+    int reduced_powers;
+    int vectorized;             // Loops marked with IR_VECTOR
+    int parallelized;           // Loops marked with IR_PARALLEL
+} IrLoopStats;
+
+IrLoopStats ir_optimize_loops(IrModule *module);
+
+// inline.c
+typedef struct {
+    int inlined;                // Calls replaced by the body of their callee
+    int skipped;                // Calls to candidates over the size limits
+    int added;                  // Instructions copied into callers
+} IrInlineStats;
+
+IrInlineStats ir_inline_functions(IrModule *module);
+
+// purity.c
+typedef struct {
+    int functions;              // With a body
+    int pure;
+    int memoized;               // Pure and recursive
+} IrPurityStats;
+
+IrPurityStats ir_find_pure_functions(IrModule *module);
+
+// range.c
+typedef struct {
+    int checks;                 // Loads and stores
+    int removed;                // Of them proven in bounds
+} IrBoundsStats;
+
+IrBoundsStats ir_eliminate_bounds_checks(IrModule *module);
+
+// image.c
+#define IR_IMAGE_VERSION 1      // Of .corec images, raised when the meaning of the IR changes
+
+bool ir_save_image(const IrModule *module, const char *path);
+// Maps an image written by ir_save_image() into an empty module, ir_module_free() unmaps it
+bool ir_load_image(IrModule *module, const char *path);
+
+// ir_interp.c
+#define IR_MAX_CALL_DEPTH 10000     // Calls running at once, interpreted or compiled by the JIT
+
+typedef struct {
+    long long instructions;     // Executed instructions, phis included, in the interpreter only
+    int compiled_functions;     // By the JIT
+    long long memo_calls;       // Interpreted calls of memoized functions
+    long long memo_hits;        // Of them answered from the cache
+    double seconds;
+} IrRunStats;
+
+// With profile, samples the calls for profile_write() of profile.h
+bool ir_run(const IrModule *module, bool use_jit, bool profile, int *exit_code, IrRunStats *stats);
+
+// codegen.c
+bool ir_emit_x86_64(FILE *file, const IrModule *module);
+void ir_emit_x86_64_jit(FILE *file, const IrModule *module, int function);
+
+// assembler.c
+typedef struct X86Object X86Object;
+
+// Gives the address of a symbol outside the object, or a slot holding it that may change later
+typedef bool (*X86Resolver)(void *context, const char *name, void **address, void ***slot);
+
+X86Object *x86_assemble(const char *text, size_t length);
+size_t x86_code_size(const X86Object *object);
+size_t x86_data_size(const X86Object *object);
+bool x86_link(const X86Object *object, uint8_t *code, uint8_t *data, X86Resolver resolve, void *context);
+void *x86_symbol(const X86Object *object, const char *name, uint8_t *code, uint8_t *data);
+void x86_free(X86Object *object);
+
+// jit.c
+typedef struct IrJit IrJit;
+
+// What compiled code calls back into
+typedef struct {
+    uint64_t (*interpret)(int function, const uint64_t *args);     // Runs a function not compiled yet
+    void (*index_error)(int64_t index, int length, int line);
+    void (*division_error)(int line);
+    void (*stack_overflow)(int function);
+    int *call_depth;            // Calls running, each compiled call counts itself
+    void **globals;             // Elements of each global
+} IrJitRuntime;
+
+// Entry points of a compiled function: the arguments, or for an OSR entry every value of the
+// function by id, with array values as pointers to their elements
+typedef int64_t (*IrJitIntEntry)(const uint64_t *values);
+typedef double (*IrJitFloatEntry)(const uint64_t *values);
+
+IrJit *ir_jit_new(const IrModule *module, const IrJitRuntime *runtime);
+bool ir_jit_compile(IrJit *jit, int function);
+void *ir_jit_entry(const IrJit *jit, int function);
+void *ir_jit_osr_entry(const IrJit *jit, int function, int block);
+void ir_jit_free(IrJit *jit);
+
+#endif //IR_H
@@ -0,0 +1,1264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "ir.h"
+#include "output.h"
+#include "input.h"
+#include "vector.h"
+#include "parallel.h"
+#include "profile.h"
+
+// Interpreter for the SSA IR
+//
+// Runs a lowered module directly, so optimizations can be checked for the output they
+// produce and measured by the number of instructions they execute. Ints are 64 bits wide
+// and wrap around, floats are doubles.
+//
+// Calls run on one contiguous stack of IrValues. The frame of a function is sized once from
+// its IR: its arguments, which the caller writes in place at the top of the stack, a slot per
+// value, room for the phis of a block and the elements of the arrays it declares. A call
+// whose value is returned right away reuses the frame of the caller, so a recursion through
+// "return f(x);" runs in constant space.
+//
+// With the JIT, every call and loop back edge counts towards its function, and a function
+// that reaches IR_JIT_THRESHOLD is compiled by jit.c. Later calls run the compiled code, and
+// a call still in the interpreter moves to it at the next loop header it reaches. Compiled
+// calls count themselves in call_depth too, so both are held to IR_MAX_CALL_DEPTH.
+//
+// A loop marked with IR_VECTOR runs whole through the kernels of vector.c, which count as
+// one instruction; when an array is too short for its range the loop runs as usual instead,
+// and fails where it would have.
+//
+// Calls of a function purity.c marked to be memoized look up their arguments in a table of
+// the results of the function first, and a call that runs puts its result there, except while
+// the global initializers run. Such functions are not compiled by the JIT, their calls from
+// compiled code come back here.
+//
+// Each call, and each call to compiled code, has a frame in frames[] for the profiler, which
+// holds the instruction the call is at: it is stored before each instruction runs, which is
+// the one cost of the profiler when it is off.
+//
+// A loop marked with IR_PARALLEL and at least IR_PARALLEL_MIN_ITERATIONS iterations runs on
+// the threads of parallel.c. Each thread runs its iterations on its own copy of the values of
+// the frame, where induction variables are computed from the iteration, and reductions start
+// from 0 for +, 1 for *, true for && and false for ||; the results of the threads are combined
+// with the value before the loop at the end. When an
+// iteration fails, the error reported is the one of the first iteration that failed, like
+// without threads. The instructions of the iterations are counted as they run.
+
+#define IR_STACK_BYTES ((size_t)1 << 30)     // Reserved, pages are only used as frames reach them
+#ifndef IR_JIT_THRESHOLD
+#define IR_JIT_THRESHOLD 1000
+#endif
+#define IR_MEMO_INITIAL_ENTRIES 256
+#define IR_MEMO_MAX_ENTRIES (1 << 16)       // Per function
+#define IR_MEMO_PROBES 8                    // Entries looked at from the place of some arguments
+#ifndef IR_PARALLEL_MIN_ITERATIONS
+#define IR_PARALLEL_MIN_ITERATIONS 1024     // Fewer do not make up for waking the threads
+#endif
+
+// The handlers of the opcodes that do the most stay out of call_function, whose C stack frame
+// every interpreted call adds to: inlined, their locals let IR_MAX_CALL_DEPTH calls outgrow an
+// 8 MB stack
+#define COLD __attribute__((noinline))
+
+typedef struct IrArray IrArray;
+
+typedef union {
+    int64_t i;
+    double f;
+    IrArray *a;
+} IrValue;
+
+// The elements follow the header, aligned for vector loads, all of the type of the IR_ARRAY
+struct IrArray {
+    int length;
+    _Alignas(IR_ARRAY_ALIGNMENT) IrValue data[];
+};
+
+#define SLOTS(bytes) (((bytes) + IR_ARRAY_ALIGNMENT - 1) / IR_ARRAY_ALIGNMENT * (IR_ARRAY_ALIGNMENT / sizeof(IrValue)))
+
+// Where things are in the frame of a function, in IrValue slots from its start
+typedef struct {
+    int values;         // After the arguments, the value of instruction i is at values + i
+    int phis;           // Values of the phis of a block while they are assigned
+    int max_phis;       // Of a block
+    int size;           // A multiple of IR_ARRAY_ALIGNMENT bytes, so every frame starts aligned
+    int *arrays;        // Per instruction, where the IrArray of an IR_ARRAY starts
+} FrameLayout;
+
+static const IrModule *module;
+static IrRunStats *stats;
+static IrArray **globals;
+static jmp_buf runtime_error;
+static int call_depth;
+
+// Calls running, innermost last, for the profiler: each interpreted call, and each call of
+// compiled code made from one
+static volatile ProfileFrame frames[2 * IR_MAX_CALL_DEPTH + 2];
+static volatile int num_frames;
+
+static IrValue *stack;
+static size_t stack_top, stack_slots;
+static FrameLayout *layouts;
+
+static IrJit *jit;
+static int *hotness;        // Calls and back edges so far, per function
+static bool *jit_failed;
+
+// Compiled printf format of each string of the module, on first use
+static PrintFormat **print_formats;
+static char *print_text;         // Char arrays printed with %s, as C strings
+static size_t print_text_capacity;
+
+// Compiled scanf format of each string of the module, on first use
+static ScanPlan **scan_plans;
+
+// Results of each memoized function by arguments, an open addressing table of up to
+// IR_MEMO_MAX_ENTRIES entries; past that, a new result can replace an old one
+typedef struct {
+    int capacity;       // Entries, a power of two, 0 before the first result
+    int count;
+    IrValue *keys;      // The arguments of each entry, one after the other
+    IrValue *results;
+    bool *used;
+} MemoCache;
+
+static MemoCache *memo_caches;
+static bool initializing;   // While the global initializers run, the globals a pure function reads are not set yet
+
+// Results of the last scanf, read by the IR_SCAN_VALUEs that follow it
+static IrValue scan_results[IR_MAX_PARAMS];
+static bool scan_is_float[IR_MAX_PARAMS];
+
+static IrValue call_function(int id);
+
+static void fail(const IrInstr *in, const char *message) {
+    output_flush();
+    fprintf(stderr, "Error: %s at line %d\n", message, in->line_number);
+    longjmp(runtime_error, 1);
+}
+
+static IrArray *new_array(int length) {
+    size_t size = (sizeof(IrArray) + sizeof(IrValue) * length + IR_ARRAY_ALIGNMENT - 1) / IR_ARRAY_ALIGNMENT *
+                  IR_ARRAY_ALIGNMENT;
+    IrArray *array = aligned_alloc(IR_ARRAY_ALIGNMENT, size);
+    if (!array) {
+        fprintf(stderr, "Error: Memory allocation failed in new_array\n");
+        exit(1);
+    }
+    memset(array, 0, size);
+    array->length = length;
+    return array;
+}
+
+static void compute_layout(const IrFunction *f, FrameLayout *layout) {
+    int max_phis = 0;
+    for (int b = 0; b < f->num_blocks; b++) {
+        int num_phis = 0;
+        IR_FOR_EACH_INSTR(f, b, i) {
+            num_phis += f->instrs[i].op == IR_PHI;
+        }
+        max_phis = num_phis > max_phis ? num_phis : max_phis;
+    }
+    layout->values = f->num_params;
+    layout->phis = layout->values + f->num_instrs;
+    layout->max_phis = max_phis;
+    layout->size = (int)SLOTS(sizeof(IrValue) * (size_t)(layout->phis + max_phis));
+    layout->arrays = malloc(sizeof(int) * (f->num_instrs + 1));
+    for (int i = 0; i < f->num_instrs; i++) {
+        if (f->instrs[i].op == IR_ARRAY) {
+            layout->arrays[i] = layout->size;
+            layout->size += (int)SLOTS(sizeof(IrArray) + sizeof(IrValue) * (size_t)f->instrs[i].imm);
+        }
+    }
+}
+
+// Makes room for a frame at the top of the stack, returns where it starts
+static size_t push_frame(const IrFunction *f, size_t base) {
+    if (base + (size_t)layouts[f - module->functions].size > stack_slots) {
+        fprintf(stderr, "Error: call stack overflow in '%s'\n", f->name);
+        longjmp(runtime_error, 1);
+    }
+    stack_top = base + (size_t)layouts[f - module->functions].size;
+    return base;
+}
+
+static int64_t to_int(double f) {
+    // Out of range conversions give the same value as on x86-64
+    if (!(f > -9223372036854775808.0 && f < 9223372036854775808.0)) {
+        return INT64_MIN;
+    }
+    return (int64_t)f;
+}
+
+static int64_t int_pow(int64_t base, int64_t exponent) {
+    if (exponent < 0) {
+        return base == 1 ? 1 : base == -1 ? (exponent % 2 ? -1 : 1) : 0;
+    }
+    uint64_t result = 1, b = (uint64_t)base;
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result *= b;
+        }
+        b *= b;
+        exponent >>= 1;
+    }
+    return (int64_t)result;
+}
+
+static IrValue *checked_element(const IrInstr *in, IrArray *array, int64_t index) {
+    if (index < 0 || index >= array->length) {
+        char message[96];
+        snprintf(message, sizeof(message), "index %lld out of bounds of array of length %d",
+                 (long long)index, array->length);
+        fail(in, message);
+    }
+    return &array->data[index];
+}
+
+/******************************************************/
+/* Input and output */
+
+static COLD void run_printf(const IrFunction *f, const IrInstr *in, const IrValue *values) {
+    PrintFormat *format = print_formats[in->imm];
+    if (format == NULL) {
+        int length;
+        const char *text = ir_string(module, (int)in->imm, &length);
+        format = print_formats[in->imm] = print_format_compile(text, length);
+    }
+
+    // Char arrays are copied out up to their first zero element
+    const int *operands = &f->pool[in->operands.start];
+    size_t text_length = 0;
+    for (int s = 0, k = 0; s < format->num_segments; s++) {
+        if (format->segments[s].kind == SEGMENT_STRING) {
+            text_length += values[operands[k]].a->length + 1;
+        }
+        k += format->segments[s].kind != SEGMENT_TEXT;
+    }
+    if (text_length > print_text_capacity) {
+        print_text_capacity = text_length * 2;
+        free(print_text);
+        print_text = malloc(print_text_capacity);
+        if (print_text == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed in run_printf\n");
+            exit(1);
+        }
+    }
+
+    PrintArg args[IR_MAX_PARAMS];
+    char *text = print_text;
+    for (int s = 0, k = 0; s < format->num_segments; s++) {
+        SegmentKind kind = format->segments[s].kind;
+        if (kind == SEGMENT_TEXT) {
+            continue;
+        }
+        IrValue value = values[operands[k]];
+        if (kind == SEGMENT_FLOAT) {
+            args[k].f = value.f;
+        } else if (kind == SEGMENT_STRING) {
+            IrArray *array = value.a;
+            args[k].s = text;
+            for (int e = 0; e < array->length && array->data[e].i != 0; e++) {
+                *text++ = (char)array->data[e].i;
+            }
+            *text++ = '\0';
+        } else {
+            args[k].i = value.i;
+        }
+        k++;
+    }
+    output_print(format, args);
+}
+
+// Reads into long long and double through the compiled plan of the format
+static COLD int64_t run_scanf(const IrInstr *in) {
+    ScanPlan *plan = scan_plans[in->imm];
+    if (plan == NULL) {
+        int length;
+        const char *text = ir_string(module, (int)in->imm, &length);
+        plan = scan_plans[in->imm] = scan_plan_compile(text, length);
+    }
+
+    ScanTarget targets[IR_MAX_PARAMS];
+    char chars[IR_MAX_PARAMS];
+    int count = 0;
+    for (int s = 0; s < plan->num_steps && count < IR_MAX_PARAMS; s++) {
+        ScanStepKind kind = plan->steps[s].kind;
+        if (kind != SCAN_INT && kind != SCAN_FLOAT && kind != SCAN_CHAR) {
+            continue;
+        }
+        scan_is_float[count] = kind == SCAN_FLOAT;
+        targets[count] = kind == SCAN_CHAR ? (void *)&chars[count] :
+                         kind == SCAN_FLOAT ? (void *)&scan_results[count].f : (void *)&scan_results[count].i;
+        chars[count] = 0;
+        scan_results[count].i = 0;
+        count++;
+    }
+
+    output_flush();
+    int done = input_scan(plan, targets);
+    for (int k = 0; k < count; k++) {
+        if (targets[k] == &chars[k]) {
+            scan_results[k].i = (unsigned char)chars[k];
+        }
+    }
+    return done < 0 ? 0 : done;
+}
+
+/******************************************************/
+/* Vectorized loops */
+
+// Runs the loop after an IR_VECTOR through vector.c and sets the phis of its header as they are
+// at its exit. Returns false, leaving the loop to run, if an array is too short for the range.
+static COLD bool run_vector_loop(const IrFunction *f, const IrInstr *in, IrValue *values) {
+    const int *operands = f->pool + in->operands.start;
+    int64_t start = values[operands[0]].i, bound = values[operands[1]].i;
+    IrOpcode op = IR_VECTOR_OP(in->imm);
+    VectorLoop loop = {
+        .op = op,
+        .is_float = f->instrs[operands[3]].type == IR_FLOAT,
+        .count = bound > start ? bound - start : 0,
+    };
+    IrArray *dst = in->flags & IR_VECTOR_REDUCE ? NULL : values[operands[2]].a;
+    IrArray *x = in->flags & IR_VECTOR_X_ARRAY ? values[operands[3]].a : NULL;
+    IrArray *y = in->flags & IR_VECTOR_Y_ARRAY ? values[operands[4]].a : NULL;
+    if (loop.count > 0) {
+        IrArray *arrays[3] = { dst, x, y };
+        for (int k = 0; k < 3; k++) {
+            if (arrays[k] != NULL && (start < 0 || bound > arrays[k]->length)) {
+                return false;
+            }
+        }
+    }
+    if (x != NULL) {
+        loop.x.array = (const VectorValue *)&x->data[start];
+    } else {
+        memcpy(&loop.x.value, &values[operands[3]], sizeof(VectorValue));
+    }
+    if (y != NULL) {
+        loop.y.array = (const VectorValue *)&y->data[start];
+    } else if (op != IR_NOP) {
+        memcpy(&loop.y.value, &values[operands[4]], sizeof(VectorValue));
+    }
+
+    int counter = f->blocks[in->targets[0]].first;
+    for (int k = 0; k < IR_VECTOR_COUNTER(in->imm); k++) {
+        counter = f->instrs[counter].next;
+    }
+    if (in->flags & IR_VECTOR_REDUCE) {
+        int acc = f->blocks[in->targets[0]].first;
+        for (int k = 0; k < IR_VECTOR_ACC(in->imm); k++) {
+            acc = f->instrs[acc].next;
+        }
+        VectorValue init;
+        memcpy(&init, &values[operands[2]], sizeof(init));
+        VectorValue sum = vector_reduce(&loop, init);
+        memcpy(&values[acc], &sum, sizeof(sum));
+    } else if (loop.count > 0) {
+        vector_map(&loop, (VectorValue *)&dst->data[start]);
+    }
+    values[counter].i = loop.count > 0 ? bound : start;
+    return true;
+}
+
+/******************************************************/
+/* Execution */
+
+static int64_t compare(IrOpcode op, IrValue a, IrValue b, bool is_float) {
+    if (is_float) {
+        switch (op) {
+            case IR_EQ: return a.f == b.f;
+            case IR_NE: return a.f != b.f;
+            case IR_LT: return a.f < b.f;
+            case IR_LE: return a.f <= b.f;
+            case IR_GT: return a.f > b.f;
+            default: return a.f >= b.f;
+        }
+    }
+    switch (op) {
+        case IR_EQ: return a.i == b.i;
+        case IR_NE: return a.i != b.i;
+        case IR_LT: return a.i < b.i;
+        case IR_LE: return a.i <= b.i;
+        case IR_GT: return a.i > b.i;
+        default: return a.i >= b.i;
+    }
+}
+
+/******************************************************/
+/* Parallel loops */
+
+// What one thread did in a parallel loop, on its own cache lines
+typedef struct {
+    _Alignas(64) long long executed;
+    int64_t failed_iteration;
+    const IrInstr *failed;
+    char message[96];
+} ParallelThread;
+
+// A run of a loop marked with IR_PARALLEL, shared by the threads
+typedef struct {
+    const IrFunction *f;
+    int header, body;           // body is where an iteration starts
+    int counter;                // Value of i
+    int64_t start;
+    int num_reductions;
+    int reductions[IR_PARALLEL_MAX_PHIS];   // Header phis
+    int updates[IR_PARALLEL_MAX_PHIS];      // Their values for the next iteration
+    IrReduction kinds[IR_PARALLEL_MAX_PHIS];
+    int64_t firsts[IR_PARALLEL_MAX_PHIS], steps[IR_PARALLEL_MAX_PHIS];    // Of induction variables
+    size_t frame_size;          // Values of the function, then room for the phis of a block
+    IrValue *frames;            // One per thread
+    ParallelThread *threads;
+    _Atomic int64_t first_failure;          // Earliest failed iteration so far, INT64_MAX if none
+} ParallelRun;
+
+static bool iteration_failed(ParallelRun *run, ParallelThread *thread, int64_t k, const IrInstr *in,
+                             const char *message) {
+    thread->failed_iteration = k;
+    thread->failed = in;
+    snprintf(thread->message, sizeof(thread->message), "%s", message);
+    int64_t first = atomic_load(&run->first_failure);
+    while (k < first && !atomic_compare_exchange_weak(&run->first_failure, &first, k)) {
+    }
+    return false;
+}
+
+// Runs iteration k from its first block back to the header, with the operations of
+// call_function() that a parallel loop can have. Returns false if it failed, or if an earlier
+// iteration failed while it was in a loop of its own.
+static bool run_iteration(ParallelRun *run, ParallelThread *thread, IrValue *values, int64_t k) {
+    const IrFunction *f = run->f;
+    IrValue *phi_values = values + f->num_instrs;
+    values[run->counter].i = run->start + k;
+    int block = run->body;
+    int pred = run->header;
+    long long executed = 0;
+    char message[96];
+
+    for (;;) {
+        int i = f->blocks[block].first;
+        int p = ir_pred_index(f, block, pred);
+        int num_phis = 0;
+        for (int phi = i; phi != IR_NONE && f->instrs[phi].op == IR_PHI; phi = f->instrs[phi].next) {
+            phi_values[num_phis++] = values[ir_operand(f, phi, p)];
+        }
+        for (int n = 0; n < num_phis; n++) {
+            values[i] = phi_values[n];
+            i = f->instrs[i].next;
+        }
+        executed += num_phis;
+
+        for (; i != IR_NONE; i = f->instrs[i].next) {
+            const IrInstr *in = &f->instrs[i];
+            const int *operands = f->pool + in->operands.start;
+            IrValue a = {0}, b = {0};
+            if (in->operands.count > 0) {
+                a = values[operands[0]];
+            }
+            if (in->operands.count > 1) {
+                b = values[operands[1]];
+            }
+            bool is_float = in->type == IR_FLOAT;
+            executed++;
+
+            switch ((IrOpcode)in->op) {
+                case IR_CONST:
+                    values[i].i = in->imm;
+                    break;
+                case IR_ADD:
+                    if (is_float) values[i].f = a.f + b.f;
+                    else values[i].i = (int64_t)((uint64_t)a.i + (uint64_t)b.i);
+                    break;
+                case IR_SUB:
+                    if (is_float) values[i].f = a.f - b.f;
+                    else values[i].i = (int64_t)((uint64_t)a.i - (uint64_t)b.i);
+                    break;
+                case IR_MUL:
+                    if (is_float) values[i].f = a.f * b.f;
+                    else values[i].i = (int64_t)((uint64_t)a.i * (uint64_t)b.i);
+                    break;
+                case IR_DIV:
+                case IR_MOD:
+                    if (is_float) {
+                        values[i].f = a.f / b.f;
+                    } else if (b.i == 0) {
+                        thread->executed += executed;
+                        return iteration_failed(run, thread, k, in, "division by zero");
+                    } else if (b.i == -1) {
+                        values[i].i = in->op == IR_DIV ? (int64_t)(0 - (uint64_t)a.i) : 0;
+                    } else {
+                        values[i].i = in->op == IR_DIV ? a.i / b.i : a.i % b.i;
+                    }
+                    break;
+                case IR_POW:
+                    if (is_float) values[i].f = pow(a.f, b.f);
+                    else values[i].i = int_pow(a.i, b.i);
+                    break;
+                case IR_NEG:
+                    if (is_float) values[i].f = -a.f;
+                    else values[i].i = (int64_t)(0 - (uint64_t)a.i);
+                    break;
+                case IR_NOT:
+                    values[i].i = f->instrs[operands[0]].type == IR_FLOAT ? a.f == 0.0 : a.i == 0;
+                    break;
+                case IR_EQ:
+                case IR_NE:
+                case IR_LT:
+                case IR_LE:
+                case IR_GT:
+                case IR_GE:
+                    values[i].i = compare(in->op, a, b, f->instrs[operands[0]].type == IR_FLOAT);
+                    break;
+                case IR_CONVERT:
+                    if (is_float) values[i].f = (double)a.i;
+                    else values[i].i = to_int(a.f);
+                    break;
+                case IR_GLOBAL:
+                    values[i].a = globals[in->imm];
+                    break;
+                case IR_LOAD:
+                case IR_STORE:
+                    if (!(in->flags & IR_IN_BOUNDS) && (b.i < 0 || b.i >= a.a->length)) {
+                        snprintf(message, sizeof(message), "index %lld out of bounds of array of length %d",
+                                 (long long)b.i, a.a->length);
+                        thread->executed += executed;
+                        return iteration_failed(run, thread, k, in, message);
+                    }
+                    if (in->op == IR_LOAD) values[i] = a.a->data[b.i];
+                    else a.a->data[b.i] = values[operands[2]];
+                    break;
+                case IR_VECTOR:
+                    if (run_vector_loop(f, in, values)) {
+                        pred = in->targets[0];
+                        block = in->targets[1];
+                        goto next_block;
+                    }
+                    break;
+                case IR_JUMP:
+                case IR_BRANCH:
+                    pred = block;
+                    block = in->targets[in->op == IR_JUMP || a.i != 0 ? 0 : 1];
+                    if (block == run->header) {
+                        thread->executed += executed;
+                        return true;
+                    }
+                    // An inner loop may not end, but it does not matter after a failure
+                    if (f->blocks[block].rpo_index <= f->blocks[pred].rpo_index &&
+                        k > atomic_load_explicit(&run->first_failure, memory_order_relaxed)) {
+                        thread->executed += executed;
+                        return false;
+                    }
+                    goto next_block;
+                default:
+                    // Nested parallel loops run on the thread of the outer one
+                    break;
+            }
+        }
+        fprintf(stderr, "Error: block b%d of '%s' has no terminator\n", block, f->name);
+        exit(1);
+next_block:
+        continue;
+    }
+}
+
+static void run_iterations(void *context, int t, int64_t start, int64_t end) {
+    ParallelRun *run = context;
+    ParallelThread *thread = &run->threads[t];
+    IrValue *values = run->frames + run->frame_size * (size_t)t;
+    for (int64_t k = start; k < end; k++) {
+        // Iterations after a failure would not have run
+        if (k > atomic_load_explicit(&run->first_failure, memory_order_relaxed)) {
+            return;
+        }
+        for (int r = 0; r < run->num_reductions; r++) {
+            if (run->kinds[r] == IR_REDUCE_STEP) {
+                uint64_t offset = (uint64_t)k * (uint64_t)run->steps[r];
+                values[run->reductions[r]].i = (int64_t)((uint64_t)run->firsts[r] + offset);
+            }
+        }
+        if (!run_iteration(run, thread, values, k)) {
+            return;
+        }
+        for (int r = 0; r < run->num_reductions; r++) {
+            values[run->reductions[r]] = values[run->updates[r]];
+        }
+    }
+}
+
+// Runs the loop after an IR_PARALLEL on the threads and sets the phis of its header as they are
+// at its exit. Returns false, leaving the loop to run, if it is too short to be worth it.
+static COLD bool run_parallel_loop(const IrFunction *f, const IrInstr *in, IrValue *values) {
+    const int *operands = f->pool + in->operands.start;
+    int64_t start = values[operands[0]].i, bound = values[operands[1]].i, count;
+    int threads = parallel_threads();
+    if (threads < 2 || bound <= start || __builtin_sub_overflow(bound, start, &count) ||
+        count < IR_PARALLEL_MIN_ITERATIONS || count > INT64_MAX / 2) {
+        return false;
+    }
+
+    ParallelRun run = {
+        .f = f,
+        .header = in->targets[0],
+        .body = f->instrs[ir_terminator(f, in->targets[0])].targets[0],
+        .start = start,
+        .frame_size = (size_t)f->num_instrs + (size_t)layouts[f - module->functions].max_phis,
+    };
+    atomic_init(&run.first_failure, INT64_MAX);
+    int entry = ir_pred_index(f, run.header, in->block);
+    int latch = 1 - entry;
+    int position = 0;
+    for (int p = f->blocks[run.header].first; p != IR_NONE && f->instrs[p].op == IR_PHI; p = f->instrs[p].next) {
+        IrReduction kind = IR_PARALLEL_KIND(in->imm, position++);
+        if (kind == IR_REDUCE_COUNTER) {
+            run.counter = p;
+            continue;
+        }
+        int r = run.num_reductions++;
+        run.reductions[r] = p;
+        run.updates[r] = ir_operand(f, p, latch);
+        run.kinds[r] = kind;
+        if (kind == IR_REDUCE_STEP) {
+            // phi + step, step + phi or phi - step
+            const IrInstr *update = &f->instrs[run.updates[r]];
+            int step = ir_operand(f, run.updates[r], 0) == p ? ir_operand(f, run.updates[r], 1) :
+                       ir_operand(f, run.updates[r], 0);
+            run.firsts[r] = values[ir_operand(f, p, entry)].i;
+            run.steps[r] = update->op == IR_SUB ? (int64_t)(0 - (uint64_t)values[step].i) : values[step].i;
+        }
+    }
+
+    run.frames = malloc(sizeof(IrValue) * run.frame_size * threads);
+    run.threads = aligned_alloc(_Alignof(ParallelThread), sizeof(ParallelThread) * threads);
+    if (!run.frames || !run.threads) {
+        fprintf(stderr, "Error: Memory allocation failed in run_parallel_loop\n");
+        exit(1);
+    }
+    for (int t = 0; t < threads; t++) {
+        IrValue *frame = run.frames + run.frame_size * (size_t)t;
+        memcpy(frame, values, sizeof(IrValue) * f->num_instrs);
+        for (int r = 0; r < run.num_reductions; r++) {
+            frame[run.reductions[r]].i = run.kinds[r] == IR_REDUCE_MUL || run.kinds[r] == IR_REDUCE_AND ? 1 : 0;
+        }
+        run.threads[t] = (ParallelThread){ .executed = 0 };
+    }
+
+    parallel_for(count, run_iterations, &run);
+
+    // The header runs once per iteration and once more to leave
+    int header_size = 0;
+    IR_FOR_EACH_INSTR(f, run.header, i) {
+        header_size++;
+    }
+    stats->instructions += (long long)header_size * (count + 1);
+    for (int t = 0; t < threads; t++) {
+        stats->instructions += run.threads[t].executed;
+    }
+    int64_t first_failure = atomic_load(&run.first_failure);
+    for (int t = 0; t < threads && first_failure != INT64_MAX; t++) {
+        if (run.threads[t].failed != NULL && run.threads[t].failed_iteration == first_failure) {
+            char message[96];
+            memcpy(message, run.threads[t].message, sizeof(message));
+            const IrInstr *failed = run.threads[t].failed;
+            free(run.frames);
+            free(run.threads);
+            fail(failed, message);
+        }
+    }
+
+    for (int r = 0; r < run.num_reductions; r++) {
+        int acc = run.reductions[r];
+        IrValue result = values[ir_operand(f, acc, entry)];
+        if (run.kinds[r] == IR_REDUCE_STEP) {
+            values[acc].i = (int64_t)((uint64_t)run.firsts[r] + (uint64_t)count * (uint64_t)run.steps[r]);
+            continue;
+        }
+        for (int t = 0; t < threads; t++) {
+            IrValue partial = run.frames[run.frame_size * (size_t)t + (size_t)acc];
+            switch (run.kinds[r]) {
+                case IR_REDUCE_ADD: result.i = (int64_t)((uint64_t)result.i + (uint64_t)partial.i); break;
+                case IR_REDUCE_MUL: result.i = (int64_t)((uint64_t)result.i * (uint64_t)partial.i); break;
+                case IR_REDUCE_AND: result.i = result.i != 0 && partial.i != 0; break;
+                default: result.i = result.i != 0 || partial.i != 0; break;
+            }
+        }
+        values[acc] = result;
+    }
+    values[run.counter].i = bound;
+    free(run.frames);
+    free(run.threads);
+    return true;
+}
+
+/******************************************************/
+/* Compiled code */
+
+static void jit_index_error(int64_t index, int length, int line) {
+    fprintf(stderr, "Error: index %lld out of bounds of array of length %d at line %d\n",
+            (long long)index, length, line);
+    longjmp(runtime_error, 1);
+}
+
+static void jit_division_error(int line) {
+    fprintf(stderr, "Error: division by zero at line %d\n", line);
+    longjmp(runtime_error, 1);
+}
+
+static void jit_stack_overflow(int function) {
+    fprintf(stderr, "Error: call stack overflow in '%s'\n", module->functions[function].name);
+    longjmp(runtime_error, 1);
+}
+
+// Called by compiled code for a function that is not compiled
+static uint64_t jit_interpret(int id, const uint64_t *args) {
+    size_t top = stack_top;
+    if (top + IR_MAX_PARAMS > stack_slots) {
+        fprintf(stderr, "Error: call stack overflow in '%s'\n", module->functions[id].name);
+        longjmp(runtime_error, 1);
+    }
+    memcpy(&stack[top], args, sizeof(IrValue) * module->functions[id].num_params);
+    IrValue result = call_function(id);
+    uint64_t bits;
+    memcpy(&bits, &result, sizeof(bits));
+    return bits;
+}
+
+static void count_hotness(int id) {
+    // Compiled code would call a memoized function without looking at its results
+    if (module->functions[id].memoize || ir_jit_entry(jit, id) != NULL || jit_failed[id] ||
+        ++hotness[id] < IR_JIT_THRESHOLD) {
+        return;
+    }
+    if (ir_jit_compile(jit, id)) {
+        stats->compiled_functions++;
+    } else {
+        jit_failed[id] = true;
+    }
+}
+
+static IrValue enter_compiled(const IrFunction *f, void *entry, const uint64_t *values) {
+    IrValue result;
+    if (f->return_type == IR_FLOAT) {
+        result.f = ((IrJitFloatEntry)entry)(values);
+    } else {
+        result.i = ((IrJitIntEntry)entry)(values);
+    }
+    return result;
+}
+
+// Continues a running call in compiled code from the start of a loop header
+static COLD IrValue enter_loop(const IrFunction *f, void *entry, const IrValue *values) {
+    uint64_t *raw = malloc(sizeof(uint64_t) * (f->num_instrs + 1));
+    for (int i = 0; i < f->num_instrs; i++) {
+        IrOpcode op = f->instrs[i].op;
+        if ((op == IR_ARRAY || op == IR_GLOBAL) && values[i].a != NULL) {
+            raw[i] = (uint64_t)(uintptr_t)values[i].a->data;
+        } else {
+            memcpy(&raw[i], &values[i], sizeof(uint64_t));
+        }
+    }
+    IrValue result = enter_compiled(f, entry, raw);
+    free(raw);
+    return result;
+}
+
+/******************************************************/
+/* Memoization */
+
+static uint64_t hash_arguments(const IrValue *args, int n) {
+    uint64_t hash = 0x9e3779b97f4a7c15u;
+    for (int k = 0; k < n; k++) {
+        uint64_t bits;
+        memcpy(&bits, &args[k], sizeof(bits));
+        hash = (hash ^ bits) * 0xff51afd7ed558ccdu;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// Finds the entry of the arguments, or else where they go: a free entry near their place, or
+// the place itself once the entries around it are taken, replacing the result there
+static int memo_slot(const MemoCache *cache, int n, const IrValue *args, bool *found) {
+    int mask = cache->capacity - 1;
+    int home = (int)(hash_arguments(args, n) & (uint64_t)mask);
+    for (int p = 0; p < IR_MEMO_PROBES; p++) {
+        int slot = (home + p) & mask;
+        if (!cache->used[slot]) {
+            break;
+        }
+        if (memcmp(&cache->keys[(size_t)slot * n], args, sizeof(IrValue) * n) == 0) {
+            *found = true;
+            return slot;
+        }
+    }
+    *found = false;
+    for (int p = 0; p < IR_MEMO_PROBES; p++) {
+        if (!cache->used[(home + p) & mask]) {
+            return (home + p) & mask;
+        }
+    }
+    return home;
+}
+
+static void memo_insert(MemoCache *cache, int n, const IrValue *args, IrValue result) {
+    bool found;
+    int slot = memo_slot(cache, n, args, &found);
+    if (!cache->used[slot]) {
+        cache->used[slot] = true;
+        cache->count++;
+    }
+    memcpy(&cache->keys[(size_t)slot * n], args, sizeof(IrValue) * n);
+    cache->results[slot] = result;
+}
+
+static void memo_grow(MemoCache *cache, int n) {
+    MemoCache old = *cache;
+    cache->capacity = old.capacity > 0 ? old.capacity * 2 : IR_MEMO_INITIAL_ENTRIES;
+    cache->count = 0;
+    cache->keys = malloc(sizeof(IrValue) * (size_t)cache->capacity * (n > 0 ? n : 1));
+    cache->results = malloc(sizeof(IrValue) * (size_t)cache->capacity);
+    cache->used = calloc(cache->capacity, sizeof(bool));
+    if (!cache->keys || !cache->results || !cache->used) {
+        fprintf(stderr, "Error: Memory allocation failed in memo_grow\n");
+        exit(1);
+    }
+    for (int slot = 0; slot < old.capacity; slot++) {
+        if (old.used[slot]) {
+            memo_insert(cache, n, &old.keys[(size_t)slot * n], old.results[slot]);
+        }
+    }
+    free(old.keys);
+    free(old.results);
+    free(old.used);
+}
+
+// Looks up the result of a call of a memoized function, counting it in the run stats
+static bool memo_lookup(int id, const IrValue *args, IrValue *result) {
+    MemoCache *cache = &memo_caches[id];
+    stats->memo_calls++;
+    if (cache->count == 0) {
+        return false;
+    }
+    bool found;
+    int slot = memo_slot(cache, module->functions[id].num_params, args, &found);
+    if (found) {
+        stats->memo_hits++;
+        *result = cache->results[slot];
+    }
+    return found;
+}
+
+static void memo_store(int id, const IrValue *args, IrValue result) {
+    MemoCache *cache = &memo_caches[id];
+    int n = module->functions[id].num_params;
+    if (cache->capacity < IR_MEMO_MAX_ENTRIES && cache->count * 2 >= cache->capacity) {
+        memo_grow(cache, n);
+    }
+    memo_insert(cache, n, args, result);
+}
+
+/******************************************************/
+/* Interpretation */
+
+// Runs a function on a frame at the top of the stack, where the caller put the arguments
+static IrValue call_function(int id) {
+    const IrFunction *f = &module->functions[id];
+    size_t base = stack_top;
+    IrValue result = { .i = 0 };
+    if (f->memoize && !initializing && memo_lookup(id, &stack[base], &result)) {
+        return result;
+    }
+    if (jit != NULL && id != module->init_function) {
+        count_hotness(id);
+        void *entry = ir_jit_entry(jit, id);
+        if (entry != NULL) {
+            frames[num_frames].function = id;
+            frames[num_frames].instr = IR_NONE;
+            num_frames++;
+            result = enter_compiled(f, entry, (const uint64_t *)&stack[base]);
+            num_frames--;
+            return result;
+        }
+    }
+
+    if (++call_depth > IR_MAX_CALL_DEPTH) {
+        fprintf(stderr, "Error: call stack overflow in '%s'\n", f->name);
+        longjmp(runtime_error, 1);
+    }
+
+    push_frame(f, base);
+    volatile ProfileFrame *where = &frames[num_frames];
+    where->function = id;
+    where->instr = f->blocks[f->entry].first;
+    num_frames++;
+    const FrameLayout *layout = &layouts[id];
+    const IrValue *args = &stack[base];
+    IrValue *values = &stack[base + layout->values];
+    IrValue *phi_values = &stack[base + layout->phis];
+    if (jit != NULL) {
+        // Zeroed so that arrays not created yet are recognizable when moving to compiled code
+        memset(values, 0, sizeof(IrValue) * f->num_instrs);
+    }
+    long long executed = 0;
+
+    int block = f->entry;
+    int pred = IR_NONE;
+    int osr_block = IR_NONE;
+    for (;;) {
+        int i = f->blocks[block].first;
+
+        // Phis read their operands for the edge taken, all at once
+        if (pred != IR_NONE) {
+            int k = ir_pred_index(f, block, pred);
+            int num_phis = 0;
+            for (int p = i; p != IR_NONE && f->instrs[p].op == IR_PHI; p = f->instrs[p].next) {
+                phi_values[num_phis++] = values[ir_operand(f, p, k)];
+            }
+            for (int p = 0; p < num_phis; p++) {
+                values[i] = phi_values[p];
+                i = f->instrs[i].next;
+            }
+            executed += num_phis;
+        }
+
+        if (block == osr_block) {
+            void *entry = ir_jit_osr_entry(jit, id, block);
+            osr_block = IR_NONE;
+            if (entry != NULL) {
+                stats->instructions += executed;
+                executed = 0;
+                where->instr = IR_NONE;
+                // The compiled code counts the call from here on
+                call_depth--;
+                result = enter_loop(f, entry, values);
+                call_depth++;
+                goto done;
+            }
+        }
+
+        for (; i != IR_NONE; i = f->instrs[i].next) {
+            const IrInstr *in = &f->instrs[i];
+            const int *operands = f->pool + in->operands.start;
+            IrValue a = {0}, b = {0};
+            if (in->operands.count > 0) {
+                a = values[operands[0]];
+            }
+            if (in->operands.count > 1) {
+                b = values[operands[1]];
+            }
+            bool is_float = in->type == IR_FLOAT;
+            executed++;
+            where->instr = i;
+
+            switch ((IrOpcode)in->op) {
+                case IR_NOP:
+                case IR_PHI:
+                    break;
+                case IR_CONST:
+                    values[i].i = in->imm;
+                    break;
+                case IR_PARAM:
+                    values[i] = args[in->imm];
+                    break;
+                case IR_ADD:
+                    if (is_float) values[i].f = a.f + b.f;
+                    else values[i].i = (int64_t)((uint64_t)a.i + (uint64_t)b.i);
+                    break;
+                case IR_SUB:
+                    if (is_float) values[i].f = a.f - b.f;
+                    else values[i].i = (int64_t)((uint64_t)a.i - (uint64_t)b.i);
+                    break;
+                case IR_MUL:
+                    if (is_float) values[i].f = a.f * b.f;
+                    else values[i].i = (int64_t)((uint64_t)a.i * (uint64_t)b.i);
+                    break;
+                case IR_DIV:
+                case IR_MOD:
+                    if (is_float) {
+                        values[i].f = a.f / b.f;
+                        break;
+                    }
+                    if (b.i == 0) {
+                        fail(in, "division by zero");
+                    }
+                    if (b.i == -1) {
+                        values[i].i = in->op == IR_DIV ? (int64_t)(0 - (uint64_t)a.i) : 0;
+                    } else {
+                        values[i].i = in->op == IR_DIV ? a.i / b.i : a.i % b.i;
+                    }
+                    break;
+                case IR_POW:
+                    if (is_float) values[i].f = pow(a.f, b.f);
+                    else values[i].i = int_pow(a.i, b.i);
+                    break;
+                case IR_NEG:
+                    if (is_float) values[i].f = -a.f;
+                    else values[i].i = (int64_t)(0 - (uint64_t)a.i);
+                    break;
+                case IR_NOT:
+                    values[i].i = f->instrs[operands[0]].type == IR_FLOAT ? a.f == 0.0 : a.i == 0;
+                    break;
+                case IR_EQ:
+                case IR_NE:
+                case IR_LT:
+                case IR_LE:
+                case IR_GT:
+                case IR_GE:
+                    values[i].i = compare(in->op, a, b, f->instrs[operands[0]].type == IR_FLOAT);
+                    break;
+                case IR_CONVERT:
+                    if (is_float) values[i].f = (double)a.i;
+                    else values[i].i = to_int(a.f);
+                    break;
+                case IR_CALL: {
+                    int callee = (int)in->imm;
+                    stats->instructions += executed;
+                    executed = 0;
+                    const IrInstr *next = in->next != IR_NONE ? &f->instrs[in->next] : NULL;
+                    // A memoized function keeps its frame, its arguments are the key of its result
+                    bool is_tail = next != NULL && next->op == IR_RETURN && !f->memoize &&
+                                   !module->functions[callee].memoize &&
+                                   (next->operands.count == 0 ? in->type == IR_VOID : ir_operand(f, in->next, 0) == i);
+                    if (!is_tail || (jit != NULL && ir_jit_entry(jit, callee) != NULL)) {
+                        // The arguments go straight into the frame of the callee
+                        for (int k = 0; k < in->operands.count; k++) {
+                            stack[stack_top + k] = values[operands[k]];
+                        }
+                        values[i] = call_function(callee);
+                        break;
+                    }
+
+                    // A tail call: the callee takes over the frame, the arguments are read first
+                    if (jit != NULL) {
+                        count_hotness(callee);
+                    }
+                    IrValue call_args[IR_MAX_PARAMS];
+                    for (int k = 0; k < in->operands.count; k++) {
+                        call_args[k] = values[operands[k]];
+                    }
+                    id = callee;
+                    f = &module->functions[id];
+                    where->function = id;
+                    where->instr = f->blocks[f->entry].first;
+                    layout = &layouts[id];
+                    push_frame(f, base);
+                    memcpy(&stack[base], call_args, sizeof(IrValue) * in->operands.count);
+                    values = &stack[base + layout->values];
+                    phi_values = &stack[base + layout->phis];
+                    if (jit != NULL) {
+                        memset(values, 0, sizeof(IrValue) * f->num_instrs);
+                    }
+                    block = f->entry;
+                    pred = IR_NONE;
+                    goto next_block;
+                }
+                case IR_ARRAY: {
+                    IrArray *array = (IrArray *)&stack[base + layout->arrays[i]];
+                    array->length = (int)in->imm;
+                    memset(array->data, 0, sizeof(IrValue) * in->imm);
+                    values[i].a = array;
+                    break;
+                }
+                case IR_GLOBAL:
+                    values[i].a = globals[in->imm];
+                    break;
+                case IR_LOAD:
+                    values[i] = in->flags & IR_IN_BOUNDS ? a.a->data[b.i] : *checked_element(in, a.a, b.i);
+                    break;
+                case IR_STORE:
+                    if (in->flags & IR_IN_BOUNDS) a.a->data[b.i] = values[operands[2]];
+                    else *checked_element(in, a.a, b.i) = values[operands[2]];
+                    break;
+                case IR_PRINTF:
+                    run_printf(f, in, values);
+                    break;
+                case IR_SCANF:
+                    values[i].i = run_scanf(in);
+                    break;
+                case IR_SCAN_VALUE: {
+                    int k = (int)in->imm;
+                    if (k >= a.i) {
+                        values[i] = b;
+                    } else if (scan_is_float[k]) {
+                        if (is_float) values[i].f = scan_results[k].f;
+                        else values[i].i = to_int(scan_results[k].f);
+                    } else {
+                        if (is_float) values[i].f = (double)scan_results[k].i;
+                        else values[i].i = scan_results[k].i;
+                    }
+                    break;
+                }
+                case IR_VECTOR:
+                    if (run_vector_loop(f, in, values)) {
+                        // As if the loop had run and its header had branched to the exit
+                        pred = in->targets[0];
+                        block = in->targets[1];
+                        goto next_block;
+                    }
+                    break;
+                case IR_PARALLEL:
+                    if (run_parallel_loop(f, in, values)) {
+                        pred = in->targets[0];
+                        block = in->targets[1];
+                        goto next_block;
+                    }
+                    break;
+                case IR_JUMP:
+                    pred = block;
+                    block = in->targets[0];
+                    goto back_edge;
+                case IR_BRANCH:
+                    pred = block;
+                    block = in->targets[a.i != 0 ? 0 : 1];
+                    goto back_edge;
+                case IR_RETURN:
+                    if (in->operands.count > 0) {
+                        result = a;
+                    }
+                    goto done;
+                case IR_OPCODE_COUNT:
+                    break;
+            }
+        }
+        fprintf(stderr, "Error: block b%d of '%s' has no terminator\n", block, f->name);
+        longjmp(runtime_error, 1);
+back_edge:
+        if (jit != NULL && f->blocks[block].rpo_index <= f->blocks[pred].rpo_index && id != module->init_function) {
+            count_hotness(id);
+            if (ir_jit_entry(jit, id) != NULL) {
+                osr_block = block;
+            }
+        }
+next_block:
+        continue;
+    }
+
+done:
+    stats->instructions += executed;
+    if (f->memoize && !initializing) {
+        memo_store(id, &stack[base], result);
+    }
+    stack_top = base;
+    call_depth--;
+    num_frames--;
+    return result;
+}
+
+// Runs the global initializers and main(), returns false on a runtime error
+bool ir_run(const IrModule *program, bool use_jit, bool profile, int *exit_code, IrRunStats *run_stats) {
+    module = program;
+    stats = run_stats;
+    memset(stats, 0, sizeof(*stats));
+    call_depth = 0;
+    num_frames = 0;
+    initializing = false;
+    vector_init();
+    parallel_init();
+
+    if (module->main_function == IR_NONE) {
+        fprintf(stderr, "Error: no main function to run\n");
+        return false;
+    }
+
+    stack = mmap(NULL, IR_STACK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) {
+        fprintf(stderr, "Error: Memory allocation failed in ir_run\n");
+        exit(1);
+    }
+    stack_top = 0;
+    stack_slots = IR_STACK_BYTES / sizeof(IrValue);
+    layouts = calloc(module->num_functions + 1, sizeof(FrameLayout));
+    for (int id = 0; id < module->num_functions; id++) {
+        if (module->functions[id].defined) {
+            compute_layout(&module->functions[id], &layouts[id]);
+        }
+    }
+
+    memo_caches = calloc(module->num_functions + 1, sizeof(MemoCache));
+    print_formats = calloc(module->num_strings + 1, sizeof(PrintFormat *));
+    scan_plans = calloc(module->num_strings + 1, sizeof(ScanPlan *));
+    globals = malloc(sizeof(IrArray *) * (module->num_globals + 1));
+    void **global_elements = malloc(sizeof(void *) * (module->num_globals + 1));
+    for (int g = 0; g < module->num_globals; g++) {
+        globals[g] = new_array(module->globals[g].length);
+        global_elements[g] = globals[g]->data;
+    }
+
+    if (use_jit) {
+        IrJitRuntime runtime = { jit_interpret, jit_index_error, jit_division_error, jit_stack_overflow, &call_depth,
+                                 global_elements };
+        jit = ir_jit_new(module, &runtime);
+        hotness = calloc(module->num_functions + 1, sizeof(int));
+        jit_failed = calloc(module->num_functions + 1, sizeof(bool));
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (profile) {
+        profile_start(module, frames, &num_frames);
+    }
+    bool ok = true;
+    if (setjmp(runtime_error) == 0) {
+        if (module->init_function != IR_NONE) {
+            initializing = true;
+            call_function(module->init_function);
+            initializing = false;
+        }
+        IrValue result = call_function(module->main_function);
+        *exit_code = module->functions[module->main_function].return_type == IR_FLOAT ?
+                     (int)to_int(result.f) : (int)result.i;
+    } else {
+        // The frames left on the C stack are abandoned, the run is over anyway
+        ok = false;
+    }
+    output_end();
+    input_end();
+    parallel_end();
+    if (profile) {
+        profile_stop();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+    munmap(stack, IR_STACK_BYTES);
+    stack = NULL;
+    for (int id = 0; id < module->num_functions; id++) {
+        free(layouts[id].arrays);
+        free(memo_caches[id].keys);
+        free(memo_caches[id].results);
+        free(memo_caches[id].used);
+    }
+    free(memo_caches);
+    memo_caches = NULL;
+    free(layouts);
+    layouts = NULL;
+    ir_jit_free(jit);
+    jit = NULL;
+    free(hotness);
+    free(jit_failed);
+    for (int g = 0; g < module->num_globals; g++) {
+        free(globals[g]);
+    }
+    free(globals);
+    free(global_elements);
+    globals = NULL;
+    for (int s = 0; s < module->num_strings; s++) {
+        print_format_free(print_formats[s]);
+        scan_plan_free(scan_plans[s]);
+    }
+    free(print_formats);
+    free(scan_plans);
+    scan_plans = NULL;
+    free(print_text);
+    print_formats = NULL;
+    print_text = NULL;
+    print_text_capacity = 0;
+    return ok;
+}
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "ir.h"
+#include "output.h"
+#include "input.h"
+
+// Just-in-time compiler for hot functions
+//
+// Compiles a function with codegen.c and assembler.c straight into executable memory. All
+// code lives in one reserved range of address space, so compiled code reaches everything
+// with 32-bit displacements: a table with the current address of every function comes
+// first, then the compiled functions, each with its code mapped read and execute and its
+// data read only. Functions the interpreter still runs are called through small bridges
+// that hand the arguments back to it, and the table is updated as functions get compiled.
+
+#define IR_JIT_ARENA_SIZE (256 << 20)
+
+struct IrJit {
+    const IrModule *module;
+    IrJitRuntime runtime;
+    uint8_t *arena;
+    size_t used;
+    size_t page_size;
+    void **table;           // Address called for each function
+    void **entries;         // __jit_entry of each compiled function
+    void ***osr_entries;    // __jit_osr_<block> of each compiled function, by block
+};
+
+static const struct {
+    const char *name;
+    void *address;
+} library_symbols[] = {
+    // Output goes through the buffer of the interpreter, in the order both print
+    { "printf", (void *)output_printf },
+    { "scanf", (void *)input_scanf },
+    { "fflush", (void *)output_fflush },
+    { "pow", (void *)pow },
+};
+
+// Page aligned space for size bytes, readable and writable until protect() is called
+static uint8_t *arena_alloc(IrJit *jit, size_t size) {
+    size = (size + jit->page_size - 1) / jit->page_size * jit->page_size;
+    if (size == 0 || jit->used + size > IR_JIT_ARENA_SIZE) {
+        return NULL;
+    }
+    uint8_t *memory = jit->arena + jit->used;
+    if (mprotect(memory, size, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+    jit->used += size;
+    return memory;
+}
+
+static bool protect(IrJit *jit, uint8_t *memory, size_t size, int protection) {
+    size = (size + jit->page_size - 1) / jit->page_size * jit->page_size;
+    return size == 0 || mprotect(memory, size, protection) == 0;
+}
+
+static bool resolve(void *context, const char *name, void **address, void ***slot) {
+    IrJit *jit = context;
+    const IrModule *module = jit->module;
+    if (strncmp(name, "core_", 5) == 0) {
+        int id = ir_find_function(module, name + 5);
+        if (id != IR_NONE) {
+            *slot = &jit->table[id];
+            return true;
+        }
+    }
+    if (strncmp(name, "g_", 2) == 0) {
+        for (int g = 0; g < module->num_globals; g++) {
+            if (strcmp(module->globals[g].name, name + 2) == 0) {
+                *address = jit->runtime.globals[g];
+                return true;
+            }
+        }
+    }
+    if (strcmp(name, "__core_index_error") == 0) {
+        *address = (void *)jit->runtime.index_error;
+        return true;
+    }
+    if (strcmp(name, "__core_division_error") == 0) {
+        *address = (void *)jit->runtime.division_error;
+        return true;
+    }
+    if (strcmp(name, "__core_stack_overflow") == 0) {
+        *address = (void *)jit->runtime.stack_overflow;
+        return true;
+    }
+    if (strcmp(name, "__core_call_depth") == 0) {
+        *address = jit->runtime.call_depth;
+        return true;
+    }
+    if (strcmp(name, "__jit_interpret") == 0) {
+        *address = (void *)jit->runtime.interpret;
+        return true;
+    }
+    if (strcmp(name, "stdout") == 0) {
+        *address = (void *)&stdout;
+        return true;
+    }
+    for (size_t s = 0; s < sizeof(library_symbols) / sizeof(library_symbols[0]); s++) {
+        if (strcmp(name, library_symbols[s].name) == 0) {
+            *address = library_symbols[s].address;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Assembles and links text into the arena, returns the object to look symbols up in
+static X86Object *load(IrJit *jit, const char *text, size_t length, uint8_t **code, uint8_t **data) {
+    X86Object *object = x86_assemble(text, length);
+    if (object == NULL) {
+        return NULL;
+    }
+    size_t code_size = x86_code_size(object);
+    size_t data_size = x86_data_size(object);
+    *code = arena_alloc(jit, code_size);
+    *data = arena_alloc(jit, data_size ? data_size : 1);
+    if (*code == NULL || *data == NULL) {
+        fprintf(stderr, "Error: out of memory for compiled code\n");
+        x86_free(object);
+        return NULL;
+    }
+    if (!x86_link(object, *code, *data, resolve, jit) ||
+        !protect(jit, *code, code_size, PROT_READ | PROT_EXEC) ||
+        !protect(jit, *data, data_size, PROT_READ)) {
+        x86_free(object);
+        return NULL;
+    }
+    return object;
+}
+
+// Bridges from compiled code back to the interpreter: the arguments go to an array on the stack
+static bool load_bridges(IrJit *jit) {
+    const IrModule *module = jit->module;
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    fputs("    .intel_syntax noprefix\n    .text\n", out);
+    for (int id = 0; id < module->num_functions; id++) {
+        const IrFunction *f = &module->functions[id];
+        if (!f->defined) {
+            continue;
+        }
+        static const char *int_registers[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+        int int_regs = 0, float_regs = 0, stack_index = 0;
+        fprintf(out, "__jit_bridge_%d:\n    push rbp\n    mov rbp, rsp\n    sub rsp, %d\n", id, 8 * IR_MAX_PARAMS);
+        for (int p = 0; p < f->num_params; p++) {
+            if (f->param_types[p] == IR_FLOAT && float_regs < 8) {
+                fprintf(out, "    movsd QWORD PTR [rsp + %d], xmm%d\n", 8 * p, float_regs++);
+            } else if (f->param_types[p] != IR_FLOAT && int_regs < 6) {
+                fprintf(out, "    mov QWORD PTR [rsp + %d], %s\n", 8 * p, int_registers[int_regs++]);
+            } else {
+                fprintf(out, "    mov rax, QWORD PTR [rbp + %d]\n", 16 + 8 * stack_index++);
+                fprintf(out, "    mov QWORD PTR [rsp + %d], rax\n", 8 * p);
+            }
+        }
+        fprintf(out, "    mov edi, %d\n    mov rsi, rsp\n    call __jit_interpret\n", id);
+        if (f->return_type == IR_FLOAT) {
+            fputs("    movq xmm0, rax\n", out);
+        }
+        fputs("    mov rsp, rbp\n    pop rbp\n    ret\n", out);
+    }
+    fclose(out);
+
+    uint8_t *code, *data;
+    X86Object *object = load(jit, text, length, &code, &data);
+    free(text);
+    if (object == NULL) {
+        return false;
+    }
+    for (int id = 0; id < module->num_functions; id++) {
+        char name[32];
+        snprintf(name, sizeof(name), "__jit_bridge_%d", id);
+        jit->table[id] = x86_symbol(object, name, code, data);
+    }
+    x86_free(object);
+    return true;
+}
+
+IrJit *ir_jit_new(const IrModule *module, const IrJitRuntime *runtime) {
+    IrJit *jit = calloc(1, sizeof(IrJit));
+    jit->module = module;
+    jit->runtime = *runtime;
+    jit->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    jit->arena = mmap(NULL, IR_JIT_ARENA_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (jit->arena == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map memory for compiled code\n");
+        free(jit);
+        return NULL;
+    }
+    jit->table = (void **)arena_alloc(jit, sizeof(void *) * (module->num_functions + 1));
+    jit->entries = calloc(module->num_functions + 1, sizeof(void *));
+    jit->osr_entries = calloc(module->num_functions + 1, sizeof(void **));
+    if (jit->table == NULL || !load_bridges(jit)) {
+        ir_jit_free(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+// Compiles a function, later calls from compiled code go straight to it
+bool ir_jit_compile(IrJit *jit, int function) {
+    const IrFunction *f = &jit->module->functions[function];
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    ir_emit_x86_64_jit(out, jit->module, function);
+    fclose(out);
+
+    uint8_t *code, *data;
+    X86Object *object = load(jit, text, length, &code, &data);
+    free(text);
+    if (object == NULL) {
+        return false;
+    }
+    char name[IR_NAME_LENGTH + 16];
+    snprintf(name, sizeof(name), "core_%s", f->name);
+    void *address = x86_symbol(object, name, code, data);
+    jit->entries[function] = x86_symbol(object, "__jit_entry", code, data);
+    jit->osr_entries[function] = calloc(f->num_blocks + 1, sizeof(void *));
+    for (int b = 0; b < f->num_blocks; b++) {
+        snprintf(name, sizeof(name), "__jit_osr_%d", b);
+        jit->osr_entries[function][b] = x86_symbol(object, name, code, data);
+    }
+    x86_free(object);
+    jit->table[function] = address;
+    return true;
+}
+
+// IrJitIntEntry or IrJitFloatEntry taking the arguments, NULL if the function is not compiled
+void *ir_jit_entry(const IrJit *jit, int function) {
+    return jit->entries[function];
+}
+
+// Entry at a loop header taking all the values of the function, NULL if there is none
+void *ir_jit_osr_entry(const IrJit *jit, int function, int block) {
+    return jit->osr_entries[function] ? jit->osr_entries[function][block] : NULL;
+}
+
+void ir_jit_free(IrJit *jit) {
+    if (jit == NULL) {
+        return;
+    }
+    for (int id = 0; id < jit->module->num_functions; id++) {
+        free(jit->osr_entries[id]);
+    }
+    free(jit->osr_entries);
+    free(jit->entries);
+    munmap(jit->arena, IR_JIT_ARENA_SIZE);
+    free(jit);
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "logger.h"
+
+// Buffered console output with levels and categories (see logger.h)
+
+#define LOG_BUFFER_SIZE (64 * 1024)
+
+LogLevel log_level = LOG_LEVEL_INFO;
+unsigned log_categories = LOG_ALL;
+
+static char buffer[LOG_BUFFER_SIZE];
+static size_t used;
+static bool initialized;
+
+static const char *level_names[] = { "error", "warn", "info", "debug", "trace" };
+static const struct {
+    const char *name;
+    LogCategory category;
+} category_names[] = {
+    { "scanner", LOG_SCANNER },
+    { "parser", LOG_PARSER },
+    { "ir", LOG_IR },
+    { "all", LOG_ALL },
+};
+
+void log_flush(void) {
+    if (used > 0) {
+        fwrite(buffer, 1, used, stdout);
+        used = 0;
+    }
+    fflush(stdout);
+}
+
+// CORE_LOG is a comma separated list of a level and categories, e.g. CORE_LOG=trace,parser
+static void parse_environment(void) {
+    const char *setting = getenv("CORE_LOG");
+    if (setting == NULL) {
+        return;
+    }
+    unsigned categories = 0;
+    while (*setting != '\0') {
+        size_t length = strcspn(setting, ",");
+        bool known = false;
+        for (int l = 0; l <= LOG_LEVEL_TRACE; l++) {
+            if (strlen(level_names[l]) == length && strncmp(setting, level_names[l], length) == 0) {
+                log_level = (LogLevel)l;
+                known = true;
+            }
+        }
+        for (size_t c = 0; c < sizeof(category_names) / sizeof(category_names[0]); c++) {
+            if (strlen(category_names[c].name) == length && strncmp(setting, category_names[c].name, length) == 0) {
+                categories |= category_names[c].category;
+                known = true;
+            }
+        }
+        if (!known && length > 0) {
+            fprintf(stderr, "Error: unknown level or category '%.*s' in CORE_LOG\n", (int)length, setting);
+        }
+        setting += length + (setting[length] == ',');
+    }
+    if (categories != 0) {
+        log_categories = categories;
+    }
+}
+
+void log_init(LogLevel level) {
+    log_level = level;
+    parse_environment();
+    if (!initialized) {
+        initialized = true;
+        atexit(log_flush);
+    }
+}
+
+void log_write(LogLevel level, LogCategory category, const char *format, ...) {
+    (void)category;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer + used, sizeof(buffer) - used, format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length >= sizeof(buffer) - used) {
+        // Did not fit: write out what is buffered and format again, straight to stdout if still too long
+        log_flush();
+        va_start(args, format);
+        if ((size_t)length < sizeof(buffer)) {
+            vsnprintf(buffer, sizeof(buffer), format, args);
+            used = (size_t)length;
+        } else {
+            vfprintf(stdout, format, args);
+        }
+        va_end(args);
+    } else {
+        used += (size_t)length;
+    }
+    if (level <= LOG_LEVEL_WARN) {
+        log_flush();
+    }
+}
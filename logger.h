@@ -0,0 +1,56 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdbool.h>
+
+// Buffered console output of the scanner and the parser (logger.c)
+//
+// Messages have a level and a category and go to stdout through one buffer, which is only
+// written when it fills up, when an error or warning is logged, on log_flush() and at exit.
+// A message above the current level or outside the enabled categories is dropped before its
+// arguments are formatted. The per-token trace lines use log_trace(), which builds with
+// NDEBUG (release builds) compile out entirely.
+
+typedef enum {
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_TRACE
+} LogLevel;
+
+typedef enum {
+    LOG_SCANNER = 1 << 0,
+    LOG_PARSER = 1 << 1,
+    LOG_IR = 1 << 2,
+    LOG_ALL = LOG_SCANNER | LOG_PARSER | LOG_IR
+} LogCategory;
+
+extern LogLevel log_level;
+extern unsigned log_categories;
+
+// level is the default, the CORE_LOG environment variable can override it and the categories
+void log_init(LogLevel level);
+void log_write(LogLevel level, LogCategory category, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+void log_flush(void);
+
+static inline bool log_enabled(LogLevel level, LogCategory category) {
+    return level <= log_level && (log_categories & category) != 0;
+}
+
+#define log_message(level, category, ...) \
+    (log_enabled(level, category) ? log_write(level, category, __VA_ARGS__) : (void)0)
+
+#define log_error(category, ...) log_message(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+#define log_warn(category, ...) log_message(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define log_info(category, ...) log_message(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define log_debug(category, ...) log_message(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+
+#ifdef NDEBUG
+#define log_trace(category, ...) ((void)0)
+#else
+#define log_trace(category, ...) log_message(LOG_LEVEL_TRACE, category, __VA_ARGS__)
+#endif
+
+#endif //LOGGER_H
@@ -0,0 +1,921 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ir.h"
+
+// Loop optimizations over the SSA IR
+//
+// Natural loops are found from the back edges of the dominator tree, each one gets a
+// preheader, then, from the innermost loop outwards:
+//   - loop-invariant code motion moves instructions whose operands are all defined outside
+//     the loop into the preheader
+//   - strength reduction replaces the multiplication of an induction variable by an
+//     invariant with a new induction variable that is stepped by an addition
+//   - a loop that only maps arrays element by element, or sums such elements, gets an
+//     IR_VECTOR in its preheader so the interpreter can run it through vector.c
+//   - otherwise a loop whose iterations only share reductions and arrays they read, or write
+//     each at its own index, gets an IR_PARALLEL so the interpreter can split it across threads
+// Outside of loops, "^" with a small constant exponent becomes multiplications.
+
+typedef struct {
+    int header;
+    int preheader;
+    int *blocks;        // Body in reverse postorder, header first
+    int num_blocks;
+    bool *contains;     // Indexed by block
+    int num_latches;
+    int latch;          // The source of the back edge when there is only one
+} Loop;
+
+static IrModule *module;
+static IrFunction *fn;
+static IrLoopStats stats;
+
+static Loop *loops;
+static int num_loops;
+
+/******************************************************/
+/* Finding loops */
+
+static void free_loops(void) {
+    for (int l = 0; l < num_loops; l++) {
+        free(loops[l].blocks);
+        free(loops[l].contains);
+    }
+    free(loops);
+    loops = NULL;
+    num_loops = 0;
+}
+
+// Collects the natural loop of every header, loops sharing a header are merged
+static void find_loops(void) {
+    free_loops();
+    int *stack = malloc(sizeof(int) * (fn->num_blocks + 1));
+
+    for (int r = 0; r < fn->rpo.count; r++) {
+        int header = fn->pool[fn->rpo.start + r];
+        Loop loop = { .header = header, .preheader = IR_NONE, .latch = IR_NONE };
+
+        for (int k = 0; k < fn->blocks[header].preds.count; k++) {
+            int pred = ir_pred(fn, header, k);
+            if (!ir_dominates(fn, header, pred)) {
+                continue;
+            }
+            if (loop.contains == NULL) {
+                loop.contains = calloc(fn->num_blocks, sizeof(bool));
+                loop.contains[header] = true;
+            }
+            loop.num_latches++;
+            loop.latch = pred;
+
+            // Everything that reaches the latch without going through the header
+            int top = 0;
+            if (!loop.contains[pred]) {
+                loop.contains[pred] = true;
+                stack[top++] = pred;
+            }
+            while (top > 0) {
+                int b = stack[--top];
+                for (int p = 0; p < fn->blocks[b].preds.count; p++) {
+                    int above = ir_pred(fn, b, p);
+                    if (!loop.contains[above] && fn->blocks[above].rpo_index != IR_NONE) {
+                        loop.contains[above] = true;
+                        stack[top++] = above;
+                    }
+                }
+            }
+        }
+        if (loop.contains == NULL) {
+            continue;
+        }
+
+        loop.blocks = malloc(sizeof(int) * fn->rpo.count);
+        for (int k = 0; k < fn->rpo.count; k++) {
+            int b = fn->pool[fn->rpo.start + k];
+            if (loop.contains[b]) {
+                loop.blocks[loop.num_blocks++] = b;
+            }
+        }
+        loops = realloc(loops, sizeof(Loop) * (num_loops + 1));
+        loops[num_loops++] = loop;
+    }
+    free(stack);
+}
+
+static int compare_loop_size(const void *a, const void *b) {
+    return ((const Loop *)a)->num_blocks - ((const Loop *)b)->num_blocks;
+}
+
+// Makes a single block the only way into the loop from outside, returns true if one was created
+static bool make_preheader(Loop *loop) {
+    int header = loop->header;
+    int outside[64];
+    int num_outside = 0;
+    for (int k = 0; k < fn->blocks[header].preds.count; k++) {
+        int pred = ir_pred(fn, header, k);
+        if (!loop->contains[pred]) {
+            if (num_outside == 64) {
+                return false;
+            }
+            outside[num_outside++] = pred;
+        }
+    }
+    if (num_outside == 0 || header == fn->entry) {
+        return false;
+    }
+    if (num_outside == 1 && ir_num_succs(fn, outside[0]) == 1) {
+        loop->preheader = outside[0];
+        return false;
+    }
+
+    int preheader = ir_add_block(fn);
+    for (int o = 0; o < num_outside; o++) {
+        IrInstr *terminator = &fn->instrs[ir_terminator(fn, outside[o])];
+        for (int t = 0; t < 2; t++) {
+            if (terminator->targets[t] == header) {
+                terminator->targets[t] = preheader;
+            }
+        }
+        ir_add_pred(fn, preheader, outside[o]);
+    }
+
+    // The phis of the header take their outside value from the preheader
+    int num_phis = 0;
+    for (int phi = fn->blocks[header].first; phi != IR_NONE && fn->instrs[phi].op == IR_PHI;
+         phi = fn->instrs[phi].next) {
+        num_phis++;
+    }
+    int *merged = malloc(sizeof(int) * (num_phis + 1));
+    int p = 0;
+    for (int phi = fn->blocks[header].first; p < num_phis; phi = fn->instrs[phi].next, p++) {
+        if (num_outside == 1) {
+            merged[p] = ir_operand(fn, phi, ir_pred_index(fn, header, outside[0]));
+            continue;
+        }
+        merged[p] = ir_new_instr(fn, IR_PHI, fn->instrs[phi].type);
+        fn->instrs[merged[p]].line_number = fn->instrs[phi].line_number;
+        fn->instrs[merged[p]].column_number = fn->instrs[phi].column_number;
+        ir_append(fn, preheader, merged[p]);
+        for (int o = 0; o < num_outside; o++) {
+            ir_add_operand(fn, merged[p], ir_operand(fn, phi, ir_pred_index(fn, header, outside[o])));
+        }
+    }
+    for (int o = 0; o < num_outside; o++) {
+        ir_remove_pred(fn, header, outside[o]);
+    }
+    ir_add_pred(fn, header, preheader);
+    p = 0;
+    for (int phi = fn->blocks[header].first; p < num_phis; phi = fn->instrs[phi].next, p++) {
+        ir_add_operand(fn, phi, merged[p]);
+    }
+    free(merged);
+
+    int jump = ir_new_instr(fn, IR_JUMP, IR_VOID);
+    fn->instrs[jump].targets[0] = header;
+    ir_append(fn, preheader, jump);
+    return true;
+}
+
+/******************************************************/
+/* Loop-invariant code motion */
+
+static bool is_invariant(const Loop *loop, int value) {
+    return !loop->contains[fn->instrs[value].block];
+}
+
+static bool is_const(int value, int64_t *imm) {
+    const IrInstr *in = &fn->instrs[value];
+    if (in->op == IR_CONST && in->type == IR_INT) {
+        *imm = in->imm;
+        return true;
+    }
+    return false;
+}
+
+// Length of the array behind a handle, or -1 if unknown
+static int64_t array_length(int handle) {
+    const IrInstr *in = &fn->instrs[handle];
+    if (in->op == IR_ARRAY) {
+        return in->imm;
+    }
+    if (in->op == IR_GLOBAL) {
+        return module->globals[in->imm].length;
+    }
+    return -1;
+}
+
+static bool writes_memory(const Loop *loop) {
+    for (int k = 0; k < loop->num_blocks; k++) {
+        IR_FOR_EACH_INSTR(fn, loop->blocks[k], i) {
+            IrOpcode op = fn->instrs[i].op;
+            if (op == IR_STORE || op == IR_CALL || op == IR_SCANF) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Checks if an instruction with invariant operands can run in the preheader instead.
+// It may then run when the loop body would not, so it must not be able to fail.
+static bool can_hoist(const Loop *loop, int i, bool memory_written) {
+    const IrInstr *in = &fn->instrs[i];
+    int64_t divisor, index;
+    switch ((IrOpcode)in->op) {
+        case IR_CONST:
+        case IR_GLOBAL:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_POW:
+        case IR_NEG:
+        case IR_NOT:
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+        case IR_CONVERT:
+            return true;
+        case IR_DIV:
+        case IR_MOD:
+            return in->type == IR_FLOAT ||
+                   (is_const(ir_operand(fn, i, 1), &divisor) && divisor != 0 && divisor != -1);
+        case IR_LOAD:
+            // The header runs whenever the preheader does, elsewhere the index must be in bounds
+            if (memory_written) {
+                return false;
+            }
+            return in->block == loop->header ||
+                   (is_const(ir_operand(fn, i, 1), &index) && index >= 0 &&
+                    index < array_length(ir_operand(fn, i, 0)));
+        default:
+            return false;
+    }
+}
+
+static void hoist_invariants(Loop *loop) {
+    bool memory_written = writes_memory(loop);
+    int terminator = ir_terminator(fn, loop->preheader);
+
+    for (int k = 0; k < loop->num_blocks; k++) {
+        int i = fn->blocks[loop->blocks[k]].first;
+        while (i != IR_NONE) {
+            int next = fn->instrs[i].next;
+            bool invariant = can_hoist(loop, i, memory_written);
+            for (int o = 0; invariant && o < fn->instrs[i].operands.count; o++) {
+                invariant = is_invariant(loop, ir_operand(fn, i, o));
+            }
+            if (invariant) {
+                ir_unlink(fn, i);
+                ir_insert_before(fn, terminator, i);
+                if (fn->instrs[i].op != IR_CONST) {
+                    stats.hoisted++;
+                }
+            }
+            i = next;
+        }
+    }
+}
+
+/******************************************************/
+/* Strength reduction */
+
+// An induction variable: phi = init on entry, phi + step (or phi - step) on the back edge
+typedef struct {
+    int phi;
+    int init;
+    int update;
+    int step;
+    bool decrements;
+} Induction;
+
+static bool find_induction(const Loop *loop, int phi, Induction *iv) {
+    const IrInstr *in = &fn->instrs[phi];
+    if (in->op != IR_PHI || in->type != IR_INT || in->operands.count != 2) {
+        return false;
+    }
+    int header = loop->header;
+    iv->phi = phi;
+    iv->init = ir_operand(fn, phi, ir_pred_index(fn, header, loop->preheader));
+    iv->update = ir_operand(fn, phi, ir_pred_index(fn, header, loop->latch));
+
+    const IrInstr *update = &fn->instrs[iv->update];
+    if (update->op != IR_ADD && update->op != IR_SUB) {
+        return false;
+    }
+    int a = ir_operand(fn, iv->update, 0);
+    int b = ir_operand(fn, iv->update, 1);
+    iv->decrements = update->op == IR_SUB;
+    if (a == phi && is_invariant(loop, b)) {
+        iv->step = b;
+        return true;
+    }
+    if (!iv->decrements && b == phi && is_invariant(loop, a)) {
+        iv->step = a;
+        return true;
+    }
+    return false;
+}
+
+static int insert_binary(IrOpcode op, IrType type, int before, int a, int b) {
+    int instr = ir_new_instr(fn, op, type);
+    fn->instrs[instr].line_number = fn->instrs[before].line_number;
+    fn->instrs[instr].column_number = fn->instrs[before].column_number;
+    ir_add_operand(fn, instr, a);
+    ir_add_operand(fn, instr, b);
+    ir_insert_before(fn, before, instr);
+    return instr;
+}
+
+// i * k becomes j, with j = init * k on entry and j + step * k on the back edge
+static void reduce_multiplications(Loop *loop) {
+    if (loop->num_latches != 1 || loop->preheader == IR_NONE) {
+        return;
+    }
+    int header = loop->header;
+    int terminator = ir_terminator(fn, loop->preheader);
+
+    for (int phi = fn->blocks[header].first; phi != IR_NONE && fn->instrs[phi].op == IR_PHI;
+         phi = fn->instrs[phi].next) {
+        Induction iv;
+        if (!find_induction(loop, phi, &iv)) {
+            continue;
+        }
+
+        // Reduced values by factor, shared by the multiplications with the same factor
+        int factors[16], reduced[16];
+        int num_factors = 0;
+
+        for (int k = 0; k < loop->num_blocks; k++) {
+            int i = fn->blocks[loop->blocks[k]].first;
+            while (i != IR_NONE) {
+                int next = fn->instrs[i].next;
+                const IrInstr *in = &fn->instrs[i];
+                if (in->op != IR_MUL || in->type != IR_INT || i == iv.update) {
+                    i = next;
+                    continue;
+                }
+                int a = ir_operand(fn, i, 0);
+                int b = ir_operand(fn, i, 1);
+                int factor = a == phi && is_invariant(loop, b) ? b :
+                             b == phi && is_invariant(loop, a) ? a : IR_NONE;
+                if (factor == IR_NONE) {
+                    i = next;
+                    continue;
+                }
+
+                int f = 0;
+                while (f < num_factors && factors[f] != factor) {
+                    f++;
+                }
+                if (f == num_factors) {
+                    if (num_factors == 16) {
+                        i = next;
+                        continue;
+                    }
+                    int start = insert_binary(IR_MUL, IR_INT, terminator, iv.init, factor);
+                    int step = insert_binary(IR_MUL, IR_INT, terminator, iv.step, factor);
+                    int j = ir_new_instr(fn, IR_PHI, IR_INT);
+                    fn->instrs[j].line_number = fn->instrs[i].line_number;
+                    fn->instrs[j].column_number = fn->instrs[i].column_number;
+                    ir_prepend(fn, header, j);
+                    int after_update = fn->instrs[iv.update].next;
+                    int j_next = insert_binary(iv.decrements ? IR_SUB : IR_ADD, IR_INT, after_update, j, step);
+                    for (int p = 0; p < fn->blocks[header].preds.count; p++) {
+                        ir_add_operand(fn, j, ir_pred(fn, header, p) == loop->preheader ? start : j_next);
+                    }
+                    factors[num_factors] = factor;
+                    reduced[num_factors++] = j;
+                }
+
+                ir_replace_uses(fn, i, reduced[f]);
+                ir_unlink(fn, i);
+                fn->instrs[i].op = IR_NOP;
+                stats.reduced_multiplications++;
+                i = next;
+            }
+        }
+    }
+}
+
+/******************************************************/
+/* Vectorization */
+
+// What the body of a loop marked with IR_VECTOR is made of
+typedef struct {
+    int counter;        // Header phi of i
+    int matched[8];     // Instructions of the body that belong to the pattern
+    int num_matched;
+} VectorMatch;
+
+static bool is_array_handle(const Loop *loop, int value) {
+    IrOpcode op = fn->instrs[value].op;
+    return (op == IR_ARRAY || op == IR_GLOBAL) && is_invariant(loop, value);
+}
+
+static void add_matched(VectorMatch *match, int instr) {
+    for (int k = 0; k < match->num_matched; k++) {
+        if (match->matched[k] == instr) {
+            return;
+        }
+    }
+    match->matched[match->num_matched++] = instr;
+}
+
+// An operand of the operation: the element at i of an array, or a value set before the loop
+static bool vector_operand(const Loop *loop, VectorMatch *match, int value, IrType type, int *operand,
+                           bool *is_array) {
+    const IrInstr *in = &fn->instrs[value];
+    if (in->type != type) {
+        return false;
+    }
+    if (is_invariant(loop, value)) {
+        *operand = value;
+        *is_array = false;
+        return true;
+    }
+    if (in->op != IR_LOAD || ir_operand(fn, value, 1) != match->counter ||
+        !is_array_handle(loop, ir_operand(fn, value, 0))) {
+        return false;
+    }
+    add_matched(match, value);
+    *operand = ir_operand(fn, value, 0);
+    *is_array = true;
+    return true;
+}
+
+// The test of a loop counting i up by one from start while i < bound
+typedef struct {
+    int counter;        // Header phi of i
+    int bound;
+    int exit;
+    int condition;
+    Induction iv;
+} CountedLoop;
+
+// Checks that a loop has a preheader, one back edge and nothing in its header but phis and the
+// test i < bound, where i counts up by one and bound does not change in the loop
+static bool find_counted_loop(const Loop *loop, CountedLoop *counted) {
+    int header = loop->header;
+    int branch = ir_terminator(fn, header);
+    if (loop->preheader == IR_NONE || loop->num_latches != 1 || branch == IR_NONE ||
+        fn->instrs[branch].op != IR_BRANCH) {
+        return false;
+    }
+    counted->exit = fn->instrs[branch].targets[1];
+    if (loop->contains[counted->exit] || !loop->contains[fn->instrs[branch].targets[0]]) {
+        return false;
+    }
+
+    counted->condition = ir_operand(fn, branch, 0);
+    IR_FOR_EACH_INSTR(fn, header, i) {
+        if (fn->instrs[i].op != IR_PHI && i != counted->condition && i != branch) {
+            return false;
+        }
+    }
+    const IrInstr *condition = &fn->instrs[counted->condition];
+    if (condition->op != IR_LT || condition->block != header) {
+        return false;
+    }
+    counted->counter = ir_operand(fn, counted->condition, 0);
+    counted->bound = ir_operand(fn, counted->condition, 1);
+    if (fn->instrs[counted->counter].op != IR_PHI || fn->instrs[counted->counter].block != header ||
+        fn->instrs[counted->counter].type != IR_INT || !is_invariant(loop, counted->bound)) {
+        return false;
+    }
+    int64_t step;
+    return find_induction(loop, counted->counter, &counted->iv) && !counted->iv.decrements &&
+           is_const(counted->iv.step, &step) && step == 1;
+}
+
+// Marks a loop doing dst[i] = x op y or acc = acc + (x op y) for i from start up to a bound, with
+// x and y elements at i or invariants. Nothing is carried from one i to the next but acc, so
+// the whole loop can run as a kernel. Returns true if the loop was marked.
+static bool vectorize(Loop *loop) {
+    CountedLoop counted;
+    if (!find_counted_loop(loop, &counted)) {
+        return false;
+    }
+    int header = loop->header;
+    int phis[2], num_phis = 0;
+    IR_FOR_EACH_INSTR(fn, header, i) {
+        if (fn->instrs[i].op == IR_PHI) {
+            if (num_phis == 2) {
+                return false;
+            }
+            phis[num_phis++] = i;
+        }
+    }
+    VectorMatch match = { .counter = counted.counter };
+    int bound = counted.bound;
+    Induction iv = counted.iv;
+    add_matched(&match, iv.update);
+
+    // The body runs straight from the header back to it
+    int body_size = 0;
+    int block = fn->instrs[ir_terminator(fn, header)].targets[0];
+    for (int k = 1; k < loop->num_blocks; k++) {
+        int jump = ir_terminator(fn, block);
+        if (fn->blocks[block].preds.count != 1 || jump == IR_NONE || fn->instrs[jump].op != IR_JUMP) {
+            return false;
+        }
+        IR_FOR_EACH_INSTR(fn, block, i) {
+            body_size += fn->instrs[i].op != IR_CONST && i != jump;
+        }
+        block = fn->instrs[jump].targets[0];
+    }
+    if (block != header) {
+        return false;
+    }
+
+    // What is computed: the stored value, or what the other phi adds
+    int counter_position = phis[0] == match.counter ? 0 : 1;
+    int acc = num_phis == 2 ? phis[1 - counter_position] : IR_NONE;
+    int dst = IR_NONE, value, init = IR_NONE;
+    if (acc == IR_NONE) {
+        int store = IR_NONE;
+        for (int k = 1; k < loop->num_blocks; k++) {
+            IR_FOR_EACH_INSTR(fn, loop->blocks[k], i) {
+                if (fn->instrs[i].op == IR_STORE) {
+                    store = i;
+                }
+            }
+        }
+        if (store == IR_NONE || ir_operand(fn, store, 1) != match.counter ||
+            !is_array_handle(loop, ir_operand(fn, store, 0))) {
+            return false;
+        }
+        add_matched(&match, store);
+        dst = ir_operand(fn, store, 0);
+        value = ir_operand(fn, store, 2);
+    } else {
+        int sum = ir_operand(fn, acc, ir_pred_index(fn, header, loop->latch));
+        init = ir_operand(fn, acc, ir_pred_index(fn, header, loop->preheader));
+        if (fn->instrs[sum].op != IR_ADD || is_invariant(loop, sum)) {
+            return false;
+        }
+        add_matched(&match, sum);
+        if (ir_operand(fn, sum, 0) == acc) {
+            value = ir_operand(fn, sum, 1);
+        } else if (ir_operand(fn, sum, 1) == acc) {
+            value = ir_operand(fn, sum, 0);
+        } else {
+            return false;
+        }
+    }
+
+    // x op y, or x alone
+    IrType type = fn->instrs[value].type;
+    IrOpcode op = fn->instrs[value].op;
+    int x, y = IR_NONE;
+    bool x_array, y_array = false;
+    if (!is_invariant(loop, value) && (op == IR_ADD || op == IR_SUB || op == IR_MUL)) {
+        add_matched(&match, value);
+        if (!vector_operand(loop, &match, ir_operand(fn, value, 0), type, &x, &x_array) ||
+            !vector_operand(loop, &match, ir_operand(fn, value, 1), type, &y, &y_array)) {
+            return false;
+        }
+    } else {
+        op = IR_NOP;
+        if (!vector_operand(loop, &match, value, type, &x, &x_array)) {
+            return false;
+        }
+    }
+    if (type == IR_VOID || value == acc || value == match.counter || body_size != match.num_matched ||
+        (acc != IR_NONE && fn->instrs[acc].type != type) ||
+        (dst != IR_NONE && fn->instrs[dst].type != type)) {
+        return false;
+    }
+
+    int vector = ir_new_instr(fn, IR_VECTOR, IR_VOID);
+    IrInstr *in = &fn->instrs[vector];
+    in->imm = IR_VECTOR_IMM(op, counter_position, 1 - counter_position);
+    in->flags = (acc != IR_NONE ? IR_VECTOR_REDUCE : 0) | (x_array ? IR_VECTOR_X_ARRAY : 0) |
+                (y_array ? IR_VECTOR_Y_ARRAY : 0);
+    in->targets[0] = header;
+    in->targets[1] = counted.exit;
+    in->line_number = fn->instrs[counted.condition].line_number;
+    in->column_number = fn->instrs[counted.condition].column_number;
+    ir_add_operand(fn, vector, iv.init);
+    ir_add_operand(fn, vector, bound);
+    ir_add_operand(fn, vector, acc != IR_NONE ? init : dst);
+    ir_add_operand(fn, vector, x);
+    if (op != IR_NOP) {
+        ir_add_operand(fn, vector, y);
+    }
+    ir_insert_before(fn, ir_terminator(fn, loop->preheader), vector);
+    stats.vectorized++;
+    return true;
+}
+
+/******************************************************/
+/* Parallelization */
+
+// Handles of the same array: the same global, or the same IR_ARRAY
+static bool same_array(int a, int b) {
+    const IrInstr *x = &fn->instrs[a], *y = &fn->instrs[b];
+    return a == b || (x->op == IR_GLOBAL && y->op == IR_GLOBAL && x->imm == y->imm);
+}
+
+static int count_uses(const Loop *loop, int value) {
+    int uses = 0;
+    for (int k = 0; k < loop->num_blocks; k++) {
+        IR_FOR_EACH_INSTR(fn, loop->blocks[k], i) {
+            for (int o = 0; o < fn->instrs[i].operands.count; o++) {
+                uses += ir_operand(fn, i, o) == value;
+            }
+        }
+    }
+    return uses;
+}
+
+// Values lower.c gives && and || as their right operand, always 0 or 1
+static bool is_boolean(int value) {
+    const IrInstr *in = &fn->instrs[value];
+    int64_t imm;
+    return (in->op >= IR_EQ && in->op <= IR_GE) || in->op == IR_NOT ||
+           (is_const(value, &imm) && (imm == 0 || imm == 1));
+}
+
+// Checks that the blocks of the right operand of && or ||, from its first block up to the join,
+// can run when the operator would skip them: no stores, no loads that may be out of bounds, no
+// divisions by what may be 0, and no loops that may not end
+static bool can_speculate(const Loop *loop, int first, int join) {
+    for (int k = 0; k < loop->num_blocks; k++) {
+        int block = loop->blocks[k];
+        if (block == join || !ir_dominates(fn, first, block)) {
+            continue;
+        }
+        for (int p = 0; p < fn->blocks[block].preds.count; p++) {
+            if (fn->blocks[ir_pred(fn, block, p)].rpo_index >= fn->blocks[block].rpo_index) {
+                return false;
+            }
+        }
+        IR_FOR_EACH_INSTR(fn, block, i) {
+            const IrInstr *in = &fn->instrs[i];
+            int64_t divisor;
+            if (in->op == IR_STORE || (in->op == IR_LOAD && !(in->flags & IR_IN_BOUNDS)) ||
+                ((in->op == IR_DIV || in->op == IR_MOD) && in->type == IR_INT &&
+                 (!is_const(ir_operand(fn, i, 1), &divisor) || divisor == 0))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// How a header phi other than i goes from one iteration to the next, -1 if it is not a
+// reduction. acc && x is lowered to a branch on acc, to the join if it is false and else to x,
+// then a phi of 0 and x at the join, which an assignment to a bool compares with 0 again.
+static int find_reduction(const Loop *loop, int acc) {
+    const IrInstr *in = &fn->instrs[acc];
+    if (in->type != IR_INT || in->operands.count != 2 || count_uses(loop, acc) != 1) {
+        return -1;
+    }
+    int next = ir_operand(fn, acc, ir_pred_index(fn, loop->header, loop->latch));
+    if (count_uses(loop, next) != 1) {
+        return -1;
+    }
+    const IrInstr *update = &fn->instrs[next];
+    if ((update->op == IR_ADD || update->op == IR_MUL) && update->type == IR_INT) {
+        // Ints wrap around, so the sums and products of the iterations can be taken in any order
+        if ((ir_operand(fn, next, 0) == acc) == (ir_operand(fn, next, 1) == acc)) {
+            return -1;
+        }
+        return update->op == IR_ADD ? IR_REDUCE_ADD : IR_REDUCE_MUL;
+    }
+
+    int64_t imm;
+    int phi = next;
+    if (update->op == IR_NE && is_const(ir_operand(fn, next, 1), &imm) && imm == 0) {
+        phi = ir_operand(fn, next, 0);
+        if (count_uses(loop, phi) != 1) {
+            return -1;
+        }
+    }
+    int join = fn->instrs[phi].block;
+    if (fn->instrs[phi].op != IR_PHI || fn->instrs[phi].operands.count != 2 || join == loop->header) {
+        return -1;
+    }
+    for (int k = 0; k < 2; k++) {
+        int test = ir_terminator(fn, ir_pred(fn, join, k));
+        int64_t shortcut;
+        if (test == IR_NONE || fn->instrs[test].op != IR_BRANCH || ir_operand(fn, test, 0) != acc ||
+            !is_const(ir_operand(fn, phi, k), &shortcut) || (shortcut != 0 && shortcut != 1)) {
+            continue;
+        }
+        // The shortcut is taken on false for &&, on true for ||
+        bool is_or = shortcut == 1;
+        int right = fn->instrs[test].targets[is_or ? 1 : 0];
+        if (fn->instrs[test].targets[is_or ? 0 : 1] != join || right == join ||
+            fn->blocks[right].preds.count != 1 || !is_boolean(ir_operand(fn, phi, 1 - k)) ||
+            !can_speculate(loop, right, join)) {
+            return -1;
+        }
+        return is_or ? IR_REDUCE_OR : IR_REDUCE_AND;
+    }
+    return -1;
+}
+
+// Marks a counted loop whose iterations only depend on each other through induction variables,
+// which strength reduction adds, and reductions: nothing leaves the loop but from its header,
+// nothing is called, scanned or printed, and an array written in the loop is only read and
+// written at i. Returns true if the loop was marked.
+static bool parallelize(Loop *loop) {
+    CountedLoop counted;
+    if (!find_counted_loop(loop, &counted)) {
+        return false;
+    }
+    int64_t kinds = 0;
+    int position = 0;
+    IR_FOR_EACH_INSTR(fn, loop->header, i) {
+        if (fn->instrs[i].op != IR_PHI) {
+            break;
+        }
+        Induction iv;
+        int kind = i == counted.counter ? IR_REDUCE_COUNTER :
+                   find_induction(loop, i, &iv) ? IR_REDUCE_STEP : find_reduction(loop, i);
+        if (kind < 0 || position == IR_PARALLEL_MAX_PHIS) {
+            return false;
+        }
+        kinds |= (int64_t)kind << IR_PARALLEL_BITS * position++;
+    }
+
+    for (int k = 1; k < loop->num_blocks; k++) {
+        IR_FOR_EACH_INSTR(fn, loop->blocks[k], i) {
+            const IrInstr *in = &fn->instrs[i];
+            switch ((IrOpcode)in->op) {
+                case IR_CALL:
+                case IR_ARRAY:
+                case IR_PRINTF:
+                case IR_SCANF:
+                case IR_SCAN_VALUE:
+                case IR_RETURN:
+                    return false;
+                case IR_JUMP:
+                case IR_BRANCH:
+                    for (int t = 0; t < ir_num_succs(fn, in->block); t++) {
+                        if (!loop->contains[ir_succ(fn, in->block, t)]) {
+                            return false;
+                        }
+                    }
+                    break;
+                case IR_LOAD:
+                    if (!is_array_handle(loop, ir_operand(fn, i, 0))) {
+                        return false;
+                    }
+                    break;
+                case IR_STORE: {
+                    // Each iteration has its own elements of the arrays it writes
+                    int array = ir_operand(fn, i, 0);
+                    if (!is_array_handle(loop, array) || ir_operand(fn, i, 1) != counted.counter) {
+                        return false;
+                    }
+                    for (int l = 1; l < loop->num_blocks; l++) {
+                        IR_FOR_EACH_INSTR(fn, loop->blocks[l], j) {
+                            if (fn->instrs[j].op == IR_LOAD && same_array(ir_operand(fn, j, 0), array) &&
+                                ir_operand(fn, j, 1) != counted.counter) {
+                                return false;
+                            }
+                        }
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    int parallel = ir_new_instr(fn, IR_PARALLEL, IR_VOID);
+    IrInstr *in = &fn->instrs[parallel];
+    in->imm = kinds;
+    in->targets[0] = loop->header;
+    in->targets[1] = counted.exit;
+    in->line_number = fn->instrs[counted.condition].line_number;
+    in->column_number = fn->instrs[counted.condition].column_number;
+    ir_add_operand(fn, parallel, counted.iv.init);
+    ir_add_operand(fn, parallel, counted.bound);
+    ir_insert_before(fn, ir_terminator(fn, loop->preheader), parallel);
+    stats.parallelized++;
+    return true;
+}
+
+/******************************************************/
+/* Constant powers */
+
+static bool constant_exponent(int value, int64_t *exponent) {
+    const IrInstr *in = &fn->instrs[value];
+    if (in->op == IR_CONVERT) {
+        return constant_exponent(ir_operand(fn, value, 0), exponent);
+    }
+    if (in->op != IR_CONST) {
+        return false;
+    }
+    if (in->type == IR_INT) {
+        *exponent = in->imm;
+        return true;
+    }
+    if (in->fimm == floor(in->fimm) && fabs(in->fimm) < 64) {
+        *exponent = (int64_t)in->fimm;
+        return true;
+    }
+    return false;
+}
+
+// x ^ n with a small constant n becomes square-and-multiply. For floats only the
+// powers where the multiplication rounds exactly like pow() are changed.
+static void reduce_powers(void) {
+    for (int b = 0; b < fn->num_blocks; b++) {
+        int i = fn->blocks[b].first;
+        while (i != IR_NONE) {
+            int next = fn->instrs[i].next;
+            int64_t n;
+            if (fn->instrs[i].op != IR_POW || !constant_exponent(ir_operand(fn, i, 1), &n) ||
+                n < 0 || n > (fn->instrs[i].type == IR_FLOAT ? 2 : 64)) {
+                i = next;
+                continue;
+            }
+            IrType type = fn->instrs[i].type;
+            int base = ir_operand(fn, i, 0);
+            int result;
+
+            if (n == 0) {
+                result = ir_new_instr(fn, IR_CONST, type);
+                if (type == IR_FLOAT) {
+                    fn->instrs[result].fimm = 1.0;
+                } else {
+                    fn->instrs[result].imm = 1;
+                }
+                ir_insert_before(fn, i, result);
+            } else {
+                result = IR_NONE;
+                int square = base;
+                for (int64_t rest = n; rest > 0; rest >>= 1) {
+                    if (rest & 1) {
+                        result = result == IR_NONE ? square : insert_binary(IR_MUL, type, i, result, square);
+                    }
+                    if (rest > 1) {
+                        square = insert_binary(IR_MUL, type, i, square, square);
+                    }
+                }
+            }
+
+            ir_replace_uses(fn, i, result);
+            ir_unlink(fn, i);
+            fn->instrs[i].op = IR_NOP;
+            stats.reduced_powers++;
+            i = next;
+        }
+    }
+}
+
+/******************************************************/
+
+static void optimize_function(void) {
+    reduce_powers();
+
+    find_loops();
+    bool changed = false;
+    for (int l = 0; l < num_loops; l++) {
+        changed |= make_preheader(&loops[l]);
+    }
+    if (changed) {
+        ir_compute_dominators(fn);
+        find_loops();
+        for (int l = 0; l < num_loops; l++) {
+            make_preheader(&loops[l]);
+        }
+    }
+
+    // Inner loops first, what they hoist can then leave the outer loop too
+    qsort(loops, num_loops, sizeof(Loop), compare_loop_size);
+    for (int l = 0; l < num_loops; l++) {
+        if (loops[l].preheader == IR_NONE) {
+            continue;
+        }
+        hoist_invariants(&loops[l]);
+        reduce_multiplications(&loops[l]);
+        if (!vectorize(&loops[l])) {
+            parallelize(&loops[l]);
+        }
+    }
+    free_loops();
+    ir_remove_dead_values(fn);
+}
+
+// Runs the loop optimizations on every function of the module
+IrLoopStats ir_optimize_loops(IrModule *program) {
+    module = program;
+    stats = (IrLoopStats){0};
+    for (int f = 0; f < module->num_functions; f++) {
+        fn = &module->functions[f];
+        if (fn->defined) {
+            optimize_function();
+        }
+    }
+    return stats;
+}
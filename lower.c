@@ -0,0 +1,1313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "ir.h"
+#include "string_table.h"
+
+// Lowering from the parse tree to the SSA IR
+//
+// Local scalars never live in memory: every assignment defines a new value, and reads are
+// resolved on the fly with the algorithm of Braun et al., "Simple and Efficient Construction
+// of Static Single Assignment Form" (2013). A block is sealed once all its predecessors are
+// known, reads in unsealed blocks get an operandless phi that is completed at sealing time.
+// Global scalars and arrays are memory, accessed with IR_LOAD and IR_STORE.
+
+// A name visible while lowering
+typedef struct {
+    char name[IR_NAME_LENGTH];
+    TokenType data_type;    // INT, FLOAT, CHAR or BOOL
+    bool is_array;
+    bool is_global;
+    int id;                 // SSA variable, IR_ARRAY value of a local array, or global id
+} Variable;
+
+// Current definition of an SSA variable at the end of a block
+typedef struct {
+    int var;
+    int block;
+    int value;
+} Definition;
+
+typedef struct {
+    int block;
+    int var;
+    int phi;
+} IncompletePhi;
+
+// SSA construction state of the function being lowered
+typedef struct {
+    IrFunction *fn;
+    int current_block;
+    bool *sealed;
+    int sealed_capacity;
+    Definition *defs;       // Open addressing hash table on (var, block)
+    int defs_count, defs_capacity;
+    IncompletePhi *incomplete;
+    int num_incomplete, incomplete_capacity;
+    IrType *var_types;
+    int num_vars, vars_capacity;
+} LowerState;
+
+static IrModule *module;
+static LowerState *state;
+static LowerState body_state;
+static LowerState init_state;
+static bool failed;
+static int current_line, current_column;
+
+static Variable *scope;
+static int scope_size, scope_capacity;
+static bool *called;
+static int *module_strings;         // IR string of each literal_strings id, -1 until used
+
+static int lower_exp(ParseTreeNode *node);
+static void lower_block(ParseTreeNode *block);
+static void lower_statement(ParseTreeNode *statement);
+static int read_variable(int var, int block);
+
+/******************************************************/
+/* Errors and positions */
+
+static void lower_error(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "Error: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, " at line %d\n", current_line);
+    va_end(args);
+    failed = true;
+}
+
+// Remembers the position of the first token below node for the next instructions
+static void note_position(ParseTreeNode *node) {
+    while (node != NULL && node->token == NULL && node->num_children > 0) {
+        node = node->children[0];
+    }
+    if (node != NULL && node->token != NULL) {
+        current_line = node->token->line_number;
+        current_column = node->token->column_number;
+    }
+}
+
+static const char *identifier_name(ParseTreeNode *identifier) {
+    return identifier->children[0]->token->lexeme;
+}
+
+static TokenType data_type_of(ParseTreeNode *data_type) {
+    return data_type->children[0]->token->type;
+}
+
+static IrType ir_type_of(TokenType data_type) {
+    return data_type == FLOAT ? IR_FLOAT : IR_INT;
+}
+
+/******************************************************/
+/* Scopes */
+
+static int push_scope(void) {
+    return scope_size;
+}
+
+static void pop_scope(int saved) {
+    scope_size = saved;
+}
+
+static Variable *lookup(const char *name) {
+    for (int i = scope_size - 1; i >= 0; i--) {
+        if (strcmp(scope[i].name, name) == 0) {
+            return &scope[i];
+        }
+    }
+    return NULL;
+}
+
+static Variable *declare(const char *name, TokenType data_type, bool is_array, bool is_global, int scope_start) {
+    for (int i = scope_start; i < scope_size; i++) {
+        if (strcmp(scope[i].name, name) == 0) {
+            lower_error("redefinition of '%s'", name);
+            break;
+        }
+    }
+    if (scope_size == scope_capacity) {
+        scope_capacity = scope_capacity ? scope_capacity * 2 : 32;
+        scope = realloc(scope, sizeof(Variable) * scope_capacity);
+    }
+    Variable *var = &scope[scope_size++];
+    memset(var, 0, sizeof(*var));
+    strncpy(var->name, name, IR_NAME_LENGTH - 1);
+    var->data_type = data_type;
+    var->is_array = is_array;
+    var->is_global = is_global;
+    var->id = IR_NONE;
+    return var;
+}
+
+/******************************************************/
+/* Emitting instructions */
+
+static void reset_state(LowerState *s, IrFunction *fn) {
+    s->fn = fn;
+    s->current_block = IR_NONE;
+    s->defs_count = 0;
+    s->num_incomplete = 0;
+    s->num_vars = 0;
+    if (s->defs_capacity > 0) {
+        for (int i = 0; i < s->defs_capacity; i++) {
+            s->defs[i].var = IR_NONE;
+        }
+    }
+}
+
+static int new_block(void) {
+    int block = ir_add_block(state->fn);
+    if (block >= state->sealed_capacity) {
+        state->sealed_capacity = state->sealed_capacity ? state->sealed_capacity * 2 : 64;
+        state->sealed = realloc(state->sealed, sizeof(bool) * state->sealed_capacity);
+    }
+    state->sealed[block] = false;
+    return block;
+}
+
+static bool is_terminated(int block) {
+    return ir_terminator(state->fn, block) != IR_NONE;
+}
+
+static void add_phi_operands(int var, int phi);
+
+static void seal_block(int block) {
+    for (int i = 0; i < state->num_incomplete; i++) {
+        IncompletePhi pending = state->incomplete[i];
+        if (pending.block == block) {
+            add_phi_operands(pending.var, pending.phi);
+            state->incomplete[i--] = state->incomplete[--state->num_incomplete];
+        }
+    }
+    state->sealed[block] = true;
+}
+
+// Creates an instruction at the end of the current block. Code after a "return"
+// goes into a fresh block without predecessors, removed once the function is done.
+static int emit(IrOpcode op, IrType type) {
+    if (is_terminated(state->current_block)) {
+        state->current_block = new_block();
+        seal_block(state->current_block);
+    }
+    int instr = ir_new_instr(state->fn, op, type);
+    state->fn->instrs[instr].line_number = current_line;
+    state->fn->instrs[instr].column_number = current_column;
+    ir_append(state->fn, state->current_block, instr);
+    return instr;
+}
+
+static IrType type_of(int value) {
+    return state->fn->instrs[value].type;
+}
+
+static int emit_int(int64_t value) {
+    int instr = emit(IR_CONST, IR_INT);
+    state->fn->instrs[instr].imm = value;
+    return instr;
+}
+
+static int emit_float(double value) {
+    int instr = emit(IR_CONST, IR_FLOAT);
+    state->fn->instrs[instr].fimm = value;
+    return instr;
+}
+
+static int emit_unary(IrOpcode op, IrType type, int a) {
+    if (a == IR_NONE) {
+        return IR_NONE;
+    }
+    int instr = emit(op, type);
+    ir_add_operand(state->fn, instr, a);
+    return instr;
+}
+
+static int emit_binary(IrOpcode op, IrType type, int a, int b) {
+    if (a == IR_NONE || b == IR_NONE) {
+        return IR_NONE;
+    }
+    int instr = emit(op, type);
+    ir_add_operand(state->fn, instr, a);
+    ir_add_operand(state->fn, instr, b);
+    return instr;
+}
+
+// The operands must already be emitted, C leaves the evaluation order of arguments unspecified
+static void emit_store(int array, int index, int value) {
+    int store = emit(IR_STORE, IR_VOID);
+    ir_add_operand(state->fn, store, array);
+    ir_add_operand(state->fn, store, index);
+    ir_add_operand(state->fn, store, value);
+}
+
+static int convert(int value, IrType type) {
+    if (value == IR_NONE || type_of(value) == type) {
+        return value;
+    }
+    return emit_unary(IR_CONVERT, type, value);
+}
+
+// Converts a value for storing into a variable of the given data type, bools hold 0 or 1
+static int convert_for(int value, TokenType data_type) {
+    if (value == IR_NONE) {
+        return IR_NONE;
+    }
+    if (data_type != BOOL) {
+        return convert(value, ir_type_of(data_type));
+    }
+    IrInstr *in = &state->fn->instrs[value];
+    if ((in->op >= IR_EQ && in->op <= IR_GE) || in->op == IR_NOT ||
+        (in->op == IR_CONST && in->type == IR_INT && (in->imm == 0 || in->imm == 1))) {
+        return value;
+    }
+    int zero = in->type == IR_FLOAT ? emit_float(0.0) : emit_int(0);
+    return emit_binary(IR_NE, IR_INT, value, zero);
+}
+
+// Converts a value to a branch condition
+static int condition(int value) {
+    if (value != IR_NONE && type_of(value) == IR_FLOAT) {
+        return emit_binary(IR_NE, IR_INT, value, emit_float(0.0));
+    }
+    return value;
+}
+
+static void jump(int target) {
+    if (is_terminated(state->current_block)) {
+        return;
+    }
+    int instr = emit(IR_JUMP, IR_VOID);
+    state->fn->instrs[instr].targets[0] = target;
+    ir_add_pred(state->fn, target, state->current_block);
+}
+
+static void branch(int cond, int if_true, int if_false) {
+    if (cond == IR_NONE) {
+        cond = emit_int(0);
+    }
+    int instr = emit(IR_BRANCH, IR_VOID);
+    ir_add_operand(state->fn, instr, cond);
+    state->fn->instrs[instr].targets[0] = if_true;
+    state->fn->instrs[instr].targets[1] = if_false;
+    ir_add_pred(state->fn, if_true, state->current_block);
+    ir_add_pred(state->fn, if_false, state->current_block);
+}
+
+/******************************************************/
+/* SSA variables */
+
+static int new_variable(IrType type) {
+    if (state->num_vars == state->vars_capacity) {
+        state->vars_capacity = state->vars_capacity ? state->vars_capacity * 2 : 32;
+        state->var_types = realloc(state->var_types, sizeof(IrType) * state->vars_capacity);
+    }
+    state->var_types[state->num_vars] = type;
+    return state->num_vars++;
+}
+
+static unsigned hash_definition(int var, int block, int capacity) {
+    return ((unsigned)var * 2654435761u ^ (unsigned)block * 40503u) & (unsigned)(capacity - 1);
+}
+
+static void write_variable(int var, int block, int value) {
+    if (value == IR_NONE) {
+        return;
+    }
+    if ((state->defs_count + 1) * 2 > state->defs_capacity) {
+        Definition *old = state->defs;
+        int old_capacity = state->defs_capacity;
+        state->defs_capacity = old_capacity ? old_capacity * 2 : 256;
+        state->defs = malloc(sizeof(Definition) * state->defs_capacity);
+        for (int i = 0; i < state->defs_capacity; i++) {
+            state->defs[i].var = IR_NONE;
+        }
+        state->defs_count = 0;
+        for (int i = 0; i < old_capacity; i++) {
+            if (old[i].var != IR_NONE) {
+                write_variable(old[i].var, old[i].block, old[i].value);
+            }
+        }
+        free(old);
+    }
+
+    unsigned slot = hash_definition(var, block, state->defs_capacity);
+    while (state->defs[slot].var != IR_NONE) {
+        if (state->defs[slot].var == var && state->defs[slot].block == block) {
+            state->defs[slot].value = value;
+            return;
+        }
+        slot = (slot + 1) & (unsigned)(state->defs_capacity - 1);
+    }
+    state->defs[slot] = (Definition){ var, block, value };
+    state->defs_count++;
+}
+
+static int find_definition(int var, int block) {
+    if (state->defs_capacity == 0) {
+        return IR_NONE;
+    }
+    unsigned slot = hash_definition(var, block, state->defs_capacity);
+    while (state->defs[slot].var != IR_NONE) {
+        if (state->defs[slot].var == var && state->defs[slot].block == block) {
+            return state->defs[slot].value;
+        }
+        slot = (slot + 1) & (unsigned)(state->defs_capacity - 1);
+    }
+    return IR_NONE;
+}
+
+static int new_phi(int block, IrType type) {
+    int phi = ir_new_instr(state->fn, IR_PHI, type);
+    state->fn->instrs[phi].line_number = current_line;
+    state->fn->instrs[phi].column_number = current_column;
+    ir_prepend(state->fn, block, phi);
+    return phi;
+}
+
+static int read_variable_recursive(int var, int block) {
+    IrFunction *fn = state->fn;
+    int value;
+
+    if (!state->sealed[block]) {
+        value = new_phi(block, state->var_types[var]);
+        if (state->num_incomplete == state->incomplete_capacity) {
+            state->incomplete_capacity = state->incomplete_capacity ? state->incomplete_capacity * 2 : 32;
+            state->incomplete = realloc(state->incomplete, sizeof(IncompletePhi) * state->incomplete_capacity);
+        }
+        state->incomplete[state->num_incomplete++] = (IncompletePhi){ block, var, value };
+    } else if (fn->blocks[block].preds.count == 0) {
+        // Read before any assignment, variables start out as zero
+        value = ir_new_instr(fn, IR_CONST, state->var_types[var]);
+        ir_prepend(fn, block, value);
+    } else if (fn->blocks[block].preds.count == 1) {
+        value = read_variable(var, ir_pred(fn, block, 0));
+    } else {
+        value = new_phi(block, state->var_types[var]);
+        write_variable(var, block, value);
+        add_phi_operands(var, value);
+    }
+    write_variable(var, block, value);
+    return value;
+}
+
+static int read_variable(int var, int block) {
+    int value = find_definition(var, block);
+    if (value != IR_NONE) {
+        return value;
+    }
+    return read_variable_recursive(var, block);
+}
+
+static void add_phi_operands(int var, int phi) {
+    int block = state->fn->instrs[phi].block;
+    for (int k = 0; k < state->fn->blocks[block].preds.count; k++) {
+        int value = read_variable(var, ir_pred(state->fn, block, k));
+        ir_add_operand(state->fn, phi, value);
+    }
+}
+
+/******************************************************/
+/* Literals */
+
+// Adds the decoded contents of a STRING token, once per distinct literal in the program
+static int add_string_literal(const Token *token) {
+    if (token->string_id < 0 || token->string_id >= literal_strings.count) {
+        return ir_add_string(module, "", 0);
+    }
+    if (module_strings[token->string_id] < 0) {
+        int length;
+        const char *bytes = string_table_get(&literal_strings, token->string_id, &length);
+        module_strings[token->string_id] = ir_add_string(module, bytes, length);
+    }
+    return module_strings[token->string_id];
+}
+
+// <const> ::= <int> | <float> | <char> | <bool>
+static int lower_const(ParseTreeNode *node) {
+    if (node->num_children != 1 || node->children[0]->num_children != 1) {
+        return IR_NONE;
+    }
+    Token *token = node->children[0]->children[0]->token;
+    current_line = token->line_number;
+    current_column = token->column_number;
+    switch (token->type) {
+        case INTEGER_LITERAL:
+            return emit_int(token->value.integer);
+        case FLOAT_LITERAL:
+            return emit_float(token->value.real);
+        case CHARACTER_LITERAL: {
+            int length;
+            const char *c = string_table_get(&literal_strings, token->string_id, &length);
+            return emit_int(length > 0 ? (unsigned char)c[0] : 0);
+        }
+        case TRUE:
+            return emit_int(1);
+        case FALSE:
+            return emit_int(0);
+        default:
+            lower_error("invalid constant '%s'", token->lexeme);
+            return IR_NONE;
+    }
+}
+
+/******************************************************/
+/* Expressions */
+
+static int array_handle(Variable *var) {
+    if (var->is_global) {
+        int instr = emit(IR_GLOBAL, ir_type_of(var->data_type));
+        state->fn->instrs[instr].imm = var->id;
+        return instr;
+    }
+    return var->id;
+}
+
+static int read_name(const char *name) {
+    Variable *var = lookup(name);
+    if (var == NULL) {
+        lower_error("'%s' undeclared", name);
+        return IR_NONE;
+    }
+    if (var->is_array) {
+        lower_error("array '%s' used as a value", name);
+        return IR_NONE;
+    }
+    if (var->is_global) {
+        int handle = array_handle(var);
+        return emit_binary(IR_LOAD, ir_type_of(var->data_type), handle, emit_int(0));
+    }
+    return read_variable(var->id, state->current_block);
+}
+
+static void assign_name(Variable *var, int value) {
+    if (value == IR_NONE) {
+        return;
+    }
+    if (var->is_global) {
+        int handle = array_handle(var);
+        emit_store(handle, emit_int(0), value);
+    } else {
+        write_variable(var->id, state->current_block, value);
+    }
+}
+
+static int lower_index(Variable *var, ParseTreeNode *index) {
+    if (!var->is_array) {
+        lower_error("'%s' is not an array", var->name);
+        return IR_NONE;
+    }
+    return convert(lower_exp(index), IR_INT);
+}
+
+// <identifier> "(" [ <argument_list> ] ")"
+static int lower_call(ParseTreeNode *factor) {
+    const char *name = identifier_name(factor->children[0]);
+    int callee = ir_find_function(module, name);
+    if (callee == IR_NONE) {
+        lower_error("call to undeclared function '%s'", name);
+        return IR_NONE;
+    }
+    called[callee] = true;
+    IrFunction *target = &module->functions[callee];
+
+    int args[IR_MAX_PARAMS];
+    int num_args = 0;
+    if (factor->num_children == 4) {
+        ParseTreeNode *list = factor->children[2];
+        for (int i = 0; i < list->num_children; i += 2) {
+            int value = lower_exp(list->children[i]);
+            if (num_args < target->num_params) {
+                args[num_args] = convert(value, target->param_types[num_args]);
+            }
+            num_args++;
+        }
+    }
+    if (num_args != target->num_params) {
+        lower_error("function '%s' expects %d arguments, %d given", name, target->num_params, num_args);
+        return IR_NONE;
+    }
+    for (int i = 0; i < num_args; i++) {
+        if (args[i] == IR_NONE) {
+            return IR_NONE;
+        }
+    }
+
+    int call = emit(IR_CALL, target->return_type);
+    state->fn->instrs[call].imm = callee;
+    for (int i = 0; i < num_args; i++) {
+        ir_add_operand(state->fn, call, args[i]);
+    }
+    return call;
+}
+
+// <factor> ::= <const> | <identifier> | "(" <exp> ")" | <identifier> "(" [ <argument_list> ] ")"
+//            | <identifier> "[" <exp> "]"
+static int lower_factor(ParseTreeNode *node) {
+    note_position(node);
+    if (node->num_children == 0) {
+        return IR_NONE;
+    }
+    ParseTreeNode *first = node->children[0];
+
+    if (node_is(first, "Const")) {
+        return lower_const(first);
+    }
+    if (node_is_token(first, LEFT_PARENTHESIS)) {
+        return lower_exp(node->children[1]);
+    }
+    if (!node_is(first, "Identifier")) {
+        return IR_NONE;
+    }
+    if (node->num_children == 1) {
+        return read_name(identifier_name(first));
+    }
+    if (node_is_token(node->children[1], LEFT_PARENTHESIS)) {
+        return lower_call(node);
+    }
+
+    Variable *var = lookup(identifier_name(first));
+    if (var == NULL) {
+        lower_error("'%s' undeclared", identifier_name(first));
+        return IR_NONE;
+    }
+    int index = lower_index(var, node->children[2]);
+    if (index == IR_NONE) {
+        return IR_NONE;
+    }
+    return emit_binary(IR_LOAD, ir_type_of(var->data_type), array_handle(var), index);
+}
+
+// <identifier> [ "[" <exp> "]" ] "=" <exp>
+static int lower_assignment(ParseTreeNode *node) {
+    note_position(node);
+    const char *name = identifier_name(node->children[0]);
+    Variable *var = lookup(name);
+    if (var == NULL) {
+        lower_error("'%s' undeclared", name);
+        return IR_NONE;
+    }
+
+    if (node_is_token(node->children[1], LEFT_BRACKET)) {
+        int index = lower_index(var, node->children[2]);
+        int value = convert_for(lower_exp(node->children[5]), var->data_type);
+        if (index == IR_NONE || value == IR_NONE) {
+            return IR_NONE;
+        }
+        emit_store(array_handle(var), index, value);
+        return value;
+    }
+
+    if (var->is_array) {
+        lower_error("assignment to array '%s'", name);
+        return IR_NONE;
+    }
+    int value = convert_for(lower_exp(node->children[2]), var->data_type);
+    assign_name(var, value);
+    return value;
+}
+
+// Short-circuit "||" and "&&", the result is 0 or 1
+static int lower_logical(ParseTreeNode *node, bool is_or) {
+    int left = condition(lower_exp(node->children[0]));
+    if (left == IR_NONE) {
+        return IR_NONE;
+    }
+    int shortcut = emit_int(is_or ? 1 : 0);
+    int left_end = state->current_block;
+    int rhs = new_block();
+    int join = new_block();
+    if (is_or) {
+        branch(left, join, rhs);
+    } else {
+        branch(left, rhs, join);
+    }
+    seal_block(rhs);
+
+    state->current_block = rhs;
+    int right = convert_for(lower_exp(node->children[2]), BOOL);
+    if (right == IR_NONE) {
+        right = emit_int(0);
+    }
+    jump(join);
+    seal_block(join);
+
+    state->current_block = join;
+    int phi = new_phi(join, IR_INT);
+    for (int k = 0; k < state->fn->blocks[join].preds.count; k++) {
+        ir_add_operand(state->fn, phi, ir_pred(state->fn, join, k) == left_end ? shortcut : right);
+    }
+    return phi;
+}
+
+static int lower_binary(ParseTreeNode *node) {
+    int left = lower_exp(node->children[0]);
+    TokenType op = node->children[1]->token->type;
+    int right = lower_exp(node->children[2]);
+    if (left == IR_NONE || right == IR_NONE) {
+        return IR_NONE;
+    }
+    current_line = node->children[1]->token->line_number;
+    current_column = node->children[1]->token->column_number;
+
+    // Mixed operands are computed in float
+    IrType type = type_of(left) == IR_FLOAT || type_of(right) == IR_FLOAT ? IR_FLOAT : IR_INT;
+    left = convert(left, type);
+    right = convert(right, type);
+
+    switch (op) {
+        case PLUS: return emit_binary(IR_ADD, type, left, right);
+        case MINUS: return emit_binary(IR_SUB, type, left, right);
+        case MULTIPLY: return emit_binary(IR_MUL, type, left, right);
+        case DIVIDE: return emit_binary(IR_DIV, type, left, right);
+        case EXPONENT: return emit_binary(IR_POW, type, left, right);
+        case MODULO:
+            if (type == IR_FLOAT) {
+                lower_error("invalid float operands to '%%'");
+                return IR_NONE;
+            }
+            return emit_binary(IR_MOD, type, left, right);
+        case EQUAL: return emit_binary(IR_EQ, IR_INT, left, right);
+        case NOT_EQUAL: return emit_binary(IR_NE, IR_INT, left, right);
+        case LESS: return emit_binary(IR_LT, IR_INT, left, right);
+        case LESS_EQUAL: return emit_binary(IR_LE, IR_INT, left, right);
+        case GREATER: return emit_binary(IR_GT, IR_INT, left, right);
+        case GREATER_EQUAL: return emit_binary(IR_GE, IR_INT, left, right);
+        default:
+            lower_error("unsupported operator '%s'", token_names[op]);
+            return IR_NONE;
+    }
+}
+
+static int lower_unary(ParseTreeNode *node) {
+    TokenType op = node->children[0]->token->type;
+    int value = lower_exp(node->children[1]);
+    if (value == IR_NONE) {
+        return IR_NONE;
+    }
+    switch (op) {
+        case PLUS: return value;
+        case MINUS: return emit_unary(IR_NEG, type_of(value), value);
+        default: return emit_unary(IR_NOT, IR_INT, value);
+    }
+}
+
+static int lower_exp(ParseTreeNode *node) {
+    if (node == NULL) {
+        return IR_NONE;
+    }
+    if (node_is(node, "Exp")) {
+        return lower_exp(node->children[0]);
+    }
+    if (node_is(node, "Factor")) {
+        return lower_factor(node);
+    }
+    if (node_is(node, "Const")) {
+        return lower_const(node);
+    }
+    if (node_is(node, "Assignment")) {
+        return lower_assignment(node);
+    }
+    if (node_is(node, "LogicalOr")) {
+        return lower_logical(node, true);
+    }
+    if (node_is(node, "LogicalAnd")) {
+        return lower_logical(node, false);
+    }
+    if (node_is(node, "UnaryOp")) {
+        return lower_unary(node);
+    }
+    if (node->num_children == 3 && node->children[1]->token != NULL) {
+        return lower_binary(node);
+    }
+    lower_error("unsupported expression '%s'", node->name);
+    return IR_NONE;
+}
+
+/******************************************************/
+/* Declarations */
+
+// <variable_declaration> ::= <data_type> <identifier> [ "=" <exp> ] { "," <identifier> [ "=" <exp> ] } ";"
+static void lower_variable_declaration(ParseTreeNode *node, bool is_global, int scope_start) {
+    note_position(node);
+    TokenType data_type = data_type_of(node->children[0]);
+
+    for (int i = 1; i < node->num_children; i++) {
+        if (!node_is(node->children[i], "Identifier")) {
+            continue;
+        }
+        const char *name = identifier_name(node->children[i]);
+        bool has_value = i + 2 < node->num_children && node_is_token(node->children[i + 1], ASSIGN);
+
+        int value = IR_NONE;
+        if (has_value) {
+            value = convert_for(lower_exp(node->children[i + 2]), data_type);
+        }
+
+        Variable *var = declare(name, data_type, false, is_global, scope_start);
+        if (is_global) {
+            var->id = ir_add_global(module, name, ir_type_of(data_type), 1, false);
+            if (has_value) {
+                assign_name(var, value);
+            }
+        } else {
+            var->id = new_variable(ir_type_of(data_type));
+            if (!has_value) {
+                value = data_type == FLOAT ? emit_float(0.0) : emit_int(0);
+            }
+            assign_name(var, value);
+        }
+    }
+}
+
+// <array_declaration> ::= <data_type> <identifier> "[" [<const>] "]" [ "=" "{" [<argument_list>] "}" ] ";"
+static void lower_array_declaration(ParseTreeNode *node, bool is_global, int scope_start) {
+    note_position(node);
+    TokenType data_type = data_type_of(node->children[0]);
+    const char *name = identifier_name(node->children[1]);
+
+    int length = -1;
+    int i = 3;
+    if (node_is(node->children[i], "Const")) {
+        Token *size = node->children[i]->children[0]->children[0]->token;
+        if (size->type != INTEGER_LITERAL || size->value.integer <= 0) {
+            lower_error("size of array '%s' must be a positive integer", name);
+            return;
+        }
+        length = (int)size->value.integer;
+        i++;
+    }
+    i++; // "]"
+
+    ParseTreeNode *list = NULL;
+    if (node_is_token(node->children[i], ASSIGN) && node_is(node->children[i + 2], "Argument_List")) {
+        list = node->children[i + 2];
+    }
+    int num_values = list ? (list->num_children + 1) / 2 : 0;
+    if (length < 0) {
+        length = num_values;
+    }
+    if (length <= 0) {
+        lower_error("size of array '%s' is missing", name);
+        return;
+    }
+    if (num_values > length) {
+        lower_error("too many initializers for array '%s'", name);
+        return;
+    }
+
+    Variable *var = declare(name, data_type, true, is_global, scope_start);
+    if (is_global) {
+        var->id = ir_add_global(module, name, ir_type_of(data_type), length, true);
+    } else {
+        var->id = emit(IR_ARRAY, ir_type_of(data_type));
+        state->fn->instrs[var->id].imm = length;
+    }
+
+    for (int k = 0; k < num_values; k++) {
+        int value = convert_for(lower_exp(list->children[k * 2]), data_type);
+        if (value == IR_NONE) {
+            continue;
+        }
+        int handle = array_handle(var);
+        emit_store(handle, emit_int(k), value);
+    }
+}
+
+/******************************************************/
+/* Statements */
+
+// Collects the conversions of a format string, returns their count or -1 for an unsupported one
+static int format_conversions(int string, IrType *types, bool *is_string, int max) {
+    int length;
+    const char *format = ir_string(module, string, &length);
+    int count = 0;
+    for (int i = 0; i < length; i++) {
+        if (format[i] != '%') {
+            continue;
+        }
+        i++;
+        while (i < length && strchr("-+ #0123456789.", format[i])) {
+            i++;
+        }
+        while (i < length && (format[i] == 'l' || format[i] == 'h')) {
+            i++;
+        }
+        if (i >= length) {
+            return -1;
+        }
+        if (format[i] == '%') {
+            continue;
+        }
+        if (count == max) {
+            return -1;
+        }
+        is_string[count] = false;
+        switch (format[i]) {
+            case 'd': case 'i': case 'c': case 'u': case 'x':
+                types[count++] = IR_INT;
+                break;
+            case 'f': case 'g': case 'e':
+                types[count++] = IR_FLOAT;
+                break;
+            case 's':
+                is_string[count] = true;
+                types[count++] = IR_INT;
+                break;
+            default:
+                return -1;
+        }
+    }
+    return count;
+}
+
+// "scanf" "(" <string> { "," "&" <identifier> } ")" ";"
+static void lower_input_statement(ParseTreeNode *node) {
+    note_position(node);
+    int string = add_string_literal(node->children[2]->token);
+    IrType types[IR_MAX_PARAMS];
+    bool is_string[IR_MAX_PARAMS];
+    int num_conversions = format_conversions(string, types, is_string, IR_MAX_PARAMS);
+
+    int num_targets = 0;
+    for (int i = 3; i < node->num_children; i++) {
+        if (node_is(node->children[i], "Identifier")) {
+            num_targets++;
+        }
+    }
+    if (num_conversions < 0) {
+        lower_error("unsupported scanf format");
+        return;
+    }
+    if (num_conversions != num_targets) {
+        lower_error("scanf format expects %d arguments, %d given", num_conversions, num_targets);
+        return;
+    }
+
+    int scanf_instr = emit(IR_SCANF, IR_INT);
+    state->fn->instrs[scanf_instr].imm = string;
+
+    int k = 0;
+    for (int i = 3; i < node->num_children; i++) {
+        if (!node_is(node->children[i], "Identifier")) {
+            continue;
+        }
+        const char *name = identifier_name(node->children[i]);
+        Variable *var = lookup(name);
+        if (var == NULL || var->is_array || is_string[k]) {
+            lower_error(var == NULL ? "'%s' undeclared" : "scanf into array '%s'", name);
+            k++;
+            continue;
+        }
+
+        // A conversion that fails leaves the variable unchanged
+        int old = read_name(name);
+        int value = emit_unary(IR_SCAN_VALUE, ir_type_of(var->data_type), scanf_instr);
+        if (value != IR_NONE && old != IR_NONE) {
+            state->fn->instrs[value].imm = k;
+            ir_add_operand(state->fn, value, old);
+            assign_name(var, convert_for(value, var->data_type));
+        }
+        k++;
+    }
+}
+
+// "printf" "(" <string> { "," <exp> } ")" ";" | "printf" "(" <identifier> ")" ";"
+static void lower_output_statement(ParseTreeNode *node) {
+    note_position(node);
+    int string;
+    int args[IR_MAX_PARAMS];
+    int num_args = 0;
+    IrType types[IR_MAX_PARAMS];
+    bool is_string[IR_MAX_PARAMS];
+
+    if (node_is(node->children[2], "Identifier")) {
+        // Prints a char array
+        string = ir_add_string(module, "%s", 2);
+        Variable *var = lookup(identifier_name(node->children[2]));
+        if (var == NULL || !var->is_array || var->data_type != CHAR) {
+            lower_error("printf expects a string or a char array");
+            return;
+        }
+        args[num_args++] = array_handle(var);
+    } else {
+        string = add_string_literal(node->children[2]->token);
+        int num_conversions = format_conversions(string, types, is_string, IR_MAX_PARAMS);
+        if (num_conversions < 0) {
+            lower_error("unsupported printf format");
+            return;
+        }
+
+        for (int i = 3; i < node->num_children; i++) {
+            ParseTreeNode *child = node->children[i];
+            if (child->token != NULL) {
+                continue;
+            }
+            int value;
+            if (num_args < num_conversions && is_string[num_args]) {
+                ParseTreeNode *factor = child;
+                Variable *var = NULL;
+                if (node_is(factor, "Factor") && factor->num_children == 1 &&
+                    node_is(factor->children[0], "Identifier")) {
+                    var = lookup(identifier_name(factor->children[0]));
+                }
+                if (var == NULL || !var->is_array || var->data_type != CHAR) {
+                    lower_error("%%s expects a char array");
+                    return;
+                }
+                value = array_handle(var);
+            } else {
+                value = lower_exp(child);
+                if (num_args < num_conversions) {
+                    value = convert(value, types[num_args]);
+                }
+            }
+            if (value == IR_NONE) {
+                return;
+            }
+            // Extra arguments are evaluated and ignored like in C
+            if (num_args < num_conversions) {
+                args[num_args++] = value;
+            }
+        }
+        if (num_args < num_conversions) {
+            lower_error("printf format expects %d arguments, %d given", num_conversions, num_args);
+            return;
+        }
+    }
+
+    int instr = emit(IR_PRINTF, IR_VOID);
+    state->fn->instrs[instr].imm = string;
+    for (int i = 0; i < num_args; i++) {
+        ir_add_operand(state->fn, instr, args[i]);
+    }
+}
+
+// "if" "(" <exp> ")" <block> [<else-clause>]
+static void lower_if_statement(ParseTreeNode *node) {
+    note_position(node);
+    int cond = condition(lower_exp(node->children[2]));
+    bool has_else = node->num_children > 5 && node_is(node->children[5], "Else_Clause");
+
+    int then_block = new_block();
+    int else_block = has_else ? new_block() : IR_NONE;
+    int join = new_block();
+    branch(cond, then_block, has_else ? else_block : join);
+    seal_block(then_block);
+
+    state->current_block = then_block;
+    lower_block(node->children[4]);
+    jump(join);
+
+    if (has_else) {
+        // "else" <block> | "else" <if_statement>
+        seal_block(else_block);
+        state->current_block = else_block;
+        ParseTreeNode *taken = node->children[5]->children[1];
+        if (node_is(taken, "If_Statement")) {
+            lower_if_statement(taken);
+        } else {
+            lower_block(taken);
+        }
+        jump(join);
+    }
+
+    seal_block(join);
+    state->current_block = join;
+}
+
+// "while" "(" <exp> ")" <block>
+static void lower_while_statement(ParseTreeNode *node) {
+    note_position(node);
+    int header = new_block();
+    jump(header);
+
+    state->current_block = header;
+    int cond = condition(lower_exp(node->children[2]));
+    int body = new_block();
+    int exit = new_block();
+    branch(cond, body, exit);
+    seal_block(body);
+    seal_block(exit);
+
+    state->current_block = body;
+    lower_block(node->children[4]);
+    jump(header);
+    seal_block(header);
+
+    state->current_block = exit;
+}
+
+// "for" "(" (<variable_declaration> | <array_declaration> | <exp> ";") <exp> ";" <exp> ")" <block>
+static void lower_for_statement(ParseTreeNode *node) {
+    note_position(node);
+    int saved = push_scope();
+    int n = node->num_children;
+
+    ParseTreeNode *init = node->children[2];
+    if (node_is(init, "Variable_Declaration")) {
+        lower_variable_declaration(init, false, saved);
+    } else if (node_is(init, "Array_Declaration")) {
+        lower_array_declaration(init, false, saved);
+    } else {
+        lower_exp(init);
+    }
+
+    int header = new_block();
+    jump(header);
+
+    state->current_block = header;
+    int cond = condition(lower_exp(node->children[n - 5]));
+    int body = new_block();
+    int exit = new_block();
+    branch(cond, body, exit);
+    seal_block(body);
+    seal_block(exit);
+
+    state->current_block = body;
+    lower_block(node->children[n - 1]);
+    int latch = new_block();
+    jump(latch);
+    seal_block(latch);
+
+    state->current_block = latch;
+    lower_exp(node->children[n - 3]);
+    jump(header);
+    seal_block(header);
+
+    state->current_block = exit;
+    pop_scope(saved);
+}
+
+// "return" <exp> ";"
+static void lower_return_statement(ParseTreeNode *node) {
+    note_position(node);
+    int value = convert(lower_exp(node->children[1]), state->fn->return_type);
+    if (value == IR_NONE) {
+        return;
+    }
+    int instr = emit(IR_RETURN, IR_VOID);
+    ir_add_operand(state->fn, instr, value);
+}
+
+static void lower_statement(ParseTreeNode *statement) {
+    if (statement->num_children == 0) {
+        return;
+    }
+    ParseTreeNode *inner = statement->children[0];
+    if (inner->token != NULL) {
+        return; // ";"
+    }
+    note_position(inner);
+
+    if (node_is(inner, "Return_Statement")) {
+        lower_return_statement(inner);
+    } else if (node_is(inner, "If_Statement")) {
+        lower_if_statement(inner);
+    } else if (node_is(inner, "While_Statement")) {
+        lower_while_statement(inner);
+    } else if (node_is(inner, "For_Statement")) {
+        lower_for_statement(inner);
+    } else if (node_is(inner, "Input_Statement")) {
+        lower_input_statement(inner);
+    } else if (node_is(inner, "Output_Statement")) {
+        lower_output_statement(inner);
+    } else if (node_is(inner, "Block")) {
+        lower_block(inner);
+    } else if (node_is(inner, "Expression_Statement")) {
+        lower_exp(inner->children[0]);
+    } else {
+        lower_exp(inner);
+    }
+}
+
+// "{" { <block_item> } "}"
+static void lower_block(ParseTreeNode *block) {
+    int saved = push_scope();
+    for (int i = 0; i < block->num_children; i++) {
+        ParseTreeNode *item = block->children[i];
+        if (!node_is(item, "Block_Item") || item->num_children == 0) {
+            continue;
+        }
+        ParseTreeNode *inner = item->children[0];
+        if (node_is(inner, "Variable_Declaration")) {
+            lower_variable_declaration(inner, false, saved);
+        } else if (node_is(inner, "Array_Declaration")) {
+            lower_array_declaration(inner, false, saved);
+        } else {
+            lower_statement(inner);
+        }
+    }
+    pop_scope(saved);
+}
+
+/******************************************************/
+/* Functions */
+
+// Removes leftovers of the construction and computes the dominator tree
+static void finish_function(IrFunction *fn) {
+    ir_remove_unreachable_blocks(fn);
+    ir_remove_trivial_phis(fn);
+    ir_compute_dominators(fn);
+}
+
+// <function_declaration> ::= <data_type> <identifier> "(" <parameter_list> ")" <block>
+static void lower_function(ParseTreeNode *node) {
+    note_position(node);
+    int id = ir_find_function(module, identifier_name(node->children[1]));
+    IrFunction *fn = &module->functions[id];
+    if (fn->defined) {
+        lower_error("redefinition of function '%s'", fn->name);
+        return;
+    }
+    fn->defined = true;
+
+    state = &body_state;
+    reset_state(state, fn);
+    fn->entry = new_block();
+    seal_block(fn->entry);
+    state->current_block = fn->entry;
+
+    int saved = push_scope();
+    ParseTreeNode *params = node->children[3];
+    int k = 0;
+    for (int i = 0; i + 1 < params->num_children; i++) {
+        if (!node_is(params->children[i], "Data_Type")) {
+            continue;
+        }
+        TokenType data_type = data_type_of(params->children[i]);
+        Variable *var = declare(identifier_name(params->children[i + 1]), data_type, false, false, saved);
+        var->id = new_variable(ir_type_of(data_type));
+        int param = emit(IR_PARAM, ir_type_of(data_type));
+        fn->instrs[param].imm = k++;
+        assign_name(var, convert_for(param, data_type));
+    }
+
+    lower_block(node->children[5]);
+
+    // Falling off the end returns zero
+    if (!is_terminated(state->current_block)) {
+        int zero = fn->return_type == IR_FLOAT ? emit_float(0.0) : emit_int(0);
+        int instr = emit(IR_RETURN, IR_VOID);
+        ir_add_operand(fn, instr, zero);
+    }
+    pop_scope(saved);
+    finish_function(fn);
+}
+
+// Adds the function to the module, or checks it against an earlier prototype
+static void register_function(ParseTreeNode *node) {
+    note_position(node);
+    const char *name = identifier_name(node->children[1]);
+    IrType return_type = ir_type_of(data_type_of(node->children[0]));
+    IrType param_types[IR_MAX_PARAMS];
+    int num_params = 0;
+
+    ParseTreeNode *params = node->children[3];
+    for (int i = 0; i < params->num_children; i++) {
+        if (node_is(params->children[i], "Data_Type")) {
+            if (num_params == IR_MAX_PARAMS) {
+                lower_error("too many parameters in '%s'", name);
+                return;
+            }
+            param_types[num_params++] = ir_type_of(data_type_of(params->children[i]));
+        }
+    }
+
+    int id = ir_find_function(module, name);
+    if (id != IR_NONE) {
+        IrFunction *fn = &module->functions[id];
+        if (fn->num_params != num_params || fn->return_type != return_type ||
+            memcmp(fn->param_types, param_types, sizeof(IrType) * num_params) != 0) {
+            lower_error("conflicting types for '%s'", name);
+        }
+        return;
+    }
+    id = ir_add_function(module, name, return_type, num_params);
+    memcpy(module->functions[id].param_types, param_types, sizeof(IrType) * num_params);
+}
+
+static bool has_initializer(ParseTreeNode *declaration) {
+    for (int i = 0; i < declaration->num_children; i++) {
+        if (node_is_token(declaration->children[i], ASSIGN)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Lowers a whole <program>, returns false after reporting errors
+bool ir_lower_program(IrModule *lowered, ParseTreeNode *program) {
+    module = lowered;
+    failed = false;
+    scope_size = 0;
+
+    // Functions can be called before their declaration, register all of them first
+    bool needs_init = false;
+    for (int i = 0; i < program->num_children; i++) {
+        ParseTreeNode *declaration = program->children[i]->children[0];
+        if (node_is(declaration, "Function_Declaration")) {
+            register_function(declaration);
+        } else if (has_initializer(declaration)) {
+            needs_init = true;
+        }
+    }
+    if (needs_init) {
+        module->init_function = ir_add_function(module, "$init", IR_VOID, 0);
+        IrFunction *init = &module->functions[module->init_function];
+        init->defined = true;
+        state = &init_state;
+        reset_state(state, init);
+        init->entry = new_block();
+        seal_block(init->entry);
+        state->current_block = init->entry;
+    }
+    called = calloc(module->num_functions, sizeof(bool));
+    module_strings = malloc((literal_strings.count + 1) * sizeof(int));
+    for (int i = 0; i < literal_strings.count; i++) {
+        module_strings[i] = -1;
+    }
+
+    // Globals are visible to the functions that follow them
+    for (int i = 0; i < program->num_children; i++) {
+        ParseTreeNode *declaration = program->children[i]->children[0];
+        if (node_is(declaration, "Function_Declaration")) {
+            if (node_is(declaration->children[declaration->num_children - 1], "Block")) {
+                lower_function(declaration);
+            }
+            continue;
+        }
+        state = &init_state;
+        if (node_is(declaration, "Variable_Declaration")) {
+            lower_variable_declaration(declaration, true, 0);
+        } else if (node_is(declaration, "Array_Declaration")) {
+            lower_array_declaration(declaration, true, 0);
+        }
+    }
+
+    if (needs_init) {
+        state = &init_state;
+        emit(IR_RETURN, IR_VOID);
+        finish_function(state->fn);
+    }
+
+    for (int i = 0; i < module->num_functions; i++) {
+        if (called[i] && !module->functions[i].defined) {
+            current_line = 0;
+            fprintf(stderr, "Error: function '%s' is declared but never defined\n", module->functions[i].name);
+            failed = true;
+        }
+    }
+    module->main_function = ir_find_function(module, "main");
+    if (module->main_function != IR_NONE && !module->functions[module->main_function].defined) {
+        module->main_function = IR_NONE;
+    }
+
+    free(called);
+    called = NULL;
+    free(module_strings);
+    module_strings = NULL;
+    return !failed;
+}
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "output.h"
+
+// Buffered output of running programs (see output.h)
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+#define MAX_SLOTS 16                    // IR_MAX_PARAMS, the most arguments a printf has
+
+static char buffer[OUTPUT_BUFFER_SIZE];
+static size_t used;
+static int interactive = -1;            // Standard output is a terminal, -1 until known
+
+// Formats compiled for output_printf(), open addressing on the address of the format
+typedef struct {
+    const char *key;
+    PrintFormat *format;
+} CompiledFormat;
+
+static CompiledFormat *compiled;
+static int num_compiled, compiled_capacity;
+
+/******************************************************/
+/* Compiling formats */
+
+// Adds a byte of text, to the segment before if that is text too
+static void add_text(PrintFormat *format, int *text_used, char c) {
+    if (format->num_segments == 0 || format->segments[format->num_segments - 1].kind != SEGMENT_TEXT) {
+        format->segments[format->num_segments++] = (FormatSegment){ SEGMENT_TEXT, format->text + *text_used, 0, 0 };
+    }
+    format->text[(*text_used)++] = c;
+    format->segments[format->num_segments - 1].length++;
+}
+
+PrintFormat *print_format_compile(const char *format, int length) {
+    PrintFormat *result = malloc(sizeof(PrintFormat));
+    // A byte starts at most one segment, and a specification gets at most "ll" and a NUL more
+    FormatSegment *segments = malloc(sizeof(FormatSegment) * (length + 1));
+    char *text = malloc(length * 3 + 1);
+    if (result == NULL || segments == NULL || text == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed in print_format_compile\n");
+        exit(1);
+    }
+    *result = (PrintFormat){ segments, 0, 0, text };
+    int n = 0;
+
+    for (int i = 0; i < length; i++) {
+        if (format[i] != '%') {
+            add_text(result, &n, format[i]);
+            continue;
+        }
+
+        int start = n;
+        text[n++] = '%';
+        i++;
+        while (i < length && format[i] != '\0' && strchr("-+ #0123456789.", format[i])) {
+            text[n++] = format[i++];
+        }
+        int plain = n == start + 1;
+        while (i < length && (format[i] == 'l' || format[i] == 'h')) {
+            i++;
+        }
+        if (i >= length) {
+            // A '%' at the end prints nothing
+            n = start;
+            break;
+        }
+        if (format[i] == '%') {
+            // "%%", and "%5%" and the like, print just the '%'
+            n = start;
+            add_text(result, &n, '%');
+            continue;
+        }
+
+        SegmentKind kind;
+        switch (format[i]) {
+            case 'c': kind = SEGMENT_CHAR; break;
+            case 's': kind = SEGMENT_STRING; break;
+            case 'f': case 'g': case 'e': kind = SEGMENT_FLOAT; break;
+            default: kind = SEGMENT_INT; break;
+        }
+        if (kind == SEGMENT_INT) {
+            text[n++] = 'l';
+            text[n++] = 'l';
+            plain &= format[i] == 'd' || format[i] == 'i';
+        }
+        text[n++] = format[i];
+        text[n++] = '\0';
+        segments[result->num_segments++] = (FormatSegment){ kind, text + start, n - start - 1, plain };
+        result->num_slots++;
+    }
+    return result;
+}
+
+void print_format_free(PrintFormat *format) {
+    if (format != NULL) {
+        free(format->segments);
+        free(format->text);
+        free(format);
+    }
+}
+
+/******************************************************/
+/* The buffer */
+
+// Writes all of the vectors, picking up after partial writes
+static void write_vectors(struct iovec *vectors, int count) {
+    while (count > 0) {
+        ssize_t written = writev(STDOUT_FILENO, vectors, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;         // Lost, like output to a closed stdout
+        }
+        while (count > 0 && (size_t)written >= vectors->iov_len) {
+            written -= (ssize_t)vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0) {
+            vectors->iov_base = (char *)vectors->iov_base + written;
+            vectors->iov_len -= (size_t)written;
+        }
+    }
+}
+
+void output_flush(void) {
+    // Whatever stdio still holds was printed first
+    fflush(stdout);
+    if (used > 0) {
+        struct iovec vector = { buffer, used };
+        write_vectors(&vector, 1);
+        used = 0;
+    }
+}
+
+// Most text between conversions is short, copied in words instead of with a call to memcpy()
+static inline void copy_bytes(char *to, const char *from, size_t length) {
+    if (length >= 8 && length <= 16) {
+        uint64_t head, tail;
+        memcpy(&head, from, 8);
+        memcpy(&tail, from + length - 8, 8);
+        memcpy(to, &head, 8);
+        memcpy(to + length - 8, &tail, 8);
+    } else if (length < 8) {
+        for (size_t i = 0; i < length; i++) {
+            to[i] = from[i];
+        }
+    } else {
+        memcpy(to, from, length);
+    }
+}
+
+void output_write(const char *bytes, size_t length) {
+    if (length <= OUTPUT_BUFFER_SIZE - used) {
+        copy_bytes(buffer + used, bytes, length);
+        used += length;
+        return;
+    }
+    if (length < OUTPUT_BUFFER_SIZE / 2) {
+        output_flush();
+        memcpy(buffer, bytes, length);
+        used = length;
+        return;
+    }
+    // Too long to be worth copying: the buffer and the bytes go out in one writev()
+    fflush(stdout);
+    struct iovec vectors[2] = { { buffer, used }, { (void *)bytes, length } };
+    write_vectors(vectors, 2);
+    used = 0;
+}
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Two digits per division, written from the end
+static void put_int(int64_t value) {
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+    while (magnitude >= 100) {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * (magnitude % 100), 2);
+        magnitude /= 100;
+    }
+    if (magnitude >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * magnitude, 2);
+    } else {
+        *--p = (char)('0' + magnitude);
+    }
+    if (value < 0) {
+        *--p = '-';
+    }
+    output_write(p, (size_t)(digits + sizeof(digits) - p));
+}
+
+static int format_into(char *out, size_t size, const FormatSegment *segment, PrintArg arg) {
+    switch (segment->kind) {
+        case SEGMENT_INT: return snprintf(out, size, segment->text, (long long)arg.i);
+        case SEGMENT_CHAR: return snprintf(out, size, segment->text, (int)arg.i);
+        case SEGMENT_FLOAT: return snprintf(out, size, segment->text, arg.f);
+        default: return snprintf(out, size, segment->text, arg.s);
+    }
+}
+
+// Formats with the C library into the free part of the buffer, making room if it does not fit
+static void put_formatted(const FormatSegment *segment, PrintArg arg) {
+    size_t space = OUTPUT_BUFFER_SIZE - used;
+    int length = format_into(buffer + used, space, segment, arg);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length < space) {
+        used += (size_t)length;
+        return;
+    }
+    if (length < OUTPUT_BUFFER_SIZE) {
+        output_flush();
+        used = (size_t)format_into(buffer, OUTPUT_BUFFER_SIZE, segment, arg);
+        return;
+    }
+    char *text = malloc((size_t)length + 1);
+    if (text == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed in put_formatted\n");
+        exit(1);
+    }
+    format_into(text, (size_t)length + 1, segment, arg);
+    output_write(text, (size_t)length);
+    free(text);
+}
+
+void output_print(const PrintFormat *format, const PrintArg *args) {
+    for (int s = 0; s < format->num_segments; s++) {
+        const FormatSegment *segment = &format->segments[s];
+        if (segment->kind == SEGMENT_TEXT) {
+            output_write(segment->text, (size_t)segment->length);
+            continue;
+        }
+        PrintArg arg = *args++;
+        if (!segment->plain || segment->kind == SEGMENT_FLOAT) {
+            put_formatted(segment, arg);
+        } else if (segment->kind == SEGMENT_INT) {
+            put_int(arg.i);
+        } else if (segment->kind == SEGMENT_CHAR) {
+            char c = (char)arg.i;
+            output_write(&c, 1);
+        } else {
+            output_write(arg.s, strlen(arg.s));
+        }
+    }
+
+    if (interactive < 0) {
+        interactive = isatty(STDOUT_FILENO);
+    }
+    if (interactive) {
+        output_flush();
+    }
+}
+
+/******************************************************/
+/* Library functions for compiled code */
+
+static PrintFormat *compiled_format(const char *format) {
+    if (2 * (num_compiled + 1) > compiled_capacity) {
+        CompiledFormat *old = compiled;
+        int old_capacity = compiled_capacity;
+        compiled_capacity = compiled_capacity ? compiled_capacity * 2 : 64;
+        compiled = calloc((size_t)compiled_capacity, sizeof(CompiledFormat));
+        if (compiled == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed in compiled_format\n");
+            exit(1);
+        }
+        num_compiled = 0;
+        for (int i = 0; i < old_capacity; i++) {
+            if (old[i].key != NULL) {
+                int slot = (int)(((uintptr_t)old[i].key >> 4) & (uintptr_t)(compiled_capacity - 1));
+                while (compiled[slot].key != NULL) {
+                    slot = (slot + 1) & (compiled_capacity - 1);
+                }
+                compiled[slot] = old[i];
+                num_compiled++;
+            }
+        }
+        free(old);
+    }
+
+    int slot = (int)(((uintptr_t)format >> 4) & (uintptr_t)(compiled_capacity - 1));
+    while (compiled[slot].key != NULL && compiled[slot].key != format) {
+        slot = (slot + 1) & (compiled_capacity - 1);
+    }
+    if (compiled[slot].key == NULL) {
+        compiled[slot].key = format;
+        compiled[slot].format = print_format_compile(format, (int)strlen(format));
+        num_compiled++;
+    }
+    return compiled[slot].format;
+}
+
+// The arguments are read with the types of the slots, codegen.c passes them that way.
+// The result is not the byte count of printf(), compiled code never uses it.
+int output_printf(const char *format, ...) {
+    const PrintFormat *compiled_print = compiled_format(format);
+    PrintArg args[MAX_SLOTS];
+    int num_args = 0;
+    va_list list;
+    va_start(list, format);
+    for (int s = 0; s < compiled_print->num_segments && num_args < MAX_SLOTS; s++) {
+        switch (compiled_print->segments[s].kind) {
+            case SEGMENT_TEXT: break;
+            case SEGMENT_FLOAT: args[num_args++].f = va_arg(list, double); break;
+            case SEGMENT_STRING: args[num_args++].s = va_arg(list, const char *); break;
+            default: args[num_args++].i = va_arg(list, long long); break;
+        }
+    }
+    va_end(list);
+    output_print(compiled_print, args);
+    return 0;
+}
+
+int output_fflush(FILE *stream) {
+    output_flush();
+    return fflush(stream);
+}
+
+void output_end(void) {
+    output_flush();
+    for (int i = 0; i < compiled_capacity; i++) {
+        print_format_free(compiled[i].format);
+    }
+    free(compiled);
+    compiled = NULL;
+    num_compiled = compiled_capacity = 0;
+}
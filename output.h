@@ -0,0 +1,63 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Buffered output of running programs (output.c)
+//
+// A printf format is compiled once into a list of segments: literal text, with "%%" already
+// turned into '%', and typed conversion slots. Printing goes through that list into one
+// 64 KB buffer, which is written to standard output with write() or writev() when it fills
+// up, before a scanf reads, and when the run ends. A conversion without flags, width or
+// precision is formatted by hand where that is simple (%d, %i, %c and %s); the rest use
+// snprintf() straight into the buffer. Nothing takes the stdio lock of stdout.
+//
+// The IR interpreter compiles the formats of its module. Code compiled by the JIT calls
+// output_printf() with the format codegen.c made for the C library; it is compiled the first
+// time and found by its address after that. On a terminal the buffer is written after every
+// printf, so output shows up as it would with a line buffered stdout.
+
+typedef enum {
+    SEGMENT_TEXT,
+    SEGMENT_INT,        // d i u x, as long long
+    SEGMENT_CHAR,       // c
+    SEGMENT_FLOAT,      // f g e, as double
+    SEGMENT_STRING,     // s, a NUL terminated char array
+} SegmentKind;
+
+typedef struct {
+    SegmentKind kind;
+    const char *text;   // The bytes of a SEGMENT_TEXT, or the C specification of a conversion
+    int length;
+    int plain;          // Conversion is just '%' and the character, formatted by hand if it can be
+} FormatSegment;
+
+typedef struct {
+    FormatSegment *segments;
+    int num_segments;
+    int num_slots;      // Conversions, each takes one argument
+    char *text;         // Storage of the texts and specifications
+} PrintFormat;
+
+typedef union {
+    int64_t i;
+    double f;
+    const char *s;
+} PrintArg;
+
+PrintFormat *print_format_compile(const char *format, int length);
+void print_format_free(PrintFormat *format);
+void output_print(const PrintFormat *format, const PrintArg *args);
+
+void output_write(const char *bytes, size_t length);
+void output_flush(void);
+// Flushes and forgets the formats compiled for output_printf(), at the end of a run
+void output_end(void);
+
+// Library functions for compiled code
+int output_printf(const char *format, ...);
+int output_fflush(FILE *stream);
+
+#endif //OUTPUT_H
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include "parallel.h"
+
+// Thread pool of parallel loops, see parallel.h
+//
+// The pool threads sleep on a condition variable between loops. A loop is published under the
+// lock with a new generation number, each thread takes chunks until the counter passes the end
+// and reports back, and the last one to finish wakes the caller, which has taken chunks too.
+
+#define MAX_THREADS 256
+#define CHUNKS_PER_THREAD 8
+
+static int num_threads = 1;
+static pthread_t *threads;      // Pool threads, numbered from 1
+static int num_started;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+static unsigned generation;     // Of the current loop, under the lock
+static int busy;                // Pool threads still in the current loop, under the lock
+static bool stopping;
+
+// The current loop, set before its generation is published
+static ParallelBody body;
+static void *context;
+static int64_t count, chunk;
+static _Atomic int64_t next;
+
+static void take_chunks(int thread) {
+    for (;;) {
+        int64_t start = atomic_fetch_add_explicit(&next, chunk, memory_order_relaxed);
+        if (start >= count) {
+            return;
+        }
+        body(context, thread, start, count - start > chunk ? start + chunk : count);
+    }
+}
+
+static void *pool_thread(void *argument) {
+    int thread = (int)(intptr_t)argument;
+    unsigned seen = 0;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (generation == seen && !stopping) {
+            pthread_cond_wait(&work_ready, &lock);
+        }
+        if (stopping) {
+            break;
+        }
+        seen = generation;
+        pthread_mutex_unlock(&lock);
+
+        take_chunks(thread);
+
+        pthread_mutex_lock(&lock);
+        if (--busy == 0) {
+            pthread_cond_signal(&work_done);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+static void start_pool(void) {
+    threads = malloc(sizeof(pthread_t) * num_threads);
+    if (!threads) {
+        fprintf(stderr, "Error: Memory allocation failed in start_pool\n");
+        exit(1);
+    }
+    stopping = false;
+    generation = 0;
+    // The threads start with SIGPROF blocked, so the samples of profile.c are all taken on the
+    // thread that keeps the call frames
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    for (num_started = 1; num_started < num_threads; num_started++) {
+        if (pthread_create(&threads[num_started], NULL, pool_thread, (void *)(intptr_t)num_started) != 0) {
+            // Fewer threads just take more chunks each
+            fprintf(stderr, "Warning: could only start %d threads\n", num_started);
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+/******************************************************/
+
+void parallel_init(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = cpus > 0 ? (int)(cpus < MAX_THREADS ? cpus : MAX_THREADS) : 1;
+
+    const char *setting = getenv("CORE_THREADS");
+    if (setting != NULL) {
+        char *end;
+        long n = strtol(setting, &end, 10);
+        if (*setting == '\0' || *end != '\0' || n < 1 || n > MAX_THREADS) {
+            fprintf(stderr, "Warning: CORE_THREADS must be from 1 to %d, using %d threads\n", MAX_THREADS,
+                    num_threads);
+        } else {
+            num_threads = (int)n;
+        }
+    }
+}
+
+int parallel_threads(void) {
+    return num_threads;
+}
+
+void parallel_for(int64_t iterations, ParallelBody loop_body, void *loop_context) {
+    if (threads == NULL && num_threads > 1) {
+        start_pool();
+    }
+    int64_t share = iterations / ((int64_t)num_threads * CHUNKS_PER_THREAD);
+
+    pthread_mutex_lock(&lock);
+    body = loop_body;
+    context = loop_context;
+    count = iterations;
+    chunk = share > 0 ? share : 1;
+    atomic_store_explicit(&next, 0, memory_order_relaxed);
+    busy = num_started > 1 ? num_started - 1 : 0;
+    generation++;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+
+    take_chunks(0);
+
+    pthread_mutex_lock(&lock);
+    while (busy > 0) {
+        pthread_cond_wait(&work_done, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void parallel_end(void) {
+    if (threads == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+    for (int t = 1; t < num_started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    threads = NULL;
+    num_started = 0;
+}
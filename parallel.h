@@ -0,0 +1,27 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+// Thread pool for the loops loop_opt.c marks with IR_PARALLEL (parallel.c)
+//
+// parallel_for() cuts a range of iterations into chunks of about an eighth of a thread's share,
+// and the threads, the calling one included, take the next chunk from a shared counter until
+// none are left, so a thread that got cheap iterations just takes more of them. The pool has a
+// thread per CPU, or as many as the CORE_THREADS environment variable asks for. The threads are
+// started by the first parallel_for() and wait for the next one in between.
+
+// Runs iterations start to end - 1 on one thread, numbered from 0 for the calling thread
+typedef void (*ParallelBody)(void *context, int thread, int64_t start, int64_t end);
+
+void parallel_init(void);
+// Threads parallel_for() runs on, 1 when it would only run on the calling thread
+int parallel_threads(void);
+
+// Runs iterations 0 to count - 1 and returns when they are all done
+void parallel_for(int64_t count, ParallelBody body, void *context);
+
+// Stops the threads of the pool
+void parallel_end(void);
+
+#endif //PARALLEL_H
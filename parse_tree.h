@@ -0,0 +1,45 @@
+#ifndef PARSE_TREE_H
+#define PARSE_TREE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "token.h"
+
+// Data structure for the parse tree
+typedef struct ParseTreeNode {
+    char *name;
+    Token *token;
+    struct ParseTreeNode **children;
+    int num_children;
+    const char *recovery;   // "inserted" or "unexpected" on tokens error recovery put in, else NULL
+} ParseTreeNode;
+
+// Tree helpers defined in parser.c, shared with the passes that walk the tree
+ParseTreeNode *create_node(const char *name);
+void add_child(ParseTreeNode *parent, ParseTreeNode *child);
+void free_parse_tree(ParseTreeNode *node);
+
+// Parses a whole symbol table from a stream and closes it (parser.c). Returns the program,
+// or NULL after syntax errors, of which there were *num_errors
+ParseTreeNode *parse_symbol_table(FILE *symbols, int *num_errors);
+
+// Checks if a node is the non-terminal with the given name, e.g. node_is(node, "Block")
+static inline bool node_is(const ParseTreeNode *node, const char *name) {
+    return node != NULL && node->token == NULL && strcmp(node->name, name) == 0;
+}
+
+// Checks if a node is a terminal holding a token of the given type
+static inline bool node_is_token(const ParseTreeNode *node, TokenType type) {
+    return node != NULL && node->token != NULL && node->token->type == type;
+}
+
+// Dead code elimination pass (dead_code.c)
+typedef struct {
+    int removed_statements;
+    int removed_functions;
+} DeadCodeStats;
+
+DeadCodeStats eliminate_dead_code(ParseTreeNode *program);
+
+#endif //PARSE_TREE_H
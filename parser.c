@@ -1,17 +1,19 @@
 #include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include "token.h"
-
-// Data structure for the parse tree
-typedef struct ParseTreeNode {
-    char *name;
-    Token *token;
-    struct ParseTreeNode **children;
-    int num_children;
-} ParseTreeNode;
+#include "parse_tree.h"
+#include "ir.h"
+#include "profile.h"
+#include "instrument.h"
+#include "logger.h"
+#include "alloc.h"
+#include "string_table.h"
 
 // Function prototypes for creating parse tree nodes
 ParseTreeNode *create_program_node();
@@ -51,20 +53,66 @@ void print_indent(int indent_level);
 
 void free_parse_tree(ParseTreeNode *node);
 
-void report_error(const char *message, TokenType expected);
-void synchronize();
-
-// Global variables to store the token list and the current token index
+// Error recovery: sets of token types as bit masks, diagnostics collected while parsing
+typedef uint64_t TokenSet;
+#define TOKEN_BIT(type) ((TokenSet)1 << (type))
+
+// FIRST(<declaration>), and where a declaration after an error can start again
+#define FIRST_DECLARATION (TOKEN_BIT(INT) | TOKEN_BIT(FLOAT) | TOKEN_BIT(CHAR) | TOKEN_BIT(BOOL))
+#define SYNC_DECLARATION (FIRST_DECLARATION | TOKEN_BIT(TOKEN_EOF))
+// Statement boundaries: the keywords that start a <block_item> and the tokens that end one
+#define SYNC_STATEMENT (SYNC_DECLARATION | TOKEN_BIT(SEMICOLON) | TOKEN_BIT(RIGHT_BRACE) | TOKEN_BIT(IF) | \
+                        TOKEN_BIT(WHILE) | TOKEN_BIT(FOR) | TOKEN_BIT(RETURN) | TOKEN_BIT(PRINTF) | TOKEN_BIT(SCANF))
+// FOLLOW(<exp>) within a statement
+#define FOLLOW_EXPRESSION (SYNC_STATEMENT | TOKEN_BIT(RIGHT_PARENTHESIS) | TOKEN_BIT(RIGHT_BRACKET) | TOKEN_BIT(COMMA))
+// Punctuation that is assumed missing, and inserted, when it is expected but not there
+#define INSERTABLE (TOKEN_BIT(SEMICOLON) | TOKEN_BIT(LEFT_PARENTHESIS) | TOKEN_BIT(RIGHT_PARENTHESIS) | \
+                    TOKEN_BIT(LEFT_BRACKET) | TOKEN_BIT(RIGHT_BRACKET) | TOKEN_BIT(LEFT_BRACE) | TOKEN_BIT(RIGHT_BRACE))
+
+typedef struct {
+    int line;
+    int column;
+    int end_column;         // Span of the token the error is reported at
+    int order;
+    char message[192];
+} Diagnostic;
+
+void diagnose(const Token *at, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void synchronize(TokenSet sync);
+void print_diagnostics(void);
+
+// Global variables to store the token list and the current token index. Tokens are read
+// from the symbol table as they are needed into a window, tokens[0] is token window_start.
+// Without --stream the window keeps every token, with it only those of the current declaration
 Token *tokens;
+int window_start = 0;
+int window_capacity;
 int current_token = 0;
-int num_tokens;
+int num_tokens;         // Tokens read so far
 bool panic_mode = false;
+FILE *token_file;
+
+// Diagnostics of this parse. After an error nothing more is reported until a token matches,
+// so one mistake does not produce a cascade of follow-up errors
+Diagnostic *diagnostics;
+int num_diagnostics = 0;
+int diagnostics_capacity = 0;
+bool recovering = false;
+
+// Declarations are handed to this instead of being added to the program with --stream
+void (*on_declaration)(ParseTreeNode *declaration);
+int streamed_declarations = 0;
 
 // Global file pointer for the output file
 FILE *output_file;
 
 // Function prototypes
-Token *load_tokens(const char *filename, int *num_tokens);
+bool open_tokens(const char *filename);
+bool open_token_stream(FILE *file);
+bool load_strings(const char *filename);
+bool load_tokens_until(int index);
+void release_tokens(int index);
+void close_tokens(void);
 ParseTreeNode *parse_program();
 ParseTreeNode *parse_declaration();
 ParseTreeNode *parse_function_declaration();
@@ -108,12 +156,97 @@ ParseTreeNode *parse_unary_exp();
 void match(TokenType type);
 void add_child(ParseTreeNode *parent, ParseTreeNode *child);
 ParseTreeNode *match_and_create_node(TokenType type, const char* node_name);
+int compile_and_run(ParseTreeNode *root, bool optimize, const char *save_path, bool dump_ir, bool run, bool use_jit,
+                    bool profile, bool emit_asm);
+int run_image(const char *path, bool dump_ir, bool run, bool use_jit, bool profile, bool emit_asm);
+int run_module(IrModule *module, bool dump_ir, bool run, bool use_jit, bool profile, bool emit_asm);
+void emit_declaration(ParseTreeNode *declaration);
+
+// Checks that there is a token at index, reading up to it from the symbol table if needed
+static inline bool has_token(int index) {
+    return index < num_tokens || load_tokens_until(index);
+}
+
+// The token at index, past the end of the symbol table the last one
+static inline Token *token_at(int index) {
+    static Token no_tokens = { .type = TOKEN_EOF, .lexeme = "EOF" };
+    if (!has_token(index)) {
+        if (num_tokens == 0) {
+            return &no_tokens;
+        }
+        index = num_tokens - 1;
+    }
+    if (index < window_start) {
+        index = window_start;
+    }
+    return &tokens[index - window_start];
+}
+
+#ifndef CORE_NO_MAIN
+int main(int argc, char* argv[argc + 1]) {
+    bool optimize = false;
+    bool dump_ir = false;
+    bool run = false;
+    bool use_jit = false;
+    bool profile = false;
+    bool emit_asm = false;
+    bool quiet = false;
+    bool stream = false;
+    const char *save_path = NULL;
+    const char *load_path = NULL;
+    int status = 0;
+    stats_init("parser");
+    heap_profile_init();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O") == 0) {
+            optimize = true;
+        } else if (strcmp(argv[i], "--ir") == 0) {
+            dump_ir = true;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            run = true;
+            use_jit = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            run = true;
+            profile = true;
+        } else if (strcmp(argv[i], "--asm") == 0) {
+            emit_asm = true;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            load_path = argv[++i];
+        } else {
+            printf("Usage: ./%s [-q] [-O] [--ir] [--run] [--jit] [--profile] [--asm] [--stream] [--save {file}.corec] "
+                   "[--load {file}.corec]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (stream && (optimize || dump_ir || run || emit_asm || save_path != NULL || load_path != NULL)) {
+        fprintf(stderr, "Error: --stream only writes the parse tree, it cannot be combined with -O, --ir, --run, --jit, --profile, --asm, --save or --load\n");
+        return 1;
+    }
+    if (load_path != NULL && (optimize || save_path != NULL)) {
+        fprintf(stderr, "Error: --load runs an image as it was saved, -O and --save apply when saving it\n");
+        return 1;
+    }
+    log_init(quiet ? LOG_LEVEL_INFO : LOG_LEVEL_TRACE);
+    if (load_path != NULL) {
+        return run_image(load_path, dump_ir, run, use_jit, profile, emit_asm);
+    }
 
-int main(void) {
-    tokens = load_tokens("symbol_table.txt", &num_tokens);
-    if (tokens == NULL) {
+    StatTime start = stats_now();
+    if (!open_tokens("symbol_table.txt") || !load_strings("string_table.txt")) {
         return 1;
     }
+    if (!stream) {
+        load_tokens_until(INT_MAX);
+        stats_phase("load_tokens", start);
+    }
 
     output_file = fopen("parse_tree_output.ebnf", "w");
     if (output_file == NULL) {
@@ -121,30 +254,209 @@ int main(void) {
         return 1;
     }
 
-    printf("\nPARSING!\n\n");
+    log_info(LOG_PARSER, "\nPARSING!\n\n");
+    start = stats_now();
+    if (stream) {
+        on_declaration = emit_declaration;
+    }
     ParseTreeNode *root = parse_program();
+    stats_phase("parse", start);
+    STAT_SET(STAT_TOKENS, num_tokens);
 
-    if (panic_mode) {
-        printf("Parsing failed!\n");
+    if (stream && !panic_mode) {
+        // The declarations are written already, only the end of the program is left
+        log_info(LOG_PARSER, "Parsing successful!\n");
+        fprintf(output_file, streamed_declarations == 0 ? "Program()" : "\n)");
+        fclose(output_file);
+    } else if (panic_mode) {
+        log_flush();
+        print_diagnostics();
+        log_info(LOG_PARSER, "Parsing failed with %d error%s!\n", num_diagnostics, num_diagnostics == 1 ? "" : "s");
+        // The partial tree is still written, with the tokens error recovery put in marked
+        if (stream) {
+            fprintf(output_file, streamed_declarations == 0 ? "Program()" : "\n)");
+        } else {
+            print_parse_tree(root, 0);
+        }
         fclose(output_file);
-        remove("parse_tree_output.ebnf");
+        status = 1;
     } else {
-        printf("Parsing successful!\n");
+        log_info(LOG_PARSER, "Parsing successful!\n");
+        if (optimize) {
+            start = stats_now();
+            DeadCodeStats stats = eliminate_dead_code(root);
+            stats_phase("dead_code", start);
+            log_info(LOG_PARSER, "Dead code elimination: removed %d statements, %d functions\n",
+                     stats.removed_statements, stats.removed_functions);
+        }
+        start = stats_now();
         print_parse_tree(root, 0);
         fclose(output_file);
+        stats_phase("print_tree", start);
+
+        if (dump_ir || run || emit_asm || save_path != NULL) {
+            status = compile_and_run(root, optimize, save_path, dump_ir, run, use_jit, profile, emit_asm);
+        }
     }
+    start = stats_now();
     free_parse_tree(root);
-    free(tokens);
-    return 0;
+    close_tokens();
+    stats_phase("free", start);
+    return status;
+}
+#endif
+
+// Lowers the parse tree to the IR, then optimizes, saves, dumps, compiles and runs it as requested
+int compile_and_run(ParseTreeNode *root, bool optimize, const char *save_path, bool dump_ir, bool run, bool use_jit,
+                    bool profile, bool emit_asm) {
+    IrModule module;
+    StatTime start = stats_now();
+    ir_module_init(&module);
+    if (!ir_lower_program(&module, root)) {
+        log_info(LOG_IR, "IR lowering failed!\n");
+        ir_module_free(&module);
+        return 1;
+    }
+    stats_phase("lower", start);
+
+    if (optimize) {
+        // First, so the other passes see the inlined bodies together with the loops around them
+        start = stats_now();
+        IrInlineStats inlining = ir_inline_functions(&module);
+        stats_phase("inline", start);
+        log_info(LOG_IR, "Inlining: %d calls inlined, %d instructions added, %d calls over the size limits\n",
+                 inlining.inlined, inlining.added, inlining.skipped);
+
+        start = stats_now();
+        IrPurityStats purity = ir_find_pure_functions(&module);
+        stats_phase("purity", start);
+        log_info(LOG_IR, "Memoization: %d of %d functions pure, %d memoized\n", purity.pure, purity.functions,
+                 purity.memoized);
+
+        // Before the loop optimizations, which turn the indices they reduce into induction variables of their own
+        start = stats_now();
+        IrBoundsStats bounds = ir_eliminate_bounds_checks(&module);
+        stats_phase("range", start);
+        log_info(LOG_IR, "Bounds checks: %d of %d removed\n", bounds.removed, bounds.checks);
+
+        start = stats_now();
+        IrLoopStats stats = ir_optimize_loops(&module);
+        stats_phase("loop_opt", start);
+        log_info(LOG_IR, "Loop optimization: hoisted %d instructions, reduced %d multiplications, %d powers, "
+                 "vectorized %d loops, parallelized %d\n", stats.hoisted, stats.reduced_multiplications,
+                 stats.reduced_powers, stats.vectorized, stats.parallelized);
+    }
+
+    if (save_path != NULL) {
+        start = stats_now();
+        bool saved = ir_save_image(&module, save_path);
+        stats_phase("save_image", start);
+        if (!saved) {
+            ir_module_free(&module);
+            return 1;
+        }
+        log_info(LOG_IR, "Image written to %s\n", save_path);
+    }
+    return run_module(&module, dump_ir, run, use_jit, profile, emit_asm);
+}
+
+// Loads a precompiled image in place of scanning, parsing and lowering, then runs it like compile_and_run()
+int run_image(const char *path, bool dump_ir, bool run, bool use_jit, bool profile, bool emit_asm) {
+    IrModule module;
+    StatTime start = stats_now();
+    if (!ir_load_image(&module, path)) {
+        return 1;
+    }
+    stats_phase("load_image", start);
+    log_info(LOG_IR, "Image loaded from %s\n", path);
+    return run_module(&module, dump_ir, run, use_jit, profile, emit_asm);
+}
+
+// Dumps, compiles and runs a module as requested, then frees it
+int run_module(IrModule *module, bool dump_ir, bool run, bool use_jit, bool profile, bool emit_asm) {
+    StatTime start;
+    if (dump_ir) {
+        FILE *ir_file = fopen("ir_output.txt", "w");
+        if (ir_file == NULL) {
+            fprintf(stderr, "Error opening IR output file.\n");
+        } else {
+            ir_print_module(ir_file, module);
+            fclose(ir_file);
+            log_info(LOG_IR, "IR written to ir_output.txt\n");
+        }
+    }
+
+    for (int f = 0; f < module->num_functions; f++) {
+        STAT_ADD(STAT_IR_INSTRUCTIONS, module->functions[f].num_instrs);
+    }
+
+    int status = 0;
+    if (emit_asm) {
+        start = stats_now();
+        FILE *asm_file = fopen("output.s", "w");
+        if (asm_file == NULL) {
+            fprintf(stderr, "Error opening assembly output file.\n");
+            status = 1;
+        } else {
+            bool emitted = ir_emit_x86_64(asm_file, module);
+            fclose(asm_file);
+            if (emitted) {
+                log_info(LOG_IR, "Assembly written to output.s\n");
+            } else {
+                remove("output.s");
+                status = 1;
+            }
+        }
+        stats_phase("codegen", start);
+    }
+
+    if (run) {
+        int exit_code = 0;
+        IrRunStats stats;
+        log_flush();
+        start = stats_now();
+        bool ran = ir_run(module, use_jit, profile, &exit_code, &stats);
+        stats_phase("run", start);
+        if (!ran) {
+            status = 1;
+        } else if (use_jit) {
+            fprintf(stderr, "Program returned %d (%lld IR instructions interpreted, %d functions compiled, %.3f ms)\n",
+                    exit_code, stats.instructions, stats.compiled_functions, stats.seconds * 1000);
+        } else {
+            fprintf(stderr, "Program returned %d (%lld IR instructions, %.3f ms)\n",
+                    exit_code, stats.instructions, stats.seconds * 1000);
+        }
+        if (ran && stats.memo_calls > 0) {
+            fprintf(stderr, "Memoized calls: %lld, %lld answered from the cache (%.1f%%)\n", stats.memo_calls,
+                    stats.memo_hits, 100.0 * (double)stats.memo_hits / (double)stats.memo_calls);
+        }
+        STAT_SET(STAT_EXECUTED_INSTRUCTIONS, stats.instructions);
+        STAT_SET(STAT_MEMO_CALLS, stats.memo_calls);
+        STAT_SET(STAT_MEMO_HITS, stats.memo_hits);
+        if (profile) {
+            FILE *folded_file = fopen("profile.folded", "w");
+            if (folded_file == NULL) {
+                fprintf(stderr, "Error opening profile output file.\n");
+                status = 1;
+            } else {
+                profile_write(stderr, folded_file);
+                fclose(folded_file);
+                // Next to the flat profile, the program's own output stays the same as without --profile
+                fprintf(stderr, "Folded stacks written to profile.folded\n");
+            }
+        }
+    }
+    ir_module_free(module);
+    return status;
 }
 
 // Helper function to add a child to a parse tree node
 void add_child(ParseTreeNode *parent, ParseTreeNode *child) {
     parent->num_children++;
-    ParseTreeNode **new_children = realloc(parent->children, sizeof(ParseTreeNode *) * parent->num_children);
+    ParseTreeNode **new_children = core_realloc(parent->children, sizeof(ParseTreeNode *) * parent->num_children);
     if (!new_children) {
         fprintf(stderr, "Error: Memory allocation failed in add_child\n");
-        synchronize(); 
+        exit(1);
     }
     parent->children = new_children;
     parent->children[parent->num_children - 1] = child;
@@ -152,66 +464,91 @@ void add_child(ParseTreeNode *parent, ParseTreeNode *child) {
 
 // Helper function to match the current token with the expected type and create a node for it
 ParseTreeNode *match_and_create_node(TokenType type, const char* node_name) {
-    printf("Parsing token: %-20s %-20s Line: %d, Column: %d\n", token_names[tokens[current_token].type], tokens[current_token].lexeme, tokens[current_token].line_number, tokens[current_token].column_number);
+    log_trace(LOG_PARSER, "Parsing token: %-20s %-20s Line: %d, Column: %d\n", token_names[token_at(current_token)->type], token_at(current_token)->lexeme, token_at(current_token)->line_number, token_at(current_token)->column_number);
     ParseTreeNode *node = create_node(node_name);
-    node->token = malloc(sizeof(Token));
+    node->token = core_malloc(sizeof(Token));
     if (!node->token) {
         fprintf(stderr, "Error: Memory allocation failed in match_and_create_node\n");
-        synchronize();
+        exit(1);
     }
-    *node->token = tokens[current_token];
+    Token *token = token_at(current_token);
+    *node->token = *token;
 
-    if (current_token < num_tokens && tokens[current_token].type == type) {
+    if (token->type == type) {
         current_token++;
+        recovering = false;
+    } else if (token->type != TOKEN_EOF && has_token(current_token + 1) && token_at(current_token + 1)->type == type) {
+        // One token too many: skip it
+        diagnose(token, "Unexpected %s '%s' before %s", token_names[token->type], token->lexeme, token_names[type]);
+        current_token++;
+        *node->token = *token_at(current_token);
+        current_token++;
+    } else if ((TOKEN_BIT(type) & INSERTABLE) &&
+               ((TOKEN_BIT(token->type) & FOLLOW_EXPRESSION) ||
+                token->line_number > token_at(current_token - 1)->line_number)) {
+        // Missing punctuation before a token that can follow it, or at the end of a line:
+        // the node gets a token of the expected type, nothing is consumed
+        diagnose(token, "Missing %s before '%s'", token_names[type], token->lexeme);
+        node->token->type = type;
+        node->token->lexeme[0] = '\0';
+        node->recovery = "inserted";
     } else {
-        report_error("Unexpected token", type);
-        synchronize();
+        diagnose(token, "Unexpected token %s '%s', Expected: %s", token_names[token->type], token->lexeme, token_names[type]);
+        node->recovery = "unexpected";
+        synchronize(SYNC_STATEMENT);
     }
     return node;
 }
 
 // <program> ::= { <declaration> }
 ParseTreeNode *parse_program() {
+    STAT_RULE();
     ParseTreeNode *node = create_program_node();
     
-    while (current_token < num_tokens && tokens[current_token].type != TOKEN_EOF) {
+    while (has_token(current_token) && token_at(current_token)->type != TOKEN_EOF) {
         ParseTreeNode *declaration = parse_declaration();
         if (declaration == NULL) {
-            // If not a valid declaration, synchronize and continue
-            fprintf(stderr, "Error: Invalid declaration at Line: %d\n", 
-                    tokens[current_token].line_number);
-            synchronize();
+            // If not a valid declaration, skip to where the next one can start
+            diagnose(token_at(current_token), "Invalid declaration");
+            current_token++;
+            synchronize(SYNC_DECLARATION);
             continue;
         }
-        add_child(node, declaration);
+        if (on_declaration != NULL) {
+            // Streaming: the declaration is gone after this, so are its tokens but the last
+            on_declaration(declaration);
+            release_tokens(current_token - 1);
+        } else {
+            add_child(node, declaration);
+        }
     }
     return node;
 }
 
 // <declaration> ::= <variable_declaration> | <array_declaration> | <function_declaration>
 ParseTreeNode *parse_declaration() {
-    ParseTreeNode *node = create_declaration_node();
-
+    STAT_RULE();
     // Return NULL if not a valid declaration start
-    if (current_token >= num_tokens || 
-        (tokens[current_token].type != INT && 
-         tokens[current_token].type != FLOAT &&
-         tokens[current_token].type != CHAR && 
-         tokens[current_token].type != BOOL)) {
+    if (!has_token(current_token) || 
+        (token_at(current_token)->type != INT && 
+         token_at(current_token)->type != FLOAT &&
+         token_at(current_token)->type != CHAR && 
+         token_at(current_token)->type != BOOL)) {
         return NULL;
     }
 
     // Find valid category of declaration
-    if (current_token + 1 < num_tokens && 
-        tokens[current_token+1].type == IDENTIFIER) {
+    if (has_token(current_token + 1) && 
+        token_at(current_token + 1)->type == IDENTIFIER) {
+        ParseTreeNode *node = create_declaration_node();
         
-        if (current_token + 2 < num_tokens && 
-            tokens[current_token+2].type == LEFT_PARENTHESIS) {
+        if (has_token(current_token + 2) && 
+            token_at(current_token + 2)->type == LEFT_PARENTHESIS) {
             ParseTreeNode *function_declaration = parse_function_declaration();
             add_child(node, function_declaration);
         } 
-        else if(current_token + 2 < num_tokens && 
-                tokens[current_token+2].type == LEFT_BRACKET) {
+        else if(has_token(current_token + 2) && 
+                token_at(current_token + 2)->type == LEFT_BRACKET) {
             ParseTreeNode *array_declaration = parse_array_declaration();
             add_child(node, array_declaration);
         } 
@@ -228,6 +565,7 @@ ParseTreeNode *parse_declaration() {
 // <variable_declaration> ::= <data_type> <identifier> [ “=” <exp> ] “;”
 //                         | <data_type> <identifier> { “,” <identifier> } “;”
 ParseTreeNode *parse_variable_declaration() {
+    STAT_RULE();
     ParseTreeNode *node = create_variable_declaration_node();
     ParseTreeNode *data_type = parse_data_type();
     add_child(node, data_type);
@@ -237,7 +575,7 @@ ParseTreeNode *parse_variable_declaration() {
     add_child(node, identifier_node);
 
     // Handle assignment if present
-    if (current_token < num_tokens && tokens[current_token].type == ASSIGN) {
+    if (has_token(current_token) && token_at(current_token)->type == ASSIGN) {
         add_child(node, match_and_create_node(ASSIGN, "Assign"));
         
         // Parse the assignment expression
@@ -246,7 +584,7 @@ ParseTreeNode *parse_variable_declaration() {
     }
     
     // Handle multiple declarations
-    while (current_token < num_tokens && tokens[current_token].type == COMMA) {
+    while (has_token(current_token) && token_at(current_token)->type == COMMA) {
         add_child(node, match_and_create_node(COMMA, "Comma"));
         
         // Parse next identifier
@@ -254,7 +592,7 @@ ParseTreeNode *parse_variable_declaration() {
         add_child(node, identifier_node);
         
         // Handle assignment for this identifier if present
-        if (current_token < num_tokens && tokens[current_token].type == ASSIGN) {
+        if (has_token(current_token) && token_at(current_token)->type == ASSIGN) {
             add_child(node, match_and_create_node(ASSIGN, "Assign"));
             
             // Parse the assignment expression
@@ -264,12 +602,14 @@ ParseTreeNode *parse_variable_declaration() {
     }
 
     // Expect semicolon at end
-    if (current_token < num_tokens && tokens[current_token].type == SEMICOLON) {
+    if (has_token(current_token) && token_at(current_token)->type == SEMICOLON) {
         add_child(node, match_and_create_node(SEMICOLON, "Semicolon"));
     } else {
-        fprintf(stderr, "Error: Expected semicolon at end of variable declaration at line %d\n", 
-                tokens[current_token].line_number);
-        synchronize();
+        diagnose(token_at(current_token), "Expected semicolon at end of variable declaration");
+        synchronize(SYNC_STATEMENT);
+        if (token_at(current_token)->type == SEMICOLON) {
+            add_child(node, match_and_create_node(SEMICOLON, "Semicolon"));
+        }
     }
 
     return node;
@@ -277,6 +617,7 @@ ParseTreeNode *parse_variable_declaration() {
 
 // <array_declaration> ::= <data_type> <identifier> “[“ [<const>]  “]”  [ “=” “{“ <argument_list>“}” ] “;”
 ParseTreeNode *parse_array_declaration() {
+    STAT_RULE();
     ParseTreeNode *node = create_array_declaration_node();
     ParseTreeNode *data_type = parse_data_type();
     add_child(node, data_type);
@@ -286,23 +627,23 @@ ParseTreeNode *parse_array_declaration() {
 
     add_child(node, match_and_create_node(LEFT_BRACKET, "Left_Bracket"));
 
-    if (current_token < num_tokens && (tokens[current_token].type == INTEGER_LITERAL ||
-                                       tokens[current_token].type == FLOAT_LITERAL ||
-                                       tokens[current_token].type == CHARACTER_LITERAL ||
-                                       tokens[current_token].type == TRUE ||
-                                       tokens[current_token].type == FALSE)) {
+    if (has_token(current_token) && (token_at(current_token)->type == INTEGER_LITERAL ||
+                                     token_at(current_token)->type == FLOAT_LITERAL ||
+                                     token_at(current_token)->type == CHARACTER_LITERAL ||
+                                     token_at(current_token)->type == TRUE ||
+                                     token_at(current_token)->type == FALSE)) {
         ParseTreeNode *const_node = parse_const();
         add_child(node, const_node);
     }
 
     add_child(node, match_and_create_node(RIGHT_BRACKET, "Right_Bracket"));
 
-    if (current_token < num_tokens && tokens[current_token].type == ASSIGN) {
+    if (has_token(current_token) && token_at(current_token)->type == ASSIGN) {
         add_child(node, match_and_create_node(ASSIGN, "Assign"));
         add_child(node, match_and_create_node(LEFT_BRACE, "Left_Brace"));
 
         // Parse argument list
-        if (current_token < num_tokens && tokens[current_token].type != RIGHT_BRACE) {
+        if (has_token(current_token) && token_at(current_token)->type != RIGHT_BRACE) {
             ParseTreeNode *argument_list = parse_argument_list();
             add_child(node, argument_list);
         }
@@ -316,6 +657,7 @@ ParseTreeNode *parse_array_declaration() {
 
 // <function_declaration> ::= <data_type> <identifier> "(" <parameter_list> ")" ( <block> | “;” )
 ParseTreeNode *parse_function_declaration() {
+    STAT_RULE();
     ParseTreeNode *node = create_function_declaration_node();
     ParseTreeNode *data_type = parse_data_type();
     add_child(node, data_type);
@@ -330,13 +672,14 @@ ParseTreeNode *parse_function_declaration() {
 
     add_child(node, match_and_create_node(RIGHT_PARENTHESIS, "Right_Parenthesis"));
 
-    if (current_token < num_tokens && tokens[current_token].type == LEFT_BRACE) {
+    if (has_token(current_token) && token_at(current_token)->type == LEFT_BRACE) {
         ParseTreeNode *block = parse_block();
         add_child(node, block);
-    } else if (current_token < num_tokens && tokens[current_token].type == SEMICOLON) {
+    } else if (has_token(current_token) && token_at(current_token)->type == SEMICOLON) {
         add_child(node, match_and_create_node(SEMICOLON, "Semicolon"));
     } else {
-        report_error("Invalid function declaration, Expected: \"{\" or \";\", Current: %s", tokens[current_token].type);
+        diagnose(token_at(current_token), "Invalid function declaration, Expected: \"{\" or \";\"");
+        synchronize(SYNC_DECLARATION);
     }
     return node;
 }
@@ -344,25 +687,26 @@ ParseTreeNode *parse_function_declaration() {
 // <parameter_list> ::= [“void”]
 //   | <data_type> <identifier> {"," <data_type> <identifier>}
 ParseTreeNode *parse_parameter_list() {
+    STAT_RULE();
     ParseTreeNode *node = create_parameter_list_node();
-    if (current_token < num_tokens && tokens[current_token].type == RIGHT_PARENTHESIS) {
+    if (has_token(current_token) && token_at(current_token)->type == RIGHT_PARENTHESIS) {
         // Empty parameter list
-    } else if (current_token < num_tokens && tokens[current_token].type == VOID) {
+    } else if (has_token(current_token) && token_at(current_token)->type == VOID) {
             add_child(node, match_and_create_node(VOID, "VOID"));
     } else {
-        if (current_token < num_tokens && (tokens[current_token].type == INT || tokens[current_token].type == FLOAT ||
-                                           tokens[current_token].type == CHAR || tokens[current_token].type == BOOL)) {
+        if (has_token(current_token) && (token_at(current_token)->type == INT || token_at(current_token)->type == FLOAT ||
+                                         token_at(current_token)->type == CHAR || token_at(current_token)->type == BOOL)) {
             ParseTreeNode *data_type = parse_data_type();
             add_child(node, data_type);
 
             ParseTreeNode *identifier_node = parse_identifier();
             add_child(node, identifier_node);
 
-            while (current_token < num_tokens && tokens[current_token].type == COMMA) {
+            while (has_token(current_token) && token_at(current_token)->type == COMMA) {
                 add_child(node, match_and_create_node(COMMA, "Comma"));
 
-                if (current_token < num_tokens && (tokens[current_token].type == INT || tokens[current_token].type == FLOAT ||
-                                                   tokens[current_token].type == CHAR || tokens[current_token].type == BOOL)) {
+                if (has_token(current_token) && (token_at(current_token)->type == INT || token_at(current_token)->type == FLOAT ||
+                                                 token_at(current_token)->type == CHAR || token_at(current_token)->type == BOOL)) {
                     ParseTreeNode *data_type = parse_data_type();
                     add_child(node, data_type);
 
@@ -370,13 +714,13 @@ ParseTreeNode *parse_parameter_list() {
                     add_child(node, identifier_node);
 
                 } else {
-                    fprintf(stderr, "Error: Expected data type after comma in parameter list at line %d\n", tokens[current_token].line_number);
-                    synchronize();
+                    diagnose(token_at(current_token), "Expected data type after comma in parameter list");
+                    synchronize(FOLLOW_EXPRESSION);
                 }
             }
         } else {
-            fprintf(stderr, "Error: Expected data type or ')' at the start of parameter list at line %d\n", tokens[current_token].line_number);
-            synchronize();
+            diagnose(token_at(current_token), "Expected data type or ')' at the start of parameter list");
+            synchronize(FOLLOW_EXPRESSION);
         }
     }
     return node;
@@ -384,19 +728,20 @@ ParseTreeNode *parse_parameter_list() {
 
 // <data_type> ::= “int” | “float” | “char” | “bool”
 ParseTreeNode *parse_data_type() {
+    STAT_RULE();
     ParseTreeNode *node = create_data_type_node();
-    if (current_token < num_tokens) {
-        if (tokens[current_token].type == INT) {
+    if (has_token(current_token)) {
+        if (token_at(current_token)->type == INT) {
             add_child(node, match_and_create_node(INT, "INTT"));
-        } else if (tokens[current_token].type == FLOAT) {
+        } else if (token_at(current_token)->type == FLOAT) {
             add_child(node, match_and_create_node(FLOAT, "FLOATT"));
-        } else if (tokens[current_token].type == CHAR) {
+        } else if (token_at(current_token)->type == CHAR) {
             add_child(node, match_and_create_node(CHAR, "CHARR"));
-        } else if (tokens[current_token].type == BOOL) {
+        } else if (token_at(current_token)->type == BOOL) {
             add_child(node, match_and_create_node(BOOL, "BOOL"));
         } else {
-            fprintf(stderr, "Error: Expected data type at line %d\n", tokens[current_token].line_number);
-            synchronize();
+            diagnose(token_at(current_token), "Expected data type");
+            synchronize(SYNC_STATEMENT);
         }
     }
     return node;
@@ -404,12 +749,13 @@ ParseTreeNode *parse_data_type() {
 
 // <identifier> ::= identifier token
 ParseTreeNode *parse_identifier() {
+    STAT_RULE();
     ParseTreeNode *node = create_identifier_node();
-    if (tokens[current_token].type == IDENTIFIER) {
+    if (token_at(current_token)->type == IDENTIFIER) {
         add_child(node, match_and_create_node(IDENTIFIER, "IDENTIFIERR"));
     } else {
-        fprintf(stderr, "Error: Expected data type at line %d\n", tokens[current_token].line_number);
-        synchronize();
+        diagnose(token_at(current_token), "Expected identifier");
+        synchronize(FOLLOW_EXPRESSION);
     }
 
     return node;
@@ -417,28 +763,34 @@ ParseTreeNode *parse_identifier() {
 
 // <block> ::= "{" <block-item-list>  "}"
 ParseTreeNode *parse_block() {
+    STAT_RULE();
     ParseTreeNode *node = create_block_node();
     add_child(node, match_and_create_node(LEFT_BRACE, "Left_Brace"));
 
-    while (current_token < num_tokens && tokens[current_token].type != RIGHT_BRACE) {
+    while (has_token(current_token) && token_at(current_token)->type != RIGHT_BRACE &&
+           token_at(current_token)->type != TOKEN_EOF) {
+        // A function declaration means the closing brace is missing
+        if ((TOKEN_BIT(token_at(current_token)->type) & FIRST_DECLARATION) &&
+            token_at(current_token + 2)->type == LEFT_PARENTHESIS) {
+            break;
+        }
+        int start = current_token;
         ParseTreeNode *block_item = parse_block_item();
         if (block_item != NULL) {
             add_child(node, block_item);
-        } else {
-            synchronize();
-            if (current_token >= num_tokens || 
-                tokens[current_token].type == RIGHT_BRACE) {
-                break;
-            }
+        }
+        if (current_token == start) {
+            // Nothing matched, the error is reported already: skip the token so parsing moves on
+            diagnose(token_at(current_token), "Unexpected %s '%s'", token_names[token_at(current_token)->type],
+                     token_at(current_token)->lexeme);
+            current_token++;
         }
     }
 
-    if (current_token < num_tokens && tokens[current_token].type == RIGHT_BRACE) {
+    if (has_token(current_token) && token_at(current_token)->type == RIGHT_BRACE) {
         add_child(node, match_and_create_node(RIGHT_BRACE, "Right_Brace"));
     } else {
-        fprintf(stderr, "Error: Missing closing brace at line %d\n", 
-                tokens[current_token-1].line_number);
-        synchronize();
+        diagnose(token_at(current_token - 1), "Missing closing brace");
     }
 
     return node;
@@ -446,15 +798,18 @@ ParseTreeNode *parse_block() {
 
 // <block_item_list> ::= (<block_item_list> <block_item>) | <block_item>
 ParseTreeNode *parse_block_item_list() {
+    STAT_RULE();
     ParseTreeNode *node = create_block_item_list_node();
-    while (current_token < num_tokens) {
-        if (tokens[current_token].type == RIGHT_BRACE) {
+    while (has_token(current_token)) {
+        if (token_at(current_token)->type == RIGHT_BRACE) {
             break; // Exit the loop if we encounter a RIGHT_BRACE
         }
+        int start = current_token;
         ParseTreeNode *block_item = parse_block_item();
         if (block_item != NULL) {
             add_child(node, block_item);
-        } else {
+        }
+        if (block_item == NULL || current_token == start) {
             return node;
         }
     }
@@ -463,18 +818,19 @@ ParseTreeNode *parse_block_item_list() {
 
 // <block_item> ::= <statement> | <variable_declaration> | <array_declaration>
 ParseTreeNode *parse_block_item() {
+    STAT_RULE();
     ParseTreeNode *node = create_block_item_node();
     
     // Check for variable/array declarations first
-    if (current_token < num_tokens && 
-        (tokens[current_token].type == INT || 
-         tokens[current_token].type == FLOAT ||
-         tokens[current_token].type == CHAR || 
-         tokens[current_token].type == BOOL)) {
+    if (has_token(current_token) && 
+        (token_at(current_token)->type == INT || 
+         token_at(current_token)->type == FLOAT ||
+         token_at(current_token)->type == CHAR || 
+         token_at(current_token)->type == BOOL)) {
         
         // Look ahead to distinguish between array and variable declaration
-        if (current_token + 2 < num_tokens && 
-            tokens[current_token + 2].type == LEFT_BRACKET) {
+        if (has_token(current_token + 2) && 
+            token_at(current_token + 2)->type == LEFT_BRACKET) {
             add_child(node, parse_array_declaration());
         } else {
             add_child(node, parse_variable_declaration());
@@ -489,9 +845,10 @@ ParseTreeNode *parse_block_item() {
 
 // <statement> ::= "return" <const> ;" | <const> ";" | ";" 
 ParseTreeNode *parse_statement() {
+    STAT_RULE();
     ParseTreeNode *node = create_statement_node();
     
-    switch (tokens[current_token].type) {
+    switch (token_at(current_token)->type) {
         case RETURN:
             add_child(node, parse_return_statement());
             break;
@@ -530,82 +887,168 @@ ParseTreeNode *parse_statement() {
     return node;
 }
 
-Token *load_tokens(const char *filename, int *num_tokens) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
+// Opens the symbol table, tokens are then read from it as the parser asks for them
+bool open_tokens(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
         fprintf(stderr, "Error opening symbol table file: %s\n", filename);
-        synchronize();
+        return false;
     }
-
-    Token *token_list = NULL;
-    size_t capacity = 16;
-    token_list = malloc(sizeof(Token) * capacity);
-
-    if (!token_list) {
-        fprintf(stderr, "Error: Memory allocation failed in load_tokens!\n");
-        fclose(fp);
-        synchronize();
+    return open_token_stream(file);
+}
+
+// Takes over a symbol table that is already open, it is closed when all of it is read
+bool open_token_stream(FILE *file) {
+    token_file = file;
+    window_start = 0;
+    num_tokens = 0;
+    window_capacity = 16;
+    tokens = core_malloc(sizeof(Token) * window_capacity);
+    if (!tokens) {
+        fprintf(stderr, "Error: Memory allocation failed in open_tokens!\n");
+        fclose(token_file);
+        return false;
     }
+    return true;
+}
 
-    *num_tokens = 0;
-
-    char line[256];
-    while (fgets(line, sizeof(line), fp) != NULL) {
-        if (*num_tokens >= capacity) {
-            capacity *= 2;
-            Token *new_list = realloc(token_list, sizeof(Token) * capacity);
-            if (!new_list) {
-                fprintf(stderr, "Error: Memory reallocation failed in load_tokens!\n");
-                free(token_list);
-                fclose(fp);
-                synchronize();
-            }
-            token_list = new_list;
+// Reads the next token of the symbol table into the window, false at the end of the file
+static bool read_token(void) {
+    if (token_file == NULL) {
+        return false;
+    }
+    if (num_tokens - window_start >= window_capacity) {
+        window_capacity *= 2;
+        Token *new_list = core_realloc(tokens, sizeof(Token) * window_capacity);
+        if (!new_list) {
+            fprintf(stderr, "Error: Memory reallocation failed in read_token!\n");
+            exit(1);
         }
+        tokens = new_list;
+    }
 
+    // Rows hold a lexeme of up to MAX_LEXEME_LENGTH characters after the other columns
+    char line[MAX_LEXEME_LENGTH + 160];
+    while (fgets(line, sizeof(line), token_file) != NULL) {
         int token_code;
         char token_name[50];
+        char value[32] = "";
         char lexeme_val[MAX_LEXEME_LENGTH];
-        int line_num, col_num;
+        int line_num, col_num, columns = 0;
+
+        // Only the rows of literals have a VALUE column
+        if (sscanf(line, "%d | %49[^|] | %d | %d | %n", &token_code, token_name, &line_num, &col_num, &columns) == 4 &&
+            columns > 0 &&
+            (token_code == STRING || token_code == CHARACTER_LITERAL || token_code == INTEGER_LITERAL ||
+             token_code == FLOAT_LITERAL ? sscanf(line + columns, "%31[^|] | %499[^\n]", value, lexeme_val) == 2 :
+                                           sscanf(line + columns, "%499[^\n]", lexeme_val) == 1)) {
+            Token *token = &tokens[num_tokens - window_start];
+            token->type = token_code;
+            token->string_id = token_code == STRING || token_code == CHARACTER_LITERAL ? atoi(value) : -1;
+            if (token_code == INTEGER_LITERAL) {
+                token->value.integer = strtoll(value, NULL, 10);
+            }
+            else if (token_code == FLOAT_LITERAL) {
+                token->value.real = strtod(value, NULL);       // Hexadecimal, so exact
+            }
 
-        if (sscanf(line, "%d | %[^|] | %d | %d | %[^\n]", &token_code, token_name, &line_num, &col_num, lexeme_val) == 5) {
-                    token_list[*num_tokens].type = token_code;
+            // Trim trailing spaces from lexeme_val
+            int len = strlen(lexeme_val);
+            while (len > 0 && isspace(lexeme_val[len - 1])) {
+                lexeme_val[len - 1] = '\0';
+                len--;
+            }
 
-                    // Trim trailing spaces from token_name
-                    int len = strlen(token_name);
-                    while (len > 0 && isspace(token_name[len - 1])) {
-                        token_name[len - 1] = '\0';
-                        len--;
-                    }
+            strncpy(token->lexeme, lexeme_val, MAX_LEXEME_LENGTH - 1);
+            token->lexeme[MAX_LEXEME_LENGTH - 1] = '\0';
+            token->line_number = line_num;
+            token->column_number = col_num;
+            num_tokens++;
+            return true;
+        }
+    }
+    fclose(token_file);
+    token_file = NULL;
+    return false;
+}
 
-                    // Trim trailing spaces from lexeme_val
-                    len = strlen(lexeme_val);
-                    while (len > 0 && isspace(lexeme_val[len - 1])) {
-                        lexeme_val[len - 1] = '\0';
-                        len--;
-                    }
-                    
-                    strncpy(token_list[*num_tokens].lexeme, lexeme_val, MAX_LEXEME_LENGTH - 1);
-                    token_list[*num_tokens].lexeme[MAX_LEXEME_LENGTH - 1] = '\0';
-                    
-                    token_list[*num_tokens].line_number = line_num;
-                    token_list[*num_tokens].column_number = col_num;
-
-                    (*num_tokens)++;
+// Reads the decoded string and character literals the scanner wrote next to the symbol table
+bool load_strings(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Error opening string table file: %s\n", filename);
+        return false;
+    }
+    bool read = string_table_read(&literal_strings, file);
+    fclose(file);
+    if (!read) {
+        fprintf(stderr, "Error: invalid string table file: %s\n", filename);
+    }
+    return read;
+}
+
+// Parses a whole symbol table without writing anything, used by the fuzz targets
+ParseTreeNode *parse_symbol_table(FILE *symbols, int *num_errors) {
+    current_token = 0;
+    panic_mode = false;
+    recovering = false;
+    num_diagnostics = 0;
+    on_declaration = NULL;
+    if (!open_token_stream(symbols)) {
+        return NULL;
+    }
+    load_tokens_until(INT_MAX);
+    ParseTreeNode *root = parse_program();
+    close_tokens();
+
+    *num_errors = num_diagnostics;
+    core_free(diagnostics);
+    diagnostics = NULL;
+    diagnostics_capacity = 0;
+    if (panic_mode) {
+        free_parse_tree(root);
+        return NULL;
+    }
+    return root;
+}
+
+// Reads tokens until there is one at index, false if the symbol table has fewer
+bool load_tokens_until(int index) {
+    while (index >= num_tokens) {
+        if (!read_token()) {
+            return false;
         }
     }
-    fclose(fp);
-    return token_list;
+    return true;
+}
+
+// Drops the tokens before index from the window, they cannot be looked at again
+void release_tokens(int index) {
+    if (index <= window_start) {
+        return;
+    }
+    memmove(tokens, tokens + (index - window_start), sizeof(Token) * (num_tokens - index));
+    window_start = index;
+}
+
+void close_tokens(void) {
+    if (token_file != NULL) {
+        fclose(token_file);
+        token_file = NULL;
+    }
+    core_free(tokens);
+    tokens = NULL;
 }
 
 ParseTreeNode *parse_argument_list() {
+    STAT_RULE();
     ParseTreeNode *node = create_argument_list_node();
     // The first argument should be parsed as a full expression
     ParseTreeNode *exp = create_exp_node(); // Create an Exp node
     add_child(exp, parse_exp());
     add_child(node, exp); // Add the Exp node to the argument list
 
-    while (current_token < num_tokens && tokens[current_token].type == COMMA) {
+    while (has_token(current_token) && token_at(current_token)->type == COMMA) {
         add_child(node, match_and_create_node(COMMA, "Comma"));
         // Subsequent arguments are also full expressions
         ParseTreeNode *exp = create_exp_node(); // Create an Exp node
@@ -617,10 +1060,11 @@ ParseTreeNode *parse_argument_list() {
 
 // Function to parse a constant: <const> ::= <int> | <float> | <char> | <bool>
 ParseTreeNode *parse_const() {
+    STAT_RULE();
     ParseTreeNode *node = create_const_node();
     
-    if (current_token < num_tokens) {
-        switch (tokens[current_token].type)
+    if (has_token(current_token)) {
+        switch (token_at(current_token)->type)
         {
             case INTEGER_LITERAL:
                 ParseTreeNode *int_node = parse_int_literal();
@@ -641,8 +1085,8 @@ ParseTreeNode *parse_const() {
                 break;
             
             default:
-                fprintf(stderr, "Error: Expected a constant (int, float, char, or bool) at line %d\n", tokens[current_token].line_number);
-                synchronize();
+                diagnose(token_at(current_token), "Expected a constant (int, float, char, or bool)");
+                synchronize(FOLLOW_EXPRESSION);
         }
     }
 
@@ -650,10 +1094,11 @@ ParseTreeNode *parse_const() {
 }
 
 ParseTreeNode *parse_factor() {
+    STAT_RULE();
     ParseTreeNode *node = create_node("Factor");
 
-    if (current_token < num_tokens) {
-        switch (tokens[current_token].type) {
+    if (has_token(current_token)) {
+        switch (token_at(current_token)->type) {
             case INTEGER_LITERAL:
             case FLOAT_LITERAL:
             case CHARACTER_LITERAL:
@@ -663,15 +1108,15 @@ ParseTreeNode *parse_factor() {
                 break;
             case IDENTIFIER:
                 add_child(node, parse_identifier());
-                if (current_token < num_tokens && tokens[current_token].type == LEFT_PARENTHESIS) {
+                if (has_token(current_token) && token_at(current_token)->type == LEFT_PARENTHESIS) {
                     add_child(node, match_and_create_node(LEFT_PARENTHESIS, "Left_Parenthesis"));
-                    if (current_token < num_tokens && tokens[current_token].type != RIGHT_PARENTHESIS) {
+                    if (has_token(current_token) && token_at(current_token)->type != RIGHT_PARENTHESIS) {
                         add_child(node, parse_argument_list());
                     }
                     add_child(node, match_and_create_node(RIGHT_PARENTHESIS, "Right_Parenthesis"));
-                } else if (current_token < num_tokens && tokens[current_token].type == LEFT_BRACKET) {
+                } else if (has_token(current_token) && token_at(current_token)->type == LEFT_BRACKET) {
                     add_child(node, match_and_create_node(LEFT_BRACKET, "Left_Bracket"));
-                    add_child(node, parse_const());
+                    add_child(node, parse_exp());
                     add_child(node, match_and_create_node(RIGHT_BRACKET, "Right_Bracket"));
                 }
                 break;
@@ -683,8 +1128,9 @@ ParseTreeNode *parse_factor() {
                 add_child(node, match_and_create_node(RIGHT_PARENTHESIS, "Right_Parenthesis"));
                 break;
             default:
-                fprintf(stderr, "Error: Unexpected token in factor at line %d\n", tokens[current_token].line_number);
-                synchronize();
+                diagnose(token_at(current_token), "Unexpected token %s '%s' in factor",
+                         token_names[token_at(current_token)->type], token_at(current_token)->lexeme);
+                synchronize(FOLLOW_EXPRESSION);
                 break;
         }
     }
@@ -716,14 +1162,14 @@ static int get_precedence(TokenType t) {
 
 // Parses expressions with operator precedence
 ParseTreeNode *parse_expression(int min_prec) {
+    STAT_RULE();
     ParseTreeNode *lhs = parse_unary(); // parse first piece
 
-    while (current_token < num_tokens) {
-        int prec = get_precedence(tokens[current_token].type);
+    while (has_token(current_token)) {
+        int prec = get_precedence(token_at(current_token)->type);
         if (prec < min_prec) break;
 
-        TokenType op_type = tokens[current_token].type;
-        match(op_type); // consume operator
+        TokenType op_type = token_at(current_token)->type;
 
         ParseTreeNode *new_node = create_node("OpExpr");
         add_child(new_node, lhs);
@@ -736,11 +1182,11 @@ ParseTreeNode *parse_expression(int min_prec) {
 }
 
 ParseTreeNode *parse_unary() {
-    if (tokens[current_token].type == PLUS ||
-        tokens[current_token].type == MINUS ||
-        tokens[current_token].type == NOT_EQUAL /* '!' if desired */) {
-        TokenType op_type = tokens[current_token].type;
-        match(op_type);
+    STAT_RULE();
+    if (token_at(current_token)->type == PLUS ||
+        token_at(current_token)->type == MINUS ||
+        token_at(current_token)->type == NOT) {
+        TokenType op_type = token_at(current_token)->type;
         ParseTreeNode *node = create_node("UnaryOp");
         add_child(node, match_and_create_node(op_type, "Unary_Operator"));
         add_child(node, parse_unary());
@@ -751,19 +1197,26 @@ ParseTreeNode *parse_unary() {
 
 // Integrate with existing parse_exp
 ParseTreeNode *parse_exp() {
+    STAT_RULE();
     // Handle assignment expressions
-    if (current_token < num_tokens && tokens[current_token].type == IDENTIFIER) {
+    if (has_token(current_token) && token_at(current_token)->type == IDENTIFIER) {
         int lookahead = current_token + 1;
         
-        // Look for assignment operator
-        while (lookahead < num_tokens && 
-               (tokens[lookahead].type == LEFT_BRACKET || 
-                tokens[lookahead].type == RIGHT_BRACKET ||
-                tokens[lookahead].type == IDENTIFIER)) {
+        // Look for assignment operator, skipping an array index
+        if (has_token(lookahead) && token_at(lookahead)->type == LEFT_BRACKET) {
+            int depth = 0;
+            while (has_token(lookahead) && token_at(lookahead)->type != SEMICOLON) {
+                if (token_at(lookahead)->type == LEFT_BRACKET) {
+                    depth++;
+                } else if (token_at(lookahead)->type == RIGHT_BRACKET && --depth == 0) {
+                    break;
+                }
+                lookahead++;
+            }
             lookahead++;
         }
         
-        if (lookahead < num_tokens && tokens[lookahead].type == ASSIGN) {
+        if (has_token(lookahead) && token_at(lookahead)->type == ASSIGN) {
             return parse_assignment();
         }
     }
@@ -771,17 +1224,18 @@ ParseTreeNode *parse_exp() {
     return parse_logical_or_exp();
 }
 
-// Parse assignment <identifier> ["[" <const> "]"] "=" <exp>
+// Parse assignment <identifier> ["[" <exp> "]"] "=" <exp>
 ParseTreeNode *parse_assignment() {
+    STAT_RULE();
     ParseTreeNode *node = create_node("Assignment");
 
     // Parse left-hand side
     add_child(node, parse_identifier());
     
     // Handle array access if present
-    if (current_token < num_tokens && tokens[current_token].type == LEFT_BRACKET) {
+    if (has_token(current_token) && token_at(current_token)->type == LEFT_BRACKET) {
         add_child(node, match_and_create_node(LEFT_BRACKET, "Left_Bracket"));
-        add_child(node, parse_const());
+        add_child(node, parse_exp());
         add_child(node, match_and_create_node(RIGHT_BRACKET, "Right_Bracket"));
     }
 
@@ -789,8 +1243,8 @@ ParseTreeNode *parse_assignment() {
     add_child(node, match_and_create_node(ASSIGN, "Assign"));
 
     // Parse right-hand side (which could be another assignment)
-    if (current_token < num_tokens && tokens[current_token].type == IDENTIFIER &&
-        current_token + 1 < num_tokens && tokens[current_token + 1].type == ASSIGN) {
+    if (has_token(current_token) && token_at(current_token)->type == IDENTIFIER &&
+        has_token(current_token + 1) && token_at(current_token + 1)->type == ASSIGN) {
         add_child(node, parse_assignment());
     } else {
         add_child(node, parse_exp());
@@ -801,11 +1255,11 @@ ParseTreeNode *parse_assignment() {
 
 // Now implement the precedence-based expressions according to the grammar
 ParseTreeNode *parse_logical_or_exp() {
+    STAT_RULE();
     ParseTreeNode *node = parse_logical_and_exp();
 
-    while (current_token < num_tokens && tokens[current_token].type == OR) {
-        TokenType op_type = tokens[current_token].type;
-        match(op_type);
+    while (has_token(current_token) && token_at(current_token)->type == OR) {
+        TokenType op_type = token_at(current_token)->type;
         ParseTreeNode *new_node = create_node("LogicalOr");
         add_child(new_node, node);
         add_child(new_node, match_and_create_node(op_type, "Operator"));
@@ -816,11 +1270,11 @@ ParseTreeNode *parse_logical_or_exp() {
 }
 
 ParseTreeNode *parse_logical_and_exp() {
+    STAT_RULE();
     ParseTreeNode *node = parse_equality_exp();
 
-    while (current_token < num_tokens && tokens[current_token].type == AND) {
-        TokenType op_type = tokens[current_token].type;
-        match(op_type);
+    while (has_token(current_token) && token_at(current_token)->type == AND) {
+        TokenType op_type = token_at(current_token)->type;
         ParseTreeNode *new_node = create_node("LogicalAnd");
         add_child(new_node, node);
         add_child(new_node, match_and_create_node(op_type, "Operator"));
@@ -831,12 +1285,12 @@ ParseTreeNode *parse_logical_and_exp() {
 }
 
 ParseTreeNode *parse_equality_exp() {
+    STAT_RULE();
     ParseTreeNode *node = parse_relational_exp();
 
-    while (current_token < num_tokens &&
-          (tokens[current_token].type == EQUAL || tokens[current_token].type == NOT_EQUAL)) {
-        TokenType op_type = tokens[current_token].type;
-        match(op_type);
+    while (has_token(current_token) &&
+          (token_at(current_token)->type == EQUAL || token_at(current_token)->type == NOT_EQUAL)) {
+        TokenType op_type = token_at(current_token)->type;
         ParseTreeNode *new_node = create_node("Equality");
         add_child(new_node, node);
         add_child(new_node, match_and_create_node(op_type, "Operator"));
@@ -847,13 +1301,13 @@ ParseTreeNode *parse_equality_exp() {
 }
 
 ParseTreeNode *parse_relational_exp() {
+    STAT_RULE();
     ParseTreeNode *node = parse_additive_exp();
 
-    while (current_token < num_tokens &&
-          (tokens[current_token].type == LESS || tokens[current_token].type == GREATER ||
-           tokens[current_token].type == LESS_EQUAL || tokens[current_token].type == GREATER_EQUAL)) {
-        TokenType op_type = tokens[current_token].type;
-        match(op_type);
+    while (has_token(current_token) &&
+          (token_at(current_token)->type == LESS || token_at(current_token)->type == GREATER ||
+           token_at(current_token)->type == LESS_EQUAL || token_at(current_token)->type == GREATER_EQUAL)) {
+        TokenType op_type = token_at(current_token)->type;
         ParseTreeNode *new_node = create_node("Relational");
         add_child(new_node, node);
         add_child(new_node, match_and_create_node(op_type, "Operator"));
@@ -864,11 +1318,11 @@ ParseTreeNode *parse_relational_exp() {
 }
 
 ParseTreeNode *parse_additive_exp() {
+    STAT_RULE();
     ParseTreeNode *node = parse_multiplicative_exp();
-    while (current_token < num_tokens &&
-          (tokens[current_token].type == PLUS || tokens[current_token].type == MINUS)) {
-        TokenType op_type = tokens[current_token].type;
-        match(op_type);
+    while (has_token(current_token) &&
+          (token_at(current_token)->type == PLUS || token_at(current_token)->type == MINUS)) {
+        TokenType op_type = token_at(current_token)->type;
         ParseTreeNode *new_node = create_node("AddSub");
         add_child(new_node, node);
         add_child(new_node, match_and_create_node(op_type, "Operator"));
@@ -879,12 +1333,12 @@ ParseTreeNode *parse_additive_exp() {
 }
 
 ParseTreeNode *parse_multiplicative_exp() {
+    STAT_RULE();
     ParseTreeNode *node = parse_power_exp();
 
-    while (current_token < num_tokens &&
-          (tokens[current_token].type == MULTIPLY || tokens[current_token].type == DIVIDE || tokens[current_token].type == MODULO)) {
-        TokenType op_type = tokens[current_token].type;
-        match(op_type);
+    while (has_token(current_token) &&
+          (token_at(current_token)->type == MULTIPLY || token_at(current_token)->type == DIVIDE || token_at(current_token)->type == MODULO)) {
+        TokenType op_type = token_at(current_token)->type;
         ParseTreeNode *new_node = create_node("MulDivMod");
         add_child(new_node, node);
         add_child(new_node, match_and_create_node(op_type, "Operator"));
@@ -895,12 +1349,12 @@ ParseTreeNode *parse_multiplicative_exp() {
 }
 
 ParseTreeNode *parse_power_exp() {
+    STAT_RULE();
     ParseTreeNode *node = parse_unary_exp();
 
     // Right-associative exponent
-    while (current_token < num_tokens && tokens[current_token].type == EXPONENT) {
-        TokenType op_type = tokens[current_token].type;
-        match(op_type);
+    while (has_token(current_token) && token_at(current_token)->type == EXPONENT) {
+        TokenType op_type = token_at(current_token)->type;
         ParseTreeNode *new_node = create_node("Power");
         add_child(new_node, node);
         add_child(new_node, match_and_create_node(op_type, "Operator"));
@@ -911,13 +1365,13 @@ ParseTreeNode *parse_power_exp() {
 }
 
 ParseTreeNode *parse_unary_exp() {
+    STAT_RULE();
     // <unary_exp> ::= <factor> | <unop> <unary_exp>
-    if (tokens[current_token].type == PLUS ||
-        tokens[current_token].type == MINUS ||
-        tokens[current_token].type == NOT_EQUAL) {
+    if (token_at(current_token)->type == PLUS ||
+        token_at(current_token)->type == MINUS ||
+        token_at(current_token)->type == NOT) {
         ParseTreeNode *node = create_node("UnaryOp");
-        TokenType op = tokens[current_token].type;
-        match(op);
+        TokenType op = token_at(current_token)->type;
         add_child(node, match_and_create_node(op, "Unary_Operator"));
         add_child(node, parse_unary_exp());
         return node;
@@ -925,18 +1379,20 @@ ParseTreeNode *parse_unary_exp() {
     return parse_factor();
 }
 
-// Function to parse a return statement: "return" <const> ";"
+// Function to parse a return statement: "return" <exp> ";"
 ParseTreeNode *parse_return_statement() {
+    STAT_RULE();
     ParseTreeNode *node = create_return_statement_node();
     add_child(node, match_and_create_node(RETURN, "RETURNN"));
 
-    add_child(node, parse_factor());
+    add_child(node, parse_exp());
 
     add_child(node, match_and_create_node(SEMICOLON, "SEMICOLONN"));
     return node;
 }
 
 ParseTreeNode *parse_expression_statement() {
+    STAT_RULE();
     ParseTreeNode *node = create_expression_statement_node();
     // Create an Exp node to wrap the expression
     ParseTreeNode *exp_node = create_exp_node();
@@ -944,11 +1400,14 @@ ParseTreeNode *parse_expression_statement() {
     add_child(node, exp_node);
 
     // Match semicolon at the end of the expression statement
-    if (current_token < num_tokens && tokens[current_token].type == SEMICOLON) {
+    if (has_token(current_token) && token_at(current_token)->type == SEMICOLON) {
         add_child(node, match_and_create_node(SEMICOLON, "Semicolon"));
     } else {
-        fprintf(stderr, "Error: Expected semicolon at end of expression statement at line %d\n", tokens[current_token].line_number);
-        synchronize();
+        diagnose(token_at(current_token), "Expected semicolon at end of expression statement");
+        synchronize(SYNC_STATEMENT);
+        if (token_at(current_token)->type == SEMICOLON) {
+            add_child(node, match_and_create_node(SEMICOLON, "Semicolon"));
+        }
     }
 
     return node;
@@ -966,6 +1425,7 @@ ParseTreeNode *parse_factor_statement()
 
 // Function to parse a constant statement: <const> ";"
 ParseTreeNode *parse_const_statement() {
+    STAT_RULE();
     ParseTreeNode *node = create_const_statement_node();
     ParseTreeNode *const_node = parse_const();
     add_child(node, const_node);
@@ -976,6 +1436,7 @@ ParseTreeNode *parse_const_statement() {
 
 // Function to parse a while statement: "while" "(" <const> ")" <block>
 ParseTreeNode *parse_while_statement() {
+    STAT_RULE();
     ParseTreeNode *node = create_while_statement_node();
     add_child(node, match_and_create_node(WHILE, "While"));
     add_child(node, match_and_create_node(LEFT_PARENTHESIS, "Left_Parenthesis"));
@@ -993,6 +1454,7 @@ ParseTreeNode *parse_while_statement() {
 
 // Function to parse a for loop statement
 ParseTreeNode *parse_for_statement() {
+    STAT_RULE();
     ParseTreeNode *node = create_for_statement_node();
     
     // Match "for" and "("
@@ -1000,14 +1462,14 @@ ParseTreeNode *parse_for_statement() {
     add_child(node, match_and_create_node(LEFT_PARENTHESIS, "Left_Parenthesis"));
 
     // Parse initialization
-    if (tokens[current_token].type == INT || 
-        tokens[current_token].type == FLOAT ||
-        tokens[current_token].type == CHAR || 
-        tokens[current_token].type == BOOL) {
+    if (token_at(current_token)->type == INT || 
+        token_at(current_token)->type == FLOAT ||
+        token_at(current_token)->type == CHAR || 
+        token_at(current_token)->type == BOOL) {
         
         // Handle declarations
-        if (current_token + 2 < num_tokens && 
-            tokens[current_token + 2].type == LEFT_BRACKET) {
+        if (has_token(current_token + 2) && 
+            token_at(current_token + 2)->type == LEFT_BRACKET) {
             add_child(node, parse_array_declaration());
         } else {
             add_child(node, parse_variable_declaration());
@@ -1036,13 +1498,14 @@ ParseTreeNode *parse_for_statement() {
 }
 
 ParseTreeNode *parse_input_statement() {
+    STAT_RULE();
     ParseTreeNode *node = create_input_statement_node();
     add_child(node, match_and_create_node(SCANF, "Scanf"));
     add_child(node, match_and_create_node(LEFT_PARENTHESIS, "Left_Parenthesis"));
 
     add_child(node, match_and_create_node(STRING, "String"));
 
-    while (current_token < num_tokens && tokens[current_token].type == COMMA) {
+    while (has_token(current_token) && token_at(current_token)->type == COMMA) {
         add_child(node, match_and_create_node(COMMA, "Comma"));
         add_child(node, match_and_create_node(AMPERSAND, "Ampersand"));
         ParseTreeNode *identifier = parse_identifier();
@@ -1055,6 +1518,7 @@ ParseTreeNode *parse_input_statement() {
 }
 
 ParseTreeNode *parse_output_statement() {
+    STAT_RULE();
     ParseTreeNode *node = create_output_statement_node();
     
     // Match printf and left parenthesis
@@ -1062,23 +1526,25 @@ ParseTreeNode *parse_output_statement() {
     add_child(node, match_and_create_node(LEFT_PARENTHESIS, "Left_Parenthesis"));
 
     // Handle printf arguments
-    if (current_token < num_tokens) {
-        if (tokens[current_token].type == STRING) {
+    if (has_token(current_token)) {
+        if (token_at(current_token)->type == STRING) {
             add_child(node, match_and_create_node(STRING, "String"));
 
             // Handle variable arguments after format string
-            while (current_token < num_tokens && tokens[current_token].type == COMMA) {
+            while (has_token(current_token) && token_at(current_token)->type == COMMA) {
                 add_child(node, match_and_create_node(COMMA, "Comma"));
                 ParseTreeNode *exp = parse_exp();
                 add_child(node, exp);
             }
-        } else if (tokens[current_token].type == IDENTIFIER) {
+        } else if (token_at(current_token)->type == IDENTIFIER) {
             ParseTreeNode *identifier = parse_identifier();
             add_child(node, identifier);
         } else {
-            fprintf(stderr, "Error: Expected string or identifier in printf at line %d\n", 
-                    tokens[current_token].line_number);
-            synchronize();
+            diagnose(token_at(current_token), "Expected string or identifier in printf");
+            synchronize(SYNC_STATEMENT);
+            if (token_at(current_token)->type == SEMICOLON) {
+                add_child(node, match_and_create_node(SEMICOLON, "Semicolon"));
+            }
             return node;
         }
     }
@@ -1091,6 +1557,7 @@ ParseTreeNode *parse_output_statement() {
 }
 
 ParseTreeNode *parse_if_statement() {
+    STAT_RULE();
     ParseTreeNode *node = create_if_statement_node();
     add_child(node, match_and_create_node(IF, "If"));
     add_child(node, match_and_create_node(LEFT_PARENTHESIS, "Left_Parenthesis"));
@@ -1103,7 +1570,7 @@ ParseTreeNode *parse_if_statement() {
     ParseTreeNode *if_block = parse_block();
     add_child(node, if_block);
 
-    while (current_token < num_tokens && tokens[current_token].type == ELSE) {
+    while (has_token(current_token) && token_at(current_token)->type == ELSE) {
         ParseTreeNode *else_clause = parse_else_clause();
         add_child(node, else_clause);
     }
@@ -1112,10 +1579,11 @@ ParseTreeNode *parse_if_statement() {
 
 // "else" <block> | "else" <if_statement>
 ParseTreeNode *parse_else_clause() {
+    STAT_RULE();
     ParseTreeNode *node = create_node("Else_Clause");
     add_child(node, match_and_create_node(ELSE, "Else"));
 
-    if (current_token < num_tokens && tokens[current_token].type == IF) {
+    if (has_token(current_token) && token_at(current_token)->type == IF) {
         ParseTreeNode *if_statement = parse_if_statement();
         add_child(node, if_statement);
     } else {
@@ -1126,27 +1594,31 @@ ParseTreeNode *parse_else_clause() {
 }
 
 ParseTreeNode *parse_int_literal() {
+    STAT_RULE();
     ParseTreeNode *node = create_int_literal_node();
     add_child(node, match_and_create_node(INTEGER_LITERAL, "INTEGER_LITERALL"));
 
     return node;
 }
 ParseTreeNode *parse_float_literal() {
+    STAT_RULE();
     ParseTreeNode *node = create_float_literal_node();
     add_child(node, match_and_create_node(FLOAT_LITERAL, "FLOAT_LITERALL"));
     
     return node;
 }
 ParseTreeNode *parse_char_literal() {
+    STAT_RULE();
     ParseTreeNode *node = create_char_literal_node();
     add_child(node, match_and_create_node(CHARACTER_LITERAL, "CHARACTER_LITERALL"));
     
     return node;
 }
 ParseTreeNode *parse_bool_literal() {
+    STAT_RULE();
     ParseTreeNode *node = create_bool_literal_node();
 
-    if (tokens[current_token].type == TRUE) {
+    if (token_at(current_token)->type == TRUE) {
         add_child(node, match_and_create_node(TRUE, "TRUEE"));
     } else {
         add_child(node, match_and_create_node(FALSE, "FALSEE"));
@@ -1157,19 +1629,21 @@ ParseTreeNode *parse_bool_literal() {
 
 // Function to allocate and initialize a new ParseTreeNode
 ParseTreeNode *create_node(const char *name) {
-    ParseTreeNode *node = malloc(sizeof(ParseTreeNode));
+    ParseTreeNode *node = core_malloc(sizeof(ParseTreeNode));
     if (!node) {
         fprintf(stderr, "Error: Memory allocation failed in create_node\n");
-        synchronize();
+        exit(1);
     }
-    node->name = strdup(name);
+    node->name = core_strdup(name);
     if (!node->name) {
         fprintf(stderr, "Error: Memory allocation failed in create_node\n");
-        synchronize();
+        exit(1);
     }
     node->token = NULL;
     node->children = NULL;
     node->num_children = 0;
+    node->recovery = NULL;
+    STAT_ADD(STAT_NODES, 1);
     return node;
 }
 
@@ -1298,13 +1772,12 @@ ParseTreeNode *create_bool_literal_node()
 }
 
 void match(TokenType type) {
-    if (current_token < num_tokens && tokens[current_token].type == type) {
+    if (has_token(current_token) && token_at(current_token)->type == type) {
         current_token++;
     } else {
-        fprintf(stderr, "Error: Expected token type %s but found %s at line %d\n",
-               token_names[type], token_names[tokens[current_token].type],
-               tokens[current_token].line_number);
-        synchronize();
+        diagnose(token_at(current_token), "Expected token type %s but found %s",
+                 token_names[type], token_names[token_at(current_token)->type]);
+        synchronize(SYNC_STATEMENT);
     }
 }
 
@@ -1335,6 +1808,9 @@ void print_parse_tree(ParseTreeNode *node, int indent_level) {
         else {
             fprintf(output_file, "%s", token_names[node->token->type]);
         }
+        if (node->recovery != NULL) {
+            fprintf(output_file, " <%s>", node->recovery);
+        }
     }
     // If it's not a terminal node, print the node name and recurse
     else {
@@ -1357,6 +1833,13 @@ void print_parse_tree(ParseTreeNode *node, int indent_level) {
 }
 
 
+// With --stream: writes a finished declaration as the next child of the program and frees it
+void emit_declaration(ParseTreeNode *declaration) {
+    fprintf(output_file, streamed_declarations++ == 0 ? "Program(\n" : ",\n");
+    print_parse_tree(declaration, 1);
+    free_parse_tree(declaration);
+}
+
 // Helper function to print indentation to a file
 void print_indent(int indent_level) {
     for (int i = 0; i < indent_level; i++) {
@@ -1371,36 +1854,67 @@ void free_parse_tree(ParseTreeNode *node) {
         free_parse_tree(node->children[i]);
     }
     
-    free(node->token);
-    free(node->name);
-    free(node->children);
-    free(node);
-}
-
-void report_error(const char *message, TokenType expected) {
-    fprintf(stderr, "Error: %s, Expected: %s, Line: %d, Column: %d\n",
-            message,
-            token_names[expected],
-            tokens[current_token].line_number,
-            tokens[current_token].column_number);
-    panic_mode = true;
+    core_free(node->token);
+    core_free(node->name);
+    core_free(node->children);
+    core_free(node);
 }
 
-void synchronize() {
+/******************************************************/
+/* Error recovery */
+
+// Records an error at a token, unless the parser is still recovering from the previous one
+void diagnose(const Token *at, const char *format, ...) {
     panic_mode = true;
-    while (current_token < num_tokens) {
-        // Synchronize on statement/declaration boundaries
-        if (tokens[current_token].type == SEMICOLON ||
-            tokens[current_token].type == RIGHT_BRACE ||
-            tokens[current_token].type == INT ||
-            tokens[current_token].type == FLOAT ||
-            tokens[current_token].type == CHAR ||
-            tokens[current_token].type == BOOL ||
-            tokens[current_token].type == FOR ||
-            tokens[current_token].type == WHILE ||
-            tokens[current_token].type == IF) {
-            return;
+    if (recovering) {
+        return;
+    }
+    recovering = true;
+    if (num_diagnostics == diagnostics_capacity) {
+        diagnostics_capacity = diagnostics_capacity ? 2 * diagnostics_capacity : 16;
+        diagnostics = core_realloc(diagnostics, sizeof(Diagnostic) * diagnostics_capacity);
+        if (!diagnostics) {
+            fprintf(stderr, "Error: Memory allocation failed in diagnose\n");
+            exit(1);
         }
+    }
+    Diagnostic *d = &diagnostics[num_diagnostics];
+    d->line = at->line_number;
+    d->column = at->column_number;
+    d->end_column = at->column_number + (int)strlen(at->lexeme);
+    d->order = num_diagnostics++;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(d->message, sizeof(d->message), format, args);
+    va_end(args);
+}
+
+// Skips tokens until one in the sync set, end of file at the latest
+void synchronize(TokenSet sync) {
+    panic_mode = true;
+    while (has_token(current_token) && !(TOKEN_BIT(token_at(current_token)->type) & (sync | TOKEN_BIT(TOKEN_EOF)))) {
         current_token++;
     }
-}
\ No newline at end of file
+}
+
+static int compare_diagnostics(const void *a, const void *b) {
+    const Diagnostic *x = a, *y = b;
+    if (x->line != y->line) {
+        return x->line - y->line;
+    }
+    if (x->column != y->column) {
+        return x->column - y->column;
+    }
+    return x->order - y->order;
+}
+
+// Writes the diagnostics in source order and frees them
+void print_diagnostics(void) {
+    qsort(diagnostics, num_diagnostics, sizeof(Diagnostic), compare_diagnostics);
+    for (int i = 0; i < num_diagnostics; i++) {
+        const Diagnostic *d = &diagnostics[i];
+        fprintf(stderr, "Error: %s at line %d, columns %d-%d\n", d->message, d->line, d->column, d->end_column);
+    }
+    core_free(diagnostics);
+    diagnostics = NULL;
+}
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "profile.h"
+
+// Sampling profiler, see profile.h
+//
+// A sample is the depth of the call stack, the number of frames kept and then the function
+// and instruction of each frame, outermost first, one after the other in a buffer reserved
+// up front, so the signal handler only copies ints. Deep recursions keep their innermost
+// PROFILE_MAX_FRAMES frames. The flat profile has a row per function and source line, with
+// the samples it was running in (self), the samples it was on the stack in (total, once per
+// sample however deep a recursion goes) and the column most of its own samples were at. The
+// folded stacks have a line per distinct stack of function:line frames with its count.
+
+#define PROFILE_BUFFER_BYTES ((size_t)1 << 28)     // Reserved, pages are only used as samples reach them
+#define PROFILE_BUFFER_INTS (PROFILE_BUFFER_BYTES / sizeof(int))
+#define PROFILE_MAX_FRAMES 256
+
+static const IrModule *module;
+static const volatile ProfileFrame *frames;
+static const volatile int *sampled_depth;
+static struct sigaction previous_action;
+static timer_t timer;
+
+// Written by the signal handler only
+static int *buffer;
+static volatile size_t used;
+static volatile long long num_samples;
+static volatile long long outside;      // Samples taken between calls, e.g. while output is flushed
+static volatile long long dropped;      // Samples the buffer had no room for
+
+static void take_sample(int signal) {
+    (void)signal;
+    int depth = *sampled_depth;
+    if (depth == 0) {
+        outside++;
+        return;
+    }
+    int first = depth > PROFILE_MAX_FRAMES ? depth - PROFILE_MAX_FRAMES : 0;
+    size_t size = 2 + 2 * (size_t)(depth - first);
+    if (used + size > PROFILE_BUFFER_INTS) {
+        dropped++;
+        return;
+    }
+    int *sample = &buffer[used];
+    sample[0] = depth;
+    sample[1] = depth - first;
+    for (int k = first; k < depth; k++) {
+        sample[2 + 2 * (k - first)] = frames[k].function;
+        sample[3 + 2 * (k - first)] = frames[k].instr;
+    }
+    used += size;
+    num_samples++;
+}
+
+/******************************************************/
+/* Report */
+
+// Instructions of a function at the same line and column share a row, and rows of the same
+// line share a row of lines[]
+typedef struct {
+    int function;
+    int line, column;   // 0 for the row of compiled code
+    int first_instr;    // IR_NONE for the row of compiled code
+    long long self, total;
+    long long stamp;    // Last sample counted in total, plus one
+    int line_row;
+} Row;
+
+static Row *rows, *lines;
+static int num_rows, num_lines;
+static int *row_start;  // Per function, the row of instruction i is row_of[row_start[f] + i]
+static int *row_of;     // and the row of its compiled code row_of[row_start[f] + num_instrs]
+
+static int compare_positions(const void *a, const void *b) {
+    const Row *x = a, *y = b;
+    if (x->function != y->function) {
+        return x->function - y->function;
+    }
+    if (x->line != y->line) {
+        return x->line - y->line;
+    }
+    if (x->column != y->column) {
+        return x->column - y->column;
+    }
+    return x->first_instr - y->first_instr;
+}
+
+static void build_rows(void) {
+    int total_instrs = 0;
+    row_start = malloc(sizeof(int) * (module->num_functions + 1));
+    for (int f = 0; f < module->num_functions; f++) {
+        row_start[f] = total_instrs;
+        total_instrs += module->functions[f].num_instrs + 1;
+    }
+    Row *positions = malloc(sizeof(Row) * (total_instrs + 1));
+    rows = calloc(total_instrs + 1, sizeof(Row));
+    lines = calloc(total_instrs + 1, sizeof(Row));
+    row_of = malloc(sizeof(int) * (total_instrs + 1));
+    if (!row_start || !positions || !rows || !lines || !row_of) {
+        fprintf(stderr, "Error: Memory allocation failed in build_rows\n");
+        exit(1);
+    }
+
+    int n = 0;
+    for (int f = 0; f < module->num_functions; f++) {
+        const IrFunction *fn = &module->functions[f];
+        for (int i = 0; i < fn->num_instrs; i++) {
+            positions[n++] = (Row){ f, fn->instrs[i].line_number, fn->instrs[i].column_number, i, 0, 0, 0, 0 };
+        }
+        positions[n++] = (Row){ f, 0, 0, IR_NONE, 0, 0, 0, 0 };
+    }
+    qsort(positions, n, sizeof(Row), compare_positions);
+
+    num_rows = 0;
+    for (int p = 0; p < n; p++) {
+        const Row *at = &positions[p];
+        const Row *last = num_rows > 0 ? &rows[num_rows - 1] : NULL;
+        bool compiled = at->first_instr == IR_NONE;
+        if (last == NULL || last->function != at->function || last->line != at->line ||
+            last->column != at->column || compiled || last->first_instr == IR_NONE) {
+            if (last == NULL || last->function != at->function || last->line != at->line || compiled ||
+                last->first_instr == IR_NONE) {
+                lines[num_lines++] = *at;
+            }
+            rows[num_rows] = *at;
+            rows[num_rows++].line_row = num_lines - 1;
+        }
+        int index = compiled ? module->functions[at->function].num_instrs : at->first_instr;
+        row_of[row_start[at->function] + index] = num_rows - 1;
+    }
+    free(positions);
+}
+
+static int frame_row(int function, int instr) {
+    int index = instr == IR_NONE ? module->functions[function].num_instrs : instr;
+    return row_of[row_start[function] + index];
+}
+
+static int compare_rows(const void *a, const void *b) {
+    const Row *x = a, *y = b;
+    if (x->self != y->self) {
+        return x->self < y->self ? 1 : -1;
+    }
+    if (x->total != y->total) {
+        return x->total < y->total ? 1 : -1;
+    }
+    return compare_positions(a, b);
+}
+
+static void write_flat(FILE *out) {
+    long long n = 0;
+    for (size_t at = 0; at < used; at += 2 + 2 * (size_t)buffer[at + 1], n++) {
+        const int *sample = &buffer[at];
+        int stored = sample[1];
+        for (int k = 0; k < stored; k++) {
+            Row *line = &lines[rows[frame_row(sample[2 + 2 * k], sample[3 + 2 * k])].line_row];
+            if (line->stamp != n + 1) {
+                line->stamp = n + 1;
+                line->total++;
+            }
+        }
+        Row *row = &rows[frame_row(sample[2 * stored], sample[2 * stored + 1])];
+        row->self++;
+        lines[row->line_row].self++;
+    }
+    // Rows of a line are in order of their column, the first with the most samples wins
+    for (int r = 0, best = 0; r < num_rows; r++) {
+        if (r == 0 || rows[r].line_row != rows[r - 1].line_row || rows[r].self > rows[best].self) {
+            best = r;
+            lines[rows[r].line_row].column = rows[r].column;
+        }
+    }
+    qsort(lines, num_lines, sizeof(Row), compare_rows);
+
+    fprintf(out, "Profile: %lld samples, one every %.1f ms", num_samples, 1000.0 / PROFILE_HZ);
+    if (outside > 0) {
+        fprintf(out, ", %lld more outside of any call", outside);
+    }
+    if (dropped > 0) {
+        fprintf(out, ", %lld dropped for lack of room", dropped);
+    }
+    fprintf(out, "\n\n%7s %7s  %-12s %s\n", "self", "total", "line:column", "function");
+    for (int l = 0; l < num_lines && lines[l].total > 0; l++) {
+        const Row *row = &lines[l];
+        char position[32];
+        if (row->first_instr == IR_NONE) {
+            snprintf(position, sizeof(position), "compiled");
+        } else {
+            snprintf(position, sizeof(position), "%d:%d", row->line, row->column);
+        }
+        fprintf(out, "%6.1f%% %6.1f%%  %-12s %s\n", 100.0 * (double)row->self / (double)num_samples,
+                100.0 * (double)row->total / (double)num_samples, position, module->functions[row->function].name);
+    }
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void write_folded(FILE *out) {
+    char **stacks = malloc(sizeof(char *) * (num_samples + 1));
+    if (!stacks) {
+        fprintf(stderr, "Error: Memory allocation failed in write_folded\n");
+        exit(1);
+    }
+    long long n = 0;
+    for (size_t at = 0; at < used; at += 2 + 2 * (size_t)buffer[at + 1], n++) {
+        const int *sample = &buffer[at];
+        char *stack = NULL;
+        size_t length = 0;
+        FILE *text = open_memstream(&stack, &length);
+        if (text == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed in write_folded\n");
+            exit(1);
+        }
+        if (sample[1] < sample[0]) {
+            fputs("...", text);
+        }
+        for (int k = 0; k < sample[1]; k++) {
+            const IrFunction *fn = &module->functions[sample[2 + 2 * k]];
+            int instr = sample[3 + 2 * k];
+            if (k > 0 || sample[1] < sample[0]) {
+                fputc(';', text);
+            }
+            if (instr == IR_NONE) {
+                fprintf(text, "%s:compiled", fn->name);
+            } else {
+                fprintf(text, "%s:%d", fn->name, fn->instrs[instr].line_number);
+            }
+        }
+        fclose(text);
+        stacks[n] = stack;
+    }
+    qsort(stacks, n, sizeof(char *), compare_strings);
+    for (long long s = 0; s < n;) {
+        long long same = s + 1;
+        while (same < n && strcmp(stacks[same], stacks[s]) == 0) {
+            free(stacks[same++]);
+        }
+        fprintf(out, "%s %lld\n", stacks[s], same - s);
+        free(stacks[s]);
+        s = same;
+    }
+    free(stacks);
+}
+
+/******************************************************/
+
+void profile_start(const IrModule *program, const volatile ProfileFrame *call_frames, const volatile int *depth) {
+    module = program;
+    frames = call_frames;
+    sampled_depth = depth;
+    used = 0;
+    num_samples = outside = dropped = 0;
+    buffer = mmap(NULL, PROFILE_BUFFER_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                  -1, 0);
+    if (buffer == MAP_FAILED) {
+        fprintf(stderr, "Error: Memory allocation failed in profile_start\n");
+        exit(1);
+    }
+
+    // Reads and writes interrupted by a sample carry on
+    struct sigaction action = {0};
+    action.sa_handler = take_sample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previous_action);
+
+    // A CPU time timer only fires at the scheduler tick, often 250 times a second, while a
+    // monotonic one fires when asked; the program is busy running anyway, or waiting for input
+    struct sigevent event = {0};
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    struct itimerspec interval = { { 0, 1000000000 / PROFILE_HZ }, { 0, 1000000000 / PROFILE_HZ } };
+    if (timer_create(CLOCK_MONOTONIC, &event, &timer) != 0 || timer_settime(timer, 0, &interval, NULL) != 0) {
+        fprintf(stderr, "Error: cannot start the profiler's timer\n");
+        exit(1);
+    }
+}
+
+void profile_stop(void) {
+    timer_delete(timer);
+    sigaction(SIGPROF, &previous_action, NULL);
+}
+
+void profile_write(FILE *flat, FILE *folded) {
+    build_rows();
+    write_flat(flat);
+    write_folded(folded);
+    free(rows);
+    free(lines);
+    free(row_start);
+    free(row_of);
+    rows = lines = NULL;
+    num_rows = num_lines = 0;
+    row_start = row_of = NULL;
+    munmap(buffer, PROFILE_BUFFER_BYTES);
+    buffer = NULL;
+}
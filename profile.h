@@ -0,0 +1,31 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include "ir.h"
+
+// Sampling profiler of --run and --jit (profile.c)
+//
+// The interpreter keeps where each of its calls is in an array of frames, innermost last: the
+// function and the instruction it runs, which it stores before running it. A timer sends
+// SIGPROF PROFILE_HZ times a second while the program runs, and the signal handler only copies
+// the frames into a buffer. After the run the samples are mapped to the line and column of their
+// instructions, for a flat profile and for folded stacks that flame graph tools read.
+
+#ifndef PROFILE_HZ
+#define PROFILE_HZ 1000
+#endif
+
+typedef struct {
+    int function;
+    int instr;          // IR_NONE while compiled code runs the call
+} ProfileFrame;
+
+// Starts sampling frames[0] to frames[*depth - 1], which the interpreter keeps up to date
+void profile_start(const IrModule *module, const volatile ProfileFrame *frames, const volatile int *depth);
+void profile_stop(void);
+
+// Writes the flat profile to flat and the folded stacks to folded, then frees the samples
+void profile_write(FILE *flat, FILE *folded);
+
+#endif //PROFILE_H
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+
+// Purity analysis over the SSA IR
+//
+// A function is pure when its result only depends on its arguments and calling it has no
+// effect but that result: it prints and scans nothing, stores into no global, reads only the
+// globals that nothing but the global initializers writes, and only calls pure functions.
+// Arguments are always ints or floats, so equal arguments mean an equal result. Purity is
+// found for the whole program at once: every function with a body starts out pure, then
+// functions that break a rule, or call one that does, are taken out until none changes.
+//
+// A pure function that is part of a cycle of calls is marked to be memoized, which is where
+// naive recursion computes the same results over and over, unless all of its calls back into
+// the cycle are tail calls. The interpreter then keeps its
+// results by arguments, see ir_interp.c.
+
+static IrModule *module;
+static bool *pure;              // Per function
+static bool *written;           // Per global, stored into outside the global initializers
+
+static void find_written_globals(void) {
+    for (int id = 0; id < module->num_functions; id++) {
+        const IrFunction *f = &module->functions[id];
+        if (!f->defined || id == module->init_function) {
+            continue;
+        }
+        for (int b = 0; b < f->num_blocks; b++) {
+            IR_FOR_EACH_INSTR(f, b, i) {
+                const IrInstr *handle = f->instrs[i].op == IR_STORE ? &f->instrs[ir_operand(f, i, 0)] : NULL;
+                if (handle != NULL && handle->op == IR_GLOBAL) {
+                    written[handle->imm] = true;
+                }
+            }
+        }
+    }
+}
+
+// Checks a function against the rules, given what is known to be pure so far
+static bool is_pure(int id) {
+    const IrFunction *f = &module->functions[id];
+    if (!f->defined || id == module->main_function || id == module->init_function) {
+        return false;
+    }
+    for (int b = 0; b < f->num_blocks; b++) {
+        IR_FOR_EACH_INSTR(f, b, i) {
+            const IrInstr *in = &f->instrs[i];
+            const IrInstr *handle = in->op == IR_LOAD || in->op == IR_STORE ? &f->instrs[ir_operand(f, i, 0)] : NULL;
+            switch ((IrOpcode)in->op) {
+                case IR_PRINTF:
+                case IR_SCANF:
+                case IR_SCAN_VALUE:
+                    return false;
+                case IR_CALL:
+                    if (!pure[in->imm]) {
+                        return false;
+                    }
+                    break;
+                case IR_LOAD:
+                case IR_STORE:
+                    // Local arrays are made new by every call
+                    if (handle->op == IR_GLOBAL && (in->op == IR_STORE || written[handle->imm])) {
+                        return false;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    return true;
+}
+
+// Checks if a function can call another one, directly or through other functions
+static bool reaches(int from, int to) {
+    int n = module->num_functions;
+    bool *seen = calloc(n + 1, sizeof(bool));
+    int *stack = malloc(sizeof(int) * (n + 1));
+    int top = 0;
+    stack[top++] = from;
+    bool found = false;
+    while (top > 0 && !found) {
+        const IrFunction *f = &module->functions[stack[--top]];
+        for (int b = 0; b < f->num_blocks; b++) {
+            IR_FOR_EACH_INSTR(f, b, i) {
+                int callee = (int)f->instrs[i].imm;
+                if (f->instrs[i].op != IR_CALL || seen[callee]) {
+                    continue;
+                }
+                found |= callee == to;
+                seen[callee] = true;
+                stack[top++] = callee;
+            }
+        }
+    }
+    free(seen);
+    free(stack);
+    return found;
+}
+
+// A call whose value is returned right away, which the interpreter runs in the frame of the caller
+static bool is_tail_call(const IrFunction *f, int i) {
+    int next = f->instrs[i].next;
+    if (next == IR_NONE || f->instrs[next].op != IR_RETURN) {
+        return false;
+    }
+    return f->instrs[next].operands.count == 0 ? f->instrs[i].type == IR_VOID : ir_operand(f, next, 0) == i;
+}
+
+// Checks if a function can call itself again from a call that is not a tail call. A recursion
+// made only of tail calls computes each result once, and runs in constant space only unmemoized
+static bool is_recursive(int id) {
+    if (!reaches(id, id)) {
+        return false;
+    }
+    const IrFunction *f = &module->functions[id];
+    for (int b = 0; b < f->num_blocks; b++) {
+        IR_FOR_EACH_INSTR(f, b, i) {
+            int callee = (int)f->instrs[i].imm;
+            if (f->instrs[i].op == IR_CALL && !is_tail_call(f, i) && (callee == id || reaches(callee, id))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/******************************************************/
+
+// Finds the pure functions of the module and marks the recursive ones to be memoized
+IrPurityStats ir_find_pure_functions(IrModule *program) {
+    module = program;
+    IrPurityStats stats = {0};
+    pure = calloc(module->num_functions + 1, sizeof(bool));
+    written = calloc(module->num_globals + 1, sizeof(bool));
+    if (!pure || !written) {
+        fprintf(stderr, "Error: Memory allocation failed in ir_find_pure_functions\n");
+        exit(1);
+    }
+    find_written_globals();
+
+    for (int id = 0; id < module->num_functions; id++) {
+        pure[id] = module->functions[id].defined;
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int id = 0; id < module->num_functions; id++) {
+            if (pure[id] && !is_pure(id)) {
+                pure[id] = false;
+                changed = true;
+            }
+        }
+    }
+
+    for (int id = 0; id < module->num_functions; id++) {
+        IrFunction *f = &module->functions[id];
+        f->memoize = pure[id] && is_recursive(id);
+        stats.functions += f->defined;
+        stats.pure += pure[id];
+        stats.memoized += f->memoize;
+    }
+    free(pure);
+    free(written);
+    pure = written = NULL;
+    return stats;
+}
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "ir.h"
+
+// Range analysis and bounds check elimination over the SSA IR
+//
+// The range of an int value is an interval [lo, hi] it always lies in. Constants are exact,
+// arithmetic follows from the ranges of the operands, and at a given block the range is
+// narrowed by every branch that block is dominated by: after "if (i < n)" is taken, i is
+// below the largest n. An induction variable (a phi that only adds a constant on its back
+// edges) starts at its initial values and moves one way, as far as the branch guarding its
+// step allows. A load or store whose index lies in [0, length) of its array gets
+// IR_IN_BOUNDS, and is neither checked by the interpreter nor by the code generator.
+//
+// Ranges are computed on demand for a value at a block and remembered. A value needed
+// while it is being computed, around a loop, counts as unknown, so every range stays safe.
+
+typedef struct {
+    int64_t lo, hi;
+} Range;
+
+static const Range unknown = { INT64_MIN, INT64_MAX };
+
+// Ranges computed for the current function, open addressing on value and block
+typedef struct {
+    int value, block;
+    bool done;
+    Range range;
+} RangeEntry;
+
+static const IrModule *module;
+static IrFunction *fn;
+static RangeEntry *entries;
+static int num_entries, entries_capacity;
+
+static Range range_at(int value, int block);
+
+/******************************************************/
+/* Arithmetic on ranges, unknown when a bound overflows */
+
+static Range range_add(Range a, Range b) {
+    Range r;
+    if (__builtin_add_overflow(a.lo, b.lo, &r.lo) || __builtin_add_overflow(a.hi, b.hi, &r.hi)) {
+        return unknown;
+    }
+    return r;
+}
+
+static Range range_sub(Range a, Range b) {
+    Range r;
+    if (__builtin_sub_overflow(a.lo, b.hi, &r.lo) || __builtin_sub_overflow(a.hi, b.lo, &r.hi)) {
+        return unknown;
+    }
+    return r;
+}
+
+static Range range_mul(Range a, Range b) {
+    int64_t products[4];
+    if (__builtin_mul_overflow(a.lo, b.lo, &products[0]) || __builtin_mul_overflow(a.lo, b.hi, &products[1]) ||
+        __builtin_mul_overflow(a.hi, b.lo, &products[2]) || __builtin_mul_overflow(a.hi, b.hi, &products[3])) {
+        return unknown;
+    }
+    Range r = { products[0], products[0] };
+    for (int k = 1; k < 4; k++) {
+        r.lo = products[k] < r.lo ? products[k] : r.lo;
+        r.hi = products[k] > r.hi ? products[k] : r.hi;
+    }
+    return r;
+}
+
+// Only by positive divisors, which cannot fail or overflow
+static Range range_div(Range a, Range b, bool is_mod) {
+    if (b.lo <= 0) {
+        return unknown;
+    }
+    if (is_mod) {
+        // The remainder has the sign of the dividend and is smaller than the divisor
+        Range r = { a.lo >= 0 ? 0 : -(b.hi - 1), a.hi <= 0 ? 0 : b.hi - 1 };
+        if (a.lo < 0 && a.lo > r.lo) r.lo = a.lo;
+        if (a.hi > 0 && a.hi < r.hi) r.hi = a.hi;
+        return r;
+    }
+    return (Range){ a.lo >= 0 ? a.lo / b.hi : a.lo / b.lo, a.hi >= 0 ? a.hi / b.lo : a.hi / b.hi };
+}
+
+/******************************************************/
+/* Conditions */
+
+static IrOpcode negate(IrOpcode op) {
+    switch (op) {
+        case IR_LT: return IR_GE;
+        case IR_LE: return IR_GT;
+        case IR_GT: return IR_LE;
+        case IR_GE: return IR_LT;
+        case IR_EQ: return IR_NE;
+        default: return IR_EQ;
+    }
+}
+
+// "a op b" as "b op' a"
+static IrOpcode mirror(IrOpcode op) {
+    switch (op) {
+        case IR_LT: return IR_GT;
+        case IR_LE: return IR_GE;
+        case IR_GT: return IR_LT;
+        case IR_GE: return IR_LE;
+        default: return op;
+    }
+}
+
+// Narrows r knowing that "value op other" holds, with other in the given range
+static Range constrain(Range r, IrOpcode op, Range other) {
+    switch (op) {
+        case IR_LT:
+            if (other.hi != INT64_MIN && other.hi - 1 < r.hi) r.hi = other.hi - 1;
+            break;
+        case IR_LE:
+            if (other.hi < r.hi) r.hi = other.hi;
+            break;
+        case IR_GT:
+            if (other.lo != INT64_MAX && other.lo + 1 > r.lo) r.lo = other.lo + 1;
+            break;
+        case IR_GE:
+            if (other.lo > r.lo) r.lo = other.lo;
+            break;
+        case IR_EQ:
+            if (other.hi < r.hi) r.hi = other.hi;
+            if (other.lo > r.lo) r.lo = other.lo;
+            break;
+        default:
+            break;
+    }
+    return r;
+}
+
+// Narrows the range of a value at a block by the branches taken to get there. A block with a
+// single predecessor that branches is entered only when the condition had that outcome, and
+// the value compared is still the one seen in every block it dominates.
+static Range refine(int value, Range r, int block) {
+    for (int b = block; b != IR_NONE && b != fn->entry; b = fn->blocks[b].idom) {
+        if (fn->blocks[b].preds.count != 1) {
+            continue;
+        }
+        int pred = ir_pred(fn, b, 0);
+        int terminator = ir_terminator(fn, pred);
+        const IrInstr *branch = &fn->instrs[terminator];
+        if (branch->op != IR_BRANCH || branch->targets[0] == branch->targets[1]) {
+            continue;
+        }
+        int condition = ir_operand(fn, terminator, 0);
+        const IrInstr *compare = &fn->instrs[condition];
+        if (compare->op < IR_EQ || compare->op > IR_GE) {
+            continue;
+        }
+        int left = ir_operand(fn, condition, 0), right = ir_operand(fn, condition, 1);
+        if (fn->instrs[left].type != IR_INT || (left != value && right != value)) {
+            continue;
+        }
+        IrOpcode op = compare->op;
+        if (b != branch->targets[0]) {
+            op = negate(op);
+        }
+        if (left == value) {
+            r = constrain(r, op, range_at(right, pred));
+        } else {
+            r = constrain(r, mirror(op), range_at(left, pred));
+        }
+    }
+    return r;
+}
+
+/******************************************************/
+/* Ranges of values */
+
+// The step of an induction variable: the phi plus or minus a constant
+static bool induction_step(int phi, int update, int64_t *step) {
+    const IrInstr *in = &fn->instrs[update];
+    if (in->op != IR_ADD && in->op != IR_SUB) {
+        return false;
+    }
+    int left = ir_operand(fn, update, 0), right = ir_operand(fn, update, 1);
+    if (left == phi && fn->instrs[right].op == IR_CONST) {
+        if (in->op == IR_SUB) {
+            return !__builtin_sub_overflow((int64_t)0, fn->instrs[right].imm, step);
+        }
+        *step = fn->instrs[right].imm;
+        return true;
+    }
+    if (in->op == IR_ADD && right == phi && fn->instrs[left].op == IR_CONST) {
+        *step = fn->instrs[left].imm;
+        return true;
+    }
+    return false;
+}
+
+// The values an induction variable takes: its initial values, and every step taken from a
+// value that the branches guarding the step allow. While the step does not overflow, the
+// variable never goes below its smallest initial value when it counts up.
+static Range induction_range(int phi) {
+    int header = fn->instrs[phi].block;
+    Range init = { INT64_MAX, INT64_MIN };
+    Range stepped = { INT64_MAX, INT64_MIN };
+    bool up = true, down = true;
+
+    for (int k = 0; k < fn->blocks[header].preds.count; k++) {
+        int pred = ir_pred(fn, header, k);
+        int operand = ir_operand(fn, phi, k);
+        if (!ir_dominates(fn, header, pred)) {
+            Range r = range_at(operand, pred);
+            init.lo = r.lo < init.lo ? r.lo : init.lo;
+            init.hi = r.hi > init.hi ? r.hi : init.hi;
+            continue;
+        }
+        int64_t step;
+        if (!induction_step(phi, operand, &step)) {
+            return unknown;
+        }
+        up &= step >= 0;
+        down &= step <= 0;
+        Range guarded = refine(phi, unknown, fn->instrs[operand].block);
+        Range next = range_add(guarded, (Range){ step, step });
+        if ((step > 0 && guarded.hi == INT64_MAX) || (step < 0 && guarded.lo == INT64_MIN) ||
+            next.lo > next.hi) {
+            return unknown;
+        }
+        stepped.lo = next.lo < stepped.lo ? next.lo : stepped.lo;
+        stepped.hi = next.hi > stepped.hi ? next.hi : stepped.hi;
+    }
+    if (init.lo > init.hi || (!up && !down)) {
+        return unknown;
+    }
+    if (stepped.lo > stepped.hi) {
+        return init;
+    }
+    Range r = init;
+    if (up) {
+        r.hi = stepped.hi > r.hi ? stepped.hi : r.hi;
+    }
+    if (down) {
+        r.lo = stepped.lo < r.lo ? stepped.lo : r.lo;
+    }
+    return r;
+}
+
+static Range compute_range(int value, int block) {
+    const IrInstr *in = &fn->instrs[value];
+    if (in->type != IR_INT) {
+        return unknown;
+    }
+    Range r = unknown;
+    switch ((IrOpcode)in->op) {
+        case IR_CONST:
+            r = (Range){ in->imm, in->imm };
+            break;
+        case IR_ADD:
+            r = range_add(range_at(ir_operand(fn, value, 0), block), range_at(ir_operand(fn, value, 1), block));
+            break;
+        case IR_SUB:
+            r = range_sub(range_at(ir_operand(fn, value, 0), block), range_at(ir_operand(fn, value, 1), block));
+            break;
+        case IR_MUL:
+            r = range_mul(range_at(ir_operand(fn, value, 0), block), range_at(ir_operand(fn, value, 1), block));
+            break;
+        case IR_DIV:
+        case IR_MOD:
+            r = range_div(range_at(ir_operand(fn, value, 0), block), range_at(ir_operand(fn, value, 1), block),
+                          in->op == IR_MOD);
+            break;
+        case IR_NOT:
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+            r = (Range){ 0, 1 };
+            break;
+        case IR_PHI:
+            r = induction_range(value);
+            break;
+        default:
+            break;
+    }
+    return refine(value, r, block);
+}
+
+static RangeEntry *find_entry(int value, int block) {
+    if (2 * (num_entries + 1) > entries_capacity) {
+        RangeEntry *old = entries;
+        int old_capacity = entries_capacity;
+        entries_capacity = entries_capacity ? entries_capacity * 2 : 256;
+        entries = malloc(sizeof(RangeEntry) * entries_capacity);
+        if (entries == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed in find_entry\n");
+            exit(1);
+        }
+        for (int e = 0; e < entries_capacity; e++) {
+            entries[e].value = IR_NONE;
+        }
+        num_entries = 0;
+        for (int e = 0; e < old_capacity; e++) {
+            if (old[e].value != IR_NONE) {
+                *find_entry(old[e].value, old[e].block) = old[e];
+                num_entries++;
+            }
+        }
+        free(old);
+    }
+    unsigned hash = ((unsigned)value * 2654435761u) ^ ((unsigned)block * 40503u);
+    int slot = (int)(hash & (unsigned)(entries_capacity - 1));
+    while (entries[slot].value != IR_NONE && (entries[slot].value != value || entries[slot].block != block)) {
+        slot = (slot + 1) & (entries_capacity - 1);
+    }
+    return &entries[slot];
+}
+
+static Range range_at(int value, int block) {
+    RangeEntry *entry = find_entry(value, block);
+    if (entry->value != IR_NONE) {
+        return entry->done ? entry->range : unknown;
+    }
+    *entry = (RangeEntry){ value, block, false, unknown };
+    num_entries++;
+    Range r = compute_range(value, block);
+    // The table may have grown meanwhile
+    entry = find_entry(value, block);
+    entry->done = true;
+    entry->range = r;
+    return r;
+}
+
+/******************************************************/
+
+static int array_length(int handle) {
+    const IrInstr *in = &fn->instrs[handle];
+    return in->op == IR_ARRAY ? (int)in->imm : module->globals[in->imm].length;
+}
+
+// Marks the loads and stores of every function whose index is always in bounds
+IrBoundsStats ir_eliminate_bounds_checks(IrModule *program) {
+    module = program;
+    IrBoundsStats stats = {0};
+    for (int f = 0; f < module->num_functions; f++) {
+        fn = &module->functions[f];
+        if (!fn->defined) {
+            continue;
+        }
+        ir_compute_dominators(fn);
+        for (int r = 0; r < fn->rpo.count; r++) {
+            int b = fn->pool[fn->rpo.start + r];
+            IR_FOR_EACH_INSTR(fn, b, i) {
+                IrInstr *in = &fn->instrs[i];
+                if (in->op != IR_LOAD && in->op != IR_STORE) {
+                    continue;
+                }
+                stats.checks++;
+                Range index = range_at(ir_operand(fn, i, 1), b);
+                if (index.lo >= 0 && index.hi < array_length(ir_operand(fn, i, 0))) {
+                    in->flags |= IR_IN_BOUNDS;
+                    stats.removed++;
+                }
+            }
+        }
+        free(entries);
+        entries = NULL;
+        num_entries = entries_capacity = 0;
+    }
+    return stats;
+}
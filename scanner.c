@@ -2,13 +2,22 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <limits.h>
 
 #include "token.h"
+#include "instrument.h"
+#include "logger.h"
+#include "scanner.h"
+#include "string_table.h"
+#include "decimal.h"
 
 /* Global declarations */
 
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
 /* Variables */
 char lexeme[MAX_LEXEME_LENGTH];
 int current_char;
@@ -21,13 +30,27 @@ int token_start_line;
 int token_start_column;
 int token_end_column;
 
+// Contents of a string or character literal with the escapes decoded, and its id in literal_strings
+char decoded[MAX_LEXEME_LENGTH];
+int string_id;
+
+// Value of an INTEGER_LITERAL, saturated like strtoll(), or of a FLOAT_LITERAL
+long long integer_value;
+double float_value;
+
 FILE *in_fp;
 FILE *symbol_fp;
 
+// Input already in memory: get_char() reads it directly instead of through in_fp
+const unsigned char *in_buffer;
+size_t in_size;
+size_t in_position;
+
 /* Function declarations */
+void scan(void);
 void add_char();
-char get_char();
-char get_non_blank();
+int get_char();
+int get_non_blank();
 void lex();
 void add_token(TokenType token);
 void number();
@@ -39,16 +62,23 @@ TokenType keywords(char *lexeme);
 int peek();
 void unget_char(int ch);
 void set_token_end_column();
+void decode_literal(int end);
+void write_token(const char *value, int value_length);
+char *put_field(char *at, const char *text, int length, int width);
+char *put_number(char *at, long long value, int width);
 
 /******************************************************/
-/* main driver */
+/* main driver, left out of the fuzz targets (CORE_NO_MAIN) */
+#ifndef CORE_NO_MAIN
 int main(int argc, char* argv[argc + 1]) {
-    if (argc != 2) {
-        printf("Usage: ./%s <filename>\n", argv[0]);
+    bool quiet = argc == 3 && strcmp(argv[1], "-q") == 0;
+    if (argc != 2 && !quiet) {
+        printf("Usage: ./%s [-q] <filename>\n", argv[0]);
         return 1;
     }
+    log_init(quiet ? LOG_LEVEL_INFO : LOG_LEVEL_TRACE);
 
-    const char* fname = argv[1];
+    const char* fname = argv[argc - 1];
     char* last_period = strrchr(fname, '.');
     if (!last_period || strcmp(last_period, ".core") != 0) {
         printf("Input file passed must have .core extension\n");
@@ -61,17 +91,92 @@ int main(int argc, char* argv[argc + 1]) {
         return 1;
     }
 
+    // The whole file is read into memory and scanned from there
+    size_t capacity = 1 << 16, size = 0, read;
+    char *source = malloc(capacity);
+    while (source != NULL && (read = fread(source + size, 1, capacity - size, in_fp)) > 0) {
+        size += read;
+        if (size == capacity) {
+            capacity *= 2;
+            char *larger = realloc(source, capacity);
+            if (larger == NULL) {
+                free(source);
+            }
+            source = larger;
+        }
+    }
+    fclose(in_fp);
+    if (source == NULL) {
+        printf("ERROR - out of memory reading file\n");
+        return 1;
+    }
+
     symbol_fp = fopen("symbol_table.txt", "w");
     if (symbol_fp == NULL) {
         printf("ERROR - cannot open output file\n");
-        fclose(in_fp);
+        free(source);
         return 1;
     }
+    // Most of the scanner's time goes to writing the tables, in few large writes rather than one per page
+    static char symbol_buffer[OUTPUT_BUFFER_SIZE];
+    setvbuf(symbol_fp, symbol_buffer, _IOFBF, sizeof(symbol_buffer));
+
+    stats_init("scanner");
+    StatTime scan_start = stats_now();
+    scan_buffer(source, size, symbol_fp);
+    fclose(symbol_fp);
+    free(source);
+
+    FILE *strings_fp = fopen("string_table.txt", "wb");
+    static char strings_buffer[OUTPUT_BUFFER_SIZE];
+    if (strings_fp != NULL) {
+        setvbuf(strings_fp, strings_buffer, _IOFBF, sizeof(strings_buffer));
+    }
+    if (strings_fp == NULL || !string_table_write(&literal_strings, strings_fp)) {
+        printf("ERROR - cannot write string table\n");
+        return 1;
+    }
+    fclose(strings_fp);
+    stats_phase("scan", scan_start);
+    STAT_SET(STAT_LINES, line_number);
+
+    return 0;
+}
+#endif
+
+/******************************************************/
+/* scan_file - scans a stream with fgetc, the reference for scan_buffer */
+void scan_file(FILE *in, FILE *out) {
+    in_fp = in;
+    in_buffer = NULL;
+    symbol_fp = out;
+    scan();
+}
+
+/******************************************************/
+/* scan_buffer - scans source already in memory */
+void scan_buffer(const char *source, size_t size, FILE *out) {
+    in_fp = NULL;
+    in_buffer = (const unsigned char *)source;
+    in_size = size;
+    in_position = 0;
+    symbol_fp = out;
+    scan();
+}
+
+/******************************************************/
+/* scan - writes the symbol table of the whole input */
+void scan(void) {
+    lexeme_length = 0;
+    lexeme[0] = '\0';
+    line_number = 1;
+    column_number = 0;
+    string_table_clear(&literal_strings);
 
     // Design for header
     for (int i = 0; i < 128; i++) fprintf(symbol_fp, "_");
     fprintf(symbol_fp, "\n");
-    fprintf(symbol_fp, "TOKEN CODE      | TOKEN                    | LINE #          | COLUMN #        | LEXEME\n");
+    fprintf(symbol_fp, "TOKEN CODE      | TOKEN                    | LINE #          | COLUMN #        | VALUE           | LEXEME\n");
     for (int i = 0; i < 128; i++) fprintf(symbol_fp, "_");
     fprintf(symbol_fp, "\n");
 
@@ -82,46 +187,110 @@ int main(int argc, char* argv[argc + 1]) {
 
         // Skip writing to symbol table if there's an error
         if (next_token == -1 || next_token == ERROR_INVALID_CHARACTER) {
+            STAT_ADD(STAT_LEXICAL_ERRORS, 1);
             continue;
         }
 
         // Handle TOKEN_EOF separately
         if (next_token == TOKEN_EOF) {
-            printf("Next token is: %-30s Next lexeme: is %s\n", token_names[next_token], "EOF");
+            log_trace(LOG_SCANNER, "Next token is: %-30s Next lexeme: is %s\n", token_names[next_token], "EOF");
             fprintf(symbol_fp, "47              | TOKEN_EOF                | %d               | -1              | EOF\n", line_number);
+            STAT_ADD(STAT_TOKENS, 1);
             break;
         }
 
         // Print to console
-        if (next_token >= 0 && next_token < sizeof(token_names) / sizeof(token_names[0])) {
-            printf("Next token is: %-30s Next lexeme: is %s\n", token_names[next_token], lexeme);
+        if (next_token >= 0 && next_token < NUM_TOKEN_TYPES) {
+            log_trace(LOG_SCANNER, "Next token is: %-30s Next lexeme: is %s\n", token_names[next_token], lexeme);
         }
         else {
-            printf("Next token is: Unknown, Next lexeme is %s\n", lexeme);
+            log_trace(LOG_SCANNER, "Next token is: Unknown, Next lexeme is %s\n", lexeme);
             continue;
         }
 
         // Skip comments from symbol table
         if (next_token == COMMENT) {
+            STAT_ADD(STAT_COMMENTS, 1);
             continue;
         }
 
         // Write to symbol_table.txt only valid tokens
-        if (next_token >= 0 && next_token < sizeof(token_names) / sizeof(token_names[0])) {
-            int token_code = next_token; // Example mapping
-
-            fprintf(symbol_fp, "%-15d | %-24s | %-15d | %-15d | %s\n",
-                token_code, token_names[next_token], token_start_line, token_start_column, lexeme);
+        if (next_token >= 0 && next_token < NUM_TOKEN_TYPES) {
+            // String and character literals carry the id of their decoded contents, numbers their
+            // value, a float in hexadecimal so that it is read back exactly. Other rows have no
+            // VALUE column, most of the table is written for them
+            char value[64];
+            if (next_token == STRING || next_token == CHARACTER_LITERAL) {
+                write_token(value, (int)(put_number(value, string_id, 0) - value));
+            }
+            else if (next_token == INTEGER_LITERAL) {
+                write_token(value, (int)(put_number(value, integer_value, 0) - value));
+            }
+            else if (next_token == FLOAT_LITERAL) {
+                write_token(value, snprintf(value, sizeof(value), "%a", float_value));
+            }
+            else {
+                write_token(NULL, 0);
+            }
+            STAT_ADD(STAT_TOKENS, 1);
         }
     } while (next_token != TOKEN_EOF);
 
     // Design for footer
     for (int i = 0; i < 128; i++) fprintf(symbol_fp, "_");
     fprintf(symbol_fp, "\n");
-    fclose(symbol_fp);
-    fclose(in_fp);
+}
 
-    return 0;
+/******************************************************/
+/* write_token - writes the row of next_token to the symbol table, laid out like
+   "%-15d | %-24s | %-15d | %-15d | %-15s | %s\n" but without going through fprintf for every token,
+   and without the VALUE column when value is NULL */
+void write_token(const char *value, int value_length) {
+    char row[MAX_LEXEME_LENGTH + 128];
+    char *at = put_number(row, next_token, 15);
+    const char *name = token_names[next_token];
+    at = put_field(at, name, (int)strlen(name), 24);
+    at = put_number(at, token_start_line, 15);
+    at = put_number(at, token_start_column, 15);
+    if (value != NULL) {
+        at = put_field(at, value, value_length, 15);
+    }
+    size_t length = strlen(lexeme);
+    memcpy(at, lexeme, length);
+    at += length;
+    *at++ = '\n';
+    fwrite(row, 1, at - row, symbol_fp);
+}
+
+/******************************************************/
+/* put_field - copies text padded with spaces to width, and the separator after it if width is not 0 */
+char *put_field(char *at, const char *text, int length, int width) {
+    memcpy(at, text, length);
+    at += length;
+    if (width == 0) {
+        return at;
+    }
+    while (length++ < width) {
+        *at++ = ' ';
+    }
+    memcpy(at, " | ", 3);
+    return at + 3;
+}
+
+/******************************************************/
+/* put_number - put_field with a number in decimal */
+char *put_number(char *at, long long value, int width) {
+    char digits[24];
+    int start = sizeof(digits);
+    unsigned long long magnitude = value < 0 ? 0 - (unsigned long long)value : (unsigned long long)value;
+    do {
+        digits[--start] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        digits[--start] = '-';
+    }
+    return put_field(at, digits + start, (int)sizeof(digits) - start, width);
 }
 
 /******************************************************/
@@ -132,14 +301,19 @@ void add_char() {
         lexeme[lexeme_length] = '\0';
     }
     else {
-        printf("Error - lexeme is too long \n");
+        log_error(LOG_SCANNER, "Error - lexeme is too long \n");
     }
 }
 
 /******************************************************/
 /* get_char - a function to get the next character of input */
-char get_char() {
-    int ch = fgetc(in_fp);
+int get_char() {
+    int ch;
+    if (in_buffer != NULL) {
+        ch = in_position < in_size ? in_buffer[in_position++] : EOF;
+    } else {
+        ch = fgetc(in_fp);
+    }
 
     if (ch == '\n') {
         line_number++;
@@ -148,13 +322,14 @@ char get_char() {
     else if (ch != EOF) {
         column_number++;
     }
+    STAT_ADD(STAT_BYTES, ch != EOF);
 
     return ch;
 }
 
 /******************************************************/
 /* get_non_blank - a function to call get_char until it returns a non-whitespace character */
-char get_non_blank() {
+int get_non_blank() {
     while (isspace(current_char)) {
         current_char = get_char();
     }
@@ -330,7 +505,7 @@ void lex() {
                 } else if (isdigit(current_char)) {
                     number();
                 } else {
-                    printf("ERROR - invalid char %c\n", current_char);
+                    log_error(LOG_SCANNER, "ERROR - invalid char %c\n", current_char);
                     next_token = ERROR_INVALID_CHARACTER;
                     set_token_end_column();
                     current_char = get_char();
@@ -455,14 +630,44 @@ void number() {
                 return; // Exit the function after handling the error
             }
 
-            // Reverse temp into lexeme
+            // Reverse temp into lexeme, converting the digits on the way: the integer value, and
+            // for a float the first 19 significant digits and the power of ten they are scaled by
             new_length = 0;
+            uint64_t mantissa = 0;
+            int significant = 0, exponent = 0;
+            bool after_point = false, truncated = false;
+            integer_value = 0;
             for (int i = temp_len - 1; i >= 0; i--) {
-                lexeme[new_length++] = temp[i];
+                char c = temp[i];
+                lexeme[new_length++] = c;
+                if (!isdigit(c)) {
+                    after_point |= c == '.';
+                    continue;
+                }
+                int digit = c - '0';
+                if (integer_value > (LLONG_MAX - digit) / 10) {
+                    integer_value = LLONG_MAX;
+                }
+                else {
+                    integer_value = integer_value * 10 + digit;
+                }
+                if (mantissa == 0 && digit == 0) {
+                    exponent -= after_point;        // Leading zeros
+                }
+                else if (significant < 19) {
+                    mantissa = mantissa * 10 + digit;
+                    significant++;
+                    exponent -= after_point;
+                }
+                else {
+                    exponent += !after_point;
+                    truncated |= digit != 0;
+                }
             }
+            lexeme[new_length] = '\0';
 
-            // Add 0 to leading decimal if necessary
-            if (lexeme[0] == '.') {
+            // Add 0 to leading decimal if necessary, and if there is room left after a too long number
+            if (lexeme[0] == '.' && new_length < MAX_LEXEME_LENGTH - 1) {
                 // Shift right by 1
                 for (int i = new_length; i >= 0; i--) {
                     lexeme[i + 1] = lexeme[i];
@@ -472,7 +677,7 @@ void number() {
             }
 
             // Add 0 to trailing decimal if necessary
-            if (lexeme[new_length - 1] == '.') {
+            if (lexeme[new_length - 1] == '.' && new_length < MAX_LEXEME_LENGTH - 1) {
                 lexeme[new_length] = '0';
                 new_length++;
                 lexeme[new_length] = '\0';
@@ -482,6 +687,9 @@ void number() {
             }
 
             lexeme_length = new_length;
+            if (has_decimal) {
+                float_value = decimal_to_double(mantissa, exponent, truncated, lexeme);
+            }
         }
     }
 
@@ -515,7 +723,7 @@ void identifier() {
     // Now decide if valid or invalid based on length <= 31
     if (local_length > 31) {
         // Report the entire invalid identifier
-        printf("ERROR - invalid identifier: %s\n", local_buffer);
+        log_error(LOG_SCANNER, "ERROR - invalid identifier: %s\n", local_buffer);
         // Set next_token to -1 so it won't appear as a separate token
         next_token = -1; 
         lexeme_length = 0;
@@ -791,13 +999,13 @@ void character_literal()
         }
         else {
             next_token = ERROR_INVALID_CHARACTER;
-            printf("Error - unterminated character literal\n");
+            log_error(LOG_SCANNER, "Error - unterminated character literal\n");
             return;
         }
     }
     else if (current_char == '\'' || current_char == EOF) { // Handle empty or malformed character literals
         next_token = ERROR_INVALID_CHARACTER;
-        printf("Error - invalid or unterminated character literal\n");
+        log_error(LOG_SCANNER, "Error - invalid or unterminated character literal\n");
         return;
     }
     else {
@@ -807,6 +1015,7 @@ void character_literal()
     // Read the closing single quote
     current_char = get_char();
     if (current_char == '\'') {
+        decode_literal(lexeme_length);
         add_char();
         next_token = CHARACTER_LITERAL;
         set_token_end_column();
@@ -814,7 +1023,7 @@ void character_literal()
     }
     else { // Handle missing closing single quote
         next_token = ERROR_INVALID_CHARACTER;
-        printf("Error - unterminated character literal\n");
+        log_error(LOG_SCANNER, "Error - unterminated character literal\n");
     }
 }
 
@@ -852,6 +1061,7 @@ void string()
     }
 
     if (current_char == '"') {
+        decode_literal(lexeme_length);
         add_char();  // Add the closing quote to lexeme
         next_token = STRING;
         set_token_end_column();
@@ -859,14 +1069,50 @@ void string()
     }
     else {
         // Handle error for unterminated string
-        printf("Error - unterminated string literal\n");
+        log_error(LOG_SCANNER, "Error - unterminated string literal\n");
         next_token = ERROR_INVALID_CHARACTER;
     }
 }
 
+/******************************************************/
+/* decode_literal - interns the contents of the literal in lexeme, up to end, with the escapes decoded */
+void decode_literal(int end) {
+    const char *from = lexeme + 1;     // After the opening quote
+    const char *stop = lexeme + end;
+    int length = 0;
+    while (from < stop) {
+        // Copy up to the next escape in one go
+        const char *escape = memchr(from, '\\', stop - from);
+        const char *run_end = escape != NULL ? escape : stop;
+        memcpy(decoded + length, from, run_end - from);
+        length += run_end - from;
+        if (escape == NULL) {
+            break;
+        }
+        char ch = escape + 1 < stop ? escape[1] : '\\';
+        switch (ch) {
+            case 'n': ch = '\n'; break;
+            case 't': ch = '\t'; break;
+            case 'r': ch = '\r'; break;
+            case '0': ch = '\0'; break;
+            case 'a': ch = '\a'; break;
+            case 'b': ch = '\b'; break;
+            case 'f': ch = '\f'; break;
+            case 'v': ch = '\v'; break;
+            default: break;    // \\, \', \" and any other character stand for themselves
+        }
+        decoded[length++] = ch;
+        from = escape + 2;
+    }
+    string_id = string_table_intern(&literal_strings, decoded, length);
+}
+
 /******************************************************/
 /* peek - a function to peek at the next character without consuming it */
 int peek() {
+    if (in_buffer != NULL) {
+        return in_position < in_size ? in_buffer[in_position] : EOF;
+    }
     int ch = fgetc(in_fp);
     ungetc(ch, in_fp);
     return ch;
@@ -877,7 +1123,12 @@ int peek() {
 void unget_char(int ch) {
     if (ch == EOF) return; // Do nothing for EOF
 
-    ungetc(ch, in_fp);
+    if (in_buffer != NULL) {
+        in_position--;
+    } else {
+        ungetc(ch, in_fp);
+    }
+    STAT_ADD(STAT_BYTES, -1);
 
     if (ch == '\n') {
         line_number--;
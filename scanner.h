@@ -0,0 +1,16 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Scanner entry points (scanner.c)
+//
+// Both write the symbol table of the whole input to out. scan_buffer() reads source that is
+// already in memory and is what the scanner uses; scan_file() reads a stream with fgetc()
+// and is kept as the reference the fuzz targets compare it with.
+
+void scan_file(FILE *in, FILE *out);
+void scan_buffer(const char *source, size_t size, FILE *out);
+
+#endif //SCANNER_H
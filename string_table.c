@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "string_table.h"
+
+// Interned literals, written by the scanner and read by the parser (see string_table.h)
+
+StringTable literal_strings;
+
+static uint32_t hash_bytes(const char *bytes, int length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void *grow(void *pointer, size_t size) {
+    void *grown = realloc(pointer, size);
+    if (grown == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed in the string table\n");
+        exit(1);
+    }
+    return grown;
+}
+
+// Bucket of the bytes: where they are, or the empty one where they go
+static int *find_bucket(const StringTable *table, const char *bytes, int length) {
+    uint32_t mask = (uint32_t)table->num_buckets - 1;
+    for (uint32_t slot = hash_bytes(bytes, length) & mask;; slot = (slot + 1) & mask) {
+        int id = table->buckets[slot] - 1;
+        if (id < 0 || (table->lengths[id] == length &&
+                       memcmp(table->data + table->offsets[id], bytes, length) == 0)) {
+            return &table->buckets[slot];
+        }
+    }
+}
+
+static void rehash(StringTable *table) {
+    free(table->buckets);
+    table->num_buckets = table->num_buckets ? table->num_buckets * 2 : 64;
+    table->buckets = calloc(table->num_buckets, sizeof(int));
+    if (table->buckets == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed in the string table\n");
+        exit(1);
+    }
+    for (int id = 0; id < table->count; id++) {
+        *find_bucket(table, table->data + table->offsets[id], table->lengths[id]) = id + 1;
+    }
+}
+
+// Id of the bytes, which are added if the table does not have them yet
+int string_table_intern(StringTable *table, const char *bytes, int length) {
+    // Kept at most half full
+    if (2 * (table->count + 1) > table->num_buckets) {
+        rehash(table);
+    }
+    int *bucket = find_bucket(table, bytes, length);
+    if (*bucket != 0) {
+        return *bucket - 1;
+    }
+
+    if (table->size + length + 1 > table->capacity) {
+        while (table->size + length + 1 > table->capacity) {
+            table->capacity = table->capacity ? table->capacity * 2 : 1024;
+        }
+        table->data = grow(table->data, table->capacity);
+    }
+    if (table->count == table->ids_capacity) {
+        table->ids_capacity = table->ids_capacity ? table->ids_capacity * 2 : 64;
+        table->offsets = grow(table->offsets, sizeof(int) * table->ids_capacity);
+        table->lengths = grow(table->lengths, sizeof(int) * table->ids_capacity);
+    }
+    memcpy(table->data + table->size, bytes, length);
+    table->data[table->size + length] = '\0';
+    table->offsets[table->count] = table->size;
+    table->lengths[table->count] = length;
+    table->size += length + 1;
+    *bucket = table->count + 1;
+    return table->count++;
+}
+
+const char *string_table_get(const StringTable *table, int id, int *length) {
+    if (id < 0 || id >= table->count) {
+        if (length) {
+            *length = 0;
+        }
+        return "";
+    }
+    if (length) {
+        *length = table->lengths[id];
+    }
+    return table->data + table->offsets[id];
+}
+
+void string_table_clear(StringTable *table) {
+    free(table->data);
+    free(table->offsets);
+    free(table->lengths);
+    free(table->buckets);
+    memset(table, 0, sizeof(*table));
+}
+
+// One line per string: the id, the length, a colon and the bytes as they are
+bool string_table_write(const StringTable *table, FILE *out) {
+    fprintf(out, "STRING TABLE | %d strings\n", table->count);
+    for (int id = 0; id < table->count; id++) {
+        fprintf(out, "%d %d:", id, table->lengths[id]);
+        fwrite(table->data + table->offsets[id], 1, table->lengths[id], out);
+        fputc('\n', out);
+    }
+    return !ferror(out);
+}
+
+bool string_table_read(StringTable *table, FILE *in) {
+    string_table_clear(table);
+    int count;
+    if (fscanf(in, "STRING TABLE | %d strings\n", &count) != 1) {
+        return false;
+    }
+    char *bytes = NULL;
+    for (int i = 0; i < count; i++) {
+        int id, length;
+        if (fscanf(in, "%d %d:", &id, &length) != 2 || id != i || length < 0) {
+            free(bytes);
+            return false;
+        }
+        bytes = grow(bytes, length + 1);
+        if (fread(bytes, 1, length, in) != (size_t)length || fgetc(in) != '\n') {
+            free(bytes);
+            return false;
+        }
+        string_table_intern(table, bytes, length);
+    }
+    free(bytes);
+    return true;
+}
@@ -0,0 +1,33 @@
+#ifndef STRING_TABLE_H
+#define STRING_TABLE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Interned string and character literals (string_table.c)
+//
+// The scanner decodes the escapes of every STRING and CHARACTER_LITERAL once, interns the
+// bytes here and gives the token the id, so a format string used many times is stored once
+// and two literals are equal exactly when their ids are. The table goes to string_table.txt
+// next to the symbol table, one length-prefixed entry per line, and the parser reads it back
+// into literal_strings, where lowering takes the decoded bytes from.
+
+typedef struct {
+    char *data;             // String i is data[offsets[i]], lengths[i] bytes and a NUL
+    int size, capacity;
+    int *offsets;
+    int *lengths;
+    int count, ids_capacity;
+    int *buckets;           // Open addressing on the hash of the bytes, id + 1 or 0 if empty
+    int num_buckets;
+} StringTable;
+
+extern StringTable literal_strings;
+
+int string_table_intern(StringTable *table, const char *bytes, int length);
+const char *string_table_get(const StringTable *table, int id, int *length);
+void string_table_clear(StringTable *table);
+bool string_table_write(const StringTable *table, FILE *out);
+bool string_table_read(StringTable *table, FILE *in);
+
+#endif //STRING_TABLE_H
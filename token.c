@@ -0,0 +1,55 @@
+#include "token.h"
+
+// Token names array, in the order of TokenType
+const char *const token_names[] = {
+    "LEFT_PARENTHESIS",
+    "RIGHT_PARENTHESIS",
+    "LEFT_BRACKET",
+    "RIGHT_BRACKET",
+    "LEFT_BRACE",
+    "RIGHT_BRACE",
+    "COMMA",
+    "SEMICOLON",
+    "MULTIPLY",
+    "EXPONENT",
+    "AMPERSAND",
+    "PLUS",
+    "MINUS",
+    "DIVIDE",
+    "EQUAL",
+    "NOT_EQUAL",
+    "ASSIGN",
+    "LESS",
+    "LESS_EQUAL",
+    "GREATER",
+    "GREATER_EQUAL",
+    "NOT",
+    "OR",
+    "AND",
+    "COMMENT",
+    "MODULO",
+    "IDENTIFIER",
+    "STRING",
+    "INTEGER_LITERAL",
+    "FLOAT_LITERAL",
+    "CHARACTER_LITERAL",
+    "CHAR",
+    "INT",
+    "FLOAT",
+    "BOOL",
+    "IF",
+    "ELSE",
+    "FOR",
+    "WHILE",
+    "RETURN",
+    "PRINTF",
+    "SCANF",
+    "TRUE",
+    "FALSE",
+    "VOID",
+    "ERROR_INVALID_CHARACTER",
+    "ERROR_INVALID_IDENTIFIER",
+    "TOKEN_EOF"
+};
+
+_Static_assert(sizeof(token_names) / sizeof(token_names[0]) == NUM_TOKEN_TYPES, "a token type has no name");
@@ -91,58 +91,17 @@ typedef struct {
     char lexeme[MAX_LEXEME_LENGTH];
     int line_number;
     int column_number;
+    int string_id;      // STRING and CHARACTER_LITERAL: the decoded contents in literal_strings, else -1
+    union {             // Converted by the scanner
+        long long integer;      // INTEGER_LITERAL
+        double real;            // FLOAT_LITERAL
+    } value;
 } Token;
 
-// Token names array
-char* token_names[] = {
-    "LEFT_PARENTHESIS",
-    "RIGHT_PARENTHESIS",
-    "LEFT_BRACKET",
-    "RIGHT_BRACKET",
-    "LEFT_BRACE",
-    "RIGHT_BRACE",
-    "COMMA",
-    "SEMICOLON",
-    "MULTIPLY",
-    "EXPONENT",
-    "AMPERSAND",
-    "PLUS",
-    "MINUS",
-    "DIVIDE",
-    "EQUAL",
-    "NOT_EQUAL",
-    "ASSIGN",
-    "LESS",
-    "LESS_EQUAL",
-    "GREATER",
-    "GREATER_EQUAL",
-    "NOT",
-    "OR",
-    "AND",
-    "COMMENT",
-    "MODULO",
-    "IDENTIFIER",
-    "STRING",
-    "INTEGER_LITERAL",
-    "FLOAT_LITERAL",
-    "CHARACTER_LITERAL",
-    "CHAR",
-    "INT",
-    "FLOAT",
-    "BOOL",
-    "IF",
-    "ELSE",
-    "FOR",
-    "WHILE",
-    "RETURN",
-    "PRINTF",
-    "SCANF",
-    "TRUE",
-    "FALSE",
-    "VOID",
-    "ERROR_INVALID_CHARACTER",
-    "ERROR_INVALID_IDENTIFIER",
-    "TOKEN_EOF"
-};
+// Number of token types, the names are indexed by type
+#define NUM_TOKEN_TYPES (TOKEN_EOF + 1)
+
+// Token names array (token.c)
+extern const char *const token_names[];
 
 #endif //TOKEN_H
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vector.h"
+
+// Kernels of vectorized loops, see vector.h
+//
+// The kernels are written once over GCC vector types of 1, 2 or 4 elements and built for each
+// instruction set by the macros below. Operands that stay the same are broadcast to a vector
+// before the loop, the elements left over after the last full vector are done one at a time.
+// Ints are computed as uint64_t, which wraps around without undefined behavior.
+
+typedef struct {
+    const char *name;
+    void (*map_int)(const VectorLoop *loop, VectorValue *dst);
+    void (*map_float)(const VectorLoop *loop, VectorValue *dst);
+    int64_t (*sum_int)(const VectorLoop *loop);
+} KernelSet;
+
+// Elements are only 8 byte aligned, the loop can start at any index
+typedef uint64_t ints1 __attribute__((vector_size(8), aligned(8)));
+typedef double floats1 __attribute__((vector_size(8), aligned(8)));
+typedef uint64_t ints2 __attribute__((vector_size(16), aligned(8)));
+typedef double floats2 __attribute__((vector_size(16), aligned(8)));
+typedef uint64_t ints4 __attribute__((vector_size(32), aligned(8)));
+typedef double floats4 __attribute__((vector_size(32), aligned(8)));
+
+// The operands of the current element, a and b, in vectors of V then one by one as T
+#define OPERANDS(V, T)                                                  \
+    const T *x = (const T *)loop->x.array, *y = (const T *)loop->y.array; \
+    T xs, ys;                                                           \
+    memcpy(&xs, &loop->x.value, sizeof(T));                             \
+    memcpy(&ys, &loop->y.value, sizeof(T));                             \
+    V xv = (V){0} + xs, yv = (V){0} + ys;                               \
+    int64_t k = 0, n = loop->count
+
+#define EACH_ELEMENT(V, T, lanes, vector_step, scalar_step)             \
+    for (; k + (lanes) <= n; k += (lanes)) {                            \
+        V a = x ? *(const V *)(x + k) : xv;                             \
+        V b = y ? *(const V *)(y + k) : yv;                             \
+        vector_step;                                                    \
+    }                                                                   \
+    for (; k < n; k++) {                                                \
+        T a = x ? x[k] : xs;                                            \
+        T b = y ? y[k] : ys;                                            \
+        scalar_step;                                                    \
+    }
+
+#define MAP_KERNEL(name, V, T, lanes, target)                           \
+    target static void name(const VectorLoop *loop, VectorValue *dst) { \
+        OPERANDS(V, T);                                                 \
+        T *out = (T *)dst;                                              \
+        switch (loop->op) {                                             \
+            case IR_ADD:                                                \
+                EACH_ELEMENT(V, T, lanes, *(V *)(out + k) = a + b, out[k] = a + b) \
+                break;                                                  \
+            case IR_SUB:                                                \
+                EACH_ELEMENT(V, T, lanes, *(V *)(out + k) = a - b, out[k] = a - b) \
+                break;                                                  \
+            case IR_MUL:                                                \
+                EACH_ELEMENT(V, T, lanes, *(V *)(out + k) = a * b, out[k] = a * b) \
+                break;                                                  \
+            default:                                                    \
+                EACH_ELEMENT(V, T, lanes, (void)b; *(V *)(out + k) = a, (void)b; out[k] = a) \
+                break;                                                  \
+        }                                                               \
+    }
+
+// Int sums run one total per lane, wrapping around they add up the same in any order
+#define SUM_KERNEL(name, V, lanes, target)                              \
+    target static int64_t name(const VectorLoop *loop) {                \
+        OPERANDS(V, uint64_t);                                          \
+        V totals = {0};                                                 \
+        uint64_t total = 0;                                             \
+        switch (loop->op) {                                             \
+            case IR_ADD:                                                \
+                EACH_ELEMENT(V, uint64_t, lanes, totals += a + b, total += a + b) \
+                break;                                                  \
+            case IR_SUB:                                                \
+                EACH_ELEMENT(V, uint64_t, lanes, totals += a - b, total += a - b) \
+                break;                                                  \
+            case IR_MUL:                                                \
+                EACH_ELEMENT(V, uint64_t, lanes, totals += a * b, total += a * b) \
+                break;                                                  \
+            default:                                                    \
+                EACH_ELEMENT(V, uint64_t, lanes, (void)b; totals += a, (void)b; total += a) \
+                break;                                                  \
+        }                                                               \
+        for (int l = 0; l < (lanes); l++) {                             \
+            total += totals[l];                                         \
+        }                                                               \
+        return (int64_t)total;                                          \
+    }
+
+MAP_KERNEL(map_int_scalar, ints1, uint64_t, 1, )
+MAP_KERNEL(map_float_scalar, floats1, double, 1, )
+SUM_KERNEL(sum_int_scalar, ints1, 1, )
+static const KernelSet scalar_kernels = { "scalar", map_int_scalar, map_float_scalar, sum_int_scalar };
+
+#if defined(__x86_64__)
+MAP_KERNEL(map_int_sse2, ints2, uint64_t, 2, __attribute__((target("sse2"))))
+MAP_KERNEL(map_float_sse2, floats2, double, 2, __attribute__((target("sse2"))))
+SUM_KERNEL(sum_int_sse2, ints2, 2, __attribute__((target("sse2"))))
+static const KernelSet sse2_kernels = { "sse2", map_int_sse2, map_float_sse2, sum_int_sse2 };
+
+MAP_KERNEL(map_int_avx2, ints4, uint64_t, 4, __attribute__((target("avx2"))))
+MAP_KERNEL(map_float_avx2, floats4, double, 4, __attribute__((target("avx2"))))
+SUM_KERNEL(sum_int_avx2, ints4, 4, __attribute__((target("avx2"))))
+static const KernelSet avx2_kernels = { "avx2", map_int_avx2, map_float_avx2, sum_int_avx2 };
+#endif
+
+static const KernelSet *kernels = &scalar_kernels;
+
+// Float sums are not split, rounding after every addition in order like the loop would
+static double sum_float(const VectorLoop *loop, double acc) {
+    const double *x = (const double *)loop->x.array, *y = (const double *)loop->y.array;
+    for (int64_t k = 0; k < loop->count; k++) {
+        double a = x ? x[k] : loop->x.value.f;
+        double b = y ? y[k] : loop->y.value.f;
+        switch (loop->op) {
+            case IR_ADD: acc = acc + (a + b); break;
+            case IR_SUB: acc = acc + (a - b); break;
+            case IR_MUL: acc = acc + (a * b); break;
+            default: acc = acc + a; break;
+        }
+    }
+    return acc;
+}
+
+/******************************************************/
+
+void vector_init(void) {
+    const char *setting = getenv("CORE_VECTOR");
+    bool allow_avx2 = setting == NULL || strcmp(setting, "avx2") == 0;
+    bool allow_sse2 = allow_avx2 || strcmp(setting, "sse2") == 0;
+    if (setting != NULL && !allow_sse2 && strcmp(setting, "scalar") != 0) {
+        fprintf(stderr, "Warning: unknown CORE_VECTOR '%s', the kernels are chosen by the CPU\n", setting);
+        allow_avx2 = allow_sse2 = true;
+    }
+
+    kernels = &scalar_kernels;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (allow_avx2 && __builtin_cpu_supports("avx2")) {
+        kernels = &avx2_kernels;
+    } else if (allow_sse2 && __builtin_cpu_supports("sse2")) {
+        kernels = &sse2_kernels;
+    }
+#else
+    (void)allow_avx2;
+    (void)allow_sse2;
+#endif
+}
+
+const char *vector_kernels(void) {
+    return kernels->name;
+}
+
+void vector_map(const VectorLoop *loop, VectorValue *dst) {
+    if (loop->is_float) {
+        kernels->map_float(loop, dst);
+    } else {
+        kernels->map_int(loop, dst);
+    }
+}
+
+VectorValue vector_reduce(const VectorLoop *loop, VectorValue acc) {
+    if (loop->is_float) {
+        acc.f = sum_float(loop, acc.f);
+    } else {
+        acc.i = (int64_t)((uint64_t)acc.i + (uint64_t)kernels->sum_int(loop));
+    }
+    return acc;
+}
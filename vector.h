@@ -0,0 +1,44 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ir.h"
+
+// Kernels for the loops loop_opt.c marks with IR_VECTOR (vector.c)
+//
+// A marked loop does dst[i] = x op y or acc = acc + (x op y) over a range of i, where x and y
+// are elements at i or values that stay the same. There is one set of kernels per instruction
+// set: AVX2 with four elements per operation, SSE2 with two, and portable C with one.
+// vector_init() picks the widest the CPU has through CPUID, and the CORE_VECTOR environment
+// variable (avx2, sse2 or scalar) can ask for a narrower one. Results never depend on the set:
+// ints wrap around in every lane like in the interpreter, each lane rounds a float operation
+// like one scalar operation would, and float sums are added in order, one element at a time.
+
+typedef union {
+    int64_t i;
+    double f;
+} VectorValue;
+
+typedef struct {
+    const VectorValue *array;   // Elements from the first index of the loop on, NULL for value
+    VectorValue value;
+} VectorOperand;
+
+typedef struct {
+    IrOpcode op;        // IR_ADD, IR_SUB, IR_MUL, or IR_NOP for x alone
+    bool is_float;
+    int64_t count;      // Elements
+    VectorOperand x, y;
+} VectorLoop;
+
+void vector_init(void);
+// Name of the kernels vector_init() picked
+const char *vector_kernels(void);
+
+// dst[k] = x[k] op y[k] for every k below count
+void vector_map(const VectorLoop *loop, VectorValue *dst);
+// acc + the sum of x[k] op y[k]
+VectorValue vector_reduce(const VectorLoop *loop, VectorValue acc);
+
+#endif //VECTOR_H